@@ -0,0 +1,107 @@
+
+// ~/Arduino/QIF/arena.h Located in parent directory and linked in subdirectory
+
+/*
+Scratch arena and heap guard
+
+The large transient buffers share one static pool instead of living on the stack
+or in their own statics. An operation leases the whole pool, the others are
+refused while it holds it, so they are mutually exclusive by design and the
+worst case is ARENA_SIZE, counted once in .bss:
+
+  ARENA_UPDATE_TX   firmware update sender (QSPI2CAN), one QSPI block, whole transfer
+  ARENA_UPDATE_RX   firmware update receiver (Process_Update), page and frame
+                    buffers from STX to ETX
+  ARENA_BOOT2       Boot2 probe block, never given back (reset or jump)
+  ARENA_VERIFY      verifyQSPI() read buffer
+
+Scoped use, given back at the closing brace:
+
+  ArenaLease lease(ARENA_VERIFY, QSPI_PAGE_SIZE);
+  if(!lease.buf) return false;                    // Another operation runs
+
+Spanning several calls: arena_take() / arena_give(). The lease is one compare-and-
+swap on arenaOwner, any context (Process_Update takes it in the TCC2 interrupt).
+The owner taking the pool again gets it again (a repeated STX).
+
+Heap: the libraries allocate their buffers while the board boots (CAN driver FIFOs,
+NeoPixel). heap_seal() at the end of bootTask closes the heap: a later malloc, calloc,
+realloc or new fails and is counted. The guard needs the wrap at link time:
+  compiler.c.elf.extra_flags=-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+(arduino-cli --build-property, tools/ramreport.py shows the whole command).
+heap_seal() also paints the free RAM between the heap and the stack, the report
+finds the deepest stack use since the boot, interrupts included (one stack, MSP).
+The paint runs with interrupts off (under 1 ms for the 100-odd KB): an interrupt
+taken meanwhile would push its frames below the stack pointer, into the paint.
+
+Report: serial G 4. Build time: tools/ramreport.py, static RAM per symbol and worst
+case stack per call chain from the ELF and the -fstack-usage files.
+*/
+
+#ifndef   ARENA_H
+#define   ARENA_H
+
+#define ARENA_SIZE        4096                                                                      // QSPI_BLOCK_SIZE, largest lease
+#define ARENA_PAINT       0xA5A5A5A5UL                                                              // Unused stack pattern
+#define ARENA_GUARD       256                                                                       // Bytes below the stack pointer left unpainted, heap_seal()'s own frame
+
+enum ARENA_OWNER : uint8_t { ARENA_FREE = 0, ARENA_UPDATE_TX, ARENA_UPDATE_RX, ARENA_BOOT2, ARENA_VERIFY, ARENA_OWNERS };
+
+typedef struct {
+  uint32_t leases;
+  uint32_t refused;
+  uint16_t peak;                                                                                    // Largest size asked, bytes
+  uint8_t  refusedOwner;                                                                            // Last refusal: who asked
+  uint8_t  refusedHolder;                                                                           // and who held the pool
+} ArenaStats;
+
+typedef struct {
+  bool     sealed;
+  uint32_t bootBytes;                                                                               // Heap allocated before heap_seal()
+  uint32_t denied;                                                                                  // Calls refused after it
+  uint32_t deniedBytes;
+} HeapStats;
+
+alignas(4) uint8_t arenaPool[ARENA_SIZE];
+volatile uint8_t   arenaOwner = ARENA_FREE;
+ArenaStats         arenaStats;
+HeapStats          heapStats;
+
+//----------------------------------------------------------------------------------------
+// arena_take: The pool for owner, nullptr if another owner holds it. Any context.
+//----------------------------------------------------------------------------------------
+static inline uint8_t* arena_take(uint8_t owner, uint16_t size)
+{
+  uint8_t held = ARENA_FREE;
+  if(size <= ARENA_SIZE &&
+     (__atomic_compare_exchange_n(&arenaOwner, &held, owner, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) || held == owner))
+    {
+      arenaStats.leases++;
+      if(size > arenaStats.peak) arenaStats.peak = size;
+      return arenaPool;
+    }
+  arenaStats.refused++;
+  arenaStats.refusedOwner  = owner;
+  arenaStats.refusedHolder = held;
+  return nullptr;
+}
+
+static inline void arena_give(uint8_t owner)
+{
+  uint8_t held = owner;
+  __atomic_compare_exchange_n(&arenaOwner, &held, (uint8_t)ARENA_FREE, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+struct ArenaLease {
+  uint8_t  owner;
+  uint8_t* buf;                                                                                     // nullptr: refused
+  ArenaLease(uint8_t o, uint16_t size) : owner(o), buf(arena_take(o, size)) {}
+  ~ArenaLease() { if(buf) arena_give(owner); }
+  ArenaLease(const ArenaLease&) = delete;
+  ArenaLease& operator=(const ArenaLease&) = delete;
+};
+
+void heap_seal(void);
+void ram_print(void);
+
+#endif
@@ -0,0 +1,97 @@
+
+// ~/Arduino/QIF/switch/arena.ino
+
+
+#include "qif.h"
+
+extern "C" char* sbrk(int incr);
+extern char      end;                                                                       // Linker script: end of .bss, start of the heap
+extern uint32_t  __StackTop;
+
+extern "C" void* __real_malloc(size_t n)             __attribute__((weak));                 // Resolved to the newlib ones by --wrap, else nullptr
+extern "C" void* __real_calloc(size_t n, size_t size) __attribute__((weak));
+extern "C" void* __real_realloc(void* p, size_t n)    __attribute__((weak));
+
+static const char* const arenaNames[ARENA_OWNERS] = { "FREE", "UPDATE TX", "UPDATE RX", "BOOT2", "VERIFY" };
+static uint32_t*         ramPainted = nullptr;                                              // Lowest painted word, nullptr before heap_seal()
+
+//----------------------------------------------------------------------------------------
+// Heap guard: the wrapped allocators, fail once the heap is sealed
+//----------------------------------------------------------------------------------------
+static bool heap_refuse(size_t n)
+{
+  if(!heapStats.sealed) return false;
+  heapStats.denied++;
+  heapStats.deniedBytes += n;
+  return true;
+}
+
+extern "C" void* __wrap_malloc(size_t n)
+{
+  return heap_refuse(n) ? nullptr : __real_malloc(n);
+}
+
+extern "C" void* __wrap_calloc(size_t n, size_t size)
+{
+  return heap_refuse(n * size) ? nullptr : __real_calloc(n, size);
+}
+
+extern "C" void* __wrap_realloc(void* p, size_t n)
+{
+  return heap_refuse(n) ? nullptr : __real_realloc(p, n);
+}
+
+//----------------------------------------------------------------------------------------
+// heap_seal: End of bootTask (boot.h). Closes the heap and paints the free RAM below the stack.
+//----------------------------------------------------------------------------------------
+void heap_seal(void)
+{
+  char* top = sbrk(0);
+  heapStats.bootBytes = top - &end;
+  heapStats.sealed    = true;                                                               // The heap no longer grows into the paint
+
+  uint32_t* p = (uint32_t*)(((uint32_t)top + 3) & ~3UL);
+  ramPainted  = p;
+  ATOMIC()                                                                                  // A tick nesting below the stack pointer would be painted over
+    {
+      uint32_t* sp = (uint32_t*)(__get_MSP() - ARENA_GUARD);
+      while(p < sp) *p++ = ARENA_PAINT;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// ram_print: Serial command G 4
+//----------------------------------------------------------------------------------------
+void ram_print(void)
+{
+  if(!IDE) return;
+  const uint32_t top = (uint32_t)&__StackTop;
+
+  Serial.print(F("RAM:          ")); Serial.print(HSRAM_SIZE);                    Serial.println(F(" bytes"));
+  Serial.print(F("STATIC:       ")); Serial.print((uint32_t)&end - HSRAM_ADDR);   Serial.println(F(" bytes .data + .bss"));
+
+  Serial.print(F("ARENA:        ")); Serial.print(ARENA_SIZE);
+  Serial.print(F(" bytes, HELD BY ")); Serial.print(arenaNames[arenaOwner < ARENA_OWNERS ? arenaOwner : 0]);
+  Serial.print(F(", LEASES: "));      Serial.print(arenaStats.leases);
+  Serial.print(F(", PEAK: "));        Serial.print(arenaStats.peak);
+  Serial.print(F(", REFUSED: "));     Serial.print(arenaStats.refused);
+  if(arenaStats.refused)
+    {
+      Serial.print(F(" (LAST: "));    Serial.print(arenaNames[arenaStats.refusedOwner]);
+      Serial.print(F(" WHILE "));     Serial.print(arenaNames[arenaStats.refusedHolder]); Serial.print(')');
+    }
+  Serial.println();
+
+  Serial.print(F("HEAP:         ")); Serial.print(heapStats.sealed ? heapStats.bootBytes : (uint32_t)(sbrk(0) - &end));
+  Serial.print(F(" bytes at boot, GUARD "));
+  Serial.print(__real_malloc ? F("LINKED") : F("NOT LINKED (--wrap)"));
+  Serial.print(F(", DENIED: ")); Serial.print(heapStats.denied);
+  Serial.print(F(" (")); Serial.print(heapStats.deniedBytes); Serial.println(F(" bytes)"));
+
+  if(!ramPainted) { Serial.println(F("STACK:        NOT PAINTED (heap_seal)")); return; }
+  const uint32_t* p = ramPainted;
+  while((uint32_t)p < top && *p == ARENA_PAINT) p++;
+  Serial.print(F("STACK PEAK:   ")); Serial.print(top - (uint32_t)p);
+  Serial.print(F(" bytes, FREE BELOW IT: ")); Serial.print((uint32_t)p - (uint32_t)ramPainted);
+  Serial.println(F(" bytes"));
+}
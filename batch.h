@@ -0,0 +1,55 @@
+
+// ~/Arduino/QIF/batch.h Located in parent directory and linked in subdirectory
+
+/*
+Batch frame: many channel commands in one CAN FD frame
+
+Sent on the control channel of a board (board CAN base + ctl), or on a group
+ID (db.h GROUPS) to reach every subscriber with one frame.
+
+  Byte 0   : CTL_BATCH opcode
+  Byte 1   : Sender label
+  Byte 2   : Sequence number (wraps)
+  Byte 3.. : TLV records, up to BATCH_MAX_CMDS per frame
+
+  Record   : T = (op << 4) | channel, L = value length, V = value bytes
+             BOP_PWM  L=1  V = duty 0-100 | direction << 7
+             BOP_LED  L=1  V = LED command 1-5 (same as Process_Led)
+             BOP_PWR  L=1  V = 0 off, else on (channel ignored)
+             T = BOP_END (0x00) or the end of the frame stops the list,
+             the zero padding of the CAN FD length does the same.
+             Unknown ops are skipped using L.
+
+The receiver checks the whole frame first and applies every command in one
+interrupt-free section, so all channels of a scene change on the same PWM tick.
+A frame with one bad record is refused as a whole.
+*/
+
+#ifndef   BATCH_H
+#define   BATCH_H
+
+#define BATCH_HEADER      CTL_HEADER                                                                // Opcode, sender label, sequence
+#define BATCH_RECORD      3                                                                         // T, L, 1-byte value
+#define BATCH_MAX_CMDS    ((64 - BATCH_HEADER) / BATCH_RECORD)                                      // 20 commands per frame
+#define BATCH_DIR         0x80                                                                      // Direction bit in PWM value
+
+enum BATCH_OP : uint8_t { BOP_END = 0, BOP_PWM, BOP_LED, BOP_PWR };                                 // Record operation, high nibble of T
+
+typedef struct {
+  uint16_t id;                                                                                      // Destination CAN ID
+  uint8_t  len;                                                                                     // Bytes used in data[]
+  uint8_t  count;                                                                                   // Records written
+  uint8_t  data[64];
+} Batch;
+
+uint8_t batchSeq = 0;                                                                               // Sequence number of the next batch sent
+
+void    batch_begin(Batch* b, uint16_t id);
+bool    batch_add(Batch* b, uint8_t op, uint8_t channel, uint8_t value);
+bool    batch_pwm(Batch* b, uint8_t channel, uint8_t percent, uint8_t direction);
+bool    batch_led(Batch* b, uint8_t channel, uint8_t command);
+bool    batch_pwr(Batch* b, bool on);
+bool    batch_send(Batch* b, uint8_t prio = TXQ_NORMAL);
+uint8_t canfd_len(uint8_t len);
+
+#endif
@@ -0,0 +1,70 @@
+
+// ~/Arduino/QIF/switch/batch.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// Batch frame builder (see batch.h for the frame layout)
+//
+//   Batch b;
+//   batch_begin(&b, Lbl2Can(label) + ctl);
+//   for(uint8_t ch = 0; ch < 6; ch++) batch_pwm(&b, ch, 50, FORWARD);
+//   batch_send(&b);
+//----------------------------------------------------------------------------------------
+void batch_begin(Batch* b, uint16_t id)
+{
+  b->id    = id;
+  b->count = 0;
+  b->len   = BATCH_HEADER;
+  memset(b->data, 0, sizeof(b->data));
+  b->data[0] = CTL_BATCH;
+  b->data[1] = LABEL;                                                                       // Sender
+}
+
+// Append one record, false when the frame is full
+bool batch_add(Batch* b, uint8_t op, uint8_t channel, uint8_t value)
+{
+  if(b->len + BATCH_RECORD > 64 || channel > 0x0F) return false;
+  b->data[b->len++] = (op << 4) | channel;
+  b->data[b->len++] = 1;
+  b->data[b->len++] = value;
+  b->count++;
+  return true;
+}
+
+bool batch_pwm(Batch* b, uint8_t channel, uint8_t percent, uint8_t direction)
+{
+  if(percent > 100) percent = 100;
+  return batch_add(b, BOP_PWM, channel, percent | (direction ? BATCH_DIR : 0));
+}
+
+bool batch_led(Batch* b, uint8_t channel, uint8_t command)
+{
+  return batch_add(b, BOP_LED, channel, command);
+}
+
+bool batch_pwr(Batch* b, bool on)
+{
+  return batch_add(b, BOP_PWR, 0, on ? 1 : 0);
+}
+
+// Queue the frame, length rounded up to the next valid CAN FD length (zero padded)
+bool batch_send(Batch* b, uint8_t prio)
+{
+  if(b->count == 0) return false;
+  b->data[2] = batchSeq++;
+  return sendCANFDFrame(b->data, canfd_len(b->len), b->id, prio);
+}
+
+//----------------------------------------------------------------------------------------
+// canfd_len: Smallest valid CAN FD payload length >= len (0-8, 12, 16, 20, 24, 32, 48, 64)
+//----------------------------------------------------------------------------------------
+uint8_t canfd_len(uint8_t len)
+{
+  if(len <= 8)  return len;
+  if(len <= 24) return (len + 3) & ~3;
+  if(len <= 32) return 32;
+  if(len <= 48) return 48;
+  return 64;
+}
@@ -0,0 +1,75 @@
+
+// ~/Arduino/QIF/bench.h Located in parent directory and linked in subdirectory
+
+/*
+Benchmark suite of the hot routines
+
+The same cases run on the board (serial command G 6) and on the host
+(sim/qifbench.cpp, built from the same bench.ino):
+
+  crc64       crc64_stream_update() over a QSPI page
+  page        upd_page_add(): a QSPI page of firmware update frames, CRC64 and copy
+  filter      filter_lookup() of an id no filter takes, the whole table scanned
+  db_label    Lbl2Can() of a label no board has, the whole DB[] searched
+  db_uid      getLBL() of a UID no board has
+  switch      Switch_Handler(), switches released (SWITCH boards)
+  pwm_TYPE    boardOps.pwm, the TC3 PWM interrupt of a board type (board.h)
+
+A sample runs the case ops times between two reads of BENCH_CLOCK(), interrupts
+off: the cycle counter DWT->CYCCNT on the board, a nanosecond clock on the host.
+One warm-up sample, then BENCH_SAMPLES; the report gives per op the median, the
+fastest sample and the median absolute deviation (MAD), the spread the comparison
+takes as noise. A sample stays under about 1 ms on the board: the PWM and the tick
+are late by that much while G 6 runs, the CAN controller FIFO holds the frames.
+
+The switch case saves switchState[] and zeroes it, a released switch only counts
+its wait: no click is sent. The PWM case drives the outputs at their current duty,
+as the interrupt does. The board runs its own type (BENCH_TYPES), the host all of
+them. The host adds its own cases at the end (BENCH_MORE): pwm_legacy_TYPE, the
+PWM interrupt as it was before board.h, next to pwm_TYPE, and the time-series
+store on a RAM flash, which the board would write to its QSPI.
+
+Output: one JSON document, one case per line, for tools/benchcmp.py:
+
+  {"bench":"qif","target":"same51","type":"SWITCH","build":"...","clock_hz":120000000,"samples":15,"cases":[
+  {"name":"crc64","ops":16,"bytes":256,"ns":1234.5,"min":1230.1,"mad":2.3,"mbps":207.4},
+  ...
+  {"name":"tsdb_hour","ops":4,"bytes":0,"ns":81234.5,"min":80112.0,"mad":310.2,"mbps":0.00,"samples":360.00},
+  ]}
+*/
+
+#ifndef   BENCH_H
+#define   BENCH_H
+
+#define BENCH_SAMPLES     15                                                                        // Timed samples per case, after one warm-up
+
+#ifndef   BENCH_CLOCK                                                                               // Host: sim/qifbench.cpp
+#define BENCH_CLOCK()     (DWT->CYCCNT)                                                             // Started by DWT_Init() in setup()
+#define BENCH_HZ          SystemCoreClock
+#define BENCH_TARGET      "same51"
+#define BENCH_TYPES       (1U << TYPE)                                                              // The PWM handler of this board only
+#define BENCH_SCALE       1                                                                         // Ops per sample, multiplier
+#endif
+
+#ifndef   BENCH_MORE                                                                                // Host: cases the board does not run
+#define BENCH_MORE(first)
+#endif
+
+typedef void (*BenchFn)(uint32_t ops);                                                              // Runs the case ops times
+
+typedef struct {
+  const char* name;
+  BenchFn     run;
+  uint32_t    ops;                                                                                  // Per sample, times BENCH_SCALE
+  uint16_t    bytes;                                                                                // Per op, 0: not a throughput case
+} BenchCase;
+
+typedef struct {
+  float ns;                                                                                         // Median per op
+  float min;
+  float mad;
+} BenchStat;
+
+void bench_run(void);
+
+#endif
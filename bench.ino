@@ -0,0 +1,177 @@
+
+// ~/Arduino/QIF/switch/bench.ino
+
+
+#include "qif.h"
+
+static uint8_t           benchPage[QSPI_PAGE_SIZE];                                         // Frames of a firmware update
+static uint8_t           benchCopy[QSPI_PAGE_SIZE];
+static volatile uint16_t benchId;                                                           // Inputs read again each op: the calls are never hoisted
+static volatile uint8_t  benchLbl;
+static volatile uint64_t benchUid;
+static volatile uint32_t benchSink;                                                         // Results land here, never optimized away
+
+static void bench_crc64(uint32_t ops)
+{
+  crc64_stream crc;
+  crc64_stream_init(&crc, 0);
+  for(uint32_t i = 0; i < ops; i++) crc64_stream_update(&crc, benchPage, QSPI_PAGE_SIZE);
+  benchSink = (uint32_t)crc64_stream_finalize(&crc);
+}
+
+static void bench_page(uint32_t ops)
+{
+  crc64_stream crc;
+  crc64_stream_init(&crc, 0);
+  for(uint32_t i = 0; i < ops; i++)
+    {
+      uint16_t index = 0;
+      for(uint16_t at = 0; at < QSPI_PAGE_SIZE; at += 8) upd_page_add(&crc, benchCopy, &index, QSPI_PAGE_SIZE, benchPage + at);
+    }
+  benchSink = (uint32_t)crc64_stream_finalize(&crc) ^ benchCopy[QSPI_PAGE_SIZE - 1];
+}
+
+static void bench_filter(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) benchSink = (uint32_t)(uintptr_t)filter_lookup(&filterManager, benchId);
+}
+
+static void bench_db_label(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) benchSink = Lbl2Can(benchLbl);
+}
+
+static void bench_db_uid(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) benchSink = getLBL(benchUid);
+}
+
+static void bench_switch(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) Switch_Handler();
+}
+
+static void bench_pwm(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) boardOps.pwm();
+}
+
+static const BenchCase benchCases[] = {
+  { "crc64",    bench_crc64,    16, QSPI_PAGE_SIZE },
+  { "page",     bench_page,     16, QSPI_PAGE_SIZE },
+  { "filter",   bench_filter,   32, 0 },
+  { "db_label", bench_db_label, 32, 0 },
+  { "db_uid",   bench_db_uid,   32, 0 },
+};
+
+static void bench_sort(uint32_t* v, uint8_t n)                                              // Insertion sort, BENCH_SAMPLES values
+{
+  for(uint8_t i = 1; i < n; i++)
+    {
+      const uint32_t x = v[i];
+      int8_t j = i - 1;
+      while(j >= 0 && v[j] > x) { v[j + 1] = v[j]; j--; }
+      v[j + 1] = x;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// bench_case: One warm-up sample, BENCH_SAMPLES timed ones, statistics per op
+//----------------------------------------------------------------------------------------
+static BenchStat bench_case(BenchFn run, uint32_t ops)
+{
+  uint32_t t[BENCH_SAMPLES];
+  uint32_t dev[BENCH_SAMPLES];
+
+  for(int8_t s = -1; s < BENCH_SAMPLES; s++)
+    {
+      uint32_t dt = 0;
+      ATOMIC()
+        {
+          const uint32_t t0 = BENCH_CLOCK();
+          run(ops);
+          dt = BENCH_CLOCK() - t0;
+        }
+      if(s >= 0) t[s] = dt;
+    }
+  bench_sort(t, BENCH_SAMPLES);
+  const uint32_t median = t[BENCH_SAMPLES / 2];
+  for(uint8_t s = 0; s < BENCH_SAMPLES; s++) dev[s] = (t[s] > median) ? t[s] - median : median - t[s];
+  bench_sort(dev, BENCH_SAMPLES);
+
+  const float perOp = 1e9f / (float)BENCH_HZ / (float)ops;                                  // Clock ticks of a sample to ns per op
+  BenchStat r;
+  r.ns  = median * perOp;
+  r.min = t[0] * perOp;
+  r.mad = dev[BENCH_SAMPLES / 2] * perOp;
+  return r;
+}
+
+static void bench_print(const char* name, uint32_t ops, uint16_t bytes, const BenchStat* r, bool* first,
+                        const char* key = nullptr, float value = 0)                         // One more figure of the case
+{
+  if(!*first) Serial.println(',');
+  *first = false;
+  Serial.print(F("{\"name\":\""));  Serial.print(name);
+  Serial.print(F("\",\"ops\":"));   Serial.print(ops);
+  Serial.print(F(",\"bytes\":"));   Serial.print(bytes);
+  Serial.print(F(",\"ns\":"));      Serial.print(r->ns, 1);
+  Serial.print(F(",\"min\":"));     Serial.print(r->min, 1);
+  Serial.print(F(",\"mad\":"));     Serial.print(r->mad, 1);
+  Serial.print(F(",\"mbps\":"));    Serial.print(bytes && r->ns > 0 ? bytes * 1000.0f / r->ns : 0.0f, 2);  // MB/s
+  if(key) { Serial.print(F(",\"")); Serial.print(key); Serial.print(F("\":")); Serial.print(value, 2); }
+  Serial.print('}');
+}
+
+//----------------------------------------------------------------------------------------
+// bench_run: Serial command G 6, the suite as JSON (bench.h)
+//----------------------------------------------------------------------------------------
+void bench_run(void)
+{
+  if(!IDE) return;
+  for(uint16_t i = 0; i < QSPI_PAGE_SIZE; i++) benchPage[i] = (uint8_t)(i * 151 + 7);
+  benchId  = CAN_NULL;                                                                      // Outside every filter
+  benchLbl = 0xFF;                                                                          // No board has them: the whole DB[] searched
+  benchUid = 0xFFFFFFFFFFFFFFFFULL;
+
+  Serial.print(F("{\"bench\":\"qif\",\"target\":\"")); Serial.print(F(BENCH_TARGET));
+  Serial.print(F("\",\"type\":\""));                   Serial.print(typeNames[TYPE]);
+  Serial.print(F("\",\"build\":\""));                  Serial.print(F(__DATE__ " " __TIME__));
+  Serial.print(F("\",\"clock_hz\":"));                 Serial.print((uint32_t)BENCH_HZ);
+  Serial.print(F(",\"samples\":"));                    Serial.print(BENCH_SAMPLES);
+  Serial.println(F(",\"cases\":["));
+
+  bool first = true;
+  BenchStat r;
+  for(uint8_t i = 0; i < sizeof(benchCases) / sizeof(benchCases[0]); i++)
+    {
+      const BenchCase* c = &benchCases[i];
+      r = bench_case(c->run, c->ops * BENCH_SCALE);
+      bench_print(c->name, c->ops * BENCH_SCALE, c->bytes, &r, &first);
+    }
+
+  if(BENCH_TYPES & (1U << SWITCH))
+    {
+      Switch saved[N];
+      memcpy(saved, switchState, sizeof(saved));
+      memset(switchState, 0, sizeof(saved));                                                // Released, nothing pending: no click
+      r = bench_case(bench_switch, 32 * BENCH_SCALE);
+      memcpy(switchState, saved, sizeof(saved));
+      bench_print("switch", 32 * BENCH_SCALE, 0, &r, &first);
+    }
+
+  for(uint8_t type = SWITCH; type <= HPOWER; type++)
+    {
+      if(!(BENCH_TYPES & (1U << type))) continue;
+      char name[16];
+      snprintf(name, sizeof(name), "pwm_%s", typeNames[type]);
+      board_bind(type);
+      r = bench_case(bench_pwm, 8 * BENCH_SCALE);
+      bench_print(name, 8 * BENCH_SCALE, 0, &r, &first);
+    }
+  board_bind(TYPE);                                                                         // Back to the handlers of this board
+  BENCH_MORE(&first);
+
+  Serial.println();
+  Serial.println(F("]}"));
+}
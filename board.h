@@ -0,0 +1,53 @@
+
+// ~/Arduino/QIF/board.h Located in parent directory and linked in subdirectory
+
+/*
+Board type specialization
+
+TYPE (db.h) is only known at boot, from the UID. The interrupt code that depends
+on it is written once as a template on the type, instantiated for each board type,
+and board_bind() installs the instantiation of this board in boardOps, once, in
+setup() right after TYPE is read. The handlers then call through boardOps and
+never test TYPE again:
+
+  pwm     the TC3 PWM interrupt itself, every TIMER_INTERVAL_US:
+          one pin per channel (SWITCH, LPOWER) or an H-bridge pair (MPOWER,
+          HPOWER), PWCTRL and the current sense read except on SWITCH
+  duty    percent to pwmDuty[], inverted on SWITCH (active-low LEDs)
+  power   PWCTRL on while any channel runs, nothing on SWITCH
+  scan    the 10 ms slot of the TCC2 tick: Switch_Handler() on SWITCH, nothing
+          on the power boards
+
+BoardTraits<T> are compile-time constants, the compiler folds every test on them:
+each instantiation is the straight-line code of its type, the branches on TYPE
+are gone from the 40 us interrupt and the tick.
+
+The static filter tables stay selected by TYPE in CAN_Setup(): they are installed
+once, the hardware filters do the per-frame work.
+
+Cycles: PWM ISR and TICK ISR lines of the profiler (G 1, prof.h), the header of
+the report names the board type.
+*/
+
+#ifndef   BOARD_H
+#define   BOARD_H
+
+template<uint8_t T> struct BoardTraits {
+  static const bool HBRIDGE = (T == MPOWER || T == HPOWER);                                         // Two pins per channel, direction
+  static const bool INVERT  = (T == SWITCH);                                                        // Active-low outputs
+  static const bool POWER   = (T != SWITCH);                                                        // PWCTRL and current sense
+  static const bool SCAN    = (T == SWITCH);                                                        // Switch inputs
+};
+
+typedef struct {
+  void (*pwm)(void);                                                                                // TC3 interrupt handler
+  void (*duty)(uint8_t channel, uint8_t percent);
+  void (*power)(void);
+  void (*scan)(void);                                                                               // TCC2 tick, every 10 ms
+} BoardOps;
+
+BoardOps boardOps;
+
+void board_bind(uint8_t type);
+
+#endif
@@ -0,0 +1,109 @@
+
+// ~/Arduino/QIF/switch/board.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// board_pwm<T> — Software PWM generator, TC3 interrupt
+//
+// Called every TIMER_INTERVAL_US, generates the PWM signals with digitalWrite().
+//
+// - SWITCH, LPOWER: one output pin per channel, HIGH while pwmTick < pwmDuty[].
+// - MPOWER, HPOWER: two pins per channel (A = even index, B = odd index), H-bridge.
+//     • pwmDuty == 0 → both pins LOW, braking.
+//     • pwmDuty > 0  → forward: A = PWM, B = inverted; reverse: A = inverted, B = PWM.
+// - Except SWITCH: PWCTRL ON while at least one channel runs, current sense in Isense.
+//----------------------------------------------------------------------------------------
+template<uint8_t T> void board_pwm(void)
+{
+  PROF_PERIOD(PROF_PWM);                                                              // Duration, interval and jitter of the 40 us ISR
+  pwmTick++;
+  if(pwmTick >= PWM_RESOLUTION) pwmTick = 0;
+  const uint8_t tick = pwmTick;
+  bool anyActive = false;
+
+  for(uint8_t ch = 0; ch < PWM_CHANNELS; ch++)
+    {
+      const uint8_t duty     = pwmDuty[ch];
+      const bool    pwmState = (tick < duty);
+      if(BoardTraits<T>::POWER) anyActive |= (duty != 0);
+      if(BoardTraits<T>::HBRIDGE)
+        {
+          const uint8_t pinA = pwmPins[ch * 2];
+          const uint8_t pinB = pwmPins[ch * 2 + 1];
+          if(duty == 0)
+            {
+              digitalWrite(pinA, LOW);                                                // Braking: both LOW shorts the motor terminals
+              digitalWrite(pinB, LOW);
+            }
+          else
+            {
+              const bool dir = pwmDir[ch];                                            // 0 = forward, 1 = reverse
+              digitalWrite(pinA, pwmState != dir);
+              digitalWrite(pinB, pwmState == dir);
+            }
+        }
+      else digitalWrite(pwmPins[ch], pwmState ? HIGH : LOW);
+    }
+
+  if(BoardTraits<T>::POWER)
+    {
+      digitalWrite(PWCTRL, anyActive ? ON : OFF);
+      Isense = analogRead(analogPins[0]);                                             // Analog input A0
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// board_duty<T>: Duty cycle 0–100% of one channel to pwmDuty[] (0–PWM_RESOLUTION)
+//----------------------------------------------------------------------------------------
+template<uint8_t T> void board_duty(uint8_t channel, uint8_t percent)
+{
+  if(BoardTraits<T>::INVERT) percent = 100 - percent;                                 // LEDs of SWITCH boards are active-low
+  pwmDuty[channel] = map(percent, 0, 100, 0, PWM_RESOLUTION);
+}
+
+//----------------------------------------------------------------------------------------
+// board_power<T>: PWCTRL ON if any pwmDuty[] is active, OFF if all are 0
+//----------------------------------------------------------------------------------------
+template<uint8_t T> void board_power(void)
+{
+  if(!BoardTraits<T>::POWER) return;
+  bool anyActive = false;
+  for(uint8_t i = 0; i < PWM_CHANNELS; i++)
+  if(pwmDuty[i] > 0) { anyActive = true; break; }
+  digitalWrite(PWCTRL, anyActive ? ON : OFF);
+}
+
+//----------------------------------------------------------------------------------------
+// board_scan<T>: 10 ms slot of the TCC2 tick
+//----------------------------------------------------------------------------------------
+template<uint8_t T> void board_scan(void)
+{
+  if(BoardTraits<T>::SCAN) Switch_Handler();                                          // Debounce and click detection of the switches
+}
+
+template<uint8_t T> static void board_set(void)
+{
+  boardOps.pwm   = board_pwm<T>;
+  boardOps.duty  = board_duty<T>;
+  boardOps.power = board_power<T>;
+  boardOps.scan  = board_scan<T>;
+}
+
+//----------------------------------------------------------------------------------------
+// board_bind: Install the handlers of this board type. setup(), once TYPE is known,
+// before the PWM and tick interrupts start. UNDEF behaves as before: single pin,
+// PWCTRL, no switch scan.
+//----------------------------------------------------------------------------------------
+void board_bind(uint8_t type)
+{
+  switch(type)
+    {
+      case SWITCH: board_set<SWITCH>(); break;
+      case LPOWER: board_set<LPOWER>(); break;
+      case MPOWER: board_set<MPOWER>(); break;
+      case HPOWER: board_set<HPOWER>(); break;
+      default:     board_set<UNDEF>();  break;
+    }
+}
@@ -0,0 +1,73 @@
+
+// ~/Arduino/QIF/boot.h Located in parent directory and linked in subdirectory
+
+/*
+Staged boot and startup timeline
+
+A board that reboots (firmware update, brownout) must be back on the bus at once.
+setup() only brings up what the bus and the outputs need and returns, the slow
+peripherals come up afterwards in bootTask while CAN frames are already handled:
+
+  setup()   ENTRY     cycle counter started, t = 0
+            IDENT     UID, label, type, board handlers bound (board.h)
+            OUTPUTS   pins in their safe state, PWM timer running at 0 %
+            CAN       timing wheel, 1 ms tick, CAN controller and filters
+            SCHED     tasks started, setup() returns to loop()
+  bootTask  QSPI      flash, CRC tables, time-series store (tsdb.h)
+            SERIAL    USB serial up or BOOT_SERIAL_MS elapsed, IDE set
+            BANNER    version banner, RTC set from the build time with an IDE,
+                      QSPI state
+            I2C       I2C bus, BME688 probe
+            BME       BSEC begin, settle, state restored (bstate.h), subscription
+            BATTERY   battery voltage (LPOWER)
+            DONE      heap sealed (arena.h)
+  TCC2      FIRST RX  first frame handled by a filter callback
+
+Nothing prints before SERIAL: IDE is still false, InitPins(), CAN_Setup() and the
+QSPI stage run quiet. QSPI comes first, a few ms, not after the serial wait: a
+board without a PC would otherwise NACK every STX (Process_Update refuses it until
+QSPI is reached) and keep its history and BSEC state closed for BOOT_SERIAL_MS
+after each reboot. BME_FLAG stays false until BME, bme_task() is idle until then.
+
+Each stage keeps DWT->CYCCNT and millis() of the moment it was reached. Target:
+the CAN stage within BOOT_TARGET_MS of setup(). The time before setup() (UF2
+bootloader, C runtime start, clocks) is not seen by the counter.
+
+Report: serial G 5, also printed once at DONE with an IDE.
+*/
+
+#ifndef   BOOT_H
+#define   BOOT_H
+
+#define BOOT_TARGET_MS    50                                                                        // setup() to CAN ready
+#define BOOT_SERIAL_MS    5000                                                                      // Longest wait for the IDE
+
+enum BOOT_STAGE : uint8_t {
+  BOOT_ENTRY = 0, BOOT_IDENT, BOOT_OUTPUTS, BOOT_CAN, BOOT_SCHED,                                   // setup()
+  BOOT_QSPI, BOOT_SERIAL, BOOT_BANNER, BOOT_I2C, BOOT_BME, BOOT_BATTERY, BOOT_DONE,                 // bootTask
+  BOOT_FIRST_RX,                                                                                    // TCC2
+  BOOT_STAGES
+};
+
+typedef struct {
+  volatile uint32_t reached;                                                                        // Bit per stage
+  uint32_t failed;                                                                                  // Bit per stage, reached but not working
+  uint32_t cycles[BOOT_STAGES];                                                                     // DWT->CYCCNT, wraps after 35 s
+  uint32_t ms[BOOT_STAGES];
+} BootInfo;
+
+BootInfo boot;
+
+static inline void boot_mark(uint8_t stage)                                                         // Any context
+{
+  boot.cycles[stage] = DWT->CYCCNT;
+  boot.ms[stage]     = millis();
+  __atomic_fetch_or(&boot.reached, 1UL << stage, __ATOMIC_RELEASE);
+}
+
+static inline bool boot_reached(uint8_t stage) { return boot.reached & (1UL << stage); }
+
+uint8_t bootTask(Task* t);
+void    boot_print(void);
+
+#endif
@@ -0,0 +1,172 @@
+
+// ~/Arduino/QIF/switch/boot.ino
+
+
+#include "qif.h"
+
+static const char* const bootNames[BOOT_STAGES] = {
+  "ENTRY", "IDENT", "OUTPUTS", "CAN", "SCHED", "QSPI", "SERIAL", "BANNER", "I2C", "BME", "BATTERY", "DONE", "FIRST RX" };
+
+//----------------------------------------------------------------------------------------
+// boot_banner: Version and identity, with an IDE only
+//----------------------------------------------------------------------------------------
+static void boot_banner(void)
+{
+#define VERSION   01
+#define REVISION  00
+
+  static const char copyright[] PROGMEM = { "©2026 QIF / karel@qif.ch http://qif.ch" };
+
+  Serial.println();                                                                         // Connected to IDE, print some debugging messages
+  Serial.println ((const __FlashStringHelper *) copyright);
+  Serial.println(F("CONNECTED TO THE QIF/BATOTIK"));
+  Serial.print(F("VERSION:      "));
+  Serial.print(VERSION);
+  Serial.print('.');
+  Serial.print(REVISION);
+  Serial.print("  ");
+  Serial.print(now.timestamp(DateTime::TIMESTAMP_DATE));
+  Serial.print(" ");
+  Serial.println(now.timestamp(DateTime::TIMESTAMP_TIME));
+  Serial.print(F("GENERATED ON: "));
+  Serial.println(LABEL);
+  Serial.print(F("BOARD:        "));
+  Serial.println(BOARD_NAME);
+  Serial.print(F("UUID:         0x"));
+  for(uint8_t i = 0; i < 8; i++) { UUID[i] = UniqueID[i]; Serial.print(UniqueID[i], HEX); }
+  Serial.println();
+  Serial.print(F("UID:          0x"));
+  Serial.println(UID, HEX);
+  Serial.print(F("LABEL:        "));
+  Serial.println(LABEL);
+  Serial.print(F("CAN:          0x"));
+  Serial.println(CAN_BASE,HEX);
+  Serial.print(F("TYPE:         "));
+  Serial.println(typeToString(DB[LABEL].TYPE));
+  Serial.print(F("DB SIZE       "));
+  Serial.println(sizeof(DB));
+  uint32_t flash_used = (uint32_t)&__etext;
+  Serial.print("FLASH USED:   ");
+  Serial.print((float)flash_used / 1024.0, 2);
+  Serial.println(" KB");
+}
+
+//----------------------------------------------------------------------------------------
+// bootTask: The slow part of the boot, started by setup() once CAN runs (boot.h).
+// One stage after the other, the scheduler runs the other tasks in the waits.
+//----------------------------------------------------------------------------------------
+uint8_t bootTask(Task* t)
+{
+  TASK_BEGIN(t);
+
+  if(!flash.begin())                                                                        // Initialize QSPI flash, before the serial wait (boot.h)
+    {
+      boot.failed |= 1UL << BOOT_QSPI;                                                      // Bus and outputs keep running, nothing stored
+      BLINK(LILAC);
+    }
+  else
+    {
+      crc_init();                                                                           // CRC-32 engine for flash verification
+      tsdb_mount();                                                                         // Time-series store above the firmware image
+      boot_mark(BOOT_QSPI);
+    }
+  TASK_YIELD(t);
+
+  while(!Serial.dtr() && millis() - boot.ms[BOOT_ENTRY] < BOOT_SERIAL_MS) TASK_DELAY(t, 10);  // The IDE opens the port, dtr() does not block
+  IDE = Serial && Serial.dtr();
+  randomSeed(micros());
+  boot_mark(BOOT_SERIAL);
+
+  if(IDE)
+    {
+      now = DateTime(F(__DATE__), F(__TIME__));                                             // if IDE connected to a PC
+      rtc.adjust(now);                                                                      // The alarm matches on the seconds only
+      boot_banner();
+      Serial.println(boot_reached(BOOT_QSPI) ? F("QSPI MEMORY   INITIALIZED") : F("Failed to initialize QSPI flash"));
+    }
+  boot_mark(BOOT_BANNER);
+
+  Wire.begin();
+  Wire.setClock(250000);                                                                    // Start the I2C bus at 250 kbps
+  ScanI2C();
+  if(BME688 != 0) Wire.beginTransmission(BME688);
+  else Wire.endTransmission();                                                              // No module present, disable I2C
+  if(IDE) Serial.println(BME688 ? F("BME688        MODULE FOUND") : F("BME688        MODULE NOT FOUND"));
+  boot_mark(BOOT_I2C);
+
+  if(BME688 != 0)
+    {
+      iaqSensor.begin(BME688, Wire);                                                        // I2C connect to BME688
+      if(IDE)
+        {
+          Serial.print(F("BSEC LIBRARY VERSION: ")) ;
+          Serial.print(iaqSensor.version.major);
+          Serial.print("." );
+          Serial.println(iaqSensor.version.minor);
+        }
+      TASK_DELAY(t, 1000);
+      if(boot_reached(BOOT_QSPI)) bst_restore();                                            // BSEC state of the last run, QSPI (bstate.h)
+      iaqSensor.updateSubscription(sensorList, 13, BSEC_SAMPLE_RATE_LP);
+      checkIaqSensorStatus();
+      readBME();
+      BME_FLAG = true;                                                                      // bme_task() samples from now on
+      boot_mark(BOOT_BME);
+    }
+
+  if(TYPE == LPOWER)
+    {
+      float measuredvbat = analogRead(A6);                                                  // Read raw ADC value (0–4095)
+      measuredvbat = (measuredvbat * 2.0 * 3.3) / 4096.0;                                   // Measure was divided by 2, multiply back, multiply by 1.0V, 1.0V internal
+      if(IDE) { Serial.print("BATTERY: " ); Serial.print(measuredvbat); Serial.println(F(" Volt")); }
+      boot_mark(BOOT_BATTERY);
+    }
+
+  heap_seal();                                                                              // No heap past this point, stack paint (arena.h)
+  boot_mark(BOOT_DONE);
+  if(IDE)
+    {
+      Serial.println();
+      boot_print();
+      Help();
+    }
+  TASK_END(t);
+}
+
+//----------------------------------------------------------------------------------------
+// boot_print: Serial command G 5
+//----------------------------------------------------------------------------------------
+void boot_print(void)
+{
+  if(!IDE) return;
+  const uint32_t perUs = SystemCoreClock / 1000000;
+  float last = 0;
+
+  Serial.print(F("BOOT TIMELINE FROM setup(), "));
+  Serial.print(typeNames[TYPE]);
+  Serial.println(F(" BOARD, ms"));
+  for(uint8_t s = 0; s < BOOT_STAGES; s++)
+    {
+      if(!boot_reached(s)) continue;
+      const uint32_t ms = boot.ms[s] - boot.ms[BOOT_ENTRY];
+      const float    at = (ms < 30000) ? (boot.cycles[s] - boot.cycles[BOOT_ENTRY]) / (float)perUs / 1000.0f : (float)ms;  // Cycle counter wraps after 35 s
+      char name[16];
+      snprintf(name, sizeof(name), "  %-10s", bootNames[s]);
+      Serial.print(name); Serial.print(at, 3);
+      if(s != BOOT_FIRST_RX) { Serial.print(F("  +")); Serial.print(at - last, 3); last = at; }
+      Serial.println();
+    }
+  for(uint8_t s = 0; s < BOOT_STAGES; s++)
+    if(boot.failed & (1UL << s)) { Serial.print(F("  ")); Serial.print(bootNames[s]); Serial.println(F(" FAILED")); }
+
+  const uint32_t canUs = (boot.cycles[BOOT_CAN] - boot.cycles[BOOT_ENTRY]) / perUs;
+  Serial.print(F("CAN READY:    ")); Serial.print(canUs / 1000.0, 3);
+  Serial.print(F(" ms, TARGET "));  Serial.print(BOOT_TARGET_MS);
+  Serial.println(canUs <= BOOT_TARGET_MS * 1000UL ? F(" ms, MET") : F(" ms, MISSED"));
+  Serial.print(F("FIRST RX:     "));
+  if(boot_reached(BOOT_FIRST_RX))
+    {
+      Serial.print(boot.ms[BOOT_FIRST_RX] - boot.ms[BOOT_CAN]);
+      Serial.println(F(" ms AFTER CAN READY"));
+    }
+  else Serial.println(F("NO FRAME YET"));
+}
@@ -0,0 +1,84 @@
+
+// ~/Arduino/QIF/bstate.h Located in parent directory and linked in subdirectory
+
+/*
+BSEC state in QSPI, warm start of the IAQ readings
+
+BSEC learns the gas sensor baseline over hours of run-in: started from scratch
+(every reboot, every firmware update) IAQ and CO2 stay at accuracy 0 for that
+long. The algorithm state is saved to QSPI and given back to BSEC at boot (bootTask)
+before updateSubscription(), the readings keep their accuracy across a reboot.
+
+Saving
+  bst_sample() runs after each BSEC sample (bme_task, main context): it copies
+  the state into bstState (RAM) and writes a record when BST_PERIOD_S elapsed or
+  the IAQ accuracy went up. Process_Update writes the RAM copy once more before
+  it jumps to Boot2 (bst_final), the state is at most one sample old, never
+  taken from BSEC in the interrupt (the main loop may be inside iaqSensor.run()).
+  No write while a firmware update or the CAN capture owns the QSPI.
+
+Record area, BST_START..BST_END: 2 sectors of 16 one-page records, written in
+turn. Entering a sector erases it, the other one still holds the last good
+record. Each page written once per 32 saves: at one save per hour a sector is
+erased every 16 hours.
+
+Record, one page:  BstHeader (magic, length, sequence, RTC time, BSEC version,
+                   IAQ accuracy, reason, CRC-32 of header and state), state
+Restore takes the valid record with the highest sequence. A state of another
+BSEC version is not given to BSEC, it starts from scratch as before.
+
+Serial: L 1 status, L 2 save now.
+*/
+
+#ifndef   BSTATE_H
+#define   BSTATE_H
+
+#define BST_START         0x005FE000UL                                                              // TSDB_END
+#define BST_END           0x00600000UL                                                              // CAP_START
+#define BST_SECTOR        4096                                                                      // QSPI_BLOCK_SIZE
+#define BST_PAGE          256                                                                       // QSPI_PAGE_SIZE, one record
+#define BST_SLOTS         ((BST_END - BST_START) / BST_PAGE)                                        // 32
+#define BST_MAGIC         0x4253                                                                    // "BS", 0xFFFF = erased page
+#define BST_PERIOD_S      3600                                                                      // Periodic save
+
+enum BST_REASON : uint8_t { BST_PERIODIC = 0, BST_ACCURACY, BST_COMMAND, BST_UPDATE };
+
+typedef struct __attribute__((packed)) {
+  uint16_t magic;
+  uint16_t len;                                                                                     // State bytes after the header
+  uint32_t seq;
+  uint32_t time;                                                                                    // RTC unix time of the save
+  uint8_t  version[4];                                                                              // BSEC major, minor, major bugfix, minor bugfix
+  uint8_t  accuracy;                                                                                // IAQ accuracy 0-3 at the save
+  uint8_t  reason;                                                                                  // enum BST_REASON
+  uint16_t reserved;
+  uint32_t crc;                                                                                     // CRC-32 of this header (crc = 0) and the state
+} BstHeader;
+
+static_assert(sizeof(BstHeader) + BSEC_MAX_STATE_BLOB_SIZE <= BST_PAGE, "BSEC state does not fit a page");
+
+typedef struct {
+  bool     valid;                                                                                   // bstState holds a state
+  uint16_t len;
+  uint8_t  slot;                                                                                    // Next record
+  uint32_t seq;                                                                                     // Of the next record
+  uint32_t lastMs;                                                                                  // millis() of the last save, 0 = none since boot
+  uint8_t  accuracy;                                                                                // At the last save
+  uint32_t saves;
+  uint32_t erases;
+  uint32_t errors;
+  bool     restored;                                                                                // bootTask gave a saved state to BSEC
+  uint32_t restoredSeq;
+  uint32_t restoredTime;
+} BstInfo;
+
+uint8_t  bstState[BSEC_MAX_STATE_BLOB_SIZE];
+BstInfo  bst;
+
+bool bst_restore(void);
+void bst_sample(void);
+bool bst_save(uint8_t reason);
+void bst_final(void);
+void bst_print(void);
+
+#endif
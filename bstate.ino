@@ -0,0 +1,204 @@
+
+// ~/Arduino/QIF/switch/bstate.ino
+
+
+#include "qif.h"
+
+static const char* const bstReasons[] = { "PERIODIC", "ACCURACY", "COMMAND", "UPDATE" };
+
+static uint32_t bst_addr(uint8_t slot) { return BST_START + (uint32_t)slot * BST_PAGE; }
+
+static uint32_t bst_crc(const BstHeader* h, const uint8_t* state)
+{
+  BstHeader c = *h;
+  c.crc = 0;
+  return crc32_soft(crc32_soft(0, (const uint8_t*)&c, sizeof(c)), state, h->len);
+}
+
+static bool bst_blank(uint8_t slot)                                                         // Whole page erased: a cut record has a state but no header
+{
+  uint32_t w[8];
+  for(uint16_t at = 0; at < BST_PAGE; at += sizeof(w))
+    {
+      if(flash.readBuffer(bst_addr(slot) + at, (uint8_t*)w, sizeof(w)) != sizeof(w)) return false;
+      for(uint8_t i = 0; i < 8; i++) if(w[i] != 0xFFFFFFFF) return false;
+    }
+  return true;
+}
+
+static bool bst_version_match(const BstHeader* h)
+{
+  return h->version[0] == (uint8_t)iaqSensor.version.major && h->version[1] == (uint8_t)iaqSensor.version.minor
+      && h->version[2] == (uint8_t)iaqSensor.version.major_bugfix && h->version[3] == (uint8_t)iaqSensor.version.minor_bugfix;
+}
+
+//----------------------------------------------------------------------------------------
+// bst_write: One record from bstState in the next slot. State first, header last: a
+// record cut by a reset has no magic and is ignored. Main context, or Process_Update
+// just before the jump to Boot2.
+//----------------------------------------------------------------------------------------
+static bool bst_write(uint8_t reason)
+{
+  const uint8_t perSector = BST_SECTOR / BST_PAGE;
+  if(bst.slot % perSector && !bst_blank(bst.slot))
+    bst.slot = ((bst.slot / perSector + 1) * perSector) % BST_SLOTS;                        // Not erased: next sector
+  if(bst.slot % perSector == 0)
+    {
+      if(!flash.eraseSector(bst_addr(bst.slot) / BST_SECTOR)) { bst.errors++; return false; }
+      bst.erases++;
+    }
+
+  BstHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic      = BST_MAGIC;
+  h.len        = bst.len;
+  h.seq        = bst.seq;
+  h.time       = rtc.now().unixtime();
+  h.version[0] = iaqSensor.version.major;
+  h.version[1] = iaqSensor.version.minor;
+  h.version[2] = iaqSensor.version.major_bugfix;
+  h.version[3] = iaqSensor.version.minor_bugfix;
+  h.accuracy   = (uint8_t)iaqSensor.iaqAccuracy;
+  h.reason     = reason;
+  h.crc        = bst_crc(&h, bstState);
+
+  const uint32_t addr = bst_addr(bst.slot);
+  const bool ok = flash.writeBuffer(addr + sizeof(h), bstState, h.len) == h.len
+               && flash.writeBuffer(addr, (const uint8_t*)&h, sizeof(h)) == sizeof(h);
+  bst.slot = (bst.slot + 1) % BST_SLOTS;                                                    // Page used either way, never programmed twice
+  bst.seq++;
+  if(!ok) { bst.errors++; return false; }
+
+  bst.saves++;
+  bst.accuracy = h.accuracy;
+  bst.lastMs   = millis();
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// bst_restore: bootTask, after iaqSensor.begin() and flash.begin(), before
+// updateSubscription(). Finds the newest valid record and gives it to BSEC.
+//----------------------------------------------------------------------------------------
+bool bst_restore(void)
+{
+  uint8_t   state[BSEC_MAX_STATE_BLOB_SIZE];
+  BstHeader h, best;
+  int16_t   bestSlot = -1;
+  int16_t   lastSlot = -1;                                                                  // Highest sequence programmed, valid or not
+  uint32_t  lastSeq  = 0;
+
+  memset(&bst, 0, sizeof(bst));
+  bst.lastMs = millis();                                                                    // Periodic saves count from the boot
+
+  for(uint8_t slot = 0; slot < BST_SLOTS; slot++)
+    {
+      if(flash.readBuffer(bst_addr(slot), (uint8_t*)&h, sizeof(h)) != sizeof(h) || h.magic != BST_MAGIC) continue;
+      if(lastSlot < 0 || (int32_t)(h.seq - lastSeq) > 0) { lastSlot = slot; lastSeq = h.seq; }
+      if(h.len > BSEC_MAX_STATE_BLOB_SIZE) continue;
+      if(flash.readBuffer(bst_addr(slot) + sizeof(h), state, h.len) != h.len || bst_crc(&h, state) != h.crc) continue;
+      if(bestSlot >= 0 && (int32_t)(h.seq - best.seq) <= 0) continue;
+      bestSlot = slot;
+      best     = h;
+      memcpy(bstState, state, h.len);
+    }
+
+  bst.slot = (lastSlot < 0) ? 0 : (lastSlot + 1) % BST_SLOTS;
+  bst.seq  = lastSeq + 1;
+
+  if(bestSlot < 0)
+    {
+      if(IDE) Serial.println(F("BSEC STATE    NONE SAVED, COLD START"));
+      return false;
+    }
+  if(!bst_version_match(&best))
+    {
+      if(IDE)
+        {
+          Serial.print(F("BSEC STATE    OF VERSION ")); Serial.print(best.version[0]); Serial.print('.');
+          Serial.print(best.version[1]); Serial.println(F(", COLD START"));
+        }
+      return false;
+    }
+
+  iaqSensor.setState(bstState);
+  if(iaqSensor.bsecStatus != BSEC_OK)
+    {
+      if(IDE) { Serial.print(F("BSEC STATE    REFUSED, CODE ")); Serial.println(iaqSensor.bsecStatus); }
+      return false;
+    }
+
+  bst.valid        = true;
+  bst.len          = best.len;
+  bst.accuracy     = best.accuracy;
+  bst.restored     = true;
+  bst.restoredSeq  = best.seq;
+  bst.restoredTime = best.time;
+  if(IDE)
+    {
+      Serial.print(F("BSEC STATE    RESTORED, SEQ ")); Serial.print(best.seq);
+      Serial.print(F(" ACCURACY "));                   Serial.print(best.accuracy);
+      Serial.print(F(" ("));                           Serial.print(bstReasons[best.reason < 4 ? best.reason : 0]);
+      Serial.println(')');
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// bst_sample: After each new BSEC sample (bme_task). Keeps the RAM copy current and
+// saves it when due.
+//----------------------------------------------------------------------------------------
+void bst_sample(void)
+{
+  uint8_t state[BSEC_MAX_STATE_BLOB_SIZE];
+  iaqSensor.getState(state);
+  if(iaqSensor.bsecStatus != BSEC_OK) return;
+  ATOMIC()                                                                                  // bst_final() may read it from the interrupt
+    {
+      memcpy(bstState, state, sizeof(state));
+      bst.len   = sizeof(state);
+      bst.valid = true;
+    }
+
+  const uint8_t accuracy = (uint8_t)iaqSensor.iaqAccuracy;
+  if(accuracy > bst.accuracy) bst_save(BST_ACCURACY);
+  else if(millis() - bst.lastMs >= BST_PERIOD_S * 1000UL) bst_save(BST_PERIODIC);
+}
+
+//----------------------------------------------------------------------------------------
+// bst_save: Write the RAM copy now. Main context. false while the QSPI is taken.
+//----------------------------------------------------------------------------------------
+bool bst_save(uint8_t reason)
+{
+  if(!bst.valid || !boot_reached(BOOT_QSPI) || STX_FLAG || capState != CAP_OFF) return false;                           // Firmware update or CAN capture owns the QSPI
+  QspiLease lease(QSPI_BSTATE);
+  return lease.held && bst_write(reason);
+}
+
+//----------------------------------------------------------------------------------------
+// bst_final: Process_Update, CRC matched, just before the jump to Boot2. Never returns
+// to the interrupted code, written under the QSPI of the update (qspi.h).
+//----------------------------------------------------------------------------------------
+void bst_final(void)
+{
+  if(bst.valid) bst_write(BST_UPDATE);
+}
+
+//----------------------------------------------------------------------------------------
+// bst_print: Serial command L 1
+//----------------------------------------------------------------------------------------
+void bst_print(void)
+{
+  if(!IDE) return;
+  Serial.print(F("BSEC STATE:   "));
+  if(bst.restored) { Serial.print(F("RESTORED SEQ ")); Serial.print(bst.restoredSeq); }
+  else Serial.print(F("COLD START"));
+  Serial.print(F(", ACCURACY NOW ")); Serial.println((uint8_t)iaqSensor.iaqAccuracy);
+  Serial.print(F("SAVES:        ")); Serial.print(bst.saves);
+  Serial.print(F(", ERASES: "));     Serial.print(bst.erases);
+  Serial.print(F(", ERRORS: "));     Serial.print(bst.errors);
+  Serial.print(F(", NEXT SLOT: "));  Serial.print(bst.slot); Serial.print('/'); Serial.print(BST_SLOTS);
+  Serial.print(F(", SEQ: "));        Serial.println(bst.seq);
+  Serial.print(F("LAST SAVE:    "));
+  if(bst.saves) { Serial.print((millis() - bst.lastMs) / 1000); Serial.println(F(" s AGO")); }
+  else Serial.println(F("NONE SINCE BOOT"));
+}
@@ -0,0 +1,65 @@
+
+// ~/Arduino/QIF/bulk.h Located in parent directory and linked in subdirectory
+
+/*
+Binary bulk read-out over USB serial
+
+Serial command X streams a flash range as binary frames instead of hex lines, for
+backups and image cloning (tools/qifread.py on the host):
+
+  X S F C      S = source (0 QSPI, 1 internal flash)
+               F = first 64 KB unit, C = number of units (0 = up to the end)
+
+Every frame is COBS encoded and ends with a 0x00 byte, so the host finds frame
+boundaries even after a lost byte. Decoded frame, little-endian:
+
+   0  type      BULK_START, BULK_DATA, BULK_END or BULK_ERROR
+   1  source
+   2  address   u32, of the first data byte
+   6  length    u16, of the data that follows
+   8  data      up to BULK_CHUNK bytes
+      crc64     u64, over bytes 0 .. 8 + length - 1
+
+  START data : total length (u32)
+  END data   : bytes sent (u32), elapsed ms (u32), CRC64 of the whole image (u64)
+
+CRC64 is crc64_update() (ECMA-182 reflected, init all ones, no final inversion),
+table driven here. The transfer is a task (task.h): one chunk per scheduler pass,
+CAN and switches keep running. IDE output is muted for the duration so no text
+lands inside the binary stream. Each QSPI chunk is read holding the QSPI (qspi.h,
+QSPI_BULK): while an update receiver erases ahead or programs, the transfer waits.
+*/
+
+#ifndef   BULK_H
+#define   BULK_H
+
+#define BULK_CHUNK        4096                                                                      // Data bytes per frame
+#define BULK_UNIT         0x10000UL                                                                 // Range granularity of the serial command (64 KB)
+#define BULK_HEADER       8
+#define BULK_FRAME        (BULK_HEADER + BULK_CHUNK + 8)                                            // Decoded frame, largest
+#define BULK_COBS         (BULK_FRAME + BULK_FRAME / 254 + 2)                                       // Encoded, with the 0x00 delimiter
+#define BULK_FLASH_END    0x00080000UL                                                              // Internal flash, 512 KB
+#define BULK_QSPI_END     0x00800000UL                                                              // QSPI, 8 MB
+
+enum BULK_TYPE   : uint8_t { BULK_START = 'S', BULK_DATA = 'D', BULK_END = 'E', BULK_ERROR = 'X' };
+enum BULK_SOURCE : uint8_t { BULK_QSPI = 0, BULK_INTERNAL };
+
+typedef struct {
+  uint8_t  source;
+  uint32_t start;
+  uint32_t end;
+  uint32_t addr;                                                                                    // Next address to send
+  uint64_t crc;                                                                                     // Whole image
+  uint32_t startMs;
+  bool     ide;                                                                                     // IDE before the transfer
+} BulkJob;
+
+BulkJob  bulkJob;
+uint8_t  bulkFrame[BULK_FRAME];
+uint8_t  bulkCobs[BULK_COBS];
+uint64_t bulkCrcTable[256];
+
+bool    bulk_read(uint8_t source, uint8_t first, uint8_t count);
+uint8_t bulkTask(Task* t);
+
+#endif
@@ -0,0 +1,117 @@
+
+// ~/Arduino/QIF/switch/bulk.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// bulk_crc64: Same result as crc64_update(), one table lookup per byte
+//----------------------------------------------------------------------------------------
+static uint64_t bulk_crc64(uint64_t crc, const uint8_t* data, uint32_t len)
+{
+  if(bulkCrcTable[1] == 0)                                                                  // First use: build the table
+    for(uint16_t i = 0; i < 256; i++)
+      {
+        uint64_t c = i;
+        for(uint8_t k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0xC96C5795D7870F42ULL : c >> 1;
+        bulkCrcTable[i] = c;
+      }
+  while(len--) crc = bulkCrcTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+//----------------------------------------------------------------------------------------
+// bulk_send: Add the CRC64, COBS encode and write one frame
+//----------------------------------------------------------------------------------------
+static void bulk_send(uint8_t type, uint32_t addr, uint16_t len)
+{
+  uint8_t* f = bulkFrame;
+  f[0] = type;
+  f[1] = bulkJob.source;
+  memcpy(&f[2], &addr, 4);
+  memcpy(&f[6], &len, 2);
+  const uint64_t crc = bulk_crc64(~0ULL, f, BULK_HEADER + len);
+  memcpy(&f[BULK_HEADER + len], &crc, 8);
+
+  Serial.write(bulkCobs, cobs_encode(f, BULK_HEADER + len + 8, bulkCobs));                // cobs_encode() in gwproto.h
+}
+
+//----------------------------------------------------------------------------------------
+// bulkTask: START, one DATA frame per pass, END
+//----------------------------------------------------------------------------------------
+uint8_t bulkTask(Task* t)
+{
+  BulkJob* b = &bulkJob;
+
+  TASK_BEGIN(t);
+
+  {
+    const uint32_t total = b->end - b->start;
+    memcpy(&bulkFrame[BULK_HEADER], &total, 4);
+    bulk_send(BULK_START, b->start, 4);
+  }
+
+  for(b->addr = b->start; b->addr < b->end; b->addr += BULK_CHUNK)
+    {
+      TASK_WAIT_UNTIL(t, b->source == BULK_INTERNAL || (!STX_FLAG && qspi_take(QSPI_BULK))); // Update running: wait for its end
+      {
+        const uint16_t len = (b->end - b->addr < BULK_CHUNK) ? b->end - b->addr : BULK_CHUNK;
+        uint8_t* data = &bulkFrame[BULK_HEADER];
+        if(b->source == BULK_INTERNAL) memcpy(data, (const uint8_t*)b->addr, len);
+        else
+          {
+            const bool read = flash.readBuffer(b->addr, data, len) == len;
+            qspi_give(QSPI_BULK);
+            if(!read)
+              {
+                bulk_send(BULK_ERROR, b->addr, 0);
+                IDE = b->ide;
+                TASK_EXIT(t);
+              }
+          }
+        b->crc = bulk_crc64(b->crc, data, len);
+        bulk_send(BULK_DATA, b->addr, len);
+      }
+      TASK_YIELD(t);
+    }
+
+  {
+    const uint32_t sent    = b->end - b->start;
+    const uint32_t elapsed = millis() - b->startMs;
+    memcpy(&bulkFrame[BULK_HEADER],     &sent,    4);
+    memcpy(&bulkFrame[BULK_HEADER + 4], &elapsed, 4);
+    memcpy(&bulkFrame[BULK_HEADER + 8], &b->crc,  8);
+    bulk_send(BULK_END, b->start, 16);
+  }
+  Serial.flush();
+  IDE = b->ide;
+
+  TASK_END(t);
+}
+
+//----------------------------------------------------------------------------------------
+// bulk_read: Serial command X, start the transfer of count 64 KB units from first
+//----------------------------------------------------------------------------------------
+bool bulk_read(uint8_t source, uint8_t first, uint8_t count)
+{
+  const uint32_t limit = (source == BULK_INTERNAL) ? BULK_FLASH_END : BULK_QSPI_END;
+  const uint32_t start = (uint32_t)first * BULK_UNIT;
+  uint32_t end = count ? start + (uint32_t)count * BULK_UNIT : limit;
+  if(end > limit) end = limit;
+
+  if(source > BULK_INTERNAL || start >= limit || task_running(bulkTask) || (source == BULK_QSPI && capState != CAP_OFF))
+    {
+      if(IDE) Serial.println(F("BULK READ REFUSED (SOURCE, RANGE, ALREADY RUNNING OR CAPTURE ON)"));
+      return false;
+    }
+
+  bulkJob.source  = source;
+  bulkJob.start   = start;
+  bulkJob.end     = end;
+  bulkJob.crc     = ~0ULL;
+  bulkJob.startMs = millis();
+  bulkJob.ide     = IDE;
+  if(!task_start(bulkTask, &bulkJob, "BULK")) return false;
+  IDE = false;                                                                              // Binary from here, no text
+  return true;
+}
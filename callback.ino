@@ -23,6 +23,7 @@
 // is greater than 1 hour (3600 seconds), the local RTC is adjusted to the received value.
 void Process_Time(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_TIME);
 // Visual indication of CAN activity using onboard LED strip
     BLINK(BLUE);
 
@@ -111,6 +112,18 @@ void Process_Reboot(const CANFDMessage & message)
   }
 
 
+//----------------------------------------------------------------------------------------
+// upd_write: Program one page of the update, UPD_DEFERRED while a task holds the QSPI
+//----------------------------------------------------------------------------------------
+static uint8_t upd_write(const uint8_t* page, uint32_t offset)
+{
+  if (qspiOwner != QSPI_FREE && qspiOwner != QSPI_UPDATE) return UPD_DEFERRED;    // A task's lease from before STX, it ends when we return
+  if (!erase_wait(offset + QSPI_PAGE_SIZE) ||                                       // Waits only if the eraser is behind
+      !qspi_take(QSPI_UPDATE) ||                                                    // Held since the first erase (qspi.h)
+      !flash.writeBuffer(offset, page, QSPI_PAGE_SIZE)) return UPD_FAILED;
+  return UPD_WRITTEN;
+}
+
 //----------------------------------------------------------------------------------------
 // Process_Update: Receive firmware stream over CAN FD and store into QSPI
 //
@@ -120,23 +133,32 @@ void Process_Reboot(const CANFDMessage & message)
 //   - Verifies CRC64 at the end against the received 8-byte CRC frame
 //
 // Assumptions:
-//   - QSPI was erased beforehand up to bootloader region
+//   - QSPI is erased in the background from STX up to the bootloader region (erase.h),
+//     a page is written only when the eraser is past it
 //   - Each CAN FD frame contains exactly 8 bytes
 //   - The firmware ends with a CRC64 checksum
+//   - After a CRC64 match, the QSPI content is read back (CRC-32, crcmap.h) before ACK
+//   - A page write refused while a task holds the QSPI waits for a next frame, the
+//     second page of the lease fills meanwhile (update.h)
 //----------------------------------------------------------------------------------------
 
 void Process_Update(const CANFDMessage &message)
 {
-  static uint32_t qspiOffset = 0;
-  static uint8_t pageBuffer[QSPI_PAGE_SIZE];
+  PROF_SCOPE(PROF_UPDATE);
+  static uint32_t qspiOffset = 0;                                                    // Of the page filling
+  static uint8_t* pages = nullptr;                                                   // UPD_PAGES x QSPI_PAGE_SIZE, arena lease from STX to ETX (arena.h)
+  static uint8_t* pageBuffer = nullptr;                                              // The page filling
+  static uint8_t* pagePending = nullptr;                                             // Full, its write deferred (update.h)
+  static uint32_t pendingOffset = 0;
   static uint16_t pageIndex = 0;
   static crc64_stream crc;
-  static uint8_t crc_candidate[8];
-  static uint8_t frame_buffer[8];
+  static uint8_t* crc_candidate;                                                     // 8 bytes each, after the page in the lease
+  static uint8_t* frame_buffer;
   static bool has_prev_frame = false;
   static uint32_t byteCount = 0;
   static uint64_t lastCRCValue = 0;
   static uint32_t frameCount = 0;
+  static uint32_t writtenCrc = 0;                                                     // CRC-32 of the pages programmed, readback check
 
   // Only process valid 8-byte CAN FD frames
   if (message.len != 8) return;
@@ -147,6 +169,18 @@ void Process_Update(const CANFDMessage &message)
   // --- STX received: Initialize ---
   if (isControlFrame && isControlMarkerMatch(stx, message))
   {
+    pages = boot_reached(BOOT_QSPI) && qspiOwner != QSPI_CAPTURE ? arena_take(ARENA_UPDATE_RX, UPD_PAGES * QSPI_PAGE_SIZE + 16) : nullptr;  // Same lease again on a repeated STX
+    pageBuffer = pages;
+    pagePending = nullptr;
+    if (!pageBuffer)
+    {
+      if (IDE) Serial.println(F("STX refused, QSPI not up, capture running or arena busy (G 5, M 2, G 4) ❌"));
+      STX_FLAG = false;
+      Send_Nack();
+      return;
+    }
+    frame_buffer  = pages + UPD_PAGES * QSPI_PAGE_SIZE;
+    crc_candidate = frame_buffer + 8;
     BLINK(LILAC);
     STX_FLAG = true;
     ETX_FLAG = false;
@@ -154,8 +188,9 @@ void Process_Update(const CANFDMessage &message)
     pageIndex = 0;
     byteCount = 0;                       // Reset byte counter for update
     has_prev_frame = false;
+    writtenCrc = 0;
     crc64_stream_init(&crc, 0);         // Restart CRC
-    eraseQSPI_Safe();                   // Erase QSPI up to Boot2 area
+    erase_start(0, BOOT2_START_ADDR, QSPI_UPDATE);  // Erase up to Boot2 area in the background, returns at once. Takes the QSPI, a task may hold it now
 
     if (IDE) Serial.println(F("STX received ✅"));
     return;
@@ -164,6 +199,7 @@ void Process_Update(const CANFDMessage &message)
   // --- ETX received: Finalize update and verify CRC ---
   if (isControlFrame && isControlMarkerMatch(etx, message))
   {
+    if (!pageBuffer) return;                                                         // No update since the last ETX
     STX_FLAG = false;
     ETX_FLAG = true;
 
@@ -174,18 +210,29 @@ void Process_Update(const CANFDMessage &message)
       Serial.println(byteCount);
     }
 
-    // Flush any remaining data in the current page buffer
+    // Flush the page still waiting, then any remaining data in the current page buffer. A failed
+    // or deferred write shows in the readback below.
+    if (pagePending)
+    {
+      upd_write(pagePending, pendingOffset);
+      writtenCrc = crc32_soft(writtenCrc, pagePending, QSPI_PAGE_SIZE);
+    }
     if (pageIndex > 0)
     {
       memset(&pageBuffer[pageIndex], 0xFF, QSPI_PAGE_SIZE - pageIndex);
-      flash.writeBuffer(qspiOffset, pageBuffer, QSPI_PAGE_SIZE);
+      upd_write(pageBuffer, qspiOffset);
+      writtenCrc = crc32_soft(writtenCrc, pageBuffer, QSPI_PAGE_SIZE);
       qspiOffset += QSPI_PAGE_SIZE;
     }
+    erase_abort();                                                                    // Rest of the area not needed
+    erase_print();
 
     // Convert saved CRC candidate into uint64_t
     lastCRCValue = 0;
     for (uint8_t i = 0; i < 8; i++)
       lastCRCValue |= ((uint64_t)crc_candidate[i]) << (8 * i);
+    arena_give(ARENA_UPDATE_RX);                                                      // Page written, Boot2 takes the arena next
+    pageBuffer = nullptr;
 
     uint64_t computed_crc = crc64_stream_finalize(&crc);
     bool match = (computed_crc == lastCRCValue);
@@ -199,6 +246,14 @@ void Process_Update(const CANFDMessage &message)
     if (!match)
     {
       if (IDE) Serial.println(F("\nCRC MISMATCH ❌"));
+      qspi_give(QSPI_UPDATE);
+      Send_Nack();
+      return;
+    }
+    else if (crc_region(MQSPI_BASE_ADDR, qspiOffset) != writtenCrc)                  // What the QSPI holds, not what was received
+    {
+      if (IDE) Serial.println(F("\nQSPI READBACK MISMATCH ❌"));
+      qspi_give(QSPI_UPDATE);
       Send_Nack();
       return;
     }
@@ -210,6 +265,7 @@ void Process_Update(const CANFDMessage &message)
         Serial.println(F("SYSTEM WILL REBOOT NOW"));
       }
       Send_Ack();                                                                     
+      bst_final();                                                                    // BSEC state survives the update (bstate.h)
  
       void (*boot2_ptr)(void) = (void (*)(void))(MQSPI_BASE_ADDR + BOOT2_START_ADDR);
       boot2_ptr();                                                                                            // Jump to QSPI Boot2 mapped to 0x04000000 + 0x79000
@@ -223,31 +279,45 @@ void Process_Update(const CANFDMessage &message)
   // --- Normal data frame processing ---
   byteCount += 8;
 
-  // CRC update with *previous* frame
-  if (has_prev_frame)
+  // Page waiting for the QSPI: try again now (update.h)
+  uint8_t written = UPD_WRITTEN;
+  if (pagePending && (written = upd_write(pagePending, pendingOffset)) == UPD_WRITTEN)
   {
-    crc64_stream_update(&crc, frame_buffer, 8);
+    writtenCrc = crc32_soft(writtenCrc, pagePending, QSPI_PAGE_SIZE);
+    pagePending = nullptr;
+  }
 
-    for (uint8_t i = 0; i < 8; i++)
+  // CRC update and page assembly with *previous* frame (update.h)
+  if (written != UPD_FAILED && has_prev_frame && upd_page_add(&crc, pageBuffer, &pageIndex, QSPI_PAGE_SIZE, frame_buffer))
+  {
+    if (!pagePending && (written = upd_write(pageBuffer, qspiOffset)) == UPD_WRITTEN)
+      writtenCrc = crc32_soft(writtenCrc, pageBuffer, QSPI_PAGE_SIZE);
+    else if (!pagePending && written == UPD_DEFERRED)
     {
-      pageBuffer[pageIndex++] = frame_buffer[i];
-      if (pageIndex >= QSPI_PAGE_SIZE)
-      {
-        if (!flash.writeBuffer(qspiOffset, pageBuffer, QSPI_PAGE_SIZE))
-        {
-          if (IDE)
-          {
-            Serial.print(F("QSPI write failed at offset 0x"));
-            Serial.println(qspiOffset, HEX);
-          }
-          STX_FLAG = false;
-          Send_Nack();
-          return;
-        }
-        qspiOffset += QSPI_PAGE_SIZE;
-        pageIndex = 0;
-      }
+      pagePending   = pageBuffer;                                                   // Written with a next frame, the other page fills meanwhile
+      pendingOffset = qspiOffset;
+      pageBuffer    = (pageBuffer == pages) ? pages + QSPI_PAGE_SIZE : pages;
     }
+    else written = UPD_FAILED;                                                       // Both pages full: the QSPI stayed held too long
+    qspiOffset += QSPI_PAGE_SIZE;
+    pageIndex = 0;
+  }
+
+  if (written == UPD_FAILED)
+  {
+    if (IDE)
+    {
+      Serial.print(F("QSPI write failed at offset 0x"));
+      Serial.println(pagePending ? pendingOffset : qspiOffset - QSPI_PAGE_SIZE, HEX);
+    }
+    STX_FLAG = false;
+    erase_abort();
+    qspi_give(QSPI_UPDATE);
+    arena_give(ARENA_UPDATE_RX);
+    pageBuffer = nullptr;
+    pagePending = nullptr;
+    Send_Nack();
+    return;
   }
 
   // Save current frame for CRC64 and final CRC frame match
@@ -271,6 +341,7 @@ void Process_Update(const CANFDMessage &message)
 
 void Process_BME(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_BME);
     BLINK(BLUE);                                                                                  // Turn on BLUE LED to indicate processing activity
 
     if(message.len < 3)                                                                           // If len < 3 it's a request else a it's a response
@@ -294,6 +365,8 @@ void Process_BME(const CANFDMessage & message)
     u.b[3] = message.data[4];
     value = u.f;
 
+    if(type >= BMETEMP && type <= BMECO2) tlm_put(label, Q_TEMP + type - BMETEMP, value);        // Keep it for local readers
+
     if(IDE)                                                                                       // Print the received value if connected to IDE (serial debug)
       {
         Serial.print(F("RX BME   FROM: "));
@@ -330,8 +403,11 @@ void Process_BME(const CANFDMessage & message)
 
 void Process_Heart_Beat(const CANFDMessage &message)
   {
+    PROF_SCOPE(PROF_HBEAT);
     BLINK(ORANGE);
 
+    tlm_put(message.data[0], Q_BEAT, 1);                                                       // Last time this board was seen
+
     if(IDE)
       {
         Serial.print(F("RX BEAT  FROM: "));
@@ -361,6 +437,7 @@ void Process_Heart_Beat(const CANFDMessage &message)
  */
 void Process_ACK(const CANFDMessage & message)
 {
+  PROF_SCOPE(PROF_ACK);
 // --- Visual feedback using onboard LED strip ---
   BLINK(BLUE);       // Set LED to blue to indicate ACK reception
 
@@ -376,6 +453,7 @@ void Process_ACK(const CANFDMessage & message)
 
 //----------------------------------------------------------------------------------------
 void Process_NACK(const CANFDMessage & message) {
+  PROF_SCOPE(PROF_NACK);
   BLINK(BLUE);
   if(IDE)
     {
@@ -412,25 +490,28 @@ void Process_NACK(const CANFDMessage & message) {
 
 void Process_Led(const CANFDMessage &message)
 {
+  PROF_SCOPE(PROF_LED);
   BLINK(BLUE);  // Visual feedback for CAN activity
 
   uint8_t led   = message.id & 0x0F;                                               // Extract LED channel (0–7)
   uint8_t value = message.data[0];                                                 // LED command
 
+  DLOG(DLOG_LED, message.id, led, value);
+
+  Apply_Led(led, value);
+}
+
+//----------------------------------------------------------------------------------------
+// Apply_Led: Executes one LED command (see Process_Led), no print, safe inside ATOMIC().
+//----------------------------------------------------------------------------------------
+void Apply_Led(uint8_t led, uint8_t value)
+{
+  if (led >= PWM_CHANNELS) return;
+
 // Static state to track brightness steps for each LED (0 to 5 = 0–100% / 20% steps)
   static uint8_t level_up[8] = {0};                                                // case 1 up counter (1–5) brigthness up
   static uint8_t level_down[8] = {5};                                              // case 2 down counter (5–0) brigthness down
 
-  if (IDE)
-  {
-    Serial.print(F("LED FROM:     0x"));
-    Serial.print(message.id, HEX);
-    Serial.print(F(" -> LED "));
-    Serial.print(led);
-    Serial.print(F(" VALUE "));
-    Serial.println(value);
-  }
-
   switch (value)
   {
     case 0:                                                                         // No action
@@ -471,9 +552,14 @@ void Process_Led(const CANFDMessage &message)
 
 void Process_PwrCtrl(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_PWRCTRL);
     BLINK(BLUE);                                                                    // Visual feedback for activity
-    
-    if(message.data[0] == 0)
+    Apply_PwrCtrl(message.data[0]);
+  }
+
+void Apply_PwrCtrl(uint8_t value)
+  {
+    if(value == 0)
       {
         digitalWrite(PWCTRL, OFF);                                                  // Turn off power control
         for(uint8_t i = 0; i < PWM_CHANNELS;  i++) Set_PWM(i, 0, OFF);
@@ -483,18 +569,13 @@ void Process_PwrCtrl(const CANFDMessage & message)
 
 void Process_Lpwm(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_LPWM);
     BLINK(BLUE);                                                                    // Visual feedback for activity
 
     uint8_t channel =  message.id & 0x0F;                                           // Extract channel (0–7)
     uint8_t value   = message.data[0];                                              // PWM command duty cycle 0-100%
 
-    if (IDE)
-      {
-        Serial.print(F("PWM -> CHANNEL "));
-        Serial.print(channel);
-        Serial.print(F(" VALUE "));
-        Serial.println(value);
-      }
+    DLOG(DLOG_PWM, channel, value);
 
     switch (channel)
       {
@@ -537,6 +618,7 @@ void Process_Lpwm(const CANFDMessage & message)
 
 void Process_Hpwm(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_HPWM);
     BLINK(BLUE);                                                                              // Visual feedback for activity
 
     uint8_t channel   =  message.id & 0x0F;                                                   // Extract channel (0–6)
@@ -576,6 +658,7 @@ void Process_Hpwm(const CANFDMessage & message)
 
 void Process_Analog(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_ANALOG);
     BLINK(BLUE);                                                                              // Visual feedback for activity
     
     CANFDMessage msg;
@@ -626,12 +709,14 @@ void Process_Analog(const CANFDMessage & message)
 
 void Process_Analog_RX(const CANFDMessage & message)                                          // Receiving analog channel value
   {
+    PROF_SCOPE(PROF_ANA_RX);
     BLINK(BLUE);                                                                              // Visual feedback for activity
 
     uint8_t sender  = message.data[0];
     uint8_t channel = message.data[1];
-// Reconstruct 16-bit analog value from two bytes (little-endian: LSB first)
-    uint16_t analogValue = (uint16_t)message.data[2] | ((uint16_t)message.data[3] << 8);
+// Reconstruct 16-bit analog value from two bytes (big-endian: MSB first, as Process_Analog sends it)
+    uint16_t analogValue = ((uint16_t)message.data[2] << 8) | (uint16_t)message.data[3];
+    if(channel <= 3) tlm_put(sender, Q_ANA0 + channel, analogValue);                          // Keep it for local readers
 // Convert to voltage (assuming 3.3V reference and 16-bit resolution)
     float voltage = (analogValue / 65535.0f) * 3.3f;
     if(IDE)                                                                                   // Print the values
@@ -647,31 +732,37 @@ void Process_Analog_RX(const CANFDMessage & message)
   }
 void Process_Isense(const CANFDMessage & message)                                             // Current sense
   {
+    PROF_SCOPE(PROF_ISENSE);
     BLINK(BLUE);                                                                              // Visual feedback for activity
   }
 
 void Process_Alarm_BME(const CANFDMessage & message)                                          // Alarm detection of CO,CO2 & temp
   {
+    PROF_SCOPE(PROF_ALARM);
     BLINK(BLUE);                                                                              // Visual feedback for activity
   }
 
 void Process_GPS(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_GPS);
     BLINK(BLUE);                                                                              // Visual feedback for activity
   }
 
 void Process_Gyro(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_GYRO);
     BLINK(BLUE);                                                                              // Visual feedback for activity
   }
 
 void Process_Level(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_LEVEL);
     BLINK(BLUE);                                                                              // Visual feedback for activity
   }
 
 void Process_Pir(const CANFDMessage & message)
   {
+    PROF_SCOPE(PROF_PIR);
     BLINK(BLUE);                                                                              // Visual feedback for activity
   }
 
@@ -691,3 +782,156 @@ bool isControlMarkerMatch(uint64_t marker, const CANFDMessage &msg)
 
   return decoded == marker;
 }
+
+
+//----------------------------------------------------------------------------------------
+// Process_Ctl: Control channel of the board (CAN base + ctl).
+//
+//   Byte 0 : Opcode (enum CTL)
+//   Byte 1 : Sender label
+//   Byte 2 : Sequence number
+//   Byte 3.. Opcode payload
+//----------------------------------------------------------------------------------------
+void Process_Ctl(const CANFDMessage & message)
+  {
+    PROF_SCOPE(PROF_CTL);
+    BLINK(BLUE);                                                                              // Visual feedback for activity
+
+    if(message.len < CTL_HEADER) return;
+
+    switch(message.data[0])
+      {
+        case CTL_BATCH: Process_Batch(message, 0xFFFF, false); break;
+        case CTL_RPC_REQ: Process_Rpc_Req(message); break;
+        case CTL_RPC_RSP: Process_Rpc_Rsp(message); break;
+        case CTL_TS_QUERY: Process_Ts_Query(message); break;
+        case CTL_TS_DATA: Process_Ts_Data(message); break;
+        default:
+          if(IDE) { Serial.print(F("Unknown control opcode ")); Serial.println(message.data[0]); }
+          break;
+      }
+  }
+
+//----------------------------------------------------------------------------------------
+// Process_Batch: Applies a batch frame (see batch.h).
+//
+// mask  : local channels this frame may drive (0xFFFF for the board's own control
+//         channel, the group mask for a group frame). Channel 0xF in a record means
+//         every channel of the mask.
+// group : true for a group frame. Records that do not apply to this board (LED on a
+//         power board, channel outside the mask...) are then skipped instead of
+//         refusing the frame, since group members are of mixed types.
+//
+// All records are checked first, against this board type:
+//   - BOP_PWM : channel 0-7 (SWITCH, LPOWER) or 0-5 (MPOWER, HPOWER)
+//   - BOP_LED : SWITCH boards only, channel 0-7
+//   - BOP_PWR : power boards only, never through a group
+// then applied together with interrupts off so the PWM ISR sees the whole scene
+// at once. One bad record refuses the whole frame.
+//----------------------------------------------------------------------------------------
+void Process_Batch(const CANFDMessage & message, uint16_t mask, bool group)
+  {
+    uint8_t  op[BATCH_MAX_CMDS];
+    uint16_t chs[BATCH_MAX_CMDS];                                                             // Channels driven by each record
+    uint8_t  val[BATCH_MAX_CMDS];
+    uint8_t  count = 0;
+    bool     valid = true;
+
+    const uint8_t  maxChannel = (TYPE == MPOWER || TYPE == HPOWER) ? 6 : PWM_CHANNELS;
+    const uint16_t local      = mask & ((1 << maxChannel) - 1);                                // Channels that exist and are allowed
+    uint8_t i = BATCH_HEADER;
+
+    while(i < message.len && message.data[i] != BOP_END)
+      {
+        if(i + 2 > message.len || i + 2 + message.data[i + 1] > message.len) { valid = false; break; }  // Truncated record
+
+        const uint8_t o = message.data[i] >> 4;
+        const uint8_t c = message.data[i] & 0x0F;
+        const uint8_t l = message.data[i + 1];
+        const uint8_t at = i + 2;                                                             // Value of the record
+        i += 2 + l;
+
+        if(o != BOP_PWM && o != BOP_LED && o != BOP_PWR) continue;                            // Unknown op: skip its value
+        if(l != 1 || count >= BATCH_MAX_CMDS)                     { valid = false; break; }
+        const uint8_t v = message.data[at];                                                   // Read once l == 1 and at + l <= len are checked
+        if(o == BOP_PWM && (v & ~BATCH_DIR) > 100)                { valid = false; break; }
+
+        bool     applies = true;
+        uint16_t target  = (c == 0x0F) ? local : (1 << c);
+        if(o == BOP_LED && TYPE != SWITCH) applies = false;
+        if(o == BOP_PWR && (TYPE == SWITCH || group)) applies = false;                         // Power control is board wide, never through a group
+        if(o != BOP_PWR && (target & local) != target) applies = false;                       // Channel missing or outside the mask
+
+        if(!applies)
+          {
+            if(group) continue;                                                               // Not for this member of the group
+            valid = false; break;
+          }
+        op[count]  = o;
+        chs[count] = target;
+        val[count] = v;
+        count++;
+      }
+
+    if(!valid)
+      {
+        DLOG(DLOG_BATCH_BAD, message.data[1]);
+        return;
+      }
+
+    ATOMIC()
+      {
+        for(uint8_t n = 0; n < count; n++)
+          {
+            if(op[n] == BOP_PWR) { Apply_PwrCtrl(val[n]); continue; }
+            for(uint8_t ch = 0; ch < maxChannel; ch++)
+              {
+                if(!(chs[n] & (1 << ch))) continue;
+                if(op[n] == BOP_PWM) Set_PWM(ch, val[n] & ~BATCH_DIR, (val[n] & BATCH_DIR) ? REVERSE : FORWARD);
+                else                 Apply_Led(ch, val[n]);
+              }
+          }
+      }
+
+    if(group) DLOG(DLOG_GRP_BATCH, message.data[1], message.data[2], count);
+    else      DLOG(DLOG_BATCH, message.data[1], message.data[2], count);
+  }
+
+//----------------------------------------------------------------------------------------
+// Process_Group: Frame received on a group ID this board subscribes to (db.h GROUPS).
+//
+//   len 1  : click value (Send_Click with a group as .lnk target)
+//            SWITCH boards run it as an LED command on every channel of the mask,
+//            power boards: CLICK_S = full on, CLICK_VL = off, others ignored.
+//   else   : batch frame (CTL_BATCH), applied to the channels of the mask.
+//----------------------------------------------------------------------------------------
+void Process_Group(const CANFDMessage & message)
+  {
+    PROF_SCOPE(PROF_GROUP);
+    BLINK(BLUE);                                                                              // Visual feedback for activity
+
+    uint16_t mask = 0;
+    for(uint8_t i = 0; i < GROUPS_count; i++)                                                 // Local channels of all matching subscriptions
+      if(GROUPS[i].LBL == LABEL && GRP(GROUPS[i].GRP) == message.id) mask |= GROUPS[i].MASK;
+    if(mask == 0) return;
+
+    if(message.len == 1)
+      {
+        const uint8_t click      = message.data[0];
+        const uint8_t maxChannel = (TYPE == MPOWER || TYPE == HPOWER) ? 6 : PWM_CHANNELS;
+        ATOMIC()
+          {
+            for(uint8_t ch = 0; ch < maxChannel; ch++)
+              {
+                if(!(mask & (1 << ch))) continue;
+                if(TYPE == SWITCH)          Apply_Led(ch, click);
+                else if(click == CLICK_S)   Set_PWM(ch, 100, pwmDir[ch]);
+                else if(click == CLICK_VL)  Set_PWM(ch, 0, pwmDir[ch]);
+              }
+          }
+        DLOG(DLOG_GRP_CLICK, message.id, click);
+        return;
+      }
+
+    if(message.len >= CTL_HEADER && message.data[0] == CTL_BATCH) Process_Batch(message, mask, true);
+  }
@@ -0,0 +1,129 @@
+
+// ~/Arduino/QIF/capture.h Located in parent directory and linked in subdirectory
+
+/*
+CAN capture in monitor mode
+
+While Monitor() is on, every frame on the bus is stored, binary, with a time stamp
+taken from DWT->CYCCNT in the receive callback (microseconds since the capture
+started, 64 bits, the cycle counter wrap is tracked). Nothing is printed per frame,
+and the 1 ms tick dispatches up to GW_RX_BURST frames instead of one.
+
+Time stamp resolution: the stamp is when cap_rx() runs, not when the frame was on
+the bus. The driver does not pass on the time stamp of the M_CAN RX FIFO element;
+frames wait in the controller and driver FIFOs for the 1 ms tick. A stamp is up to
+1 ms late, one more ms per GW_RX_BURST frames queued ahead of it, and the frames of
+one tick get stamps a few us apart however far apart they were on the bus. Order
+and rates over tens of ms hold; gaps between frames and latencies under about 2 ms
+do not (bursts, response times: use a bus analyzer).
+
+  RAM ring  capRing, CAP_RAM bytes, appended by cap_rx() in the CAN interrupt.
+  QSPI      cap_poll() in the 1 ms tick programs one 256-byte page of the ring into
+            CAP_START..CAP_END when the flash is idle: up to 256 KB/s, more than a
+            saturated bus (64-byte FD frames back to back: ~180 KB/s of records).
+            The ring absorbs the scheduling jitter: 16 KB is ~90 ms at that rate.
+
+Start
+  M erases the 2 MB area in the background first (erase.h, a few seconds: no erase
+  may run once pages are being programmed, a 64 KB block erase would stall the
+  spill for 150 ms or more). Meanwhile the capture is ERASING: the ring keeps the
+  last capPre bytes. Then it is RUNNING, or ARMED if a trigger id is set (M 4):
+  the ring still keeps only the last capPre bytes (pre-trigger) until the first
+  frame with that id (or M 5), that frame is flagged CAP_TRIG and the spill starts.
+  It stops at CAP_END (FULL) or with M. History writes (tsdb.h) wait meanwhile.
+
+Record, 4-byte aligned
+  us(4) id(2) flags(1) len(1) data(len, padded to 4)
+  flags CAP_EPOCH: us upper 32 bits changed, data = new upper word (4 bytes)
+  id 0xFFFF: erased flash, end of the capture
+
+QSPI layout
+  CAP_START: CapHeader page, then the records as a byte stream.
+
+Counters (M 2): frames, drops (ring full after the trigger, the number that has
+to stay 0), frames dropped before the trigger by design, ring peak, bytes spilled.
+Export (M 3): candump log lines "(sec.usec) can0 ID#DATA", ID##F DATA for CAN FD,
+tools/qifcap.py saves them as .log or .pcap (LINKTYPE_CAN_SOCKETCAN).
+*/
+
+#ifndef   CAPTURE_H
+#define   CAPTURE_H
+
+#define CAP_START         0x00600000UL                                                              // BST_END
+#define CAP_END           0x00800000UL                                                              // 8 MB QSPI
+#define CAP_RAM           16384                                                                     // RAM ring, power of 2
+#define CAP_PAGE          256                                                                       // QSPI_PAGE_SIZE
+#define CAP_PRE_KB        4                                                                         // Default pre-trigger
+#define CAP_MAGIC         0x50414351                                                                // "QCAP"
+#define CAP_NO_TRIGGER    0xFFFF
+#define CAP_EXPORT_BURST  32                                                                        // Lines per scheduler pass
+
+#define CAP_FD            0x01                                                                      // Record flags
+#define CAP_BRS           0x02
+#define CAP_TRIG          0x40
+#define CAP_EPOCH         0x80
+#define CAP_REC(len)      (8U + (((len) + 3U) & ~3U))
+
+enum CAP_STATE : uint8_t { CAP_OFF = 0, CAP_ERASING, CAP_ARMED, CAP_RUNNING, CAP_FULL };
+
+typedef struct __attribute__((packed)) {
+  uint32_t us;                                                                                      // Low 32 bits of microseconds since start
+  uint16_t id;
+  uint8_t  flags;
+  uint8_t  len;
+} CapRecord;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t unixStart;                                                                               // RTC time of the capture start
+  uint32_t epoch;                                                                                   // us upper word of the first record
+  uint32_t trigLow;                                                                                 // Trigger time, us
+  uint32_t trigHigh;
+  uint16_t trigId;                                                                                  // CAP_NO_TRIGGER if none
+  uint16_t preBytes;
+} CapHeader;
+
+typedef struct {
+  uint32_t frames;                                                                                  // Stored
+  uint32_t drops;                                                                                   // Ring full while running
+  uint32_t preDropped;                                                                              // Older than the pre-trigger window
+  uint32_t late;                                                                                    // Received after FULL
+  uint32_t peak;                                                                                    // Highest ring fill, bytes
+  uint32_t spilled;                                                                                 // Bytes written to QSPI
+  uint32_t pageWaits;                                                                               // Ticks that found the flash busy
+} CapStats;
+
+typedef struct {
+  uint32_t addr;                                                                                    // Next record in QSPI
+  uint32_t epoch;
+  uint32_t unixStart;
+  uint32_t lines;
+} CapExport;
+
+volatile uint8_t  capState = CAP_OFF;
+uint8_t           capRing[CAP_RAM];
+volatile uint32_t capHead = 0;                                                                      // Bytes stored, free running
+volatile uint32_t capTail = 0;                                                                      // Bytes spilled or dropped
+uint32_t          capPre = CAP_PRE_KB * 1024;
+uint16_t          capTrigId = CAP_NO_TRIGGER;
+uint32_t          capEpoch;                                                                         // us upper word of the last record
+uint32_t          capTailEpoch;                                                                     // us upper word at capTail
+uint32_t          capCycHigh;                                                                       // DWT->CYCCNT extended to 64 bits
+uint32_t          capCycLast;
+uint64_t          capCycStart;
+uint32_t          capCycPerUs;
+uint64_t          capTrigUs;
+uint32_t          capUnixStart;
+uint32_t          capAddr;                                                                          // Next QSPI page
+bool              capHeaderDone;
+uint8_t           capPage[CAP_PAGE];
+CapStats          capStats;
+CapExport         capExport;
+
+void cap_start(void);
+void cap_stop(void);
+void cap_rx(const CANFDMessage & message);
+void cap_poll(void);
+void cap_command(uint8_t mode, uint8_t a, uint8_t b, uint8_t c);
+
+#endif
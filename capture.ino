@@ -0,0 +1,295 @@
+
+// ~/Arduino/QIF/switch/capture.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// cap_us: Microseconds since cap_start(), from the cycle counter. Any context.
+// Called every millisecond by cap_poll(), so a wrap of DWT->CYCCNT (35 s) is never missed.
+//----------------------------------------------------------------------------------------
+static uint64_t cap_us(void)
+{
+  uint64_t cycles = 0;
+  ATOMIC()
+    {
+      const uint32_t c = DWT->CYCCNT;
+      if(c < capCycLast) capCycHigh++;
+      capCycLast = c;
+      cycles = (uint64_t)capCycHigh << 32 | c;
+    }
+  return (cycles - capCycStart) / capCycPerUs;
+}
+
+//----------------------------------------------------------------------------------------
+// Ring access. capHead moves in the CAN interrupt only, capTail in the tick once running.
+//----------------------------------------------------------------------------------------
+static void cap_put(const void* src, uint8_t n)
+{
+  const uint8_t* s = (const uint8_t*)src;
+  for(uint8_t i = 0; i < n; i++) capRing[(capHead + i) & (CAP_RAM - 1)] = s[i];
+  capHead += (n + 3) & ~3;
+}
+
+static uint8_t cap_at(uint32_t pos) { return capRing[pos & (CAP_RAM - 1)]; }
+
+static void cap_discard(void)                                                               // Oldest record, outside the pre-trigger window
+{
+  const uint8_t flags = cap_at(capTail + 6);
+  const uint8_t len   = cap_at(capTail + 7);
+  if(flags & CAP_EPOCH)
+    capTailEpoch = cap_at(capTail + 8) | cap_at(capTail + 9) << 8 | cap_at(capTail + 10) << 16 | (uint32_t)cap_at(capTail + 11) << 24;
+  else capStats.preDropped++;
+  capTail += CAP_REC(len);
+}
+
+//----------------------------------------------------------------------------------------
+// cap_rx: Callback of the monitor filter, every frame on the bus (CAN interrupt)
+//----------------------------------------------------------------------------------------
+void cap_rx(const CANFDMessage & message)
+{
+  const uint8_t state = capState;
+  if(state == CAP_OFF) return;
+  if(state == CAP_FULL) { capStats.late++; return; }
+
+  const uint64_t us   = cap_us();
+  const uint32_t high = us >> 32;
+  CapRecord r;
+  r.us    = (uint32_t)us;
+  r.id    = message.id;
+  r.flags = 0;
+  if(message.type == CANFDMessage::CANFD_NO_BIT_RATE_SWITCH)   r.flags = CAP_FD;
+  if(message.type == CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH) r.flags = CAP_FD | CAP_BRS;
+  r.len   = message.len;
+
+  if(state == CAP_ARMED && message.id == capTrigId)
+    {
+      capTrigUs = us;
+      r.flags  |= CAP_TRIG;
+      capState  = CAP_RUNNING;
+    }
+
+  const uint32_t need = CAP_REC(r.len) + (high != capEpoch ? CAP_REC(4) : 0);
+  if(capState != CAP_RUNNING)
+    {
+      while(capHead - capTail + need > capPre) cap_discard();                               // Pre-trigger: keep the newest capPre bytes
+    }
+  else if(capHead - capTail + need > CAP_RAM)
+    {
+      capStats.drops++;                                                                     // Spill behind, the one number that must stay 0
+      return;
+    }
+
+  if(high != capEpoch)
+    {
+      const CapRecord e = { 0, 0, CAP_EPOCH, 4 };
+      cap_put(&e, sizeof(e));
+      cap_put(&high, 4);
+      capEpoch = high;
+    }
+  cap_put(&r, sizeof(r));
+  cap_put(message.data, r.len);
+  capStats.frames++;
+  if(capHead - capTail > capStats.peak) capStats.peak = capHead - capTail;
+}
+
+//----------------------------------------------------------------------------------------
+// cap_step: Program the next QSPI page, the header first. Does not wait for the flash.
+// Returns 1 written, 0 nothing to do or flash busy, -1 area full or write error.
+//----------------------------------------------------------------------------------------
+static int8_t cap_step(uint32_t minBytes)
+{
+  uint32_t n = 0;
+  if(capHeaderDone)
+    {
+      n = capHead - capTail;
+      if(n == 0 || n < minBytes) return 0;
+      if(n > CAP_PAGE) n = CAP_PAGE;
+    }
+  if(capAddr + CAP_PAGE > CAP_END) return -1;
+
+  memset(capPage, 0xFF, CAP_PAGE);
+  if(!capHeaderDone)
+    {
+      CapHeader h;
+      h.magic     = CAP_MAGIC;
+      h.unixStart = capUnixStart;
+      h.epoch     = capTailEpoch;
+      h.trigLow   = (uint32_t)capTrigUs;
+      h.trigHigh  = capTrigUs >> 32;
+      h.trigId    = capTrigId;
+      h.preBytes  = capPre;
+      memcpy(capPage, &h, sizeof(h));
+    }
+  else for(uint16_t i = 0; i < n; i++) capPage[i] = cap_at(capTail + i);
+
+  bool busy = false, ok = false;
+  ATOMIC()
+    {
+      if(!qspi_take(QSPI_CAPTURE)) busy = true;                                             // A task is in the middle of a command
+      else if(flash.readStatus() & ERASE_WIP) busy = true;                                  // Last page still programming, try next tick
+      else ok = flash.writeBuffer(capAddr, capPage, CAP_PAGE) == CAP_PAGE;
+    }
+  if(busy) { capStats.pageWaits++; return 0; }
+  if(!ok) return -1;
+
+  capAddr += CAP_PAGE;
+  if(!capHeaderDone) { capHeaderDone = true; return 1; }
+  capTail += n;
+  capStats.spilled += n;
+  return 1;
+}
+
+//----------------------------------------------------------------------------------------
+// cap_poll: Called every 1 ms from TCC2_0_Handler, after erase_poll()
+//----------------------------------------------------------------------------------------
+void cap_poll(void)
+{
+  if(capState == CAP_OFF) return;
+  cap_us();                                                                                 // Keep the wrap count right on a quiet bus
+
+  if(capState == CAP_ERASING && !eraseJob.active)
+    {
+      if(eraseJob.erased < CAP_END) { capState = CAP_FULL; return; }                        // Erase failed, nowhere to write
+      capState = (capTrigId == CAP_NO_TRIGGER) ? CAP_RUNNING : CAP_ARMED;
+    }
+  if(capState == CAP_RUNNING && cap_step(CAP_PAGE) < 0) capState = CAP_FULL;
+}
+
+//----------------------------------------------------------------------------------------
+// cap_start / cap_stop: From Monitor()
+//----------------------------------------------------------------------------------------
+void cap_start(void)
+{
+  if(flash.size() < CAP_END) { if(IDE) Serial.println(F("CAPTURE: QSPI TOO SMALL")); return; }
+  if(!qspi_take(QSPI_CAPTURE)) { if(IDE) Serial.println(F("CAPTURE: QSPI BUSY, FIRMWARE UPDATE")); return; }  // Held to cap_stop()
+
+  memset(&capStats, 0, sizeof(capStats));
+  capHead = capTail = 0;
+  capEpoch = capTailEpoch = 0;
+  capCycHigh  = 0;
+  capCycLast  = DWT->CYCCNT;
+  capCycStart = capCycLast;
+  capCycPerUs = SystemCoreClock / 1000000;
+  capTrigUs   = 0;
+  capUnixStart = rtc.now().unixtime();
+  capAddr = CAP_START;
+  capHeaderDone = false;
+  erase_start(CAP_START, CAP_END, QSPI_CAPTURE);
+  capState = CAP_ERASING;
+  if(IDE) Serial.println(F("CAPTURE       ERASING 2 MB, THEN RUNNING (M 2 FOR STATUS)"));
+}
+
+void cap_stop(void)
+{
+  const uint8_t was = capState;
+  capState = CAP_OFF;                                                                       // No more records, cap_poll() idle
+  if(was == CAP_ERASING) erase_abort();
+  if(was == CAP_RUNNING)
+    {
+      const uint32_t start = millis();
+      while((capHead != capTail || !capHeaderDone) && millis() - start < 1000)              // Rest of the ring, last page padded with 0xFF
+        if(cap_step(1) < 0) break;
+    }
+  qspi_give(QSPI_CAPTURE);
+  cap_command(2, 0, 0, 0);
+}
+
+//----------------------------------------------------------------------------------------
+// capExportTask: M 3, the capture in QSPI as candump log lines
+//----------------------------------------------------------------------------------------
+uint8_t capExportTask(Task* t)
+{
+  CapExport* x = &capExport;
+  for(uint8_t n = 0; n < CAP_EXPORT_BURST; n++)
+    {
+      CapRecord r;
+      uint8_t   data[64];
+      if(x->addr + sizeof(r) > CAP_END || !flash.readBuffer(x->addr, (uint8_t*)&r, sizeof(r)) || r.id == 0xFFFF || r.len > 64)
+        {
+          Serial.print(F("# END "));  Serial.print(x->lines); Serial.println(F(" FRAMES"));
+          return TASK_DONE;
+        }
+      flash.readBuffer(x->addr + sizeof(r), data, r.len);
+      x->addr += CAP_REC(r.len);
+      if(r.flags & CAP_EPOCH) { memcpy(&x->epoch, data, 4); continue; }
+
+      const uint64_t us = (uint64_t)x->epoch << 32 | r.us;
+      static const char hex[] = "0123456789ABCDEF";
+      char line[40 + 2 * 64];
+      uint8_t p = sprintf(line, "(%lu.%06lu) can0 %03X", (unsigned long)(x->unixStart + us / 1000000), (unsigned long)(us % 1000000), r.id);
+      if(r.flags & CAP_FD) p += sprintf(line + p, "##%c", (r.flags & CAP_BRS) ? '1' : '0');
+      else line[p++] = '#';
+      for(uint8_t i = 0; i < r.len; i++) { line[p++] = hex[data[i] >> 4]; line[p++] = hex[data[i] & 0x0F]; }
+      line[p] = 0;
+      Serial.println(line);
+      x->lines++;
+    }
+  return TASK_WAITING;
+}
+
+//----------------------------------------------------------------------------------------
+// cap_command: Serial command M with a mode
+//   M 2         status          M 4 H L P  trigger on id H * 256 + L, P KB before it
+//   M 3         export          M 4        no trigger, M 5 trigger now
+//----------------------------------------------------------------------------------------
+void cap_command(uint8_t mode, uint8_t a, uint8_t b, uint8_t c)
+{
+  static const char* const states[] = { "OFF", "ERASING", "ARMED", "RUNNING", "FULL" };
+  if(!IDE) return;
+
+  switch(mode)
+    {
+      case 2:
+        Serial.print(F("CAPTURE       "));   Serial.print(states[capState]);
+        if(capTrigId != CAP_NO_TRIGGER) { Serial.print(F("  TRIGGER ID 0x")); Serial.print(capTrigId, HEX); }
+        Serial.println();
+        Serial.print(F("FRAMES: "));         Serial.print(capStats.frames);
+        Serial.print(F("  DROPS: "));        Serial.print(capStats.drops);
+        Serial.print(F("  BEFORE WINDOW: ")); Serial.print(capStats.preDropped);
+        Serial.print(F("  AFTER FULL: "));   Serial.println(capStats.late);
+        Serial.print(F("RING PEAK: "));      Serial.print(capStats.peak); Serial.print('/'); Serial.print(CAP_RAM);
+        Serial.print(F("  QSPI: "));         Serial.print(capStats.spilled / 1024); Serial.print(F(" KB"));
+        Serial.print(F("  BUSY TICKS: "));   Serial.println(capStats.pageWaits);
+        break;
+
+      case 3:
+        {
+          CapHeader h;
+          if(capState != CAP_OFF || task_running(capExportTask))
+            { Serial.println(F("CAPTURE RUNNING, STOP IT FIRST (M)")); break; }
+          if(!flash.readBuffer(CAP_START, (uint8_t*)&h, sizeof(h)) || h.magic != CAP_MAGIC)
+            { Serial.println(F("NO CAPTURE IN QSPI")); break; }
+          capExport.addr      = CAP_START + CAP_PAGE;
+          capExport.epoch     = h.epoch;
+          capExport.unixStart = h.unixStart;
+          capExport.lines     = 0;
+          Serial.print(F("# QIF CAPTURE, START ")); Serial.print(h.unixStart);
+          if(h.trigId != CAP_NO_TRIGGER)
+            {
+              Serial.print(F(", TRIGGER 0x")); Serial.print(h.trigId, HEX);
+              Serial.print(F(" AT +"));         Serial.print((uint32_t)(((uint64_t)h.trigHigh << 32 | h.trigLow) / 1000)); Serial.print(F(" ms"));
+            }
+          Serial.println();
+          task_start(capExportTask, &capExport, "EXPORT");
+          break;
+        }
+
+      case 4:
+        capTrigId = (a || b) ? ((uint16_t)a << 8 | b) & 0x7FF : CAP_NO_TRIGGER;
+        capPre    = (c ? c : CAP_PRE_KB) * 1024UL;
+        if(capPre > CAP_RAM / 2) capPre = CAP_RAM / 2;
+        Serial.print(F("TRIGGER       "));
+        if(capTrigId == CAP_NO_TRIGGER) Serial.println(F("NONE, CAPTURE FROM THE START"));
+        else { Serial.print(F("ID 0x")); Serial.print(capTrigId, HEX); Serial.print(F(", KEEP ")); Serial.print(capPre / 1024); Serial.println(F(" KB BEFORE")); }
+        break;
+
+      case 5:
+        {
+          const uint64_t us = cap_us();
+          ATOMIC() if(capState == CAP_ARMED) { capTrigUs = us; capState = CAP_RUNNING; }
+          Serial.println(capState == CAP_RUNNING ? F("TRIGGERED") : F("NOT ARMED"));
+          break;
+        }
+    }
+}
@@ -0,0 +1,137 @@
+
+// ~/Arduino/QIF/switch/click.ino
+
+
+#include "qif.h"
+
+// Switches and their click frames, polled in the 10 ms slot of the tick (board.h)
+
+//----------------------------------------------------------------------------------------
+// Switch_Handler: Polls each switch, debounces, and detects click types (short, long, double, etc.)
+// Designed for N switches connected to GPIO pins defined in switchPins[]
+// Uses state machine per switch to detect:
+//   - Short clicks
+//   - Long presses
+//   - Very long presses
+//   - Single & double short clicks
+//----------------------------------------------------------------------------------------
+
+void Switch_Handler() {
+  PROF_SCOPE(PROF_SWITCH);
+  for (int n = 0; n < N; n++) {                       // Iterate over all N switches
+    int val = digitalRead(switchPins[n]);             // Read the current level on this switch pin    
+    switchState[n].state = (val == LOW) ? 1 : 0;      // Update switch state: 1 = pressed (LOW), 0 = released (HIGH)
+
+    if (switchState[n].state == 1) {                  // If switch is currently pressed
+      switchState[n].tim++;                           // Increment press duration counter
+      switchState[n].wait = 0;                        // Reset wait counter since button is held down
+    } else {                                          // If switch is released
+      switchState[n].wait++;                          // Increment wait counter (time since release)
+
+      if (switchState[n].wait > WAIT_RESET) {         // If released long enough, reset all state tracking
+        switchState[n].cnt = 0;
+        switchState[n].longCnt = 0;
+        switchState[n].shortDetected = 0;
+        switchState[n].shortDelay = 0;
+      }
+
+
+      if (switchState[n].tim > VERY_LONG) {           // Check if it was a very long press
+        Send_Click(n, CLICK_VL);                      // Trigger very long click event
+        switchState[n].tim = 0;                       // Reset all tracking for this switch
+        switchState[n].cnt = 0;
+        switchState[n].longCnt = 0;
+        switchState[n].shortDetected = 0;
+        switchState[n].shortDelay = 0;
+      }
+      // Check if it was a long press (not very long)
+      else if (switchState[n].tim > SHORT) {
+        switchState[n].longCnt++;                    // Count long press events
+
+        if (switchState[n].longCnt == 1 && switchState[n].cnt == 0) {
+          Send_Click(n, CLICK_L);                    // Send long press event
+        } else if (switchState[n].cnt == 1) {
+          Send_Click(n, CLICK_SL);                   // If we had a short click before, interpret as short + long
+        }
+
+        // Reset short click tracking after long press
+        switchState[n].cnt = 0;
+        switchState[n].shortDetected = 0;
+        switchState[n].shortDelay = 0;
+        switchState[n].tim = 0;
+        switchState[n].wait = 0;
+      }
+      // Handle quick short clicks
+      else if (switchState[n].tim <= SHORT && switchState[n].tim > 0) {
+        if (switchState[n].wait == 2) {              // Small debounce: check two ticks after release
+          switchState[n].shortDetected = 1;          // Mark that a short click is pending
+          switchState[n].shortDelay = 0;
+          switchState[n].cnt++;                      // Increment count of short clicks
+          switchState[n].tim = 0;
+          switchState[n].longCnt = 0;
+        }
+      }
+
+      // Handle timing window for short & double short clicks
+      if (switchState[n].shortDetected) {
+        switchState[n].shortDelay++;                 // Increment short click delay timer
+
+        if (switchState[n].shortDelay >= SHORT_DELAY_LIMIT * 2) {
+          if (switchState[n].cnt == 1) {
+            Send_Click(n, CLICK_S);                  // Single short click
+          } else if (switchState[n].cnt == 2) {
+            Send_Click(n, CLICK_SS);                 // Double short click
+          }
+          // Reset after handling
+          switchState[n].shortDetected = 0;
+          switchState[n].shortDelay = 0;
+          switchState[n].cnt = 0;
+        }
+      }
+    }
+  }
+}
+
+void Send_Click(uint8_t n, ClickValue value)
+{
+  uint8_t param = 0;
+
+  switch (value) {
+    case CLICK_S:  param = CLICK_S;  break;
+    case CLICK_SS: param = CLICK_SS; break;
+    case CLICK_L:  param = CLICK_L;  break;
+    case CLICK_SL: param = CLICK_SL; break;
+    case CLICK_VL: param = CLICK_VL; break;
+    default: return;
+  }
+
+  // Retrieve CAN base address from DB[].lnk[n]
+  uint16_t can_base = 0xFFFF;
+  for (uint8_t i = 0; i < DB_count; i++) {
+    if (DB[i].LBL == LABEL && n < 16) {
+      can_base = DB[i].lnk[n];
+      break;
+    }
+  }
+
+  if (can_base == 0xFFFF) {
+    if (IDE) {
+      Serial.print(F("Invalid .lnk target for port "));
+      Serial.println(n);
+    }
+    return;
+  }
+
+  // Construct the CAN FD message
+  CANFDMessage frame;
+  frame.id  = can_base;
+  frame.ext = false;
+  frame.len = 1;
+  frame.type = CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH;     // Enable CAN FD with bit rate switch
+  frame.idx = 0;                                             // Use default TX FIFO index
+  frame.data[0] = param;
+
+  // Queue with high priority, never waits for the bus
+  schedStats.clickStart  = micros();                          // Click latency (task.h)
+  schedStats.clickHandle = canSend(frame.data, frame.len, can_base, TXQ_HIGH, clickSent);  // Operator action, goes first
+}
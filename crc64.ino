@@ -0,0 +1,59 @@
+
+// ~/Arduino/QIF/switch/crc64.ino
+
+
+#include "qif.h"
+
+// CRC64_ECMA-182 computation, streaming (crc64.h)
+// Optimized for slice-by-8 algorithm (processes 8 bytes per iteration)
+// Kept out of routine.ino: the host benchmark builds this file as it is (bench.h)
+
+// Initialize streaming CRC
+void crc64_stream_init(crc64_stream* ctx, uint64_t initial_crc)
+  {
+    ctx->crc = ~initial_crc;
+    ctx->buffer_count = 0;
+  }
+
+// Process a chunk of data (can be called multiple times)
+void crc64_stream_update(crc64_stream* ctx, const uint8_t* data, size_t length)
+  {
+// Process any bytes left in buffer + new data to make 8-byte chunks
+    while(length > 0)
+      {
+        size_t copy_len = 8 - ctx->buffer_count;
+        if(copy_len > length) copy_len = length;       
+        memcpy(ctx->buffer + ctx->buffer_count, data, copy_len);
+        ctx->buffer_count += copy_len;
+        data += copy_len;
+        length -= copy_len;
+        
+// Process full 8-byte chunks immediately
+        if(ctx->buffer_count == 8)
+          {
+            uint64_t word;
+            memcpy(&word, ctx->buffer, 8);
+            ctx->crc ^= word;
+            ctx->crc = crc64_table[(ctx->crc >>  0) & 0xFF] ^
+                      crc64_table[(ctx->crc >>  8) & 0xFF] ^
+                      crc64_table[(ctx->crc >> 16) & 0xFF] ^
+                      crc64_table[(ctx->crc >> 24) & 0xFF] ^
+                      crc64_table[(ctx->crc >> 32) & 0xFF] ^
+                      crc64_table[(ctx->crc >> 40) & 0xFF] ^
+                      crc64_table[(ctx->crc >> 48) & 0xFF] ^
+                      crc64_table[(ctx->crc >> 56) & 0xFF];
+            ctx->buffer_count = 0;
+          }
+      }
+  }
+
+// Finalize CRC (process remaining bytes and return result)
+uint64_t crc64_stream_finalize(crc64_stream* ctx)
+  {
+// Process remaining bytes
+    for(size_t i = 0; i < ctx->buffer_count; i++)
+      {
+        ctx->crc = (ctx->crc >> 8) ^ crc64_table[(ctx->crc ^ ctx->buffer[i]) & 0xFF];
+      }
+    return ~ctx->crc;
+  }
@@ -0,0 +1,62 @@
+
+// ~/Arduino/QIF/crcmap.h Located in parent directory and linked in subdirectory
+
+/*
+Flash verification with the DMAC CRC engine
+
+CRC-32 (IEEE 802.3, same result as zlib crc32) of memory regions computed by the
+SAME51 DMAC: a software-triggered DMA channel reads the region one 32-bit word per
+beat into a dummy word, the CRC module (CRCSRC = that channel) hashes the data on
+the way. The CPU only starts the block and looks at the completion flag.
+
+Works on anything the DMAC can read: internal flash (0x00000000), RAM and the
+memory-mapped QSPI window (MQSPI_BASE_ADDR, 0x04000000).
+
+Block map: one CRC per CRC_BLOCK bytes of a region. Two maps are compared
+instead of two byte streams, a mismatch gives the 4 KB block at once:
+
+  crc_map(FLASH_BASE_ADDR, size, flashMap);                       // Internal flash
+  crc_map(MQSPI_BASE_ADDR, size, qspiMap);                        // Its copy in QSPI
+
+crc_init() checks the DMAC result against the software CRC on a test pattern
+(the engine output convention is learned, not assumed). If the DMAC is missing
+(host build) or disagrees, every call uses the table-driven software CRC, with
+QSPI read through flash.readBuffer() rather than the memory-mapped window.
+*/
+
+#ifndef   CRCMAP_H
+#define   CRCMAP_H
+
+#define CRC_BLOCK         4096                                                                      // Map granularity, QSPI_BLOCK_SIZE
+#define CRC_MAP_MAX       128                                                                       // Blocks per map: 512 KB, all of the internal flash
+#define CRC_DMA_CH        31                                                                        // Last DMAC channel, left alone by the libraries
+#define CRC_DMA_MAX_BEATS 65535                                                                     // BTCNT is 16 bits: 256 KB per DMA block
+
+enum CRC_ENGINE : uint8_t { CRC_SOFT = 0, CRC_DMAC };
+enum CRC_FIX : uint8_t { CRC_FIX_NOT = 0, CRC_FIX_NONE, CRC_FIX_RBIT_NOT, CRC_FIX_RBIT };       // DMAC checksum to zlib CRC-32
+
+typedef struct {
+  uint8_t  engine;                                                                                  // CRC_SOFT or CRC_DMAC
+  uint8_t  fix;                                                                                     // Output convention found by crc_init()
+  bool     ownDescriptors;                                                                          // DMAC enabled by us, not by a library
+  uint32_t blocks;                                                                                  // Blocks hashed
+  uint32_t bytes;
+} CrcState;
+
+uint32_t crc32Table[256];
+CrcState crcState;
+uint32_t crcMapA[CRC_MAP_MAX];                                                                      // Maps compared by verifyQSPI() and crc_bench()
+uint32_t crcMapB[CRC_MAP_MAX];
+uint32_t crcSink;                                                                                   // DMA destination, never read
+#if defined(__SAMD51__)
+__attribute__((aligned(16))) DmacDescriptor crcDescriptor[CRC_DMA_CH + 1];                          // Used only if nobody set DMAC->BASEADDR
+__attribute__((aligned(16))) DmacDescriptor crcWriteBack[CRC_DMA_CH + 1];
+#endif
+
+void     crc_init(void);
+uint32_t crc32_soft(uint32_t crc, const uint8_t* data, uint32_t len);
+uint32_t crc_region(uint32_t addr, uint32_t len);
+uint16_t crc_map(uint32_t addr, uint32_t len, uint32_t* map);
+void     crc_bench(void);
+
+#endif
@@ -0,0 +1,254 @@
+
+// ~/Arduino/QIF/switch/crcmap.ino
+
+
+#include "qif.h"
+
+//========================================================================================
+// CRC-32 over memory regions (see crcmap.h)
+//========================================================================================
+
+static bool    crcDmaBusy   = false;                                                        // One DMAC CRC at a time, others use software
+static uint8_t crcQspiDirect = 0;                                                           // QSPI window through the DMAC: 0 untested, 1 yes, 2 no
+
+//----------------------------------------------------------------------------------------
+// crc32_soft: zlib-compatible CRC-32, crc = 0 to start, or the result of a previous call
+//----------------------------------------------------------------------------------------
+uint32_t crc32_soft(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+  crc = ~crc;
+  while(len--) crc = crc32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+#if !defined(__SAMD51__)
+static uint32_t __RBIT(uint32_t v)
+{
+  uint32_t r = 0;
+  for(uint8_t i = 0; i < 32; i++, v >>= 1) r = (r << 1) | (v & 1);
+  return r;
+}
+#endif
+
+static uint32_t crc_fix(uint32_t raw, uint8_t fix)
+{
+  switch(fix)
+    {
+      case CRC_FIX_NOT:      return ~raw;
+      case CRC_FIX_RBIT_NOT: return ~__RBIT(raw);
+      case CRC_FIX_RBIT:     return __RBIT(raw);
+      default:               return raw;
+    }
+}
+
+#if defined(__SAMD51__)
+//----------------------------------------------------------------------------------------
+// crc_dma_raw: DMAC checksum of an aligned region, len multiple of 4.
+// Waits for each DMA block; from main context the other tasks run meanwhile.
+//----------------------------------------------------------------------------------------
+static uint32_t crc_dma_raw(uint32_t addr, uint32_t len)
+{
+  DmacDescriptor* d = (DmacDescriptor*)DMAC->BASEADDR.reg + CRC_DMA_CH;
+  DmacChannel*   ch = &DMAC->Channel[CRC_DMA_CH];
+
+  DMAC->CRCCTRL.reg   = 0;
+  DMAC->CRCCHKSUM.reg = 0xFFFFFFFF;
+  DMAC->CRCCTRL.reg   = DMAC_CRCCTRL_CRCBEATSIZE_WORD | DMAC_CRCCTRL_CRCPOLY_CRC32 |
+                        DMAC_CRCCTRL_CRCSRC(0x20 + CRC_DMA_CH);                             // Hash what goes through our channel
+
+  while(len)
+    {
+      const uint32_t beats = (len / 4 > CRC_DMA_MAX_BEATS) ? CRC_DMA_MAX_BEATS : len / 4;
+      d->BTCTRL.reg   = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_WORD | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_BLOCKACT_NOACT;
+      d->BTCNT.reg    = beats;
+      d->SRCADDR.reg  = addr + beats * 4;                                                   // End address when the source increments
+      d->DSTADDR.reg  = (uint32_t)&crcSink;                                                 // Fixed destination
+      d->DESCADDR.reg = 0;
+
+      ch->CHCTRLA.reg = 0;
+      while(ch->CHCTRLA.bit.ENABLE);
+      ch->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+      while(ch->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+      ch->CHCTRLA.reg   = DMAC_CHCTRLA_TRIGSRC(0) | DMAC_CHCTRLA_TRIGACT_TRANSACTION | DMAC_CHCTRLA_BURSTLEN_16BEAT;
+      ch->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR;
+      ch->CHCTRLA.reg  |= DMAC_CHCTRLA_ENABLE;
+      DMAC->SWTRIGCTRL.reg = 1UL << CRC_DMA_CH;                                             // Software trigger, whole block
+
+      while(!(ch->CHINTFLAG.reg & (DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR))) sched_yield();
+
+      addr += beats * 4;
+      len  -= beats * 4;
+    }
+
+  const uint32_t raw = DMAC->CRCCHKSUM.reg;
+  DMAC->CRCCTRL.reg   = 0;                                                                  // Release the CRC module
+  DMAC->CRCSTATUS.reg = DMAC_CRCSTATUS_CRCBUSY;
+  return raw;
+}
+#else
+static uint32_t crc_dma_raw(uint32_t addr, uint32_t len) { return 0; }                      // Host build: crc_init() keeps CRC_SOFT
+#endif
+
+//----------------------------------------------------------------------------------------
+// crc_init: Build the table, bring up the DMAC and check its result. Call once at boot (bootTask).
+//----------------------------------------------------------------------------------------
+void crc_init(void)
+{
+  for(uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for(uint8_t k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;        // Reflected 0x04C11DB7
+      crc32Table[i] = c;
+    }
+  memset(&crcState, 0, sizeof(crcState));
+  crcState.engine = CRC_SOFT;
+
+#if defined(__SAMD51__)
+  MCLK->AHBMASK.reg |= MCLK_AHBMASK_DMAC;
+  if(!DMAC->CTRL.bit.DMAENABLE)                                                             // Nobody uses the DMAC yet: our descriptors
+    {
+      DMAC->BASEADDR.reg = (uint32_t)crcDescriptor;
+      DMAC->WRBADDR.reg  = (uint32_t)crcWriteBack;
+      DMAC->CTRL.reg     = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+      crcState.ownDescriptors = true;
+    }
+
+  uint32_t pattern[16];                                                                     // 64 bytes, word aligned
+  for(uint8_t i = 0; i < 16; i++) pattern[i] = 0x9E3779B9UL * (i + 1);
+  const uint32_t expected = crc32_soft(0, (const uint8_t*)pattern, sizeof(pattern));
+  const uint32_t raw      = crc_dma_raw((uint32_t)pattern, sizeof(pattern));
+  for(uint8_t f = CRC_FIX_NOT; f <= CRC_FIX_RBIT; f++)
+    if(crc_fix(raw, f) == expected) { crcState.engine = CRC_DMAC; crcState.fix = f; break; }
+#endif
+
+  if(IDE)
+    {
+      Serial.print(F("CRC ENGINE:   "));
+      Serial.println(crcState.engine == CRC_DMAC ? F("DMAC") : F("SOFTWARE"));
+    }
+}
+
+static bool crc_in_qspi(uint32_t addr)
+{
+  return addr >= MQSPI_BASE_ADDR && addr < MQSPI_BASE_ADDR + 0x01000000UL;
+}
+
+static uint32_t crc_qspi_soft(uint32_t offset, uint32_t len)                                // QSPI through the driver
+{
+  uint8_t  buf[QSPI_PAGE_SIZE];
+  uint32_t crc = 0;
+  while(len)
+    {
+      const uint32_t n = len < sizeof(buf) ? len : sizeof(buf);
+      if(flash.readBuffer(offset, buf, n) != n) return 0;
+      crc = crc32_soft(crc, buf, n);
+      offset += n;
+      len    -= n;
+    }
+  return crc;
+}
+
+//----------------------------------------------------------------------------------------
+// crc_region: CRC-32 of [addr, addr + len). addr in internal flash, RAM or the QSPI
+// window (MQSPI_BASE_ADDR + offset).
+//----------------------------------------------------------------------------------------
+uint32_t crc_region(uint32_t addr, uint32_t len)
+{
+  const bool qspi = crc_in_qspi(addr);
+  crcState.blocks++;
+  crcState.bytes += len;
+
+  if(qspi)
+    {
+      uint8_t prime[4];
+      flash.readBuffer(addr - MQSPI_BASE_ADDR, prime, sizeof(prime));                       // Waits for a write / erase, sets the read mode of the window
+    }
+
+  bool dma = crcState.engine == CRC_DMAC && !crcDmaBusy && (addr & 3) == 0 && len >= 4 && !(qspi && crcQspiDirect == 2);
+  if(!dma) return qspi ? crc_qspi_soft(addr - MQSPI_BASE_ADDR, len) : crc32_soft(0, (const uint8_t*)addr, len);
+
+  crcDmaBusy = true;
+  const uint32_t words = len & ~3UL;
+  uint32_t crc = crc_fix(crc_dma_raw(addr, words), crcState.fix);
+  crcDmaBusy = false;
+
+  if(len > words)                                                                           // Tail bytes in software, same CRC continued
+    {
+      if(qspi)
+        {
+          uint8_t tail[4];
+          flash.readBuffer(addr - MQSPI_BASE_ADDR + words, tail, len - words);
+          crc = crc32_soft(crc, tail, len - words);
+        }
+      else crc = crc32_soft(crc, (const uint8_t*)(addr + words), len - words);
+    }
+
+  if(qspi && crcQspiDirect == 0)                                                            // First time through the window: check it once
+    {
+      crcQspiDirect = (crc == crc_qspi_soft(addr - MQSPI_BASE_ADDR, len)) ? 1 : 2;
+      if(crcQspiDirect == 2)
+        {
+          if(IDE) Serial.println(F("CRC: QSPI WINDOW NOT READABLE BY DMAC, SOFTWARE USED"));
+          return crc_qspi_soft(addr - MQSPI_BASE_ADDR, len);
+        }
+    }
+  return crc;
+}
+
+//----------------------------------------------------------------------------------------
+// crc_map: One CRC per CRC_BLOCK of [addr, addr + len), at most CRC_MAP_MAX.
+// Returns the number of blocks.
+//----------------------------------------------------------------------------------------
+uint16_t crc_map(uint32_t addr, uint32_t len, uint32_t* map)
+{
+  uint16_t n = 0;
+  for(uint32_t off = 0; off < len && n < CRC_MAP_MAX; off += CRC_BLOCK, n++)
+    map[n] = crc_region(addr + off, (len - off < CRC_BLOCK) ? len - off : CRC_BLOCK);
+  return n;
+}
+
+//----------------------------------------------------------------------------------------
+// crc_bench: Serial command V. Internal flash against its QSPI copy, three ways.
+//----------------------------------------------------------------------------------------
+void crc_bench(void)
+{
+  if(!IDE) return;
+  const uint32_t size  = 0x00080000 - FLASH_BASE_ADDR;
+  const uint32_t perUs = SystemCoreClock / 1000000;
+  uint8_t  flash_buf[256];
+  uint8_t  qspi_buf[256];
+  uint32_t diff = 0;
+
+  uint32_t t0 = DWT->CYCCNT;                                                                // 1. verifyQSPI() before: memcpy + readBuffer + byte compare
+  for(uint32_t offset = 0; offset < size; offset += sizeof(flash_buf))
+    {
+      memcpy(flash_buf, (const uint8_t*)(FLASH_BASE_ADDR + offset), sizeof(flash_buf));
+      flash.readBuffer(QSPI_BASE_ADDR + offset, qspi_buf, sizeof(qspi_buf));
+      for(uint16_t i = 0; i < sizeof(flash_buf); i++) if(flash_buf[i] != qspi_buf[i]) diff++;
+    }
+  const uint32_t bytesUs = (DWT->CYCCNT - t0) / perUs;
+
+  const uint8_t engine = crcState.engine;
+  uint32_t mapUs[2] = { 0, 0 };
+  uint16_t bad[2]   = { 0, 0 };
+  for(uint8_t pass = 0; pass < 2; pass++)                                                   // 2. software maps, 3. DMAC maps
+    {
+      if(pass == 1 && engine != CRC_DMAC) break;
+      crcState.engine = pass ? CRC_DMAC : CRC_SOFT;
+      t0 = DWT->CYCCNT;
+      const uint16_t n = crc_map(FLASH_BASE_ADDR, size, crcMapA);
+      crc_map(MQSPI_BASE_ADDR + QSPI_BASE_ADDR, size, crcMapB);
+      mapUs[pass] = (DWT->CYCCNT - t0) / perUs;
+      for(uint16_t b = 0; b < n; b++) if(crcMapA[b] != crcMapB[b]) bad[pass]++;
+    }
+  crcState.engine = engine;
+
+  Serial.print(F("VERIFY "));            Serial.print(size / 1024); Serial.println(F(" KB FLASH AGAINST QSPI"));
+  Serial.print(F("BYTE COMPARE (us): ")); Serial.print(bytesUs);   Serial.print(F("  BYTES DIFFERENT: ")); Serial.println(diff);
+  Serial.print(F("SOFT CRC MAP (us): ")); Serial.print(mapUs[0]);  Serial.print(F("  BLOCKS DIFFERENT: ")); Serial.println(bad[0]);
+  if(engine == CRC_DMAC)
+    {
+      Serial.print(F("DMAC CRC MAP (us): ")); Serial.print(mapUs[1]); Serial.print(F("  BLOCKS DIFFERENT: ")); Serial.println(bad[1]);
+    }
+  else Serial.println(F("DMAC CRC MAP: NOT AVAILABLE"));
+}
@@ -105,6 +105,7 @@ const  uint8_t NB_PINS = 21;
 #define pwm7   0x07
 #define pwm8   0x08
 #define pwr    0x09                                                          // Power control
+#define ctl    0x0E                                                          // Control channel (batch frames)
 
 // Offset from the CAN base address 0x000, Time = 0, Reset = 1 and so on
 // Used for service processing message (base address + offset)
@@ -1129,4 +1130,31 @@ const IO DB[128] = {
 
 const uint8_t DB_count = sizeof(DB) / sizeof(DB[0]);
 
+/*
+  Purpose: Multicast groups. One frame sent to a group ID reaches every subscribed board.
+  Group IDs use the CAN blocks of labels 120-127 (0x780-0x7FF): these labels must stay UNDEF.
+  A board may be in several groups, a group may drive any set of its local channels (MASK).
+  CAN_Setup installs one filter per group of the local board, routed to Process_Group.
+  A group ID can be used as a .lnk target, the click then reaches the whole group.
+*/
+#define GRP_BASE   0x780                                                                                  // First group CAN ID
+#define GRP_COUNT  128                                                                                    // Group IDs 0x780-0x7FF
+#define GRP(n)     (GRP_BASE + (n))                                                                       // CAN ID of group n
+
+struct Group
+  {
+    uint8_t   LBL;                                                                                        // Subscribing board label
+    uint8_t   GRP;                                                                                        // Group number, 0-127
+    uint16_t  MASK;                                                                                       // Local channels driven by the group, bit n = channel n
+  };
+
+const Group GROUPS[] =
+  {
+    { .LBL = 1, .GRP = 0, .MASK = 0x00FF },                                                               // Group 0: cabin lights
+    { .LBL = 2, .GRP = 0, .MASK = 0x00FF },
+    { .LBL = 4, .GRP = 0, .MASK = 0x00FF },
+  };
+
+const uint8_t GROUPS_count = sizeof(GROUPS) / sizeof(GROUPS[0]);
+
 #endif
\ No newline at end of file
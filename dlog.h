@@ -0,0 +1,122 @@
+
+// ~/Arduino/QIF/dlog.h Located in parent directory and linked in subdirectory
+
+/*
+Deferred binary log
+
+Hot paths (CAN callbacks, the transmit path, the tick) no longer print. They store
+a format id, up to DLOG_ARGS raw 32-bit arguments and an optional byte payload
+(a frame) in dlogRing, and return:
+
+  DLOG(DLOG_LED, message.id, led, value);
+  DLOG_DATA(DLOG_TX_FRAME, data, len, id, len);
+
+A record is reserved with one compare-and-swap on dlogHead (LDREX/STREX, no
+interrupt masking), filled, then published by writing its header word last, so
+any context can log, an interrupt included, and the cost does not depend on
+whether the IDE is attached: about 30 cycles plus one word per argument.
+
+dlogTask drains the ring from the main loop, DLOG_DRAIN records per pass:
+  DLOG_TEXT  formats each record with its printf format, the line printed before
+  DLOG_HEX   prints "~" and the raw record in hex, tools/qiflog.py formats it on
+             the PC from the table below (read from this file), with time stamps
+Without IDE the drain drops the records, after they were stored as usual.
+
+Levels are compile-time: a DLOG() of a level above DLOG_LEVEL is no code at all.
+Full ring: the record is dropped and counted, the drain reports it.
+
+Record, 32-bit words: header  DLOG_VALID | len << 16 | argument count << 8 | id
+                      stamp   DWT->CYCCNT
+                      arguments, then the payload bytes, little-endian, padded
+*/
+
+#ifndef   DLOG_H
+#define   DLOG_H
+
+#define DLOG_ERROR        1                                                                         // Levels
+#define DLOG_WARN         2
+#define DLOG_INFO         3
+#define DLOG_DEBUG        4
+
+#ifndef   DLOG_LEVEL
+#define   DLOG_LEVEL      DLOG_DEBUG                                                                // Records above this level are compiled out
+#endif
+
+#define DLOG_TEXT         0                                                                         // Drain output
+#define DLOG_HEX          1
+#ifndef   DLOG_MODE
+#define   DLOG_MODE       DLOG_TEXT
+#endif
+
+#define DLOG_WORDS        1024                                                                      // Ring, 4 KB (power of 2)
+#define DLOG_ARGS         4
+#define DLOG_DATA_MAX     64
+#define DLOG_DRAIN        8                                                                         // Records per scheduler pass
+#define DLOG_VALID        0x80000000UL
+
+// Format table, one line per id: id, level, printf format (arguments as unsigned long, %ld signed)
+#define DLOG_FORMATS(X) \
+  X(DLOG_TX_FRAME,  DLOG_DEBUG, "SENDING CANFD FRAME - ID: 0x%lX LEN: %lu DATA:") \
+  X(DLOG_TX_FULL,   DLOG_WARN,  "CAN FD send failed → Transmit queue full") \
+  X(DLOG_FCT_SEND,  DLOG_DEBUG, "SEND CAN ID: 0x%lX FRAME:") \
+  X(DLOG_FCT_RECV,  DLOG_DEBUG, "RECEIVE CAN ID: 0x%lX FRAME:") \
+  X(DLOG_LED,       DLOG_INFO,  "LED FROM:     0x%lX -> LED %lu VALUE %lu") \
+  X(DLOG_PWM,       DLOG_INFO,  "PWM -> CHANNEL %lu VALUE %lu") \
+  X(DLOG_BATCH,     DLOG_INFO,  "BATCH FROM: %lu SEQ %lu COMMANDS %lu") \
+  X(DLOG_GRP_BATCH, DLOG_INFO,  "GROUP BATCH FROM: %lu SEQ %lu COMMANDS %lu") \
+  X(DLOG_BATCH_BAD, DLOG_WARN,  "BATCH REFUSED FROM: %lu") \
+  X(DLOG_GRP_CLICK, DLOG_INFO,  "GROUP CLICK: 0x%lX VALUE %lu") \
+  X(DLOG_TELEM,     DLOG_INFO,  "RX BME TELEMETRY FROM: %lu  SEQ: %lu  ACCURACY: %lu  CHANGE: %lu") \
+  X(DLOG_TELEM_AIR, DLOG_INFO,  "  x100: TEMPERATURE %ld C  PRESSURE %ld hPa  HUMIDITY %ld %%  GAS %ld %%") \
+  X(DLOG_TELEM_IAQ, DLOG_INFO,  "  x100: IAQ %ld  VOC %ld  CO2 %ld ppm")
+
+#define DLOG_X_ID(id, level, format)      id,
+#define DLOG_X_LEVEL(id, level, format)   level,
+#define DLOG_X_FORMAT(id, level, format)  format,
+
+enum DLOG_ID : uint8_t { DLOG_FORMATS(DLOG_X_ID) DLOG_IDS };
+static constexpr uint8_t dlogLevels[] = { DLOG_FORMATS(DLOG_X_LEVEL) };
+
+uint32_t          dlogRing[DLOG_WORDS];
+volatile uint32_t dlogHead = 0;                                                                     // Words reserved, free running
+volatile uint32_t dlogTail = 0;                                                                     // Words drained
+volatile uint32_t dlogDropped = 0;
+
+//----------------------------------------------------------------------------------------
+// dlog_write: Store one record. Any context.
+//----------------------------------------------------------------------------------------
+static inline void dlog_write(uint8_t id, const uint32_t* args, uint8_t n, const uint8_t* data, uint8_t len)
+{
+  if(len > DLOG_DATA_MAX) len = DLOG_DATA_MAX;
+  const uint32_t words = 2 + n + (len + 3) / 4;
+  uint32_t h = dlogHead;
+  do
+    {
+      if(h + words - dlogTail > DLOG_WORDS) { __atomic_fetch_add(&dlogDropped, 1, __ATOMIC_RELAXED); return; }
+    }
+  while(!__atomic_compare_exchange_n(&dlogHead, &h, h + words, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  dlogRing[(h + 1) & (DLOG_WORDS - 1)] = DWT->CYCCNT;
+  for(uint8_t i = 0; i < n; i++) dlogRing[(h + 2 + i) & (DLOG_WORDS - 1)] = args[i];
+  for(uint8_t i = 0; i < len; i += 4)
+    {
+      uint32_t w = 0;
+      for(uint8_t k = 0; k < 4 && i + k < len; k++) w |= (uint32_t)data[i + k] << (8 * k);
+      dlogRing[(h + 2 + n + i / 4) & (DLOG_WORDS - 1)] = w;
+    }
+  __atomic_store_n(&dlogRing[h & (DLOG_WORDS - 1)], DLOG_VALID | (uint32_t)len << 16 | (uint32_t)n << 8 | id, __ATOMIC_RELEASE);
+}
+
+template<typename... A> static inline void dlog_put(uint8_t id, const uint8_t* data, uint8_t len, A... a)
+{
+  static_assert(sizeof...(a) <= DLOG_ARGS, "too many log arguments");
+  const uint32_t args[sizeof...(a) + 1] = { (uint32_t)a..., 0 };
+  dlog_write(id, args, sizeof...(a), data, len);
+}
+
+#define DLOG(id, ...)                do { if(dlogLevels[id] <= DLOG_LEVEL) dlog_put(id, nullptr, 0, ##__VA_ARGS__); } while(0)
+#define DLOG_DATA(id, data, len, ...) do { if(dlogLevels[id] <= DLOG_LEVEL) dlog_put(id, data, len, ##__VA_ARGS__); } while(0)
+
+uint8_t dlogTask(Task* t);
+
+#endif
@@ -0,0 +1,75 @@
+
+// ~/Arduino/QIF/switch/dlog.ino
+
+
+#include "qif.h"
+
+static const char* const dlogFormats[DLOG_IDS] = { DLOG_FORMATS(DLOG_X_FORMAT) };
+
+//----------------------------------------------------------------------------------------
+// dlog_print: One record as text, the format then the payload in hex
+//----------------------------------------------------------------------------------------
+static void dlog_print(uint8_t id, const uint32_t* args, const uint8_t* data, uint8_t len)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  char line[96 + 3 * DLOG_DATA_MAX];
+  uint16_t p = 0;
+  if(id < DLOG_IDS)
+    p = snprintf(line, 96, dlogFormats[id], (unsigned long)args[0], (unsigned long)args[1], (unsigned long)args[2], (unsigned long)args[3]);
+  else p = snprintf(line, 96, "LOG ID %u ?", id);
+  if(p > 95) p = 95;                                                                        // Truncated by snprintf
+  for(uint8_t i = 0; i < len; i++) { line[p++] = ' '; line[p++] = hex[data[i] >> 4]; line[p++] = hex[data[i] & 0x0F]; }
+  line[p] = 0;
+  Serial.println(line);
+}
+
+//----------------------------------------------------------------------------------------
+// dlogTask: Permanent task, drains up to DLOG_DRAIN records per scheduler pass
+//----------------------------------------------------------------------------------------
+uint8_t dlogTask(Task* t)
+{
+  static uint32_t dropped = 0;
+  for(uint8_t r = 0; r < DLOG_DRAIN; r++)
+    {
+      const uint32_t tail   = dlogTail;
+      const uint32_t header = __atomic_load_n(&dlogRing[tail & (DLOG_WORDS - 1)], __ATOMIC_ACQUIRE);
+      if(tail == dlogHead || !(header & DLOG_VALID)) break;                                 // Empty, or reserved and still being written
+
+      const uint8_t  id    = header & 0xFF;
+      const uint8_t  n     = (header >> 8) & 0x0F;
+      const uint8_t  len   = (header >> 16) & 0x7F;
+      const uint32_t words = 2 + n + (len + 3) / 4;
+
+      uint32_t rec[2 + DLOG_ARGS + DLOG_DATA_MAX / 4];
+      for(uint32_t i = 0; i < words; i++)
+        {
+          rec[i] = dlogRing[(tail + i) & (DLOG_WORDS - 1)];
+          dlogRing[(tail + i) & (DLOG_WORDS - 1)] = 0;                                      // A header may land on any word later
+        }
+      dlogTail = tail + words;                                                              // Room for the writers
+
+      if(!IDE) continue;
+#if DLOG_MODE == DLOG_HEX
+      static const char hex[] = "0123456789ABCDEF";
+      char line[2 + 8 * (2 + DLOG_ARGS + DLOG_DATA_MAX / 4)];
+      uint16_t p = 0;
+      line[p++] = '~';
+      for(uint32_t i = 0; i < words; i++)
+        for(uint8_t k = 0; k < 4; k++) { const uint8_t b = rec[i] >> (8 * k); line[p++] = hex[b >> 4]; line[p++] = hex[b & 0x0F]; }
+      line[p] = 0;
+      Serial.println(line);
+#else
+      uint32_t args[DLOG_ARGS] = { 0 };
+      for(uint8_t i = 0; i < n && i < DLOG_ARGS; i++) args[i] = rec[2 + i];
+      dlog_print(id, args, (const uint8_t*)&rec[2 + n], len);                               // Little-endian: the bytes in order
+#endif
+    }
+
+  const uint32_t lost = dlogDropped;
+  if(lost != dropped && IDE)
+    {
+      Serial.print(F("LOG: ")); Serial.print(lost - dropped); Serial.println(F(" RECORDS DROPPED, RING FULL"));
+      dropped = lost;
+    }
+  return TASK_WAITING;
+}
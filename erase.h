@@ -0,0 +1,73 @@
+
+// ~/Arduino/QIF/erase.h Located in parent directory and linked in subdirectory
+
+/*
+QSPI erase-ahead engine
+
+At STX the receiver no longer erases the whole update area before taking the first
+frame. erase_start() records the range and returns; erase_poll(), called every
+1 ms from the TCC2 tick, issues one erase command when the flash is idle (WIP bit
+of the status register clear) and never waits for it. Adafruit_SPIFlash
+eraseBlock() / eraseSector() only wait for the flash to be ready *before* sending
+the command, so a command issued on an idle flash returns in microseconds.
+
+Erase unit: 64 KB blocks (eraseBlock) where the range allows, 4 KB sectors for the
+head and the tail. The first ERASE_HEAD bytes go by sectors anyway: the first page
+can then be written after one sector erase (~45 ms) instead of one block (150 ms
+and more).
+
+  0x00000 ... 0x0FFFF   16 x 4 KB     ERASE_HEAD
+  0x10000 ... 0x6FFFF    6 x 64 KB
+  0x70000 ... 0x78FFF    9 x 4 KB     up to BOOT2_START_ADDR
+
+eraseJob.erased is the progress: everything below it is erased. The writer calls
+erase_wait(end of page) before programming a page, it only spins (polling the
+status register) when it caught up with the eraser; waits are counted.
+
+The job belongs to an owner (qspi.h), the update or the capture: erase_poll()
+takes the QSPI for it before each command and skips the tick while a task holds
+it. The owner keeps it to the end (ETX, cap_stop()), main context stays away.
+*/
+
+#ifndef   ERASE_H
+#define   ERASE_H
+
+#define ERASE_BLOCK       0x10000UL                                                                 // 64 KB block erase (0xD8)
+#define ERASE_SECTOR      0x1000UL                                                                  // 4 KB sector erase (0x20)
+#define ERASE_HEAD        0x10000UL                                                                 // Erased by sectors to accept the first page early
+#define ERASE_WIP         0x01                                                                      // Status register: write / erase in progress
+#define ERASE_WAIT_MAX_MS 3000                                                                      // Worst case 64 KB block erase, then give up
+
+typedef struct {
+  volatile bool     active;
+  volatile bool     busy;                                                                           // Erase command running in the flash
+  uint32_t          start;
+  uint32_t          end;
+  uint32_t          next;                                                                           // Next address to erase
+  uint32_t          pending;                                                                        // End of the erase in progress
+  volatile uint32_t erased;                                                                         // Everything in [start, erased) is erased
+  uint32_t          startMs;
+  uint8_t           owner;                                                                          // QSPI owner of the job (qspi.h)
+} EraseJob;
+
+typedef struct {
+  uint32_t blocks;
+  uint32_t sectors;
+  uint32_t waits;                                                                                   // Writer caught up with the eraser
+  uint32_t waitMaxMs;
+  uint32_t firstMs;                                                                                 // erase_start() to first sector erased
+  uint32_t totalMs;                                                                                 // erase_start() to job done
+  uint32_t errors;
+  uint32_t deferred;                                                                                // Ticks skipped, a task held the QSPI
+} EraseStats;
+
+EraseJob   eraseJob;
+EraseStats eraseStats;
+
+void erase_start(uint32_t start, uint32_t end, uint8_t owner);
+void erase_poll(void);
+bool erase_wait(uint32_t upTo);
+void erase_abort(void);
+void erase_print(void);
+
+#endif
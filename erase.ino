@@ -0,0 +1,119 @@
+
+// ~/Arduino/QIF/switch/erase.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// erase_start: Erase [start, end) in the background for owner (qspi.h). Both 4 KB aligned.
+// Returns at once.
+//----------------------------------------------------------------------------------------
+void erase_start(uint32_t start, uint32_t end, uint8_t owner)
+{
+  ATOMIC()
+    {
+      eraseJob.start   = start;
+      eraseJob.end     = end;
+      eraseJob.next    = start;
+      eraseJob.erased  = start;
+      eraseJob.pending = start;
+      eraseJob.busy    = false;
+      eraseJob.startMs = millis();
+      eraseJob.owner   = owner;
+      eraseJob.active  = start < end;
+      memset(&eraseStats, 0, sizeof(eraseStats));
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// erase_poll: Advance the job without waiting. Called every 1 ms from TCC2_0_Handler.
+//----------------------------------------------------------------------------------------
+void erase_poll(void)
+{
+  if(!eraseJob.active) return;
+  if(!qspi_take(eraseJob.owner)) { eraseStats.deferred++; return; }                        // A task is in the middle of a command, next tick
+
+  if(eraseJob.busy)
+    {
+      if(flash.readStatus() & ERASE_WIP) return;                                            // Still erasing
+      eraseJob.busy   = false;
+      eraseJob.erased = eraseJob.pending;
+      if(eraseStats.firstMs == 0) eraseStats.firstMs = millis() - eraseJob.startMs;
+    }
+
+  if(eraseJob.next >= eraseJob.end)
+    {
+      eraseJob.active = false;
+      eraseStats.totalMs = millis() - eraseJob.startMs;
+      return;
+    }
+
+  const uint32_t addr = eraseJob.next;
+  bool ok;
+  if(addr >= eraseJob.start + ERASE_HEAD && (addr % ERASE_BLOCK) == 0 && addr + ERASE_BLOCK <= eraseJob.end)
+    {
+      ok = flash.eraseBlock(addr / ERASE_BLOCK);                                            // Block number
+      eraseJob.next = addr + ERASE_BLOCK;
+      eraseStats.blocks++;
+    }
+  else
+    {
+      ok = flash.eraseSector(addr / ERASE_SECTOR);                                          // Sector number, not address
+      eraseJob.next = addr + ERASE_SECTOR;
+      eraseStats.sectors++;
+    }
+
+  if(!ok) { eraseStats.errors++; eraseJob.active = false; return; }
+  eraseJob.pending = eraseJob.next;
+  eraseJob.busy    = true;
+}
+
+//----------------------------------------------------------------------------------------
+// erase_wait: Return when [start, upTo) is erased. Spins only if the writer caught up.
+// Returns false if the job stopped short (erase error, abort) or after ERASE_WAIT_MAX_MS.
+//----------------------------------------------------------------------------------------
+bool erase_wait(uint32_t upTo)
+{
+  if(eraseJob.erased >= upTo) return true;                                                  // Usual case, the eraser is ahead
+
+  eraseStats.waits++;
+  const uint32_t t0    = DWT->CYCCNT;                                                       // millis() stands still in the CAN dispatch interrupt
+  const uint32_t perMs = SystemCoreClock / 1000;
+  while(eraseJob.erased < upTo)
+    {
+      if(!eraseJob.active) return false;
+      if(qspiOwner != eraseJob.owner && qspiOwner != QSPI_FREE) return false;              // Held by a task, which cannot run while we spin here
+      if((DWT->CYCCNT - t0) / perMs > ERASE_WAIT_MAX_MS) { eraseStats.errors++; return false; }
+      ATOMIC() erase_poll();                                                                // The tick cannot run while we wait in it
+    }
+  const uint32_t waited = (DWT->CYCCNT - t0) / perMs;
+  if(waited > eraseStats.waitMaxMs) eraseStats.waitMaxMs = waited;
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// erase_abort: Stop issuing erase commands, the one in progress finishes in the flash
+//----------------------------------------------------------------------------------------
+void erase_abort(void)
+{
+  eraseJob.active = false;
+}
+
+//----------------------------------------------------------------------------------------
+// erase_print: Progress and counters of the last job (printed at ETX)
+//----------------------------------------------------------------------------------------
+void erase_print(void)
+{
+  if(!IDE) return;
+  Serial.print(F("ERASED UP TO 0x"));   Serial.print(eraseJob.erased, HEX);
+  Serial.print(F(" OF 0x"));            Serial.print(eraseJob.end, HEX);
+  Serial.println(eraseJob.active ? F(" (RUNNING)") : F(""));
+  Serial.print(F("BLOCKS: "));          Serial.print(eraseStats.blocks);
+  Serial.print(F("  SECTORS: "));       Serial.print(eraseStats.sectors);
+  Serial.print(F("  ERRORS: "));        Serial.print(eraseStats.errors);
+  Serial.print(F("  DEFERRED: "));      Serial.println(eraseStats.deferred);
+  Serial.print(F("FIRST SECTOR (ms): ")); Serial.print(eraseStats.firstMs);
+  Serial.print(F("  ALL (ms): "));      Serial.println(eraseStats.totalMs);
+  Serial.print(F("WRITER WAITS: "));    Serial.print(eraseStats.waits);
+  Serial.print(F("  LONGEST (ms): "));  Serial.println(eraseStats.waitMaxMs);
+}
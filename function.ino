@@ -44,7 +44,8 @@
 
 7. ───── CAN FD frame transmission ────────────────────────────
     - Calls:
-      * `sendCANFDFrame(data, 8, channel);`
+      * `sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);`
+      * Relay level is a state: a newer value replaces one still queued.
     - Sends the 8-byte frame over CAN FD to the calculated ID.
 
 8. ───── FCT08 to FCT15 placeholders ──────────────────────────
@@ -113,269 +114,147 @@ void DUMMY(const CANFDMessage &)
 
 void FCT00(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x00;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }
-  sendCANFDFrame(data, 8, channel);                                                       // Transmit 8 bytes to CAN                      
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);                               // Transmit 8 bytes to CAN                      
 }
 
 void FCT01(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x01;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("SEND CAN ID:  0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }
-  sendCANFDFrame(data, 8, channel);                                                         // Transmit 8 bytes to CAN   
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);                                 // Transmit 8 bytes to CAN   
 }
 
 void FCT02(const CANFDMessage & msg) {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x02;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
 
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX); Serial.print(' ');
-    }
-    Serial.println();
-  }
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
 
-  sendCANFDFrame(data, 8, channel);
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);
 }
 
 void FCT03(const CANFDMessage & msg) {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x03;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
 
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX); Serial.print(' ');
-    }
-    Serial.println();
-  }
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
 
-  sendCANFDFrame(data, 8, channel);
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);
 }
 
 void FCT04(const CANFDMessage & msg) {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x04;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
 
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX); Serial.print(' ');
-    }
-    Serial.println();
-  }
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
 
-  sendCANFDFrame(data, 8, channel);
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);
 }
 
 void FCT05(const CANFDMessage & msg) {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x05;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
 
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX); Serial.print(' ');
-    }
-    Serial.println();
-  }
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
 
-  sendCANFDFrame(data, 8, channel);
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);
 }
 
 void FCT06(const CANFDMessage & msg) {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x06;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
 
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX); Serial.print(' ');
-    }
-    Serial.println();
-  }
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
 
-  sendCANFDFrame(data, 8, channel);
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);
 }
 
 void FCT07(const CANFDMessage & msg) {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x07;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
 
-  if (IDE) {
-    Serial.print("SEND CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for (uint8_t i = 0; i < 8; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX); Serial.print(' ');
-    }
-    Serial.println();
-  }
+  DLOG_DATA(DLOG_FCT_SEND, data, 8, channel);                                           // Printed later by dlogTask
 
-  sendCANFDFrame(data, 8, channel);
+  sendCANFDFrame(data, 8, channel, TXQ_NORMAL | TXQ_STATE);
 }
 
 // Leds function receive CAN frame (RX) called by filter
 
 void FCT08(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x08;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 void FCT09(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x09;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 void FCT10(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x0a;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 void FCT11(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x0b;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 void FCT12(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x0c;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 void FCT13(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x0d;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 void FCT14(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x0e;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 
 void FCT15(const CANFDMessage & msg)
 {
+  PROF_SCOPE(PROF_FCT);
   uint16_t channel = CAN_BASE + 0x0f;
   uint8_t data[8] = {0}; data[7] = msg.data[7];
-  if (IDE) {
-    Serial.print("RECEIVE CAN ID: 0x"); Serial.print(channel, HEX);
-    Serial.print(" FRAME: ");
-    for(uint8_t i = 0; i < 8; i++) {
-      if(data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }            
+  DLOG_DATA(DLOG_FCT_RECV, data, 8, channel);                                           // Printed later by dlogTask
 }
 
 
@@ -0,0 +1,75 @@
+
+// ~/Arduino/QIF/gateway.h Located in parent directory and linked in subdirectory
+
+/*
+USB to CAN FD gateway
+
+Serial command "M 1" turns the board into a bridge between the bus and a PC
+(tools/qifgw.py). From then on the USB link carries the binary records of
+gwproto.h in both directions, no text:
+
+  - every frame on the bus goes to the PC as GW_RX, stamped with micros();
+  - GW_TX records from the PC go through canSend(), each one confirmed by a
+    GW_TXC record when the controller took it (or refused, expired...);
+  - GW_SYNC / GW_TIME pair the PC clock with micros() so the PC can put its own
+    time on received frames and measure TX latency.
+
+Like Monitor(), the filters are replaced by one 0x000-0x7FF range, but the frames
+are not lost to the board: gw_rx() also calls the callback the saved filters would
+have called, the board keeps working while it bridges. In gateway mode the 1 ms
+tick dispatches up to GW_RX_BURST frames instead of one.
+
+Records are queued in gwRing (CAN interrupt and TX callbacks) and written to USB by
+gwTask, as many per USB frame as fit. The mode ends with GW_EXIT or when the PC
+closes the port (DTR low); filters and IDE output are restored.
+*/
+
+#ifndef   GATEWAY_H
+#define   GATEWAY_H
+
+#define GW_RING           64                                                                        // Records waiting for USB (power of 2)
+#define GW_PENDING        32                                                                        // GW_TX frames waiting for their confirmation
+#define GW_ORPHANS        8                                                                         // Confirmations seen before their handle was stored
+#define GW_RX_BURST       16                                                                        // Frames dispatched per 1 ms tick in gateway mode
+#define GW_STAT_MS        1000
+
+typedef struct {
+  uint16_t handle;                                                                                  // canSend() handle, 0 = free
+  uint16_t seq;                                                                                     // Host sequence number
+} GwPending;
+
+typedef struct {
+  uint16_t handle;
+  uint8_t  status;
+  uint32_t stamp;
+} GwOrphan;
+
+typedef struct {
+  uint32_t rx;                                                                                      // Frames sent to the host
+  uint32_t rxLost;                                                                                  // Records dropped, gwRing full
+  uint32_t tx;                                                                                      // GW_TX accepted by canSend()
+  uint32_t txRefused;
+  uint32_t badFrames;                                                                               // USB frames with a CRC or format error
+} GwStats;
+
+volatile bool     gwOn = false;
+bool              gwIde;                                                                            // IDE before the gateway
+GwRecord          gwRing[GW_RING];
+volatile uint8_t  gwHead = 0;
+volatile uint8_t  gwTail = 0;
+GwPending         gwPending[GW_PENDING];
+GwOrphan          gwOrphan[GW_ORPHANS];
+uint8_t           gwOrphanCount = 0;
+GwStats           gwStats;
+uint8_t           gwIn[GW_COBS_MAX];                                                                // Bytes of the frame being received
+uint16_t          gwInLen = 0;
+uint8_t           gwInFrame[GW_FRAME_MAX];                                                          // Decoded input records
+uint8_t           gwFrame[GW_FRAME_MAX];                                                            // Output records
+uint8_t           gwOut[GW_COBS_MAX];
+volatile bool     gwExit = false;
+
+bool gw_start(void);
+void gw_input(uint8_t c);
+void gw_dispatch(void);
+
+#endif
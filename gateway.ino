@@ -0,0 +1,241 @@
+
+// ~/Arduino/QIF/switch/gateway.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// gw_push: Queue a record for the host. Interrupt or main context.
+//----------------------------------------------------------------------------------------
+static void gw_push(const GwRecord* r)
+{
+  ATOMIC()
+    {
+      if((uint8_t)(gwHead - gwTail) >= GW_RING) gwStats.rxLost++;
+      else
+        {
+          gwRing[gwHead % GW_RING] = *r;
+          gwHead++;
+          if(r->type == GW_RX) gwStats.rx++;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// gw_rx: Callback of the gateway filter, every frame on the bus (CAN interrupt).
+// Forwards it to the host, then to the callback of the filters saved by gw_start().
+//----------------------------------------------------------------------------------------
+void gw_rx(const CANFDMessage & message)
+{
+  GwRecord r = {};
+  r.type  = GW_RX;
+  if(message.type == CANFDMessage::CANFD_NO_BIT_RATE_SWITCH)   r.flags = GW_RX_FD;
+  if(message.type == CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH) r.flags = GW_RX_FD | GW_RX_BRS;
+  r.stamp = micros();
+  r.id    = message.id;
+  r.len   = message.len;
+  memcpy(r.data, message.data, message.len);
+  gw_push(&r);
+
+  const FilterCallback callback = filter_lookup(&savedFilterManager, message.id);
+  if(callback) callback(message);                                                           // The board still does its own job
+}
+
+//----------------------------------------------------------------------------------------
+// gw_dispatch: 1 ms tick in gateway mode, empty the receive FIFO faster than one per tick
+//----------------------------------------------------------------------------------------
+void gw_dispatch(void)
+{
+  for(uint8_t n = 0; n < GW_RX_BURST && can1.dispatchReceivedMessage(); n++);
+}
+
+//----------------------------------------------------------------------------------------
+// gw_tx_done: TxCallback of the frames sent for the host, becomes a GW_TXC record
+//----------------------------------------------------------------------------------------
+void gw_tx_done(uint16_t handle, uint16_t id, uint8_t status)
+{
+  if(!gwOn) return;
+  GwRecord r = {};
+  r.type   = GW_TXC;
+  r.status = status;
+  r.stamp  = micros();
+  bool found = false;
+  ATOMIC()
+    {
+      for(uint8_t i = 0; i < GW_PENDING && !found; i++)
+        if(gwPending[i].handle == handle)
+          {
+            r.seq = gwPending[i].seq;
+            gwPending[i].handle = 0;
+            found = true;
+          }
+      if(!found && gwOrphanCount < GW_ORPHANS)                                              // Done before gw_send() stored the handle
+        gwOrphan[gwOrphanCount++] = (GwOrphan){ handle, status, r.stamp };
+    }
+  if(found) gw_push(&r);
+}
+
+//----------------------------------------------------------------------------------------
+// gw_send: GW_TX record from the host into the transmit queue
+//----------------------------------------------------------------------------------------
+static void gw_send(const GwRecord* r)
+{
+  GwRecord c = {};
+  c.type = GW_TXC;
+  c.seq  = r->seq;
+
+  uint8_t slot = GW_PENDING;
+  for(uint8_t i = 0; i < GW_PENDING; i++) if(!gwPending[i].handle) { slot = i; break; }
+  const uint16_t handle = slot < GW_PENDING ? canSend(r->data, r->len, r->id, r->flags, gw_tx_done) : 0;
+  if(!handle)
+    {
+      gwStats.txRefused++;
+      c.status = GW_TX_REFUSED;
+      c.stamp  = micros();
+      gw_push(&c);
+      return;
+    }
+  gwStats.tx++;
+
+  bool early = false;
+  ATOMIC()
+    {
+      for(uint8_t k = 0; k < gwOrphanCount && !early; k++)
+        if(gwOrphan[k].handle == handle)
+          {
+            c.status = gwOrphan[k].status;
+            c.stamp  = gwOrphan[k].stamp;
+            gwOrphan[k] = gwOrphan[--gwOrphanCount];
+            early = true;
+          }
+      if(!early) { gwPending[slot].handle = handle; gwPending[slot].seq = r->seq; }
+    }
+  if(early) gw_push(&c);
+}
+
+//----------------------------------------------------------------------------------------
+// gw_input: Every byte from USB while the gateway is on (from processchar)
+//----------------------------------------------------------------------------------------
+void gw_input(uint8_t c)
+{
+  if(c != 0x00)
+    {
+      if(gwInLen < sizeof(gwIn)) gwIn[gwInLen] = c;
+      if(gwInLen < 0xFFFF) gwInLen++;
+      return;
+    }
+
+  const uint16_t len = gwInLen;
+  gwInLen = 0;
+  if(len == 0) return;
+  const int32_t n = (len <= sizeof(gwIn)) ? gw_open(gwIn, len, gwInFrame, sizeof(gwInFrame)) : -1;
+  if(n < 0) { gwStats.badFrames++; return; }
+
+  GwRecord r;
+  for(uint16_t pos = 0; pos < n; )
+    {
+      pos = gw_get(gwInFrame, pos, n, &r);
+      if(!pos) { gwStats.badFrames++; return; }                                             // Records before it were done
+      switch(r.type)
+        {
+          case GW_TX:   gw_send(&r); break;
+          case GW_SYNC: r.type = GW_TIME; r.stamp = micros(); gw_push(&r); break;
+          case GW_EXIT: gwExit = true; break;
+          default:      gwStats.badFrames++; break;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// gw_flush: Seal the records of gwFrame into one USB frame
+//----------------------------------------------------------------------------------------
+static void gw_flush(uint16_t len)
+{
+  if(len) Serial.write(gwOut, gw_seal(gwFrame, len, gwOut));
+}
+
+//----------------------------------------------------------------------------------------
+// gw_stop: Back to the saved filters and text output
+//----------------------------------------------------------------------------------------
+static void gw_stop(void)
+{
+  gwOn = false;
+  memcpy(&filterManager, &savedFilterManager, sizeof(CANFilterManager));
+  filterManager_apply(&filterManager, &can1, &settings);
+  ATOMIC() { memset(gwPending, 0, sizeof(gwPending)); gwOrphanCount = 0; }
+  IDE = gwIde;
+  if(IDE)
+    {
+      Serial.println();
+      Serial.println(F("GATEWAY       OFF"));
+      Serial.print(F("RX: "));           Serial.print(gwStats.rx);
+      Serial.print(F("  LOST: "));       Serial.print(gwStats.rxLost);
+      Serial.print(F("  TX: "));         Serial.print(gwStats.tx);
+      Serial.print(F("  REFUSED: "));    Serial.print(gwStats.txRefused);
+      Serial.print(F("  BAD FRAMES: ")); Serial.println(gwStats.badFrames);
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// gwTask: Records to USB, as many per frame as fit. Counters every GW_STAT_MS.
+//----------------------------------------------------------------------------------------
+uint8_t gwTask(Task* t)
+{
+  if(gwExit) { gw_stop(); return TASK_DONE; }
+
+  if((int32_t)(millis() - t->until) >= 0)
+    {
+      if(!Serial) { gw_stop(); return TASK_DONE; }                                          // Host closed the port. Not every pass: the test can take 10 ms
+      t->until = millis() + GW_STAT_MS;
+      GwRecord s = {};
+      s.type     = GW_STAT;
+      s.count[0] = gwStats.rx;
+      s.count[1] = gwStats.rxLost;
+      s.count[2] = gwStats.tx;
+      s.count[3] = gwStats.txRefused;
+      gw_push(&s);
+    }
+
+  uint16_t len = 0;
+  while(gwTail != gwHead)
+    {
+      const uint16_t next = gw_put(gwFrame, len, GW_FRAME_MAX - 2, &gwRing[gwTail % GW_RING]);  // 2 bytes left for the CRC
+      if(!next && len) { gw_flush(len); len = 0; continue; }                              // Frame full, this record opens the next one
+      if(next) len = next;                                                                  // Else unusable, dropped
+      gwTail++;
+    }
+  gw_flush(len);
+  return TASK_WAITING;
+}
+
+//----------------------------------------------------------------------------------------
+// gw_start: Serial command M 1. Last text line, then binary until GW_EXIT.
+//----------------------------------------------------------------------------------------
+bool gw_start(void)
+{
+  if(gwOn || MONITOR_FLAG || repState != REP_OFF || task_running(bulkTask))
+    {
+      if(IDE) Serial.println(F("GATEWAY REFUSED (MONITOR, REPLAY, BULK READ OR ALREADY ON)"));
+      return false;
+    }
+
+  memset(&gwStats, 0, sizeof(gwStats));
+  memset(gwPending, 0, sizeof(gwPending));
+  gwOrphanCount = 0;
+  gwHead = gwTail = 0;
+  gwInLen = 0;
+  gwExit = false;
+  if(!task_start(gwTask, nullptr, "GATEWAY")) return false;
+
+  if(IDE) Serial.println(F("GATEWAY       ON, BINARY FROM NOW"));
+  Serial.flush();
+  gwIde = IDE;
+  IDE = false;
+
+  memcpy(&savedFilterManager, &filterManager, sizeof(CANFilterManager));                    // Backup active filters, as Monitor()
+  filterManager_clear(&filterManager);
+  filterManager_add(&filterManager, 0x000, 0x7FF, ACANFD_FeatherM4CAN_FilterAction::FIFO0, gw_rx);
+  filterManager_apply(&filterManager, &can1, &settings);
+  gwOn = true;
+  return true;
+}
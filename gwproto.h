@@ -0,0 +1,219 @@
+
+// ~/Arduino/QIF/gwproto.h Located in parent directory and linked in subdirectory
+
+/*
+USB gateway wire format (gateway.h)
+
+Only <stdint.h> and <string.h>: the codec compiles unchanged on a PC, so the
+framing can be checked against tools/qifgw.py without a board: sim/qifgw.cpp
+builds this file on the host and compares it with the frames qifgw.py packs.
+
+USB frame: records packed back to back, CRC-16/CCITT (init 0xFFFF, big-endian)
+after the last record, the whole COBS encoded and ended by a 0x00 byte. One frame
+carries as many records as fit in GW_FRAME_MAX, that is many CAN frames per USB
+packet. A damaged frame is dropped whole, the next 0x00 resynchronises.
+
+Records, little-endian, first byte = type:
+
+  Host to board
+    GW_TX      prio(1) seq(2) id(2) len(1) data(len)      prio | 0x80 = state frame
+    GW_SYNC    host(8)                                     host clock, any unit
+    GW_EXIT                                                leave gateway mode
+
+  Board to host
+    GW_RX      flags(1) stamp(4) id(2) len(1) data(len)    stamp = board micros()
+    GW_TXC     status(1) seq(2) stamp(4)                   TXSTATUS or GW_TX_REFUSED
+    GW_TIME    host(8) stamp(4)                            answer to GW_SYNC
+    GW_STAT    rx(4) rxLost(4) tx(4) txRefused(4)          once a second
+*/
+
+#ifndef   GWPROTO_H
+#define   GWPROTO_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define GW_DATA_MAX       64                                                                        // CAN FD payload
+#define GW_FRAME_MAX      1024                                                                      // Records + CRC, before COBS
+#define GW_COBS_MAX       (GW_FRAME_MAX + GW_FRAME_MAX / 254 + 2)
+
+enum GW_TYPE : uint8_t {
+  GW_TX = 0x01, GW_SYNC = 0x02, GW_EXIT = 0x03,                                                     // Host to board
+  GW_RX = 0x81, GW_TXC  = 0x82, GW_TIME = 0x83, GW_STAT = 0x84                                      // Board to host
+};
+
+#define GW_TX_REFUSED     0xFF                                                                      // GW_TXC status: transmit queue full or frame invalid
+#define GW_RX_FD          0x01                                                                      // GW_RX flags
+#define GW_RX_BRS         0x02
+
+typedef struct {
+  uint8_t  type;
+  uint8_t  flags;                                                                                   // GW_RX flags, GW_TX priority
+  uint8_t  status;                                                                                  // GW_TXC
+  uint8_t  len;
+  uint16_t seq;                                                                                     // GW_TX / GW_TXC, chosen by the host
+  uint16_t id;
+  uint32_t stamp;                                                                                   // Board micros()
+  uint64_t host;                                                                                    // GW_SYNC / GW_TIME
+  uint32_t count[4];                                                                                // GW_STAT
+  uint8_t  data[GW_DATA_MAX];
+} GwRecord;
+
+//----------------------------------------------------------------------------------------
+// Little-endian fields
+//----------------------------------------------------------------------------------------
+static inline void     gw_w16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static inline void     gw_w32(uint8_t* p, uint32_t v) { gw_w16(p, v); gw_w16(p + 2, v >> 16); }
+static inline void     gw_w64(uint8_t* p, uint64_t v) { gw_w32(p, (uint32_t)v); gw_w32(p + 4, (uint32_t)(v >> 32)); }
+static inline uint16_t gw_r16(const uint8_t* p) { return p[0] | (uint16_t)p[1] << 8; }
+static inline uint32_t gw_r32(const uint8_t* p) { return gw_r16(p) | (uint32_t)gw_r16(p + 2) << 16; }
+static inline uint64_t gw_r64(const uint8_t* p) { return gw_r32(p) | (uint64_t)gw_r32(p + 4) << 32; }
+
+//----------------------------------------------------------------------------------------
+// gw_crc16: CRC-16/CCITT-FALSE
+//----------------------------------------------------------------------------------------
+static inline uint16_t gw_crc16(const uint8_t* data, uint16_t len)
+{
+  uint16_t crc = 0xFFFF;
+  while(len--)
+    {
+      crc ^= (uint16_t)*data++ << 8;
+      for(uint8_t k = 0; k < 8; k++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  return crc;
+}
+
+//----------------------------------------------------------------------------------------
+// cobs_encode: out holds len + len / 254 + 2 bytes. Returns the size, 0x00 delimiter included.
+//----------------------------------------------------------------------------------------
+static inline uint16_t cobs_encode(const uint8_t* in, uint16_t len, uint8_t* out)
+{
+  uint16_t o    = 1;
+  uint16_t code = 0;                                                                                // Where the current run length goes
+  uint8_t  run  = 1;
+  for(uint16_t i = 0; i < len; i++)
+    {
+      if(in[i] == 0)
+        {
+          out[code] = run; code = o++; run = 1;
+          continue;
+        }
+      out[o++] = in[i];
+      if(++run == 0xFF) { out[code] = run; code = o++; run = 1; }
+    }
+  out[code] = run;
+  out[o++]  = 0x00;
+  return o;
+}
+
+//----------------------------------------------------------------------------------------
+// cobs_decode: One frame without its 0x00. Returns the decoded size, -1 if malformed.
+//----------------------------------------------------------------------------------------
+static inline int32_t cobs_decode(const uint8_t* in, uint16_t len, uint8_t* out, uint16_t max)
+{
+  uint16_t i = 0, o = 0;
+  while(i < len)
+    {
+      const uint8_t code = in[i++];
+      if(code == 0 || i + code - 1 > len) return -1;
+      for(uint8_t k = 1; k < code; k++)
+        {
+          if(o >= max) return -1;
+          out[o++] = in[i++];
+        }
+      if(code != 0xFF && i < len)
+        {
+          if(o >= max) return -1;
+          out[o++] = 0;
+        }
+    }
+  return o;
+}
+
+//----------------------------------------------------------------------------------------
+// gw_size: Encoded size of a record
+//----------------------------------------------------------------------------------------
+static inline uint16_t gw_size(const GwRecord* r)
+{
+  switch(r->type)
+    {
+      case GW_TX:   return 7 + r->len;
+      case GW_SYNC: return 9;
+      case GW_EXIT: return 1;
+      case GW_RX:   return 9 + r->len;
+      case GW_TXC:  return 8;
+      case GW_TIME: return 13;
+      case GW_STAT: return 17;
+      default:      return 0;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// gw_put: Append a record at buf[pos]. Returns the new position, 0 if it does not fit.
+//----------------------------------------------------------------------------------------
+static inline uint16_t gw_put(uint8_t* buf, uint16_t pos, uint16_t max, const GwRecord* r)
+{
+  const uint16_t n = gw_size(r);
+  if(n == 0 || r->len > GW_DATA_MAX || pos + n > max) return 0;
+  uint8_t* p = buf + pos;
+  p[0] = r->type;
+  switch(r->type)
+    {
+      case GW_TX:   p[1] = r->flags; gw_w16(p + 2, r->seq); gw_w16(p + 4, r->id); p[6] = r->len; memcpy(p + 7, r->data, r->len); break;
+      case GW_SYNC: gw_w64(p + 1, r->host); break;
+      case GW_RX:   p[1] = r->flags; gw_w32(p + 2, r->stamp); gw_w16(p + 6, r->id); p[8] = r->len; memcpy(p + 9, r->data, r->len); break;
+      case GW_TXC:  p[1] = r->status; gw_w16(p + 2, r->seq); gw_w32(p + 4, r->stamp); break;
+      case GW_TIME: gw_w64(p + 1, r->host); gw_w32(p + 9, r->stamp); break;
+      case GW_STAT: for(uint8_t k = 0; k < 4; k++) gw_w32(p + 1 + 4 * k, r->count[k]); break;
+    }
+  return pos + n;
+}
+
+//----------------------------------------------------------------------------------------
+// gw_get: Read the record at buf[pos]. Returns the next position, 0 if malformed.
+//----------------------------------------------------------------------------------------
+static inline uint16_t gw_get(const uint8_t* buf, uint16_t pos, uint16_t end, GwRecord* r)
+{
+  if(pos >= end) return 0;
+  const uint8_t* p = buf + pos;
+  memset(r, 0, sizeof(GwRecord));
+  r->type = p[0];
+  if(r->type == GW_TX && pos + 7 <= end) r->len = p[6];
+  if(r->type == GW_RX && pos + 9 <= end) r->len = p[8];
+  const uint16_t n = gw_size(r);
+  if(n == 0 || r->len > GW_DATA_MAX || pos + n > end) return 0;
+  switch(r->type)
+    {
+      case GW_TX:   r->flags = p[1]; r->seq = gw_r16(p + 2); r->id = gw_r16(p + 4); memcpy(r->data, p + 7, r->len); break;
+      case GW_SYNC: r->host = gw_r64(p + 1); break;
+      case GW_RX:   r->flags = p[1]; r->stamp = gw_r32(p + 2); r->id = gw_r16(p + 6); memcpy(r->data, p + 9, r->len); break;
+      case GW_TXC:  r->status = p[1]; r->seq = gw_r16(p + 2); r->stamp = gw_r32(p + 4); break;
+      case GW_TIME: r->host = gw_r64(p + 1); r->stamp = gw_r32(p + 9); break;
+      case GW_STAT: for(uint8_t k = 0; k < 4; k++) r->count[k] = gw_r32(p + 1 + 4 * k); break;
+    }
+  return pos + n;
+}
+
+//----------------------------------------------------------------------------------------
+// gw_seal: Add the CRC to len bytes of records and COBS encode into out (GW_COBS_MAX)
+//----------------------------------------------------------------------------------------
+static inline uint16_t gw_seal(uint8_t* frame, uint16_t len, uint8_t* out)
+{
+  const uint16_t crc = gw_crc16(frame, len);
+  frame[len]     = crc >> 8;
+  frame[len + 1] = crc & 0xFF;
+  return cobs_encode(frame, len + 2, out);
+}
+
+//----------------------------------------------------------------------------------------
+// gw_open: Decode and check one received frame (no 0x00). Returns the records size, -1 if bad.
+//----------------------------------------------------------------------------------------
+static inline int32_t gw_open(const uint8_t* in, uint16_t len, uint8_t* frame, uint16_t max)
+{
+  const int32_t n = cobs_decode(in, len, frame, max);
+  if(n < 3) return -1;
+  const uint16_t crc = (uint16_t)frame[n - 2] << 8 | frame[n - 1];
+  return gw_crc16(frame, n - 2) == crc ? n - 2 : -1;
+}
+
+#endif
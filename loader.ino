@@ -148,13 +148,15 @@ void Boot2(void)
     const uint32_t probe_block = 4096;       // Block size for scanning QSPI (4 KB)
 
     uint8_t write_buf[page_size];            // Buffer to write one page at a time
-    uint8_t probe_buf[probe_block];          // Buffer to probe blocks from QSPI
+    ArenaLease probe(ARENA_BOOT2, probe_block);
+    uint8_t* probe_buf = probe.buf;          // Buffer to probe blocks from QSPI, the arena (arena.h): not on the stack
 
     uint32_t offset = 0;                     // Offset into the QSPI flash
     uint32_t program_size = 0;               // Final detected size of firmware
     uint32_t i;
 
 NVIC_SystemReset();
+    if (!probe_buf) NVIC_SystemReset();      // Arena held: an update still running
     //------------------------------------------------------------------------------------
     // STEP 1: Scan QSPI flash for valid content (first non-0xFF region)
     while (true)
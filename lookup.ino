@@ -0,0 +1,68 @@
+
+// ~/Arduino/QIF/switch/lookup.ino
+
+
+#include "qif.h"
+
+// Table lookups: DB[] by UID or label, filters by id
+// Also built on the host, unchanged, by sim/qifbench.cpp
+
+//----------------------------------------------------------------------------------------
+uint16_t getCAN(uint64_t uid)                                                                     // Return can base address from the board UID
+  {
+    const IO *ptr = DB;                                                                           // Define a pointer to the DB array
+
+    for(uint16_t i = 0; i < DB_count; i++)                                                        // Search for the structure containing the board UID
+      { 
+        if (ptr->UID == uid) { return ptr->CAN; }                 
+        ptr++;                                                                                    // Next element in the array                                                                
+      }
+    return false;
+  }
+
+//----------------------------------------------------------------------------------------
+uint8_t getLBL(uint64_t uid)                                                                      // Return label from the board UID                                                            
+  {
+    for(uint8_t i = 0; i < DB_count; i++)
+      {
+        if(DB[i].UID == uid) return DB[i].LBL;
+      }
+    return false;
+  }
+
+//----------------------------------------------------------------------------------------
+uint8_t getTYPE(uint64_t uid)                                                                     // Return type from the board UID
+  {
+    const IO *ptr = DB;                                                                           // Define a pointer to the DB array
+
+    for(uint16_t i = 0; i < DB_count; i++)                                                        // Search for the structure containing the board UID
+      { 
+        if (ptr->UID == uid) { return ptr->TYPE; }                 
+        ptr++;                                                                                    // Next element in the array                                                                
+      }
+    return false;
+  }
+
+uint16_t Lbl2Can(uint8_t lbl)                                                                     // Extract can address from label
+  {
+    for(uint8_t i = 0; i < DB_count; i++)
+      {
+        if(DB[i].LBL == lbl)
+        return DB[i].CAN;                                                                         // Found CAN address
+      }
+    return 0xFFFF;                                                                                // Not found
+  }
+
+//----------------------------------------------------------------------------------------
+// filter_lookup: Callback the filters of mgr give to this id, nullptr if none. First
+// matching entry, as the hardware filters (gateway, replay).
+//----------------------------------------------------------------------------------------
+FilterCallback filter_lookup(const CANFilterManager* mgr, uint16_t id)
+{
+  for(uint8_t i = 0; i < MAX_FILTERS; i++)
+    {
+      const auto* e = &mgr->entries[i];
+      if(e->valid && e->callback && id >= e->idStart && id <= e->idEnd) return e->callback;
+    }
+  return nullptr;
+}
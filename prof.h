@@ -0,0 +1,126 @@
+
+// ~/Arduino/QIF/prof.h Located in parent directory and linked in subdirectory
+
+/*
+Cycle count profiler of the interrupt handlers and CAN callbacks
+
+One probe per handler, on DWT->CYCCNT (started by DWT_Init() in setup()):
+
+  void Process_Led(const CANFDMessage & message)
+  {
+    PROF_SCOPE(PROF_LED);                   // Measures up to the closing brace
+    ...
+
+Each probe keeps count, min, max, sum and a log2 histogram of the cycles spent
+(bucket 0: under 64 cycles, then 64-127, 128-255 ... bucket 15: 1M cycles and
+more). Times are inclusive: PROF_DISPATCH contains the callback it ran, PROF_CTL
+the RPC it answered. Every Process_* handler a filter calls has its probe; those
+Process_Ctl() calls (batch, RPC, time series) count in PROF_CTL, Process_Reboot()
+never returns. A probe costs two cycle counter reads and about 20 cycles
+of bookkeeping.
+
+PROF_PERIOD is the probe of a periodic interrupt (board_pwm, 40 us, and the
+1 ms TCC2 tick). It also measures the interval between two entries:
+
+  over    runs longer than the period, the next interrupt was already pending
+  late    intervals over 1.5 periods, an interrupt was delayed or lost (long
+          ATOMIC section, higher priority handler)
+  jitter  longest minus shortest interval
+  load    share of the CPU spent in the handler since the last reset
+
+Report: serial G 1 (G 2 resets), or RPC_PROF over CAN from another board (G 3 L),
+one call per probe. PROF_ENABLE 0 compiles every probe out: no code, no RAM.
+*/
+
+#ifndef   PROF_H
+#define   PROF_H
+
+#ifndef   PROF_ENABLE
+#define   PROF_ENABLE     1                                                                         // 0: probes compiled out
+#endif
+
+#define PROF_BUCKETS      16                                                                        // log2 histogram
+#define PROF_LOG0         5                                                                         // Bucket 0: under 2^(PROF_LOG0 + 1) cycles
+#define PROF_RPC_SIZE     57                                                                        // RPC_PROF payload
+
+enum PROF_ID : uint8_t {
+  PROF_PWM = 0, PROF_TICK, PROF_SWITCH, PROF_DISPATCH, PROF_TXPUMP,                                 // Interrupts and what the tick runs
+  PROF_TIME, PROF_UPDATE, PROF_BME, PROF_HBEAT, PROF_ACK, PROF_NACK, PROF_LED, PROF_PWRCTRL,         // CAN callbacks
+  PROF_LPWM, PROF_HPWM, PROF_ANALOG, PROF_ANA_RX, PROF_PIR, PROF_CTL, PROF_GROUP, PROF_TELEM, PROF_FCT,
+  PROF_ISENSE, PROF_ALARM, PROF_GPS, PROF_GYRO, PROF_LEVEL,                                         // Placeholder handlers, appended: RPC_PROF ids unchanged
+  PROF_IDS
+};
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;                                                                                     // Cycles
+  uint32_t max;
+  uint64_t sum;
+  uint32_t budget;                                                                                  // Period in cycles, 0 = not periodic
+  uint32_t over;                                                                                    // Runs longer than budget
+  uint32_t last;                                                                                    // CYCCNT at the last entry
+  uint32_t periodMin;
+  uint32_t periodMax;
+  uint32_t late;                                                                                    // Intervals over 1.5 budget
+  uint32_t hist[PROF_BUCKETS];
+} ProfSlot;
+
+#if PROF_ENABLE
+
+ProfSlot profSlots[PROF_IDS];
+uint32_t profStart;                                                                                 // millis() of the last reset
+
+//----------------------------------------------------------------------------------------
+// prof_add: One sample. Interrupt or main context, each probe used from one context.
+//----------------------------------------------------------------------------------------
+static inline void prof_add(ProfSlot* s, uint32_t cycles)
+{
+  s->count++;
+  s->sum += cycles;
+  if(cycles < s->min) s->min = cycles;
+  if(cycles > s->max) s->max = cycles;
+  if(s->budget && cycles > s->budget) s->over++;
+  uint32_t b = 31 - __builtin_clz(cycles | 1);                                              // log2, one CLZ instruction
+  b = (b > PROF_LOG0) ? b - PROF_LOG0 : 0;
+  s->hist[b < PROF_BUCKETS ? b : PROF_BUCKETS - 1]++;
+}
+
+static inline void prof_period(ProfSlot* s, uint32_t now)
+{
+  if(s->count)
+    {
+      const uint32_t p = now - s->last;
+      if(p < s->periodMin) s->periodMin = p;
+      if(p > s->periodMax) s->periodMax = p;
+      if(p > s->budget + s->budget / 2) s->late++;
+    }
+  s->last = now;
+}
+
+struct ProfScope {
+  ProfSlot* s;
+  uint32_t  t0;
+  ProfScope(uint8_t id) : s(&profSlots[id]), t0(DWT->CYCCNT) {}
+  ~ProfScope() { prof_add(s, DWT->CYCCNT - t0); }
+};
+
+struct ProfPeriod : ProfScope {
+  ProfPeriod(uint8_t id) : ProfScope(id) { prof_period(s, t0); }
+};
+
+#define PROF_SCOPE(id)    ProfScope  _prof(id)
+#define PROF_PERIOD(id)   ProfPeriod _prof(id)
+
+#else
+
+#define PROF_SCOPE(id)
+#define PROF_PERIOD(id)
+
+#endif
+
+void prof_reset(void);
+void prof_print(void);
+bool prof_fill(uint8_t id, uint8_t* payload);
+void prof_print_rpc(const uint8_t* payload, uint8_t len);
+
+#endif
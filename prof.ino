@@ -0,0 +1,129 @@
+
+// ~/Arduino/QIF/switch/prof.ino
+
+
+#include "qif.h"
+
+static const char* const profNames[PROF_IDS] = {
+  "PWM ISR ", "TICK ISR", "SWITCH  ", "DISPATCH", "TX PUMP ",
+  "TIME    ", "UPDATE  ", "BME     ", "HEARTBT ", "ACK     ", "NACK    ", "LED     ", "PWRCTRL ",
+  "LPWM    ", "HPWM    ", "ANALOG  ", "ANA RX  ", "PIR     ", "CTL     ", "GROUP   ", "TELEM   ", "FCT     ",
+  "ISENSE  ", "ALARM   ", "GPS     ", "GYRO    ", "LEVEL   "
+};
+
+//----------------------------------------------------------------------------------------
+// prof_line: One probe, from the local slots or an RPC_PROF payload
+//----------------------------------------------------------------------------------------
+static void prof_line(uint8_t id, uint32_t count, uint32_t min, uint32_t max, uint32_t mean, uint32_t over)
+{
+  Serial.print(id < PROF_IDS ? profNames[id] : "?       "); Serial.print(' ');
+  Serial.print(count);                Serial.print('\t');
+  Serial.print(count ? min : 0);      Serial.print('\t');
+  Serial.print(mean);                 Serial.print('\t');
+  Serial.print(max);                  Serial.print('\t');
+  Serial.print(max / (SystemCoreClock / 1000000)); Serial.print('\t');
+  Serial.print(over);
+}
+
+static void prof_hist(const uint32_t* hist)
+{
+  Serial.print(F("         "));
+  for(uint8_t b = 0; b < PROF_BUCKETS; b++) { Serial.print(hist[b]); Serial.print(' '); }
+  Serial.println();
+}
+
+#if PROF_ENABLE
+
+//----------------------------------------------------------------------------------------
+// prof_reset: Serial command G 2, and once from setup()
+//----------------------------------------------------------------------------------------
+void prof_reset(void)
+{
+  const uint32_t perUs = SystemCoreClock / 1000000;
+  ATOMIC()
+    {
+      memset(profSlots, 0, sizeof(profSlots));
+      for(uint8_t i = 0; i < PROF_IDS; i++) { profSlots[i].min = 0xFFFFFFFF; profSlots[i].periodMin = 0xFFFFFFFF; }
+      profSlots[PROF_PWM].budget  = TIMER_INTERVAL_US * perUs;
+      profSlots[PROF_TICK].budget = 1000 * perUs;
+      profStart = millis();
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// prof_print: Serial command G 1
+//----------------------------------------------------------------------------------------
+void prof_print(void)
+{
+  if(!IDE) return;
+  const uint32_t perUs = SystemCoreClock / 1000000;
+  const uint32_t ms    = millis() - profStart;
+
+  Serial.print(F("PROFILER, ")); Serial.print(typeNames[TYPE]);                            // Handlers are specialized per type (board.h)
+  Serial.print(F(", CYCLES AT ")); Serial.print(perUs); Serial.print(F(" MHz, OVER "));
+  Serial.print(ms); Serial.println(F(" ms"));
+  Serial.println(F("PROBE    COUNT   MIN     MEAN    MAX     MAX(us) OVER"));
+  for(uint8_t i = 0; i < PROF_IDS; i++)
+    {
+      ProfSlot s;
+      ATOMIC() s = profSlots[i];                                                           // Consistent copy, the probe may fire meanwhile
+      if(!s.count) continue;
+      prof_line(i, s.count, s.min, s.max, (uint32_t)(s.sum / s.count), s.over);
+      if(s.budget)
+        {
+          Serial.print(F("\tPERIOD(us) ")); Serial.print(s.periodMin / perUs);
+          Serial.print('-');                Serial.print(s.periodMax / perUs);
+          Serial.print(F("  JITTER: "));    Serial.print((s.periodMax - s.periodMin) / perUs);
+          Serial.print(F("  LATE: "));      Serial.print(s.late);
+          Serial.print(F("  LOAD: "));      Serial.print(ms ? (uint32_t)(s.sum * 100 / ((uint64_t)ms * 1000 * perUs)) : 0);
+          Serial.print('%');
+        }
+      Serial.println();
+      prof_hist(s.hist);
+    }
+  Serial.print(F("HISTOGRAM: <64 CYCLES, 64, 128 ... "));
+  Serial.print(1UL << (PROF_LOG0 + PROF_BUCKETS - 1)); Serial.println(F(" AND MORE"));
+}
+
+//----------------------------------------------------------------------------------------
+// prof_fill: RPC_PROF payload of one probe, little-endian
+//   id(1) count(4) min(4) max(4) mean(4) over(4) jitter(4) histogram(16 x 2, saturated)
+//----------------------------------------------------------------------------------------
+bool prof_fill(uint8_t id, uint8_t* payload)
+{
+  if(id >= PROF_IDS) return false;
+  ProfSlot s;
+  ATOMIC() s = profSlots[id];
+  payload[0] = id;
+  gw_w32(payload + 1,  s.count);
+  gw_w32(payload + 5,  s.count ? s.min : 0);
+  gw_w32(payload + 9,  s.max);
+  gw_w32(payload + 13, s.count ? (uint32_t)(s.sum / s.count) : 0);
+  gw_w32(payload + 17, s.over);
+  gw_w32(payload + 21, s.budget && s.count > 1 ? s.periodMax - s.periodMin : 0);
+  for(uint8_t b = 0; b < PROF_BUCKETS; b++) gw_w16(payload + 25 + 2 * b, s.hist[b] > 0xFFFF ? 0xFFFF : s.hist[b]);
+  return true;
+}
+
+#else
+
+void prof_reset(void) {}
+void prof_print(void) { if(IDE) Serial.println(F("PROFILER COMPILED OUT (PROF_ENABLE 0)")); }
+bool prof_fill(uint8_t id, uint8_t* payload) { return false; }
+
+#endif
+
+//----------------------------------------------------------------------------------------
+// prof_print_rpc: RPC_PROF response of another board (serial command G 3 L)
+//----------------------------------------------------------------------------------------
+void prof_print_rpc(const uint8_t* payload, uint8_t len)
+{
+  if(len < PROF_RPC_SIZE) { Serial.println(F("PROFILE TOO SHORT")); return; }
+  uint32_t hist[PROF_BUCKETS];
+  for(uint8_t b = 0; b < PROF_BUCKETS; b++) hist[b] = gw_r16(payload + 25 + 2 * b);
+  prof_line(payload[0], gw_r32(payload + 1), gw_r32(payload + 5), gw_r32(payload + 9), gw_r32(payload + 13), gw_r32(payload + 17));
+  const uint32_t jitter = gw_r32(payload + 21);
+  if(jitter) { Serial.print(F("  JITTER(cycles): ")); Serial.print(jitter); }
+  Serial.println();
+  prof_hist(hist);
+}
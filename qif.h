@@ -28,6 +28,30 @@
 #include "function.h"
 #include "db.h"
 #include "crc64.h"
+#include "update.h"
+#include "txqueue.h"
+#include "batch.h"
+#include "rpc.h"
+#include "snapshot.h"
+#include "telemetry.h"
+#include "tsdb.h"
+#include "timer.h"
+#include "task.h"
+#include "erase.h"
+#include "crcmap.h"
+#include "gwproto.h"
+#include "bulk.h"
+#include "gateway.h"
+#include "capture.h"
+#include "replay.h"
+#include "prof.h"
+#include "dlog.h"
+#include "board.h"
+#include "arena.h"
+#include "qspi.h"
+#include "bstate.h"
+#include "boot.h"
+#include "bench.h"
 
 extern "C" uint32_t __etext;                                                                       // End of code in flash (from linker script)
 
@@ -91,6 +115,9 @@ const uint8_t copyright[] PROGMEM = { "©2025 QIF / karel@qif.ch http://qif.ch"
 #define REVERSE 1
 
 enum INFO : uint8_t { BMETEMP = 30,BMEPRESS,BMEHUMID,BMEGAZ,BMEIAQ,BMEVOC,BMECO2 };                 // Message info, first byte of can message data 
+
+#define CTL_HEADER 3                                                                                // Control frame header: opcode, sender label, sequence
+enum CTL : uint8_t { CTL_NONE = 0, CTL_BATCH, CTL_RPC_REQ, CTL_RPC_RSP, CTL_TS_QUERY, CTL_TS_DATA }; // Control channel opcode, first byte of frame on board base + ctl
               
 typedef void (*FilterCallback)(const CANFDMessage &);
 
@@ -117,7 +144,7 @@ typedef struct {
 } Switch;
 
 typedef struct {
-  volatile uint64_t counter;                                                                        // Countdown in ticks
+  uint16_t          timer;                                                                          // Wheel timer handle (timer.h), 0 = none
   volatile bool     active;                                                                         // Active state
   volatile bool     flag;                                                                           // Expiry flag (set to true when expired)
 } DelayTask;
@@ -131,6 +158,7 @@ typedef struct {
       float temperature;
       float humidity;
       float gas;
+      uint8_t status;                                                                               // IAQ accuracy, stabilization, run-in (telemetry.h TLM_*)
     };
 
 typedef union {                                                                                     // Define a named union to hold the value of BME688
@@ -183,7 +211,20 @@ enum STATE_t
     MNT,                                                                                            // Set monitor mode
     FLT,                                                                                            // Print active filter
     SND,                                                                                            // Send message to: label, sub-address, value
-    MLI                                                                                             // Send message to: label, pwm channel, value
+    MLI,                                                                                            // Send message to: label, pwm channel, value
+    TXS,                                                                                            // Print CAN transmit queue statistics
+    SCN,                                                                                            // Send scene: label, value, direction to all channels in one batch frame
+    GRS,                                                                                            // Send group scene: group, value, direction
+    RPS,                                                                                            // Print RPC statistics
+    POL,                                                                                            // Ask every board for a BME688 value
+    SNP,                                                                                            // Board state snapshot, 0 = every board
+    TLP,                                                                                            // BME telemetry publish period
+    TLC,                                                                                            // Dump telemetry cache
+    TSQ,                                                                                            // Time-series query, local store
+    TSR,                                                                                            // Time-series query, remote store
+    TMS,                                                                                            // Print timer statistics
+    CRB,                                                                                            // Flash verification benchmark
+    BLK                                                                                             // Binary bulk flash read-out
   };
 
 STATE_t State     = NONE;
@@ -0,0 +1,78 @@
+
+// ~/Arduino/QIF/qspi.h Located in parent directory and linked in subdirectory
+
+/*
+QSPI owner
+
+One user of the QSPI at a time. A command sent while another one is half way
+through its transfer (a status read from the tick in the middle of a page program
+by a task) corrupts both, so every writer takes qspiOwner first, one compare-and-
+swap as for the arena lease (arena.h):
+
+  QSPI_UPDATE       firmware update receiver: the erase-ahead (erase_poll) and the
+                    page writes of Process_Update, taken by the first erase after
+                    STX, given back at ETX or on a failed write
+  QSPI_CAPTURE      CAN capture: its erase, then cap_step(), given back by cap_stop()
+  QSPI_TSDB         tsdb_flush(): the sector erase and the page program
+  QSPI_BSTATE       bst_save()
+  QSPI_BULK         bulkTask(): each chunk read of serial command X
+
+The interrupt side (erase_poll, cap_step, the page writes after STX) never waits:
+refused, it tries again at the next tick, the task holding the QSPI runs again as
+soon as the interrupt returns. An update page refused stays in the arena and is
+written with one of the next frames, the next page fills meanwhile (update.h).
+The task side takes nothing while an update runs (STX_FLAG) or a capture holds
+the QSPI and tries again later (tsdb_flush keeps its page): only a lease taken
+before STX can be in the way of the update, and only for its first pages.
+
+The owner taking the QSPI again gets it again: the update holds it from the first
+erase to ETX. Scoped use in main context:
+
+  QspiLease lease(QSPI_TSDB);
+  if(!lease.held) return false;                   // Update or capture running
+*/
+
+#ifndef   QSPI_H
+#define   QSPI_H
+
+enum QSPI_OWNER : uint8_t { QSPI_FREE = 0, QSPI_UPDATE, QSPI_CAPTURE, QSPI_TSDB, QSPI_BSTATE, QSPI_BULK, QSPI_OWNERS };
+
+typedef struct {
+  uint32_t refused;
+  uint8_t  refusedOwner;                                                                            // Last refusal: who asked
+  uint8_t  refusedHolder;                                                                           // and who held the QSPI
+} QspiStats;
+
+volatile uint8_t qspiOwner = QSPI_FREE;
+QspiStats        qspiStats;
+
+//----------------------------------------------------------------------------------------
+// qspi_take: true if owner holds the QSPI now, false if another one does. Any context.
+//----------------------------------------------------------------------------------------
+static inline bool qspi_take(uint8_t owner)
+{
+  uint8_t held = QSPI_FREE;
+  if(__atomic_compare_exchange_n(&qspiOwner, &held, owner, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) || held == owner)
+    return true;
+  qspiStats.refused++;
+  qspiStats.refusedOwner  = owner;
+  qspiStats.refusedHolder = held;
+  return false;
+}
+
+static inline void qspi_give(uint8_t owner)
+{
+  uint8_t held = owner;
+  __atomic_compare_exchange_n(&qspiOwner, &held, (uint8_t)QSPI_FREE, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+struct QspiLease {
+  uint8_t owner;
+  bool    held;                                                                                     // false: refused
+  QspiLease(uint8_t o) : owner(o), held(qspi_take(o)) {}
+  ~QspiLease() { if(held) qspi_give(owner); }
+  QspiLease(const QspiLease&) = delete;
+  QspiLease& operator=(const QspiLease&) = delete;
+};
+
+#endif
@@ -0,0 +1,104 @@
+
+// ~/Arduino/QIF/replay.h Located in parent directory and linked in subdirectory
+
+/*
+CAN trace replay, handler throughput
+
+Plays the capture stored in QSPI (capture.h) back into this board's own filter
+callbacks, as if the frames came from the bus, to find how much traffic the
+handlers of each board type take before frames are lost.
+
+  M 6 S B    replay at S times the captured speed, B frames dispatched per 1 ms
+             tick (0 = 1, what TCC2_0_Handler does with the bus). S = 0: as fast
+             as possible. Any M while it runs: stop.
+  M 7 B      sweep: 1x, 2x, 4x ... 128x then as fast as possible, one line each.
+
+Model of the receive path
+  A frame "arrives" when the replay clock (1 ms tick times S) passes its capture
+  time. A frame no filter accepts is counted and skipped, the hardware filters
+  would not have taken it. The others are copied into repFifo, REP_FIFO frames,
+  the controller FIFO plus the driver FIFO (settings in CAN_Setup()): when it is
+  full the frame is a drop, as with the real driver. repRing only holds the trace
+  ahead of the replay clock: frames waiting in the FIFO, and the records no filter
+  takes between them, never keep the loader out. The tick dispatches B frames of it
+  to the callback of filterManager, in the TCC2 interrupt like the bus frames.
+  As fast as possible: no drops, arrivals wait for room, and every tick
+  dispatches until REP_BUDGET_US of the millisecond is spent.
+
+Loading
+  repTask reads the trace into repRing (same record format as the capture, raw
+  bytes) in the main loop, ahead of the tick, only while the flash is idle. A tick
+  that finds the next record not yet loaded counts as starved (the loader, not the
+  handlers, was the limit).
+
+Report, per run
+  frames arrived / dispatched / dropped / filtered out, FIFO peak, frames per
+  second, handler time mean and max (DWT cycles), longest tick, transmit queue
+  peak and frames the transmit queue refused or expired meanwhile.
+
+The replies of the handlers do go out through canSend(): use a bench bus. Bus
+frames wait in the driver FIFO during the run. IDE is muted for the duration, the
+handlers' own prints are not part of the numbers.
+
+sim/qifreplay.cpp builds this file on the host and checks that two runs of the
+same capture hand the same frames to the handlers at the same ticks, in capture
+order, whatever the pace of the loader.
+*/
+
+#ifndef   REPLAY_H
+#define   REPLAY_H
+
+#define REP_RAM           16384                                                                     // Trace bytes loaded ahead, power of 2
+#define REP_CHUNK         1024                                                                      // QSPI read per scheduler pass
+#define REP_FIFO          272                                                                       // mHardwareRxFIFO0Size + mDriverReceiveFIFO0Size
+#define REP_BUDGET_US     800                                                                       // As fast as possible: dispatch time per 1 ms tick
+#define REP_SWEEP         9                                                                         // Speeds of M 7
+
+enum REP_STATE : uint8_t { REP_OFF = 0, REP_LOADING, REP_RUNNING, REP_DONE };
+
+typedef struct {                                                                                    // A frame in the receive FIFO
+  uint16_t id;
+  uint8_t  flags;                                                                                   // CAP_FD, CAP_BRS
+  uint8_t  len;
+  uint8_t  data[64];
+} RepFrame;
+
+typedef struct {
+  uint32_t frames;                                                                                  // Arrived
+  uint32_t dispatched;
+  uint32_t drops;                                                                                   // FIFO full on arrival
+  uint32_t filtered;                                                                                // No filter for the id
+  uint32_t starved;                                                                                 // Ticks waiting for the loader
+  uint16_t peak;                                                                                    // Highest FIFO fill, frames
+  uint64_t handlerCycles;                                                                           // Sum over the dispatched frames
+  uint32_t handlerMax;                                                                              // Cycles
+  uint32_t tickMax;                                                                                 // Cycles of the longest rep_tick()
+  uint8_t  txPeak;                                                                                  // Highest transmit ring fill, any priority
+  uint32_t txDropped;                                                                               // txStats.dropped / expired at the start, then the difference
+  uint32_t txExpired;
+} RepStats;
+
+volatile uint8_t  repState = REP_OFF;
+uint8_t           repRing[REP_RAM];
+volatile uint32_t repHead;                                                                          // Bytes loaded, free running
+volatile uint32_t repDue;                                                                           // Bytes arrived, into repFifo or skipped
+volatile bool     repEnd;                                                                           // End of the trace reached by the tick
+uint32_t          repAddr;                                                                          // Next QSPI byte to load
+RepFrame          repFifo[REP_FIFO];                                                                // 18 KB, one slot per frame as in the driver
+uint16_t          repFifoHead;                                                                      // Next slot to fill
+uint16_t          repDepth;                                                                         // Frames in the FIFO
+uint32_t          repEpoch;                                                                         // us upper word of the next record
+uint64_t          repStart;                                                                         // Capture time of the first frame
+bool              repFirst;
+uint32_t          repTicks;
+uint8_t           repSpeed;                                                                         // 0 = as fast as possible
+uint8_t           repBurst;
+uint8_t           repSweep;                                                                         // Next index in the sweep, 0 = single run
+bool              repIde;
+CapHeader         repHeader;
+RepStats          repStats;
+
+void rep_tick(void);
+void rep_command(uint8_t mode, uint8_t a, uint8_t b);
+
+#endif
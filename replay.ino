@@ -0,0 +1,243 @@
+
+// ~/Arduino/QIF/switch/replay.ino
+
+
+#include "qif.h"
+
+static const uint8_t repSpeeds[REP_SWEEP] = { 1, 2, 4, 8, 16, 32, 64, 128, 0 };
+
+//----------------------------------------------------------------------------------------
+// Ring access. repHead moves in repTask only, repDue in the tick only.
+//----------------------------------------------------------------------------------------
+static uint8_t  rep_at(uint32_t pos)  { return repRing[pos & (REP_RAM - 1)]; }
+static uint16_t rep_r16(uint32_t pos) { return rep_at(pos) | (uint16_t)rep_at(pos + 1) << 8; }
+static uint32_t rep_r32(uint32_t pos) { return rep_r16(pos) | (uint32_t)rep_r16(pos + 2) << 16; }
+
+//----------------------------------------------------------------------------------------
+// rep_callback: What the filters of the board would call for this id, nullptr if none
+//----------------------------------------------------------------------------------------
+static FilterCallback rep_callback(uint16_t id)
+{
+  return filter_lookup(&filterManager, id);
+}
+
+//----------------------------------------------------------------------------------------
+// rep_arrive: Move the frames whose time has come into the FIFO.
+// Returns false when the next record is not loaded yet.
+//----------------------------------------------------------------------------------------
+static bool rep_arrive(void)
+{
+  const uint64_t now = (uint64_t)repTicks * 1000 * repSpeed;                                // Capture us reached by the replay clock
+  while(!repEnd)
+    {
+      const uint32_t loaded = repHead - repDue;
+      if(loaded < sizeof(CapRecord)) return false;
+      const uint16_t id    = rep_r16(repDue + 4);
+      const uint8_t  flags = rep_at(repDue + 6);
+      const uint8_t  len   = rep_at(repDue + 7);
+      if(id == 0xFFFF || len > 64) { repEnd = true; break; }                                // Erased flash: end of the capture
+      if(loaded < CAP_REC(len)) return false;
+
+      if(flags & CAP_EPOCH) { repEpoch = rep_r32(repDue + 8); repDue += CAP_REC(len); continue; }
+
+      const uint64_t us = (uint64_t)repEpoch << 32 | rep_r32(repDue);
+      if(!repFirst) { repStart = us; repFirst = true; }
+      if(repSpeed && us - repStart > now) break;                                            // Not yet
+      if(!repSpeed && repDepth >= REP_FIFO) break;                                          // As fast as possible: wait for room
+
+      if(!rep_callback(id))         repStats.filtered++;
+      else if(repDepth >= REP_FIFO) repStats.drops++;
+      else
+        {
+          RepFrame* f = &repFifo[repFifoHead];
+          f->id    = id;
+          f->flags = flags;
+          f->len   = len;
+          for(uint8_t i = 0; i < len; i++) f->data[i] = rep_at(repDue + 8 + i);
+          if(++repFifoHead == REP_FIFO) repFifoHead = 0;
+          if(++repDepth > repStats.peak) repStats.peak = repDepth;
+        }
+      repDue += CAP_REC(len);
+      repStats.frames++;
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// rep_dispatch: Frames of the FIFO to the callbacks, B of them or REP_BUDGET_US worth
+//----------------------------------------------------------------------------------------
+static void rep_dispatch(uint32_t t0)
+{
+  const uint32_t budget = (SystemCoreClock / 1000000) * REP_BUDGET_US;
+  uint16_t n = 0;
+  while(repDepth)
+    {
+      if(repSpeed ? n >= repBurst : DWT->CYCCNT - t0 >= budget) break;
+      const RepFrame* f = &repFifo[(repFifoHead + REP_FIFO - repDepth) % REP_FIFO];         // Oldest
+      CANFDMessage message;
+      message.id   = f->id;
+      message.ext  = false;
+      message.len  = f->len;
+      message.type = CANFDMessage::CAN_DATA;
+      if(f->flags & CAP_FD) message.type = (f->flags & CAP_BRS) ? CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH : CANFDMessage::CANFD_NO_BIT_RATE_SWITCH;
+      memcpy(message.data, f->data, f->len);
+
+      const FilterCallback callback = rep_callback(message.id);
+      const uint32_t h0 = DWT->CYCCNT;
+      if(callback) callback(message);
+      const uint32_t cycles = DWT->CYCCNT - h0;
+      repStats.handlerCycles += cycles;
+      if(cycles > repStats.handlerMax) repStats.handlerMax = cycles;
+      repStats.dispatched++;
+      repDepth--;
+      n++;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// rep_tick: Called every 1 ms from TCC2_0_Handler instead of the bus dispatch
+//----------------------------------------------------------------------------------------
+void rep_tick(void)
+{
+  if(repState != REP_RUNNING) return;
+  const uint32_t t0 = DWT->CYCCNT;
+  repTicks++;
+  if(!rep_arrive()) repStats.starved++;
+  rep_dispatch(t0);
+
+  for(uint8_t p = 0; p < TXQ_LEVELS; p++)
+    if(txRing[p].count > repStats.txPeak) repStats.txPeak = txRing[p].count;
+  const uint32_t cycles = DWT->CYCCNT - t0;
+  if(cycles > repStats.tickMax) repStats.tickMax = cycles;
+  if(repEnd && !repDepth) repState = REP_DONE;
+}
+
+//----------------------------------------------------------------------------------------
+// rep_load: Next piece of the trace into repRing, when there is room and the flash is idle
+//----------------------------------------------------------------------------------------
+static void rep_load(void)
+{
+  if(repEnd || repAddr >= CAP_END) return;
+  const uint32_t pos = repHead & (REP_RAM - 1);
+  uint32_t n = REP_RAM - (repHead - repDue);
+  if(n > REP_CHUNK)          n = REP_CHUNK;
+  if(n > REP_RAM - pos)      n = REP_RAM - pos;                                             // Up to the wrap, the rest next pass
+  if(n > CAP_END - repAddr)  n = CAP_END - repAddr;
+  if(n == 0) return;
+
+  bool busy = false;
+  ATOMIC() busy = flash.readStatus() & ERASE_WIP;
+  if(busy || flash.readBuffer(repAddr, &repRing[pos], n) != n) return;
+  repAddr += n;
+  repHead += n;
+}
+
+//----------------------------------------------------------------------------------------
+// rep_begin: Reset for a run at this speed, the task loads then starts it
+//----------------------------------------------------------------------------------------
+static void rep_begin(uint8_t speed)
+{
+  memset(&repStats, 0, sizeof(repStats));
+  repStats.txDropped = txStats.dropped;
+  repStats.txExpired = txStats.expired;
+  repHead = repDue = 0;
+  repEnd   = false;
+  repAddr  = CAP_START + CAP_PAGE;
+  repEpoch = repHeader.epoch;
+  repFirst = false;
+  repFifoHead = 0;
+  repDepth = 0;
+  repTicks = 0;
+  repSpeed = speed;
+  repState = REP_LOADING;
+}
+
+//----------------------------------------------------------------------------------------
+// rep_report: One line per run
+//----------------------------------------------------------------------------------------
+static void rep_report(void)
+{
+  if(!repIde) return;
+  const uint32_t perUs = SystemCoreClock / 1000000;
+  const RepStats* s = &repStats;
+  if(repSpeed) { Serial.print(F("SPEED ")); Serial.print(repSpeed); Serial.print(F("x")); }
+  else Serial.print(F("SPEED MAX"));
+  Serial.print(F("  FRAMES: "));   Serial.print(s->frames);
+  Serial.print(F("  DISPATCHED: ")); Serial.print(s->dispatched);
+  Serial.print(F("  DROPS: "));    Serial.print(s->drops);
+  Serial.print(F("  NO FILTER: ")); Serial.print(s->filtered);
+  Serial.print(F("  FIFO PEAK: ")); Serial.print(s->peak); Serial.print('/'); Serial.println(REP_FIFO);
+  Serial.print(F("  FRAMES/S: ")); Serial.print(repTicks ? (uint32_t)((uint64_t)s->dispatched * 1000 / repTicks) : 0);
+  Serial.print(F("  HANDLER us MEAN: ")); Serial.print(s->dispatched ? (uint32_t)(s->handlerCycles / s->dispatched / perUs) : 0);
+  Serial.print(F(" MAX: "));       Serial.print(s->handlerMax / perUs);
+  Serial.print(F("  TICK MAX us: ")); Serial.print(s->tickMax / perUs);
+  Serial.print(F("  TX PEAK: "));  Serial.print(s->txPeak); Serial.print('/'); Serial.print(TXQ_DEPTH);
+  Serial.print(F("  TX DROPPED: ")); Serial.print(txStats.dropped - s->txDropped);
+  Serial.print(F("  EXPIRED: "));  Serial.print(txStats.expired - s->txExpired);
+  Serial.print(F("  STARVED: "));  Serial.println(s->starved);
+}
+
+//----------------------------------------------------------------------------------------
+// repTask: Loader, and the report when the tick is done. Next speed of a sweep.
+//----------------------------------------------------------------------------------------
+uint8_t repTask(Task*)
+{
+  if(repState == REP_OFF) { IDE = repIde; return TASK_DONE; }                               // Stopped by M 6
+
+  if(repState == REP_DONE)
+    {
+      rep_report();
+      if(repSweep && repSweep < REP_SWEEP) rep_begin(repSpeeds[repSweep++]);
+      else
+        {
+          repState = REP_OFF;
+          IDE = repIde;
+          return TASK_DONE;
+        }
+    }
+
+  rep_load();
+  if(repState == REP_LOADING && (repHead == REP_RAM || repAddr >= CAP_END))
+    repState = REP_RUNNING;                                                                 // Ring full before the first tick
+  return TASK_WAITING;
+}
+
+//----------------------------------------------------------------------------------------
+// rep_command: Serial command M 6 (run) and M 7 (sweep), any M while it runs stops it
+//----------------------------------------------------------------------------------------
+void rep_command(uint8_t mode, uint8_t a, uint8_t b)
+{
+  if(repState != REP_OFF)
+    {
+      repState = REP_OFF;                                                                   // Tick idle now, repTask restores IDE
+      if(repIde) Serial.println(F("REPLAY        STOPPED"));
+      return;
+    }
+  if(mode != 6 && mode != 7) return;
+
+  if(gwOn || MONITOR_FLAG || capState != CAP_OFF || eraseJob.active || task_running(repTask))
+    {
+      if(IDE) Serial.println(F("REPLAY REFUSED (MONITOR, GATEWAY OR QSPI ERASE ON)"));
+      return;
+    }
+  if(!flash.readBuffer(CAP_START, (uint8_t*)&repHeader, sizeof(repHeader)) || repHeader.magic != CAP_MAGIC)
+    {
+      if(IDE) Serial.println(F("NO CAPTURE IN QSPI"));
+      return;
+    }
+
+  const uint8_t burst = (mode == 6) ? b : a;
+  repBurst = burst ? burst : 1;
+  repSweep = (mode == 7) ? 1 : 0;
+  rep_begin(mode == 7 ? repSpeeds[0] : a);
+  if(!task_start(repTask, nullptr, "REPLAY")) { repState = REP_OFF; return; }
+
+  if(IDE)
+    {
+      Serial.print(F("REPLAY        "));
+      Serial.print(repSweep ? F("SWEEP") : F("RUN"));
+      Serial.print(F(", ")); Serial.print(repBurst); Serial.println(F(" FRAME(S) PER TICK, M STOPS"));
+    }
+  repIde = IDE;
+  IDE = false;                                                                              // Handlers quiet, only the report lines
+}
@@ -3,66 +3,6 @@
 
 #include "qif.h"
 
-// CRC64_ECMA-182 computation
-// Optimized for slice-by-8 algorithm (processes 8 bytes per iteration)
-//
-
-// Function prototypes
-void crc64_stream_init(crc64_stream* ctx, uint64_t initial_crc);
-void crc64_stream_update(crc64_stream* ctx, const uint8_t* data, size_t length);
-uint64_t crc64_stream_finalize(crc64_stream* ctx); 
-
-
-// Initialize streaming CRC
-void crc64_stream_init(crc64_stream* ctx, uint64_t initial_crc)
-  {
-    ctx->crc = ~initial_crc;
-    ctx->buffer_count = 0;
-  }
-
-// Process a chunk of data (can be called multiple times)
-void crc64_stream_update(crc64_stream* ctx, const uint8_t* data, size_t length)
-  {
-// Process any bytes left in buffer + new data to make 8-byte chunks
-    while(length > 0)
-      {
-        size_t copy_len = 8 - ctx->buffer_count;
-        if(copy_len > length) copy_len = length;       
-        memcpy(ctx->buffer + ctx->buffer_count, data, copy_len);
-        ctx->buffer_count += copy_len;
-        data += copy_len;
-        length -= copy_len;
-        
-// Process full 8-byte chunks immediately
-        if(ctx->buffer_count == 8)
-          {
-            uint64_t word;
-            memcpy(&word, ctx->buffer, 8);
-            ctx->crc ^= word;
-            ctx->crc = crc64_table[(ctx->crc >>  0) & 0xFF] ^
-                      crc64_table[(ctx->crc >>  8) & 0xFF] ^
-                      crc64_table[(ctx->crc >> 16) & 0xFF] ^
-                      crc64_table[(ctx->crc >> 24) & 0xFF] ^
-                      crc64_table[(ctx->crc >> 32) & 0xFF] ^
-                      crc64_table[(ctx->crc >> 40) & 0xFF] ^
-                      crc64_table[(ctx->crc >> 48) & 0xFF] ^
-                      crc64_table[(ctx->crc >> 56) & 0xFF];
-            ctx->buffer_count = 0;
-          }
-      }
-  }
-
-// Finalize CRC (process remaining bytes and return result)
-uint64_t crc64_stream_finalize(crc64_stream* ctx)
-  {
-// Process remaining bytes
-    for(size_t i = 0; i < ctx->buffer_count; i++)
-      {
-        ctx->crc = (ctx->crc >> 8) ^ crc64_table[(ctx->crc ^ ctx->buffer[i]) & 0xFF];
-      }
-    return ~ctx->crc;
-  }
-
 //----------------------------------------------------------------------------------------
 // CRC64-ECMA computation (bitwise implementation)
 void crc64_reset(CRC64 *ctx) { ctx->crc = 0xFFFFFFFFFFFFFFFFULL; }                                // CRC64-ECMA computation (bitwise implementation)
@@ -107,8 +47,33 @@ void Help()
         Serial.println(F("Q (XXX)       QSPI MEMORY DUMP (BLOCK)"));
         Serial.println(F("D (XXX)       FLASH MEMORY DUMP (BLOCK)"));
         Serial.println(F("M TOGGLED     START/STOP MONITOR MODE"));
+        Serial.println(F("M 1           USB GATEWAY, BINARY (tools/qifgw.py)"));
+        Serial.println(F("M 2 / M 3     CAPTURE STATUS / EXPORT AS CANDUMP LOG (tools/qifcap.py)"));
+        Serial.println(F("M 4 (D D D)   CAPTURE TRIGGER (ID HIGH, ID LOW, KB BEFORE), M 4 = NONE"));
+        Serial.println(F("M 5           CAPTURE TRIGGER NOW"));
+        Serial.println(F("M 6 (D D)     REPLAY CAPTURE (SPEED, 0 = MAX; FRAMES PER TICK), M STOPS"));
+        Serial.println(F("M 7 (D)       REPLAY SWEEP 1x..128x, MAX (FRAMES PER TICK)"));
         Serial.println(F("P (D D D D)   PWM MSG (LBL CHANNEL VALUE DIRECTION)"));
         Serial.println(F("S (D D D)     SEND MSG (LBL SUB VALUE)"));
+        Serial.println(F("C             CAN TX QUEUE STATISTICS"));
+        Serial.println(F("W (D D D)     SCENE ALL CHANNELS (LBL VALUE DIRECTION)"));
+        Serial.println(F("K (D D D)     GROUP SCENE (GROUP VALUE DIRECTION)"));
+        Serial.println(F("Y             RPC STATISTICS"));
+        Serial.println(F("O (D)         BME688 ASK ALL BOARDS (TYPE)"));
+        Serial.println(F("N (D)         STATE SNAPSHOT (LABEL, 0 = ALL)"));
+        Serial.println(F("E (D)         BME TELEMETRY PERIOD (SECONDS, 0 = ON CHANGE)"));
+        Serial.println(F("L             TELEMETRY CACHE DUMP"));
+        Serial.println(F("L 1 / L 2     BSEC STATE STATUS / SAVE NOW"));
+        Serial.println(F("Z (D D D)     HISTORY QUERY (LABEL QTY HOURS)"));
+        Serial.println(F("J (D D D D)   HISTORY FROM BOARD (BOARD LABEL QTY HOURS)"));
+        Serial.println(F("G             TIMER AND TASK STATISTICS"));
+        Serial.println(F("G 1 / G 2     HANDLER PROFILER REPORT / RESET"));
+        Serial.println(F("G 3 (D)       HANDLER PROFILER OF A BOARD (LABEL)"));
+        Serial.println(F("G 4           RAM BUDGET: ARENA, HEAP, STACK PEAK"));
+        Serial.println(F("G 5           BOOT TIMELINE"));
+        Serial.println(F("G 6           BENCHMARK SUITE, JSON"));
+        Serial.println(F("V             FLASH VERIFY BENCHMARK (BYTES / CRC MAPS)"));
+        Serial.println(F("X (D D D)     BINARY READ-OUT (0 QSPI 1 FLASH, FIRST 64K, COUNT), tools/qifread.py"));
         Serial.println();
       }
     DELAY(5000);                                                       
@@ -260,6 +225,8 @@ void processHLP() { Help(); }
 void processI2C() { ScanI2C(); }                                                                   // Scan I2C bus
 void processTIM() { TimeSend(); }                                                                  // Broadcast time
 void processFLT() { filterManager_dump(&filterManager); }                                          // Dump active filter
+void processTXS() { txqueue_stats(); }                                                             // Print CAN transmit queue counters
+void processRPS() { rpc_stats(); }                                                                 // Print RPC counters and latency
 void processRST(const uint8_t label) { Reboot(label); }                                            // Reboot selected board
 void processUPD(const uint8_t label) { QSPI2CAN(label); }                                          // Send update to board label                                 
 void processBME(const uint8_t label, uint8_t info) { requestBME(info, label); }                    // Ask for BME688 value from label
@@ -268,6 +235,31 @@ void processQSP(const uint8_t block) { DumpQSPI(block); }
 void processDMP(const uint8_t block) { dumpInternalFlash(block); }                                 // Dump FLASH block
 void processSND(const uint8_t label, uint8_t subaddr, uint8_t value) { SendCan(label, subaddr, value); }
 void processPWM(const uint8_t label, uint8_t subaddr, uint8_t value, uint8_t direction) { SendPwm(label, subaddr, value, direction != 0); }
+void processSCN(const uint8_t label, uint8_t value, uint8_t direction) { SendScene(label, value, direction != 0); }
+void processGRP(const uint8_t group, uint8_t value, uint8_t direction) { SendGroup(group, value, direction != 0); }
+void processPOL(const uint8_t info) { rpc_poll_all(RPC_BME, info ? info : BMETEMP); }              // Ask every board for a BME688 value
+void processSNP(const uint8_t label) { requestSnapshot(label); }                                   // Read the state of one or every board
+void processTLC(const uint8_t mode)                                                                 // Print telemetry cache, 1 = BSEC state, 2 = save it now
+  {
+    if(mode == 1) bst_print();
+    else if(mode == 2) { if(IDE) Serial.println(bst_save(BST_COMMAND) ? F("BSEC STATE    SAVED") : F("BSEC STATE    NOT SAVED")); }
+    else tlm_dump();
+  }
+void processTMS(const uint8_t mode, uint8_t label)                                                // Timer and task counters, 1 / 2 = profiler, 3 = profiler of a board, 4 = RAM, 5 = boot, 6 = benchmark
+  {
+    if(mode == 1) prof_print();
+    else if(mode == 4) ram_print();
+    else if(mode == 5) boot_print();
+    else if(mode == 6) bench_run();
+    else if(mode == 2) { prof_reset(); if(IDE) Serial.println(F("PROFILER      RESET")); }
+    else if(mode == 3) requestProfile(label);
+    else { timer_print(); sched_print(); }
+  }
+void processCRB() { crc_bench(); }                                                                 // Time flash verification methods
+void processBLK(const uint8_t source, uint8_t first, uint8_t count) { bulk_read(source, first, count); }
+void processTSQ(const uint8_t label, uint8_t qty, uint16_t hours) { tsdb_local(label, qty, hours); }
+void processTSR(const uint8_t board, uint8_t label, uint8_t qty, uint16_t hours) { tsdb_remote(board, label, qty, hours); }
+void processTLP(const uint16_t seconds) { bme_period(seconds); }                                   // BME telemetry publish period
 
 //----------------------------------------------------------------------------------------
 
@@ -296,7 +288,9 @@ void SendCan(uint8_t label, uint8_t subaddr, uint8_t value)
     msg.id = can_id;                                                                                // Prepare message
     msg.len = 1;                                                                                    // Set length to 8 bytes
     msg.data[0] = value;                                                                            // Set the last byte to value
-    sendCANFDFrame(msg.data, msg.len, msg.id);  
+    uint8_t prio = TXQ_NORMAL;                                                                      // LED commands are steps (events)
+    if(DB[label].TYPE != SWITCH && subaddr <= 0x08) prio |= TXQ_STATE;                              // PWM duty and power control are levels
+    sendCANFDFrame(msg.data, msg.len, msg.id, prio);  
   }
 
 void SendPwm(uint8_t label, uint8_t channel, uint8_t value, bool direction)
@@ -325,7 +319,44 @@ void SendPwm(uint8_t label, uint8_t channel, uint8_t value, bool direction)
     msg.len = 2;                                                                                    // Set length to 2 bytes
     msg.data[0] = value;                                                                            // Set the last byte to value
     msg.data[1] = direction; 
-    sendCANFDFrame(msg.data, msg.len, msg.id);  
+    sendCANFDFrame(msg.data, msg.len, msg.id, TXQ_NORMAL | TXQ_STATE);                              // Last level wins
+  }
+
+//----------------------------------------------------------------------------------------
+// SendScene: Set every PWM channel of a board to the same value with one batch frame
+// instead of one frame per channel.
+void SendScene(uint8_t label, uint8_t value, bool direction)
+  {
+    Batch batch;
+
+    if(label >= DB_count || value > 100 || DB[label].TYPE == UNDEF)                                // Basic argument validation
+      {
+        if(IDE) Serial.println(F("Invalid Argument"));
+        return;
+      }
+
+    const uint8_t channels = (DB[label].TYPE == MPOWER || DB[label].TYPE == HPOWER) ? 6 : PWM_CHANNELS;
+    batch_begin(&batch, Lbl2Can(label) + ctl);
+    for(uint8_t ch = 0; ch < channels; ch++) batch_pwm(&batch, ch, value, direction);
+    batch_send(&batch);
+  }
+
+//----------------------------------------------------------------------------------------
+// SendGroup: One batch frame on a group ID, every subscriber sets the channels of
+// its mask to the value (channel 0xF = all channels of the mask).
+void SendGroup(uint8_t group, uint8_t value, bool direction)
+  {
+    Batch batch;
+
+    if(group >= GRP_COUNT || value > 100)                                                           // Basic argument validation
+      {
+        if(IDE) Serial.println(F("Invalid Argument"));
+        return;
+      }
+
+    batch_begin(&batch, GRP(group));
+    batch_pwm(&batch, 0x0F, value, direction);
+    batch_send(&batch);
   }
 
 //----------------------------------------------------------------------------------------
@@ -342,7 +373,13 @@ void SendPwm(uint8_t label, uint8_t channel, uint8_t value, bool direction)
 // - MonitorFilter(bool on)
 // - filterManager : the global CAN filter manager instance
 //
-void processMNT() { Monitor(); }                                                                    // Set monitor mode
+void processMNT(const uint8_t mode, uint8_t a, uint8_t b, uint8_t c)                               // Monitor / capture, 1 = USB gateway, 6 / 7 = replay
+  {
+    if(repState != REP_OFF || mode >= 6) rep_command(mode, a, b);
+    else if(mode == 1) gw_start();
+    else if(mode) cap_command(mode, a, b, c);
+    else Monitor();
+  }
 
 //----------------------------------------------------------------------------------------
 // Execute the current state with its argument
@@ -354,7 +391,9 @@ void handlestate()
         case I2C: { processI2C();                       break; }
         case TIM: { processTIM();                       break; }
         case FLT: { processFLT();                       break; }
-        case MNT: { processMNT();                       break; }
+        case TXS: { processTXS();                       break; }
+        case RPS: { processRPS();                       break; }
+        case MNT: { processMNT(Value, Value1, Value2, Value3);  break; }
         case UPD: { processUPD(Value);                  break; }
         case RST: { processRST(Value);                  break; }
         case BMX: { processBME(Value,Value1);           break; }
@@ -363,6 +402,17 @@ void handlestate()
         case DMP: { processDMP(Value);                  break; }
         case SND: { processSND(Value, Value1, Value2);  break; }
         case MLI: { processPWM(Value, Value1, Value2, Value3);  break; }
+        case SCN: { processSCN(Value, Value1, Value2);  break; }
+        case GRS: { processGRP(Value, Value1, Value2);  break; }
+        case POL: { processPOL(Value);                  break; }
+        case SNP: { processSNP(Value);                  break; }
+        case TLP: { processTLP(Value);                  break; }
+        case TLC: { processTLC(Value);                  break; }
+        case TSQ: { processTSQ(Value, Value1, Value2);  break; }
+        case TSR: { processTSR(Value, Value1, Value2, Value3);  break; }
+        case TMS: { processTMS(Value, Value1);          break; }
+        case CRB: { processCRB();                       break; }
+        case BLK: { processBLK(Value, Value1, Value2);  break; }
         default:
         break;
       } 
@@ -377,6 +427,8 @@ void processchar(const uint8_t c)
   static char currentState = 0;
   static bool argStarted = false;
 
+  if(gwOn) { gw_input(c); return; }                                                         // Binary records, not commands (gateway.h)
+
   if (isdigit(c))
   {
     uint8_t digit = c - '0';
@@ -416,6 +468,19 @@ void processchar(const uint8_t c)
       case 'M': State = MNT;  break;
       case 'S': State = SND;  break;
       case 'P': State = MLI;  break;
+      case 'C': State = TXS;  break;
+      case 'W': State = SCN;  break;
+      case 'K': State = GRS;  break;
+      case 'Y': State = RPS;  break;
+      case 'O': State = POL;  break;
+      case 'N': State = SNP;  break;
+      case 'E': State = TLP;  break;
+      case 'L': State = TLC;  break;
+      case 'Z': State = TSQ;  break;
+      case 'J': State = TSR;  break;
+      case 'G': State = TMS;  break;
+      case 'V': State = CRB;  break;
+      case 'X': State = BLK;  break;
       default:  State = NONE; break;
     }
 
@@ -443,8 +508,9 @@ void processchar(const uint8_t c)
 /*
 Check the status of the BME688 sensor and handle errors or warnings.
 This function checks the status codes of the IAQ sensor (both BSEC and BME68X).
-If there are any errors or warnings, it updates the output string with the
-corresponding message, prints it to the Serial Monitor if the IDE flag is set,
+If there are any errors or warnings, it prints the corresponding message with
+its code to the Serial Monitor if the IDE flag is set (no String, the heap is
+sealed after setup, arena.h),
 and sets the LED strip to orange to indicate a failure or warning.
 The function distinguishes between errors and warnings based on the status code
 values: Errors have negative status codes, while warnings have positive status codes.
@@ -455,14 +521,12 @@ void checkIaqSensorStatus(void)
       {
         if(iaqSensor.bsecStatus < BSEC_OK)
           {
-            output = "BSEC error code : " + String(iaqSensor.bsecStatus);
-            if(IDE) Serial.println(output);
+            if(IDE) { Serial.print(F("BSEC error code : ")); Serial.println(iaqSensor.bsecStatus); }
             BLINK(ORANGE);                                                                 // Failure                  
           }
         else
           {
-            output = "BSEC warning code : " + String(iaqSensor.bsecStatus);
-            if(IDE) Serial.println(output);
+            if(IDE) { Serial.print(F("BSEC warning code : ")); Serial.println(iaqSensor.bsecStatus); }
             BLINK(ORANGE);                  
           }
       }
@@ -471,14 +535,12 @@ void checkIaqSensorStatus(void)
       {
         if(iaqSensor.bme68xStatus < BME68X_OK)
           {
-            output = "BME68X error code : " + String(iaqSensor.bme68xStatus);
-            if(IDE) Serial.println(output);
+            if(IDE) { Serial.print(F("BME68X error code : ")); Serial.println(iaqSensor.bme68xStatus); }
             BLINK(ORANGE);                                                                 // Failure                  
           }
         else
           {
-            output = "BME68X warning code : " + String(iaqSensor.bme68xStatus);
-            if(IDE)Serial.println(output);
+            if(IDE) { Serial.print(F("BME68X warning code : ")); Serial.println(iaqSensor.bme68xStatus); }
             BLINK(ORANGE);                  
           }
       }
@@ -498,22 +560,8 @@ return true if new data is available and processed, false otherwise.
 */
 boolean readBME()
   {
-    if(iaqSensor.run())
+    if(sampleBME())
       {
-        BLINK(YELLOW);                                                                          // New data is available                  
-
-        ATOMIC() LOCK = true;
-
-        BME.co2 = iaqSensor.co2Equivalent;
-        BME.voc = iaqSensor.breathVocEquivalent;
-        BME.pressure = iaqSensor.pressure / 100;
-        BME.temperature = iaqSensor.temperature;
-        BME.humidity = iaqSensor.rawHumidity;
-        BME.gas = iaqSensor.gasPercentage;
-        BME.iaq = iaqSensor.iaq;
-
-        ATOMIC() LOCK = false;
-
         if(IDE)
           {
             Serial.println("LOCAL BME");
@@ -535,44 +583,86 @@ boolean readBME()
           }
         return true;
       }
-    else
+    return false;
+  }
+
+// sampleBME: Run BSEC and store a new reading in BME, silent. false if no new data.
+boolean sampleBME()
+  {
+    if(!iaqSensor.run())
       {
         checkIaqSensorStatus();
         return false;
       }
+
+    BLINK(YELLOW);                                                                              // New data is available                  
+
+    ATOMIC() LOCK = true;
+
+    BME.co2 = iaqSensor.co2Equivalent;
+    BME.voc = iaqSensor.breathVocEquivalent;
+    BME.pressure = iaqSensor.pressure / 100;
+    BME.temperature = iaqSensor.temperature;
+    BME.humidity = iaqSensor.rawHumidity;
+    BME.gas = iaqSensor.gasPercentage;
+    BME.iaq = iaqSensor.iaq;
+    BME.status = ((uint8_t)iaqSensor.iaqAccuracy & TLM_ACCURACY)
+               | (iaqSensor.stabStatus  ? TLM_STAB  : 0)
+               | (iaqSensor.runInStatus ? TLM_RUNIN : 0);
+
+    ATOMIC() LOCK = false;
+    return true;
   }
 
 void requestBME(uint8_t type, uint8_t label)
   {
-    CANFDMessage msg;
     if(label > 127 || type > 36 || type < 30)                                                 // Argument validation
       {
         if(IDE)Serial.println(F("Invalid Argument"));
         return;                                          
       }
-
-    msg.id = Lbl2Can(label);                                                                    
-    msg.id += Bme;
-    msg.len = 2;                                                                              // info + target
-    msg.data[0] = type;
-    msg.data[1] = LABEL;                               
-    sendCANFDFrame(msg.data, msg.len, msg.id); 
+    if(!rpc_call(label, RPC_BME, &type, 1, rpc_print) && IDE)                                 // Response printed by rpc_print
+      Serial.println(F("RPC call refused"));
   }
 
 void requestANA(uint8_t label, uint8_t channel)
   {
-    CANFDMessage msg;
     if(label > 127 || channel > 3)                                                            // Argument validation
       {
         if(IDE)Serial.println(F("Invalid Argument"));
         return;                                          
       }
-    msg.id = Lbl2Can(label);                                                                    
-    msg.id += Anl;
-    msg.id += channel;
-    msg.len = 1;                                                                              // Channel
-    msg.data[0] = channel;                           
-    sendCANFDFrame(msg.data, msg.len, msg.id); 
+    if(!rpc_call(label, RPC_ANA, &channel, 1, rpc_print) && IDE)                              // Response printed by rpc_print
+      Serial.println(F("RPC call refused"));
+  }
+
+// One call per probe, all in flight at once, printed as they come by rpc_print
+void requestProfile(uint8_t label)
+  {
+    if(label > 127)                                                                           // Argument validation
+      {
+        if(IDE)Serial.println(F("Invalid Argument"));
+        return;
+      }
+    for(uint8_t id = 0; id < PROF_IDS; id++)
+      if(!rpc_call(label, RPC_PROF, &id, 1, rpc_print, 500))
+        {
+          if(IDE) Serial.println(F("RPC call refused"));
+          return;
+        }
+  }
+
+// Label 0 (never a board) sweeps every defined board, all calls in flight at once
+void requestSnapshot(uint8_t label)
+  {
+    if(label == 0) { rpc_poll_all(RPC_SNAP, 0); return; }
+    if(label > 127)                                                                           // Argument validation
+      {
+        if(IDE)Serial.println(F("Invalid Argument"));
+        return;                                          
+      }
+    if(!rpc_call(label, RPC_SNAP, nullptr, 0, rpc_print) && IDE)                              // Response printed by rpc_print
+      Serial.println(F("RPC call refused"));
   }
 
 //----------------------------------------------------------------------------------------
@@ -598,50 +688,49 @@ bool sendBME(uint8_t type, uint8_t target)
   CANFDMessage msg;
   BMEData hex;                                                                              // Union to convert float to byte array
 
-  const uint8_t info[]  = { BMETEMP, BMEPRESS, BMEHUMID, BMEGAZ, BMEIAQ, BMEVOC, BMECO2 };
-  const float   values[] = { BME.temperature, BME.pressure, BME.humidity,BME.gas, BME.iaq, BME.voc, BME.co2 };
-
   if (!BME_FLAG) return false;                                                              // Abort if no BME onboard
-
-  uint8_t index = type - BMETEMP;                                                           // Map type (30–36) to array index (0–6)
-  const uint8_t maxIndex = sizeof(values) / sizeof(values[0]);                              // Invalid access if type is not recognized
-  if (index >= maxIndex) return false;
+  if (!bmeValue(type, &hex.value)) return false;                                            // Invalid access if type is not recognized
   // Compose CAN FD message
   msg.id = Lbl2Can(target) + Bme;                                                           // Address + BME offset
   msg.len = 6;                                                                              // 1 type + 4 float + 1 label
-  hex.value = values[index];                                                                // Convert float to byte array
   msg.data[0] = type;                                                                       // Measurement type (enum)
   memcpy(&msg.data[1], hex.bytes, 4);                                                       // Float bytes
   msg.data[5] = LABEL;                                                                      // Sender label
 
-  if (!sendCANFDFrame(msg.data, msg.len, msg.id)) return false;
-  DELAY(1);                                                                                 // Pacing delay
-  return true;
+  return sendCANFDFrame(msg.data, msg.len, msg.id, TXQ_LOW);                                // Telemetry, queue paces the frames
 }
 
-
 //----------------------------------------------------------------------------------------
-// Function to send a CAN FD frame (up to 64 bytes)
+// bmeValue: Last BME688 output for a measurement type (BMETEMP–BMECO2).
+// Returns false if the type is not recognized.
+//----------------------------------------------------------------------------------------
+bool bmeValue(uint8_t type, float* value)
+{
+  const float values[] = { BME.temperature, BME.pressure, BME.humidity,BME.gas, BME.iaq, BME.voc, BME.co2 };
+
+  uint8_t index = type - BMETEMP;                                                           // Map type (30–36) to array index (0–6)
+  const uint8_t maxIndex = sizeof(values) / sizeof(values[0]);
+  if (index >= maxIndex) return false;
+  *value = values[index];
+  return true;
+}
 
-#define kTryToSendReturnStatusFD_OK                     0                                   // tryToSendReturnStatusFD return code
-#define kTryToSendReturnStatusFD_TooLong                1
-#define kTryToSendReturnStatusFD_InvalidBitRateSwitch   2
-#define kTryToSendReturnStatusFD_InvalidFormat          3
-#define kTryToSendReturnStatusFD_InvalidLength          4
-#define kTryToSendReturnStatusFD_TxFifoFull             5
 
 //========================================================================================
-// sendCANFDFrame: Sends a CAN FD frame with retry logic.
+// sendCANFDFrame: Queues a CAN FD frame for transmission (see txqueue.ino).
 //
-// This function constructs a CAN FD frame and attempts to transmit it using the
-// ACANFD_FeatherM4CAN driver. It retries up to 10 times on any transmission failure,
-// including cases such as FIFO full, invalid format, or length issues. Each error is
-// reported after the final failed attempt if debugging is enabled (IDE = true).
+// The frame is copied into the transmit queue of the given priority and the function
+// returns at once. It never waits for room in the controller: retries are done by
+// txqueue_pump() from the 1 ms tick, failures are counted in txStats.
 //
 // Parameters:
 //   - data: Pointer to the data buffer (max 64 bytes, actual length defined by `len`)
 //   - len : Payload length (must be <= 64, valid CAN FD payload size)
 //   - id  : 11-bit standard CAN ID (0x000 to 0x7FF)
+//   - prio: TXQ_HIGH, TXQ_NORMAL (default) or TXQ_LOW
+//
+// Returns:
+//   - true if queued, false if the queue is full or monitor mode is on
 //
 // Note:
 //   - Requires the CAN controller to be initialized and started (CAN_Setup()).
@@ -649,88 +738,13 @@ bool sendBME(uint8_t type, uint8_t target)
 //
 //========================================================================================
 
-bool sendCANFDFrame(const uint8_t* data, uint8_t len, uint16_t id)
+bool sendCANFDFrame(const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio)
 {
-  if(MONITOR_FLAG) return false;                                                          // Do not send anything while in monitor mode
-  CANFDMessage frame;                                                                     // Frame to be transmitted
-  uint8_t status;                                                                         // Status returned by tryToSendReturnStatusFD
-  uint8_t attempt = 0;                                                                    // Retry counter
-
-  //-------------------------------
-  // Prepare CAN FD frame
-  //-------------------------------
-  frame.id = id;                                                                          // Standard 11-bit CAN ID
-  frame.ext = false;                                                                      // Use standard frame format (not extended)
-  frame.len = len;                                                                        // Set payload length
-  frame.type = CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH;                                  // Enable CAN FD with bit rate switch
-  frame.idx = 0;                                                                          // Use default TX FIFO index
-
-  // Copy data into frame payload
-  for (uint8_t i = 0; i < len; i++) {
-    frame.data[i] = data[i];
-  }
+  DLOG_DATA(DLOG_TX_FRAME, data, len, id, len);                            // Frame content, printed later by dlogTask
 
-  //-------------------------------
-  // Debug: Print frame content
-  //-------------------------------
-  if (IDE) {
-    Serial.print(F("SENDING CANFD FRAME - ID: 0x"));
-    Serial.print(id, HEX);
-    Serial.print(F(" LEN: "));
-    Serial.print(len);
-    Serial.print(F(" DATA: "));
-    for (uint8_t i = 0; i < len; i++) {
-      if (data[i] < 0x10) Serial.print('0');
-      Serial.print(data[i], HEX);
-      Serial.print(' ');
-    }
-    Serial.println();
-  }
+  if (canSend(data, len, id, prio) != 0) return true;                     // Queued, the pump does the rest
 
-  //-------------------------------
-  // Attempt to send (up to 10 times)
-  //-------------------------------
-  do {
-    status = can1.tryToSendReturnStatusFD(frame);                         // Attempt transmission
-    if (status == kTryToSendReturnStatusFD_OK) {
-      BLINK(GREEN);
-      return true;                                                        // Success: exit early
-    }
-    attempt++;                                                            // Count failed attempt
-    DELAY(random(1, 11));                                                 // Random delay between 1 and 10 ms before retry
-  } while (attempt < 10);                                                 // Limit to 10 tries
-  BLINK(RED);
-  //-------------------------------
-  // If still failed after retries, print error
-  //-------------------------------
-  if (IDE) {
-    Serial.print(F("CAN FD send failed after "));
-    Serial.print(attempt);
-    Serial.print(F(" attempt(s)! Error code: "));
-    Serial.print(status);
-    Serial.print(F(" → "));
-
-    switch (status) {
-      case kTryToSendReturnStatusFD_TooLong:
-        Serial.println(F("Frame too long"));
-        break;
-      case kTryToSendReturnStatusFD_InvalidBitRateSwitch:
-        Serial.println(F("Invalid bit rate switch usage"));
-        break;
-      case kTryToSendReturnStatusFD_InvalidFormat:
-        Serial.println(F("Invalid frame format"));
-        break;
-      case kTryToSendReturnStatusFD_InvalidLength:
-        Serial.println(F("Invalid payload length"));
-        break;
-      case kTryToSendReturnStatusFD_TxFifoFull:
-        Serial.println(F("Transmit FIFO full"));
-        break;
-      default:
-        Serial.println(F("Unknown error"));
-        break;
-    }
-  }
+  if (!MONITOR_FLAG) DLOG(DLOG_TX_FULL);
   return false;
 }
 
@@ -803,52 +817,6 @@ void PrintHex64(uint64_t data)
       }
   }
 
-//----------------------------------------------------------------------------------------
-uint16_t getCAN(uint64_t uid)                                                                     // Return can base address from the board UID
-  {
-    const IO *ptr = DB;                                                                           // Define a pointer to the DB array
-
-    for(uint16_t i = 0; i < DB_count; i++)                                                        // Search for the structure containing the board UID
-      { 
-        if (ptr->UID == uid) { return ptr->CAN; }                 
-        ptr++;                                                                                    // Next element in the array                                                                
-      }
-    return false;
-  }
-
-//----------------------------------------------------------------------------------------
-uint8_t getLBL(uint64_t uid)                                                                      // Return label from the board UID                                                            
-  {
-    for(uint8_t i = 0; i < DB_count; i++)
-      {
-        if(DB[i].UID == uid) return DB[i].LBL;
-      }
-    return false;
-  }
-
-//----------------------------------------------------------------------------------------
-uint8_t getTYPE(uint64_t uid)                                                                     // Return type from the board UID
-  {
-    const IO *ptr = DB;                                                                           // Define a pointer to the DB array
-
-    for(uint16_t i = 0; i < DB_count; i++)                                                        // Search for the structure containing the board UID
-      { 
-        if (ptr->UID == uid) { return ptr->TYPE; }                 
-        ptr++;                                                                                    // Next element in the array                                                                
-      }
-    return false;
-  }
-
-uint16_t Lbl2Can(uint8_t lbl)                                                                     // Extract can address from label
-  {
-    for(uint8_t i = 0; i < DB_count; i++)
-      {
-        if(DB[i].LBL == lbl)
-        return DB[i].CAN;                                                                         // Found CAN address
-      }
-    return 0xFFFF;                                                                                // Not found
-  }
-
 // ----------------------------------------------------------------------------------
 // Print a CAN FD frame (like the message.data[] array) in hexadecimal format
 void PrintCANFrameHex(const uint8_t *frame, uint8_t len = 8)
@@ -881,21 +849,15 @@ void PrintCANFrameHex(const uint8_t *frame, uint8_t len = 8)
  *   - Final 4KB of QSPI is padded with 0x00 (used to detect end)
  *   - Each QSPI block is 4096 bytes
  *
+ * The transfer itself is updateTask() (update.ino): it waits for room in the transmit
+ * queue and paces the frames with TASK_DELAY, so CAN, switches and the other tasks
+ * keep running during the update.
+ *
  * @param label Target device label (must match device database and not self)
- * @return true if transmission succeeded, false if aborted or failed
+ * @return true if the transfer task was started, false if aborted
  */
  bool QSPI2CAN(uint8_t label)
 {
-  const uint32_t block_size   = QSPI_BLOCK_SIZE;  // 4 KB per block
-  const uint32_t chunk_size   = 8;                // CAN FD frame size
-  const uint32_t flash_offset = 0x00000000;
-  uint8_t buffer[block_size];
-  uint32_t offset = 0;
-  crc64_stream ctx;
-
-  if(IDE) Serial.println(F("NOT YET IMPLEMENTED"));
-  return false;
-
   if (label == 0 || label == LABEL)
   {
     if(IDE) Serial.println(F("QSPI2CAN aborted: invalid or self-addressed label ❌"));
@@ -917,69 +879,26 @@ void PrintCANFrameHex(const uint8_t *frame, uint8_t len = 8)
     return false;
   }
 
-  // Detect actual firmware size in QSPI (stop on 0x00-filled block)
-  uint32_t program_size = 0;
-  while (true)
-  {
-    if (!flash.readBuffer(flash_offset + program_size, buffer, block_size)) break;
-    bool all_00 = true;
-    for (uint32_t i = 0; i < block_size; i++)
-    {
-      if (buffer[i] != 0x00) { all_00 = false; break; }
-    }
-    if (all_00) break;
-    program_size += block_size;
-  }
-
-  uint32_t aligned_limit = ((program_size + block_size - 1) / block_size) * block_size;
-
-  if (IDE)
+  if (task_running(updateTask))
   {
-    Serial.println(F("QSPI to CAN FD transfer started ℹ️"));
-    Serial.print(F("Program size        : ")); Serial.println(program_size);
-    Serial.print(F("Aligned block limit : ")); Serial.println(aligned_limit);
+    if(IDE) Serial.println(F("QSPI2CAN aborted: transfer already running ❌"));
+    return false;
   }
 
-  sendControlMarker(obfuscate(stx), label);
-  crc64_stream_init(&ctx, 0);
-
-  while (offset < aligned_limit)
+  updateJob.buffer = arena_take(ARENA_UPDATE_TX, QSPI_BLOCK_SIZE);                          // Given back by updateTask
+  if (!updateJob.buffer)
   {
-    memset(buffer, 0xFF, block_size);
-    uint32_t valid_bytes = (offset + block_size <= program_size) ? block_size : (program_size - offset);
-    if (!flash.readBuffer(flash_offset + offset, buffer, valid_bytes)) return false;
-
-    for (uint32_t i = 0; i < block_size; i += chunk_size)
-    {
-      uint8_t frame[chunk_size];
-      memcpy(frame, &buffer[i], chunk_size);
-
-      sendCANFDFrame(frame, chunk_size, SVR + Update);
-      crc64_stream_update(&ctx, frame, chunk_size);
-      DELAY(5);
-
-      if (((offset + i) / chunk_size) % 128 == 0) { BLINK(MAGENTA); if (IDE) Serial.print("."); }
-      if (((offset + i) / chunk_size) % 256 == 0) BLINK(BLACK);
-    }
-
-    offset += block_size;
+    if(IDE) Serial.println(F("QSPI2CAN aborted: arena busy (G 4) ❌"));
+    return false;
   }
 
-  // Final CRC64 transmission
-  uint64_t crc64_val = crc64_stream_finalize(&ctx);
-  uint8_t crc_frame[8];
-  for (uint8_t i = 0; i < 8; i++) crc_frame[i] = (crc64_val >> (8 * i)) & 0xFF;
-
-  sendCANFDFrame(crc_frame, 8, SVR + Update);
-
-  if (IDE)
+  updateJob.label = label;
+  if (!task_start(updateTask, &updateJob, "UPDATE"))                                       // Runs from loop(), the board keeps working
   {
-    Serial.println(); Serial.print(F("CRC64: "));
-    PrintHex64(crc64_val); Serial.println();
+    arena_give(ARENA_UPDATE_TX);
+    if(IDE) Serial.println(F("QSPI2CAN aborted: no free task ❌"));
+    return false;
   }
-
-  sendControlMarker(obfuscate(etx), label);
-  BLINK(BLACK);
   return true;
 }
 
@@ -1164,7 +1083,7 @@ bool filterManager_apply(CANFilterManager* manager, ACANFD_FeatherM4CAN* can, AC
 // When enabled:
 //   - Saves the current filter configuration.
 //   - Clears all filters and installs a wide-open filter (0x000–0x7FF).
-//   - Routes traffic to FIFO0 handled manually in loop().
+//   - Stores every frame in the capture ring, spilled to QSPI (capture.h).
 //
 // When disabled:
 //   - Restores the previously saved filter configuration.
@@ -1183,21 +1102,19 @@ void Monitor()
         filterManager_add(&filterManager,
                       0x000, 0x7FF,                                                 // Accept all 11-bit CAN IDs
                       ACANFD_FeatherM4CAN_FilterAction::FIFO0,
-                      nullptr);                                                     // No callback; handled manually in loop()
+                      cap_rx);                                                      // Time stamped into the capture ring
 
         bool ok = filterManager_apply(&filterManager, &can1, &settings);            // Apply new filter
         if(!ok && IDE) Serial.println(F("Monitor filter not applied!"));
 
         MONITOR_FLAG = true;
 
-        if(IDE)
-          {
-            Serial.println(F("MONITOR MODE  ENABLED"));
-            Serial.println(F("DISPATCHING   FIFO0"));
-          }
+        if(IDE) Serial.println(F("MONITOR MODE  ENABLED"));
+        cap_start();
       }
     else
       {                                                                             // Disable monitor mode
+        cap_stop();                                                                 // Rest of the capture to QSPI
         memcpy(&filterManager, &savedFilterManager, sizeof(CANFilterManager));      // Restore previous filters
         filterManager_apply(&filterManager, &can1, &settings);
 
@@ -1237,7 +1154,10 @@ const NamedCallback namedCallbacks[] = {
   { Process_PwrCtrl,      F("Process_PwrCtrl") },
   { Process_Analog,       F("Process_Analog") },
   { Process_Isense,       F("Process_Isense") },
-  { Process_Analog_RX,    F("Process_Analog_RX") },                                       
+  { Process_BME_Telemetry, F("Process_BME_Telemetry") },
+  { Process_Analog_RX,    F("Process_Analog_RX") },
+  { Process_Ctl,          F("Process_Ctl") },
+  { Process_Group,        F("Process_Group") },                                       
   { NULL,                 F("Unknown") }                                              // Fallback
 };
 
@@ -1443,7 +1363,7 @@ void sendHeartbeatFrame()
     msg.id = SVR + Hbt;
     msg.len = 1; 
     msg.data[0] = LABEL;                                                              
-    sendCANFDFrame(msg.data, msg.len, msg.id);                                             // Send heartbeat on CAN SVR + Hbt
+    sendCANFDFrame(msg.data, msg.len, msg.id, TXQ_LOW);                                    // Send heartbeat on CAN SVR + Hbt
   }
 
 //----------------------------------------------------------------------------------------
@@ -1459,7 +1379,7 @@ void Send_Ack()
       {
         data[i] = (ack >> (8 * (i - 1))) & 0xFF;                                            // Store remaining 56 bits (low to high)
       }
-    sendCANFDFrame(data, 8, SVR + Ack);                                                     // Send to ACK ID
+    sendCANFDFrame(data, 8, SVR + Ack, TXQ_HIGH);                                           // Send to ACK ID
   }
 
 //----------------------------------------------------------------------------------------
@@ -1475,7 +1395,7 @@ void Send_Nack()
       {
         data[i] = (ack >> (8 * (i - 1))) & 0xFF;                                            // Store remaining 56 bits (low to high)
       }
-    sendCANFDFrame(data, 8, SVR + Nack);                                                    // Send to NACK ID
+    sendCANFDFrame(data, 8, SVR + Nack, TXQ_HIGH);                                          // Send to NACK ID
   }
 
 //----------------------------------------------------------------------------------------  
@@ -1504,7 +1424,7 @@ bool eraseQSPI()
 //----------------------------------------------------------------------------------------
 // Interrupt handler for Timer/Counter Control 2 (TCC2) overflow. 
 // This interrupt handler is triggered when TCC2 overflows.
-// Used by the timer pool
+// Drives the timing wheel (timer.h)
 //----------------------------------------------------------------------------------------
 
 void TCC2_0_Handler()                                                                        // Interrupt set every 1 ms
@@ -1512,168 +1432,38 @@ void TCC2_0_Handler()
     if(TCC2->INTFLAG.bit.OVF)                                                             
       {
         TCC2->INTFLAG.bit.OVF = TCC_INTFLAG_OVF;                                             // Clear the overflow flag
+        PROF_PERIOD(PROF_TICK);
         static uint8_t tickDivider = 0;
         tickDivider++;
     
-        for(uint8_t i = 0; i < MAX_TIMERS; i++)
-          {
-            if(delays[i].active && delays[i].counter > 0)
-              {
-                delays[i].counter--;
-                if(delays[i].counter == 0)
-                  {
-                    delays[i].flag = true;                                                   // Mark task as completed
-                    delays[i].active = false;                                                // Auto-disable after expiry
-                  }
-              }
-          }
+        timer_tick();                                                                        // Expire the timers of this millisecond
+        erase_poll();                                                                        // Next QSPI erase command when the flash is idle
+        cap_poll();                                                                          // Next capture page to QSPI
 
         if(tickDivider >= 10)
           {
             tickDivider = 0;                                                                 // Only call every 10 ms
-            if(TYPE == SWITCH) Switch_Handler();                                             // Only call switch handler if this board is a SWITCH type
-            UpdatePWMResume();                                                               // Check for motors that need to restart after direction change
-          }
-        can1.dispatchReceivedMessage();
-      }
-  }
-
-//----------------------------------------------------------------------------------------
-// Switch_Handler: Polls each switch, debounces, and detects click types (short, long, double, etc.)
-// Designed for N switches connected to GPIO pins defined in switchPins[]
-// Uses state machine per switch to detect:
-//   - Short clicks
-//   - Long presses
-//   - Very long presses
-//   - Single & double short clicks
-//----------------------------------------------------------------------------------------
-
-void Switch_Handler() {
-  for (int n = 0; n < N; n++) {                       // Iterate over all N switches
-    int val = digitalRead(switchPins[n]);             // Read the current level on this switch pin    
-    switchState[n].state = (val == LOW) ? 1 : 0;      // Update switch state: 1 = pressed (LOW), 0 = released (HIGH)
-
-    if (switchState[n].state == 1) {                  // If switch is currently pressed
-      switchState[n].tim++;                           // Increment press duration counter
-      switchState[n].wait = 0;                        // Reset wait counter since button is held down
-    } else {                                          // If switch is released
-      switchState[n].wait++;                          // Increment wait counter (time since release)
-
-      if (switchState[n].wait > WAIT_RESET) {         // If released long enough, reset all state tracking
-        switchState[n].cnt = 0;
-        switchState[n].longCnt = 0;
-        switchState[n].shortDetected = 0;
-        switchState[n].shortDelay = 0;
-      }
-
-
-      if (switchState[n].tim > VERY_LONG) {           // Check if it was a very long press
-        Send_Click(n, CLICK_VL);                      // Trigger very long click event
-        switchState[n].tim = 0;                       // Reset all tracking for this switch
-        switchState[n].cnt = 0;
-        switchState[n].longCnt = 0;
-        switchState[n].shortDetected = 0;
-        switchState[n].shortDelay = 0;
-      }
-      // Check if it was a long press (not very long)
-      else if (switchState[n].tim > SHORT) {
-        switchState[n].longCnt++;                    // Count long press events
-
-        if (switchState[n].longCnt == 1 && switchState[n].cnt == 0) {
-          Send_Click(n, CLICK_L);                    // Send long press event
-        } else if (switchState[n].cnt == 1) {
-          Send_Click(n, CLICK_SL);                   // If we had a short click before, interpret as short + long
-        }
-
-        // Reset short click tracking after long press
-        switchState[n].cnt = 0;
-        switchState[n].shortDetected = 0;
-        switchState[n].shortDelay = 0;
-        switchState[n].tim = 0;
-        switchState[n].wait = 0;
-      }
-      // Handle quick short clicks
-      else if (switchState[n].tim <= SHORT && switchState[n].tim > 0) {
-        if (switchState[n].wait == 2) {              // Small debounce: check two ticks after release
-          switchState[n].shortDetected = 1;          // Mark that a short click is pending
-          switchState[n].shortDelay = 0;
-          switchState[n].cnt++;                      // Increment count of short clicks
-          switchState[n].tim = 0;
-          switchState[n].longCnt = 0;
-        }
-      }
-
-      // Handle timing window for short & double short clicks
-      if (switchState[n].shortDetected) {
-        switchState[n].shortDelay++;                 // Increment short click delay timer
-
-        if (switchState[n].shortDelay >= SHORT_DELAY_LIMIT * 2) {
-          if (switchState[n].cnt == 1) {
-            Send_Click(n, CLICK_S);                  // Single short click
-          } else if (switchState[n].cnt == 2) {
-            Send_Click(n, CLICK_SS);                 // Double short click
+            boardOps.scan();                                                                 // Switch_Handler() on a SWITCH board, bound at boot (board.h)
+            rpc_poll();                                                                      // Complete the RPC calls past their deadline
           }
-          // Reset after handling
-          switchState[n].shortDetected = 0;
-          switchState[n].shortDelay = 0;
-          switchState[n].cnt = 0;
+        {
+          PROF_SCOPE(PROF_DISPATCH);                                                         // Callbacks included
+          if(repState != REP_OFF) rep_tick();                                                // Trace replay instead of the bus
+          else if(gwOn || MONITOR_FLAG) gw_dispatch();                                       // Gateway or capture: drain the FIFO, every frame counts
+          else if(can1.dispatchReceivedMessage() && !boot_reached(BOOT_FIRST_RX)) boot_mark(BOOT_FIRST_RX);  // Boot timeline (boot.h)
         }
+        txqueue_pump();                                                                      // Refill the CAN controller from the transmit queue
       }
-    }
   }
-}
-
-void Send_Click(uint8_t n, ClickValue value)
-{
-  uint8_t param = 0;
-
-  switch (value) {
-    case CLICK_S:  param = CLICK_S;  break;
-    case CLICK_SS: param = CLICK_SS; break;
-    case CLICK_L:  param = CLICK_L;  break;
-    case CLICK_SL: param = CLICK_SL; break;
-    case CLICK_VL: param = CLICK_VL; break;
-    default: return;
-  }
-
-  // Retrieve CAN base address from DB[].lnk[n]
-  uint16_t can_base = 0xFFFF;
-  for (uint8_t i = 0; i < DB_count; i++) {
-    if (DB[i].LBL == LABEL && n < 16) {
-      can_base = DB[i].lnk[n];
-      break;
-    }
-  }
-
-  if (can_base == 0xFFFF) {
-    if (IDE) {
-      Serial.print(F("Invalid .lnk target for port "));
-      Serial.println(n);
-    }
-    return;
-  }
-
-  // Construct the CAN FD message
-  CANFDMessage frame;
-  frame.id  = can_base;
-  frame.ext = false;
-  frame.len = 1;
-  frame.type = CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH;     // Enable CAN FD with bit rate switch
-  frame.idx = 0;                                             // Use default TX FIFO index
-  frame.data[0] = param;
-
-  // Send using tryToSendReturnStatusFD pattern
-  sendCANFDFrame(frame.data, frame.len, can_base);
-}
 
 // ----------------------------------------------------------------------------
-// Milliseconds delay
+// Milliseconds delay, the other tasks run meanwhile (task.h)
 // ----------------------------------------------------------------------------
 void DELAY(uint32_t ms)
   {
     uint32_t start = DWT->CYCCNT;
     uint32_t cycles = (SystemCoreClock / 1000) * ms;                                        // Number of cycles for ms
-    while ((DWT->CYCCNT - start) < cycles) {}                                               // Spin
+    while ((DWT->CYCCNT - start) < cycles) sched_yield();                                   // Other tasks run, spins in interrupt context
   }
  
 //----------------------------------------------------------------------------------------
@@ -1692,49 +1482,25 @@ void Reset_board(void)
     ATOMIC() NVIC_SystemReset();
   }
 
-// ----------------------------------------------------------------------------------
-// Send CAN FD control frame: label + 56-bit marker (total 64 bits)
-void sendControlMarker(uint64_t marker, uint8_t label)
-{
-  uint8_t frame[8];
-  frame[0] = label;  // First byte is always the label
-
-  // Send least significant 7 bytes of marker (56 bits)
-  for (uint8_t i = 0; i < 7; i++)
-    frame[i + 1] = (marker >> (8 * i)) & 0xFF;
-
-  sendCANFDFrame(frame, 8, SVR + Update);
-  PrintCANFrameHex(frame);
-}
-// ----------------------------------------------------------------------------------
-// Obfuscate control frames before sending
-uint64_t obfuscate(uint64_t val) {
-  return val ^ MARKER_MASK;
-}
-
 //----------------------------------------------------------------------------------------
 /**
- * @brief Erases external QSPI flash from 0x00000000 to 0x0078FFFF, skipping protected region.
+ * @brief Erases external QSPI flash from 0x00000000 to BOOT2_START_ADDR (0x00079000), blocking.
  *
  * This function:
- *   - Iterates through QSPI sectors (4 KB each)
- *   - Stops completely at address 0x00790000
- *   - Skips erasing any sector in the `.qspi_protected` range (defined below)
+ *   - Runs the erase engine (erase.h): 4 KB sectors at both ends, 64 KB blocks between
+ *   - Stops completely at BOOT2_START_ADDR, Boot2 and the protected area are kept
+ *   - Waits for the end of the job; the update receiver does not call it any more,
+ *     it erases ahead of its write pointer instead
  *
  * Typical Use:
- *   - Used to safely erase QSPI while preserving the bootloader (e.g., at 0x00790000).
+ *   - Used to safely erase QSPI while preserving the bootloader.
  *
  * @return true on success, false on any erase failure
  */
 //----------------------------------------------------------------------------------------
 bool eraseQSPI_Safe()
 {
-  const uint32_t sector_size      = 4096;                // Sector size = 4 KB
-  const uint32_t protect_start    = 0x0079000;            // Start of .qspi_protected region
-  const uint32_t protect_end      = protect_start + 0x4000; // End of protected region (inclusive)
-  const uint32_t erase_limit      = 0x0079000;            // Stop erasing at this address
-
-  bool success     = true;
+  const uint32_t erase_limit = BOOT2_START_ADDR;          // Stop erasing at this address
 
   if (IDE)
   {
@@ -1743,26 +1509,16 @@ bool eraseQSPI_Safe()
     Serial.println(flash.size());
     Serial.print(F("Erase limit     : 0x00000000 to 0x"));
     Serial.println(erase_limit - 1, HEX);
-    Serial.print(F("Protect region  : 0x"));
-    Serial.print(protect_start, HEX);
-    Serial.print(F(" - 0x"));
-    Serial.println(protect_end - 1, HEX);
   }
 
-  for (uint32_t addr = 0; addr < erase_limit; addr += sector_size)
+  if (STX_FLAG || !qspi_take(QSPI_UPDATE))               // Capture or update running (qspi.h)
   {
-
-    if (!flash.eraseSector(addr))
-      {
-        if (IDE)
-        {
-          Serial.print(F("Erase failed at 0x"));
-          Serial.println(addr, HEX);
-        }
-      success = false;
-    }
-
+    if (IDE) Serial.println(F("QSPI busy ❌"));
+    return false;
   }
+  erase_start(0, erase_limit, QSPI_UPDATE);               // Same engine as the update, 64 KB blocks where possible
+  bool success = erase_wait(erase_limit);
+  qspi_give(QSPI_UPDATE);
 
   if (IDE)
   {
@@ -1835,7 +1591,8 @@ bool Mirror2QSPI() {
 
 //----------------------------------------------------------------------------------------
 // Verifies that QSPI content at 0x00000000 matches internal flash from 0x00004000
-// up to 0x00080000 (end of flash). Compares in 256-byte blocks.
+// up to 0x00080000 (end of flash). Compares the 4 KB CRC maps of both (crcmap.h), then
+// the bytes of the first block that differs to report the address.
 bool verifyQSPI() 
   {
     const uint32_t flash_start = FLASH_BASE_ADDR;                                                    // Start of application in internal flash
@@ -1843,192 +1600,44 @@ bool verifyQSPI()
     const uint32_t flash_end   = 0x00080000;                                                         // End of flash
     const uint32_t compare_size = flash_end - flash_start;
     const uint32_t block_size   = 256;                                                               // Comparison chunk size
-    uint8_t flash_buf[block_size];
-    uint8_t qspi_buf[block_size];
+    ArenaLease lease(ARENA_VERIFY, block_size);
+    uint8_t* qspi_buf = lease.buf;                                                                   // The arena (arena.h), not the stack
+    if(!qspi_buf) { Serial.println(F("QSPI verify: arena busy (G 4)")); return false; }
 
-    for(uint32_t offset = 0; offset < compare_size; offset += block_size)
+    const uint16_t blocks = crc_map(flash_start, compare_size, crcMapA);                             // One CRC per 4 KB, DMAC when available
+    crc_map(MQSPI_BASE_ADDR + qspi_start, compare_size, crcMapB);                                    // Same through the QSPI window
+
+    for(uint16_t b = 0; b < blocks; b++)
       {
-        uint32_t len = (compare_size - offset < block_size) ? (compare_size - offset) : block_size;
-        const uint8_t* flash_ptr = (const uint8_t*)(flash_start + offset);                           // Read internal flash
-        memcpy(flash_buf, flash_ptr, len);
-        if(!flash.readBuffer(qspi_start + offset, qspi_buf, len))                                    // Read QSPI flash
-          {
-            Serial.print(F("QSPI read failed at 0x"));
-            Serial.println(qspi_start + offset, HEX);
-            return false;
-          }
-        for(uint32_t i = 0; i < len; i++)                                                            // Compare both buffers
+        if(crcMapA[b] == crcMapB[b]) continue;
+        for(uint32_t offset = b * CRC_BLOCK; offset < (b + 1) * CRC_BLOCK; offset += block_size)     // Locate the first different byte of the block
           {
-            if(flash_buf[i] != qspi_buf[i])
+            const uint8_t* flash_ptr = (const uint8_t*)(flash_start + offset);
+            if(!flash.readBuffer(qspi_start + offset, qspi_buf, block_size))                         // Read QSPI flash
               {
-                Serial.print(F("Mismatch at 0x"));
-                Serial.print(offset + i, HEX);
-                Serial.print(F(": flash=0x"));
-                Serial.print(flash_buf[i], HEX);
-                Serial.print(F(", qspi=0x"));
-                Serial.println(qspi_buf[i], HEX);
+                Serial.print(F("QSPI read failed at 0x"));
+                Serial.println(qspi_start + offset, HEX);
                 return false;
               }
+            for(uint32_t i = 0; i < block_size; i++)                                                 // Compare both buffers
+              {
+                if(flash_ptr[i] != qspi_buf[i])
+                  {
+                    Serial.print(F("Mismatch at 0x"));
+                    Serial.print(offset + i, HEX);
+                    Serial.print(F(": flash=0x"));
+                    Serial.print(flash_ptr[i], HEX);
+                    Serial.print(F(", qspi=0x"));
+                    Serial.println(qspi_buf[i], HEX);
+                    return false;
+                  }
+              }
           }
       }
     Serial.println(F("QSPI matches internal flash up to end of flash ✅"));
     return true;
   }
 
-//----------------------------------------------------------------------------------------
-// TimerHandler — Software PWM generator using TC3 interrupt
-// This routine is called at a fixed interval defined by TIMER_INTERVAL_US and generates
-// PWM signals in software using digitalWrite().
-//
-// FUNCTIONALITY:
-// - For SWITCH or LPOWER boards (TYPE == SWITCH/LPOWER):
-//     • Uses single output pin per channel.
-//     • Generates PWM by toggling output HIGH/LOW based on pwmDuty[].
-//
-// - For MPOWER or HPOWER boards (TYPE == MPOWER/HPOWER):
-//     • Uses two output pins per channel (A and B) for H-Bridge control.
-//     • If pwmDuty == 0 → both pins set to LOW for braking.
-//     • If pwmDuty > 0 → PWM signal applied to A/B with direction logic.
-//
-// RESOURCES:
-// - Uses global:
-//     • pwmDuty[]         → current PWM value for each channel (0 to PWM_RESOLUTION)
-//     • pwmDir[]          → direction (0 = forward, 1 = reverse)
-//     • pwmPins[]         → A/B pin mapping (A = even index, B = odd index)
-//     • TYPE              → board type (SWITCH, LPOWER, MPOWER, HPOWER)
-//     • PWM_CHANNELS      → total number of logical PWM channels
-//     • PWM_RESOLUTION    → full-scale resolution of PWM
-//----------------------------------------------------------------------------------------
-void qqqqqqqqqqqqqq()
-  {
-    pwmTick++;
-    if(pwmTick >= PWM_RESOLUTION) pwmTick = 0;  
-      const bool isHBridge = (TYPE == MPOWER || TYPE == HPOWER);                      // Determine if board uses H-Bridge logic
-      for(uint8_t ch = 0; ch < PWM_CHANNELS; ch++)
-        {
-          const uint8_t duty = pwmDuty[ch];
-          if(isHBridge)
-            {
-              const uint8_t pinA = pwmPins[ch * 2];                                   // Even index = A
-              const uint8_t pinB = pwmPins[ch * 2 + 1];                               // Odd index = B
-              const bool dir     = pwmDir[ch];                                        // Direction: 0 = forward, 1 = reverse
-              if(duty == 0)
-                {
-                  digitalWrite(pinA, LOW);                                            // Braking mode: set both A & B LOW to short motor terminals
-                  digitalWrite(pinB, LOW);
-                }
-              else
-                {
-                  const bool pwmState = (pwmTick < duty);
-                  if(!dir)
-                    {         
-                      digitalWrite(pinA,  pwmState);                                  // Forward: A = PWM, B = inverted
-                      digitalWrite(pinB, !pwmState);
-                    }
-                  else
-                    {
-                      digitalWrite(pinA, !pwmState);                                  // Reverse: A = inverted, B = PWM
-                      digitalWrite(pinB,  pwmState);
-                    }
-                }
-            }
-        else
-          {
-            const bool pwmState = (pwmTick < duty);                                   // Single output mode: PWM directly on pin
-            digitalWrite(pwmPins[ch], pwmState ? HIGH : LOW);
-          }
-      }
-  }
-
-
-
-
-//----------------------------------------------------------------------------------------
-// TimerHandler — Software PWM generator using TC3 interrupt
-//
-// This routine is called at a fixed interval defined by TIMER_INTERVAL_US and generates
-// PWM signals in software using digitalWrite().
-//
-// FUNCTIONALITY:
-// - For SWITCH or LPOWER boards (TYPE == SWITCH/LPOWER):
-//     • Uses single output pin per channel.
-//     • Generates PWM by toggling output HIGH/LOW based on pwmDuty[].
-//
-// - For MPOWER or HPOWER boards (TYPE == MPOWER/HPOWER):
-//     • Uses two output pins per channel (A and B) for H-Bridge control.
-//     • If pwmDuty == 0 → both pins set to LOW for braking.
-//     • If pwmDuty > 0 → PWM signal applied to A/B with direction logic.
-//
-// - Additionally, if TYPE != SWITCH:
-//     • Checks all pwmDuty[] entries.
-//     • If at least one is active, sets PWCTRL to ON.
-//     • If all are zero, sets PWCTRL to OFF.
-//
-// RESOURCES:
-// - pwmDuty[], pwmDir[], pwmPins[], TYPE, PWM_CHANNELS, PWM_RESOLUTION
-// - PWCTRL, ON, OFF must be defined elsewhere in your project
-//----------------------------------------------------------------------------------------
-void TimerHandler()
-{
-  pwmTick++;
-  if (pwmTick >= PWM_RESOLUTION) pwmTick = 0;
-
-  const bool isHBridge = (TYPE == MPOWER || TYPE == HPOWER);
-  bool anyActive = false;  // Track if any channel is running
-
-  for (uint8_t ch = 0; ch < PWM_CHANNELS; ch++)
-  {
-    const uint8_t duty = pwmDuty[ch];
-
-    if (duty > 0)
-      anyActive = true;  // At least one channel active
-
-    if (isHBridge)
-    {
-      const uint8_t pinA = pwmPins[ch * 2];       // Even index = A
-      const uint8_t pinB = pwmPins[ch * 2 + 1];   // Odd index = B
-      const bool dir     = pwmDir[ch];            // Direction: 0 = forward, 1 = reverse
-
-      if (duty == 0)
-      {
-        // Braking mode: set both A & B LOW to short motor terminals
-        digitalWrite(pinA, LOW);
-        digitalWrite(pinB, LOW);
-      }
-      else
-      {
-        const bool pwmState = (pwmTick < duty);
-
-        if (!dir)
-        {
-          digitalWrite(pinA,  pwmState);  // Forward: A = PWM
-          digitalWrite(pinB, !pwmState);  //           B = inverted
-        }
-        else
-        {
-          digitalWrite(pinA, !pwmState);  // Reverse: A = inverted
-          digitalWrite(pinB,  pwmState);  //           B = PWM
-        }
-      }
-    }
-    else
-    {
-      // Single-pin PWM mode (SWITCH or LPOWER)
-      const bool pwmState = (pwmTick < duty);
-      digitalWrite(pwmPins[ch], pwmState ? HIGH : LOW);
-    }
-  }
-
-  // Control PWCTRL if TYPE != SWITCH & update current sense
-  if (TYPE != SWITCH)
-  {
-    digitalWrite(PWCTRL, anyActive ? ON : OFF);
-    Isense = analogRead(analogPins[0]);                                               // Analog input A0
-  }
-}
-
-
-
 //----------------------------------------------------------------------------------------
 // Set_PWM(channel, percent, direction)
 // 
@@ -2053,7 +1662,7 @@ void TimerHandler()
 //
 // Notes:
 //   - Active-low logic is applied automatically if TYPE == SWITCH.
-//   - This function should be used in coordination with UpdatePWMResume().
+//   - The resume is a one-shot timer calling PWM_Resume().
 //
 
 void qqqqqqqqqqqqqqqqq(uint8_t channel, uint8_t percent, uint8_t direction)
@@ -2068,11 +1677,12 @@ void qqqqqqqqqqqqqqqqq(uint8_t channel, uint8_t percent, uint8_t direction)
       {
         pwmDuty[channel] = 0;                                                                  // Immediately stop motor
         saved_PWM[channel] = 0;
-// 2. Schedule resume after delay (handled in UpdatePWMResume)
+// 2. Schedule resume after delay (handled in PWM_Resume)
         pwmNextDuty[channel] = percent;                                                        // Save target PWM value
         pwmNextDir[channel]  = direction;                                                      // Save target direction
-        pwmStopTime[channel] = millis();                                                       // Save stop time
         pwmPendingResume[channel] = true;                                                      // Mark resume pending
+        if(!timer_start(PWM_BRAKE_MS, 0, PWM_Resume, channel, TIMER_IRQ))                      // Resume timer
+          pwmPendingResume[channel] = false;                                                   // No timer free: stay stopped
         return;                                                                                // Exit — update will happen later
       }
 // --- Apply PWM immediately if no direction change or already stopped ---
@@ -2099,8 +1709,8 @@ void qqqqqqqqqqqqqqqqq(uint8_t channel, uint8_t percent, uint8_t direction)
 //       → PWM and direction are applied immediately.
 //
 // Additional:
-//   - TYPE == SWITCH → active-low logic (inverted PWM).
-//   - If TYPE != SWITCH, checks all pwmDuty[] values and sets PWCTRL:
+//   - boardOps.duty: active-low logic (inverted PWM) on SWITCH boards.
+//   - boardOps.power: on other boards, checks all pwmDuty[] values and sets PWCTRL:
 //       → ON if any active PWM.
 //       → OFF if all are 0.
 //
@@ -2120,79 +1730,49 @@ void Set_PWM(uint8_t channel, uint8_t percent, uint8_t direction)
         saved_PWM[channel] = 0;
         pwmNextDuty[channel] = percent;                                                   // Schedule resume
         pwmNextDir[channel]  = direction;
-        pwmStopTime[channel] = millis();
         pwmPendingResume[channel] = true;
-        if(TYPE != SWITCH)                                                                // Update PWCTRL if needed
-          {
-            bool anyActive = false;
-            for(uint8_t i = 0; i < PWM_CHANNELS; i++)
-            if(pwmDuty[i] > 0) { anyActive = true; break; }
-            digitalWrite(PWCTRL, anyActive ? ON : OFF);
-          }
+        if(!timer_start(PWM_BRAKE_MS, 0, PWM_Resume, channel, TIMER_IRQ))                 // Resume in PWM_BRAKE_MS
+          pwmPendingResume[channel] = false;                                              // No timer free: stay stopped
+        boardOps.power();                                                                 // Update PWCTRL, nothing on SWITCH
         return;
       }
     saved_PWM[channel] = percent;                                                         // Apply PWM immediately (no direction change)
     pwmDir[channel]    = direction;
-    if(TYPE == SWITCH)percent = 100 - percent;                                            // Apply active-low logic   
-    pwmDuty[channel] = map(percent, 0, 100, 0, PWM_RESOLUTION);
-    if(TYPE != SWITCH)                                                                    // Update PWCTRL if needed
-      {
-        bool anyActive = false;
-        for(uint8_t i = 0; i < PWM_CHANNELS; i++)
-        if(pwmDuty[i] > 0) { anyActive = true; break; }
-        digitalWrite(PWCTRL, anyActive ? ON : OFF);
-      }
+    boardOps.duty(channel, percent);                                                      // Active-low on SWITCH (board.h)
+    boardOps.power();
   }
 
 //----------------------------------------------------------------------------------------
-// UpdatePWMResume() — Resume motor PWM after a scheduled direction change delay
+// PWM_Resume(ch) — Resume motor PWM after a scheduled direction change delay
+//
+// One-shot timer started by Set_PWM() when the direction changes on a running motor,
+// PWM_BRAKE_MS after the stop. Applies the PWM duty cycle and direction saved then.
 //
-// This function checks whether the delay period following a direction change has expired.
-// If so, it applies the new PWM duty cycle and direction that were saved earlier.
-// 
 // This mechanism ensures that motors resume with the correct parameters after
 // a safe delay, such as after a forced stop or direction update.
 //
 // Variables used:
 //   - pwmPendingResume[ch] → true if resume is pending for this channel
-//   - pwmStopTime[ch]      → millis() timestamp when the channel was stopped
 //   - pwmNextDuty[ch]      → PWM duty (0–100%) to apply after delay
 //   - pwmNextDir[ch]       → Direction to apply after delay
 //   - pwmDir[ch]           → Current direction
 //   - saved_PWM[ch]        → Currently applied duty cycle
 //   - pwmDuty[ch]          → Scaled value for PWM output (0–PWM_RESOLUTION)
-//   - TYPE                 → Used to determine if PWM needs inversion (SWITCH boards)
-//   - IDE                  → Enables debug logging
+//   - boardOps             → PWM inversion (SWITCH boards) and PWCTRL (board.h)
 //
-// Called every 10ms in TCC2 handler to apply pending updates.
+// Runs in the TCC2 tick (TIMER_IRQ), the motor does not wait for loop().
 //----------------------------------------------------------------------------------------
-void UpdatePWMResume()
+void PWM_Resume(uint32_t ch)
 {
-  bool anyActive = false;  // Track if any PWM output becomes active
+  if (ch >= PWM_CHANNELS || !pwmPendingResume[ch]) return;
 
-  for (uint8_t ch = 0; ch < PWM_CHANNELS; ch++)
-  {
-    if (pwmPendingResume[ch] && (millis() - pwmStopTime[ch] >= 1000))
-    {
-      // Resume direction and duty
-      pwmDir[ch] = pwmNextDir[ch];
-      saved_PWM[ch] = pwmNextDuty[ch];
+  // Resume direction and duty
+  pwmDir[ch] = pwmNextDir[ch];
+  saved_PWM[ch] = pwmNextDuty[ch];
 
-      uint8_t percent = pwmNextDuty[ch];
-      if (TYPE == SWITCH)
-        percent = 100 - percent;  // Invert logic if needed
-
-      pwmDuty[ch] = map(percent, 0, 100, 0, PWM_RESOLUTION);
-      pwmPendingResume[ch] = false;
-    }
-
-    // Check if the current channel has active PWM
-    if (pwmDuty[ch] > 0)
-      anyActive = true;
-  }
+  boardOps.duty(ch, pwmNextDuty[ch]);  // Inverted on SWITCH boards
+  pwmPendingResume[ch] = false;
 
-  // Apply PWCTRL logic if not a SWITCH board
-  if (TYPE != SWITCH)
-    digitalWrite(PWCTRL, anyActive ? ON : OFF);
+  boardOps.power();                    // PWCTRL, not on SWITCH boards
 }
 
@@ -0,0 +1,76 @@
+
+// ~/Arduino/QIF/rpc.h Located in parent directory and linked in subdirectory
+
+/*
+Request / response calls between boards
+
+Both frames travel on the control channel (board CAN base + ctl) of the receiver.
+
+  Request  : CTL_RPC_REQ, caller label, seq, method, arguments...
+  Response : CTL_RPC_RSP, callee label, seq, method, status, payload length, payload...
+
+The caller keeps every outstanding call in rpcPending[], matched on (callee label,
+sequence). Calls are never waited for: rpc_call() queues the request and returns,
+the callback runs when the response arrives or when the deadline passes, so many
+calls to different boards are on the bus at the same time.
+
+Deadlines are checked every 10 ms from the TCC2 tick. Callbacks run in interrupt
+context: keep them short. rpc_print(), the callback of the serial commands, only
+copies the result to rpcResults[]: rpc_drain() prints it from the RPC task, a
+snapshot or a profile takes many lines.
+*/
+
+#ifndef   RPC_H
+#define   RPC_H
+
+#define RPC_MAX_PENDING   64                                                                        // Outstanding calls
+#define RPC_TIMEOUT_MS    100                                                                       // Default deadline
+#define RPC_REQ_HEADER    (CTL_HEADER + 1)                                                          // + method
+#define RPC_RSP_HEADER    (CTL_HEADER + 3)                                                          // + method, status, payload length
+#define RPC_MAX_ARGS      (64 - RPC_REQ_HEADER)
+#define RPC_MAX_PAYLOAD   (64 - RPC_RSP_HEADER)                                                     // 58 bytes
+#define RPC_RESULTS       16                                                                        // Results waiting to be printed (power of 2)
+
+enum RPC_METHOD : uint8_t { RPC_PING = 0, RPC_BME, RPC_ANA, RPC_SNAP, RPC_PROF, RPC_METHODS };      // Remote methods
+
+enum RPC_STATUS : uint8_t {                                                                         // Call completion status
+  RPC_OK = 0,
+  RPC_TIMEOUT,                                                                                      // No response before the deadline
+  RPC_BAD_METHOD,                                                                                   // Method unknown on the callee
+  RPC_BAD_ARGS,                                                                                     // Arguments refused
+  RPC_UNAVAILABLE,                                                                                  // Resource missing on the callee (no BME...)
+  RPC_SEND_FAILED                                                                                   // Request could not be queued
+};
+
+typedef void (*RpcCallback)(uint8_t label, uint8_t method, uint8_t status,
+                            const uint8_t* payload, uint8_t len, uint32_t latency);
+
+typedef struct {
+  volatile bool used;
+  uint8_t       label;                                                                              // Callee
+  uint8_t       seq;                                                                                // Sequence sent in the request
+  uint8_t       method;
+  uint32_t      start;                                                                              // micros() when queued
+  uint32_t      deadline;                                                                           // millis() deadline
+  RpcCallback   callback;
+} RpcPending;
+
+typedef struct {
+  uint32_t calls;                                                                                   // Requests queued
+  uint32_t ok;                                                                                      // Responses with RPC_OK
+  uint32_t errors;                                                                                  // Responses with an error status
+  uint32_t timeouts;                                                                                // Deadlines passed
+  uint32_t minUs;                                                                                   // Round-trip latency
+  uint32_t maxUs;
+  uint64_t sumUs;
+} RpcStats;
+
+RpcPending rpcPending[RPC_MAX_PENDING];
+RpcStats   rpcStats[RPC_METHODS];
+uint8_t    rpcSeq  = 0;                                                                             // Sequence of the next request
+uint32_t   rpcLate = 0;                                                                             // Responses without a pending call (late or unknown)
+uint32_t   rpcFull = 0;                                                                             // Calls refused, table full
+
+bool rpc_call(uint8_t label, uint8_t method, const uint8_t* args, uint8_t len, RpcCallback cb, uint16_t timeout = RPC_TIMEOUT_MS);
+
+#endif
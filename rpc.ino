@@ -0,0 +1,386 @@
+
+// ~/Arduino/QIF/switch/rpc.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// rpc_call: Queue a request to a board, the callback gets the response or the timeout.
+//
+// Parameters:
+//   - label   : Callee board label
+//   - method  : RPC_PING, RPC_BME...
+//   - args    : Method arguments (may be nullptr if len = 0)
+//   - len     : Argument length, max RPC_MAX_ARGS
+//   - cb      : Completion callback (may be nullptr)
+//   - timeout : Deadline in ms
+//
+// Returns:
+//   true if queued, false if the label is unknown, the table is full or the bus queue is full
+//----------------------------------------------------------------------------------------
+bool rpc_call(uint8_t label, uint8_t method, const uint8_t* args, uint8_t len, RpcCallback cb, uint16_t timeout)
+{
+  const uint16_t base = Lbl2Can(label);
+  if(base == 0xFFFF || label == LABEL || method >= RPC_METHODS || len > RPC_MAX_ARGS) return false;
+
+  int8_t  slot = -1;
+  uint8_t seq  = 0;
+  ATOMIC()
+    {
+      for(uint8_t i = 0; i < RPC_MAX_PENDING; i++)
+        {
+          if(!rpcPending[i].used)
+            {
+              slot = i;
+              seq  = rpcSeq++;
+              rpcPending[i].used     = true;
+              rpcPending[i].label    = label;
+              rpcPending[i].seq      = seq;
+              rpcPending[i].method   = method;
+              rpcPending[i].callback = cb;
+              rpcPending[i].start    = micros();
+              rpcPending[i].deadline = millis() + timeout;
+              break;
+            }
+        }
+    }
+  if(slot < 0) { rpcFull++; return false; }
+
+  uint8_t frame[64] = {0};
+  frame[0] = CTL_RPC_REQ;
+  frame[1] = LABEL;                                                                         // Caller, the response goes to its control channel
+  frame[2] = seq;
+  frame[3] = method;
+  if(len) memcpy(&frame[RPC_REQ_HEADER], args, len);
+
+  if(!canSend(frame, canfd_len(RPC_REQ_HEADER + len), base + ctl, TXQ_NORMAL))
+    {
+      rpcPending[slot].used = false;                                                        // Never left, nothing to wait for
+      return false;
+    }
+  rpcStats[method].calls++;
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_reply: Send the response of a request back to the caller
+//----------------------------------------------------------------------------------------
+void rpc_reply(uint8_t caller, uint8_t seq, uint8_t method, uint8_t status, const uint8_t* payload, uint8_t len)
+{
+  const uint16_t base = Lbl2Can(caller);
+  if(base == 0xFFFF || len > RPC_MAX_PAYLOAD) return;
+
+  uint8_t frame[64] = {0};
+  frame[0] = CTL_RPC_RSP;
+  frame[1] = LABEL;                                                                         // Callee
+  frame[2] = seq;
+  frame[3] = method;
+  frame[4] = status;
+  frame[5] = len;
+  if(len) memcpy(&frame[RPC_RSP_HEADER], payload, len);
+  canSend(frame, canfd_len(RPC_RSP_HEADER + len), base + ctl, TXQ_NORMAL);
+}
+
+//----------------------------------------------------------------------------------------
+// Process_Rpc_Req: Execute a request received on the control channel (server side)
+//
+//   RPC_PING : no argument, empty payload
+//   RPC_BME  : arg 0 = BMETEMP..BMECO2, payload = type, float (4 bytes, little-endian)
+//   RPC_ANA  : arg 0 = channel 0-3, payload = channel, raw value (2 bytes, little-endian)
+//   RPC_SNAP : no argument, payload = Snapshot (see snapshot.h)
+//   RPC_PROF : arg 0 = probe PROF_PWM..PROF_FCT, payload = see prof_fill() (prof.h)
+//----------------------------------------------------------------------------------------
+void Process_Rpc_Req(const CANFDMessage & message)
+{
+  if(message.len < RPC_REQ_HEADER) return;
+
+  const uint8_t  caller = message.data[1];
+  const uint8_t  seq    = message.data[2];
+  const uint8_t  method = message.data[3];
+  const uint8_t* args   = &message.data[RPC_REQ_HEADER];
+  const uint8_t  argLen = message.len - RPC_REQ_HEADER;                                     // Includes CAN FD padding
+
+  uint8_t payload[RPC_MAX_PAYLOAD];
+  uint8_t len    = 0;
+  uint8_t status = RPC_OK;
+
+  switch(method)
+    {
+      case RPC_PING:
+        break;
+
+      case RPC_BME:
+        {
+          float value;
+          if(argLen < 1)                          status = RPC_BAD_ARGS;
+          else if(!BME_FLAG)                      status = RPC_UNAVAILABLE;
+          else if(!bmeValue(args[0], &value))     status = RPC_BAD_ARGS;
+          else { payload[0] = args[0]; memcpy(&payload[1], &value, 4); len = 5; }          // Type echoed, the response stands alone
+          break;
+        }
+
+      case RPC_ANA:
+        {
+          if(argLen < 1 || args[0] > 3 || TYPE == SWITCH) { status = RPC_BAD_ARGS; break; }
+          uint16_t value = analogRead(analogPins[args[0]]);
+          payload[0] = args[0];                                                             // Channel echoed
+          payload[1] = value & 0xFF;                                                        // LSB first
+          payload[2] = value >> 8;
+          len = 3;
+          break;
+        }
+
+      case RPC_SNAP:
+        snapshot_fill((Snapshot*)payload);
+        len = SNAP_SIZE;
+        break;
+
+      case RPC_PROF:
+        if(argLen < 1 || args[0] >= PROF_IDS) status = RPC_BAD_ARGS;
+        else if(!prof_fill(args[0], payload)) status = RPC_UNAVAILABLE;                     // Built with PROF_ENABLE 0
+        else len = PROF_RPC_SIZE;
+        break;
+
+      default:
+        status = RPC_BAD_METHOD;
+        break;
+    }
+
+  rpc_reply(caller, seq, method, status, payload, len);
+}
+
+//----------------------------------------------------------------------------------------
+// Process_Rpc_Rsp: Match a response with its pending call and complete it (client side)
+//----------------------------------------------------------------------------------------
+void Process_Rpc_Rsp(const CANFDMessage & message)
+{
+  if(message.len < RPC_RSP_HEADER) return;
+
+  const uint8_t label  = message.data[1];
+  const uint8_t seq    = message.data[2];
+  const uint8_t method = message.data[3];
+  const uint8_t status = message.data[4];
+  uint8_t       len    = message.data[5];
+  if(len > message.len - RPC_RSP_HEADER) len = message.len - RPC_RSP_HEADER;
+
+  RpcCallback cb    = nullptr;
+  uint32_t    start = 0;
+  bool        found = false;
+  ATOMIC()
+    {
+      for(uint8_t i = 0; i < RPC_MAX_PENDING; i++)
+        {
+          RpcPending* p = &rpcPending[i];
+          if(p->used && p->label == label && p->seq == seq && p->method == method)
+            {
+              cb      = p->callback;
+              start   = p->start;
+              p->used = false;
+              found   = true;
+              break;
+            }
+        }
+    }
+  if(!found) { rpcLate++; return; }                                                         // Timed out already or not ours
+
+  const uint32_t latency = micros() - start;
+  if(method < RPC_METHODS)
+    {
+      RpcStats* s = &rpcStats[method];
+      if(status == RPC_OK) s->ok++; else s->errors++;
+      if(s->ok + s->errors == 1 || latency < s->minUs) s->minUs = latency;
+      if(latency > s->maxUs) s->maxUs = latency;
+      s->sumUs += latency;
+    }
+  if(status == RPC_OK) rpc_cache(label, method, &message.data[RPC_RSP_HEADER], len);
+  if(cb) cb(label, method, status, &message.data[RPC_RSP_HEADER], len, latency);
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_cache: Keep BME and analog results in the telemetry cache
+//----------------------------------------------------------------------------------------
+void rpc_cache(uint8_t label, uint8_t method, const uint8_t* payload, uint8_t len)
+{
+  if(method == RPC_BME && len >= 5 && payload[0] >= BMETEMP && payload[0] <= BMECO2)
+    {
+      float value;
+      memcpy(&value, &payload[1], 4);
+      tlm_put(label, Q_TEMP + payload[0] - BMETEMP, value);
+    }
+  else if(method == RPC_ANA && len >= 3 && payload[0] <= 3)
+    tlm_put(label, Q_ANA0 + payload[0], (uint16_t)payload[1] | ((uint16_t)payload[2] << 8));
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_poll: Complete the calls whose deadline has passed. Called every 10 ms (TCC2).
+//----------------------------------------------------------------------------------------
+void rpc_poll(void)
+{
+  const uint32_t nowMs = millis();
+  for(uint8_t i = 0; i < RPC_MAX_PENDING; i++)
+    {
+      RpcPending* p = &rpcPending[i];
+      if(!p->used || (int32_t)(nowMs - p->deadline) < 0) continue;
+
+      RpcPending call;
+      bool expired = false;
+      ATOMIC()
+        {
+          if(p->used) { call = *p; p->used = false; expired = true; }                     // Response may have won the race
+        }
+      if(!expired) continue;
+      if(call.method < RPC_METHODS) rpcStats[call.method].timeouts++;
+      if(call.callback) call.callback(call.label, call.method, RPC_TIMEOUT, nullptr, 0, micros() - call.start);
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_stats: Print per method counters and round-trip latency
+//----------------------------------------------------------------------------------------
+void rpc_stats(void)
+{
+  if(!IDE) return;
+  static const char* const names[RPC_METHODS] = { "PING", "BME ", "ANA ", "SNAP", "PROF" };
+
+  uint8_t pending = 0;
+  for(uint8_t i = 0; i < RPC_MAX_PENDING; i++) if(rpcPending[i].used) pending++;
+
+  Serial.println(F("RPC     CALLS   OK      ERR     TIMEOUT MIN(us) AVG(us) MAX(us)"));
+  for(uint8_t m = 0; m < RPC_METHODS; m++)
+    {
+      const RpcStats* s = &rpcStats[m];
+      const uint32_t done = s->ok + s->errors;
+      Serial.print(names[m]);             Serial.print(F("    "));
+      Serial.print(s->calls);             Serial.print('\t');
+      Serial.print(s->ok);                Serial.print('\t');
+      Serial.print(s->errors);            Serial.print('\t');
+      Serial.print(s->timeouts);          Serial.print('\t');
+      Serial.print(s->minUs);             Serial.print('\t');
+      Serial.print(done ? (uint32_t)(s->sumUs / done) : 0); Serial.print('\t');
+      Serial.println(s->maxUs);
+    }
+  Serial.print(F("PENDING: "));   Serial.print(pending);
+  Serial.print(F("  LATE: "));    Serial.print(rpcLate);
+  Serial.print(F("  REFUSED: ")); Serial.println(rpcFull);
+}
+
+typedef struct {                                                                            // Completed call, printed by rpc_drain()
+  uint8_t  label;
+  uint8_t  method;
+  uint8_t  status;
+  uint8_t  len;
+  uint32_t latency;
+  uint8_t  payload[RPC_MAX_PAYLOAD];
+} RpcResult;
+
+static RpcResult        rpcResults[RPC_RESULTS];
+static volatile uint8_t rpcResultHead = 0;                                                  // Written by the callbacks, free running
+static volatile uint8_t rpcResultTail = 0;                                                  // Printed
+static uint32_t         rpcResultLost = 0;                                                  // Results not printed, ring full
+
+//----------------------------------------------------------------------------------------
+// Callback of the serial commands B, A, O, N and G 3: keep the result for rpc_drain().
+// Interrupt context, does not print.
+//----------------------------------------------------------------------------------------
+void rpc_print(uint8_t label, uint8_t method, uint8_t status, const uint8_t* payload, uint8_t len, uint32_t latency)
+{
+  if(!IDE) return;
+  ATOMIC()
+    {
+      if((uint8_t)(rpcResultHead - rpcResultTail) >= RPC_RESULTS) rpcResultLost++;
+      else
+        {
+          RpcResult* r = &rpcResults[rpcResultHead & (RPC_RESULTS - 1)];
+          r->label   = label;
+          r->method  = method;
+          r->status  = status;
+          r->len     = (len > RPC_MAX_PAYLOAD) ? RPC_MAX_PAYLOAD : len;
+          r->latency = latency;
+          if(payload) memcpy(r->payload, payload, r->len);
+          rpcResultHead++;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_show: Print one result
+//----------------------------------------------------------------------------------------
+static void rpc_show(uint8_t label, uint8_t method, uint8_t status, const uint8_t* payload, uint8_t len, uint32_t latency)
+{
+  Serial.print(F("RPC FROM: ")); Serial.print(label);
+  Serial.print(F("  "));
+
+  if(status != RPC_OK)
+    {
+      static const char* const text[] = { "OK", "TIMEOUT", "BAD METHOD", "BAD ARGUMENTS", "UNAVAILABLE", "SEND FAILED" };
+      Serial.println(status <= RPC_SEND_FAILED ? text[status] : "ERROR");
+      return;
+    }
+
+  switch(method)
+    {
+      case RPC_BME:
+        {
+          float value;
+          if(len < 5) break;
+          memcpy(&value, &payload[1], 4);
+          Serial.print(F("BME ")); Serial.print(payload[0]); Serial.print(F(": ")); Serial.print(value);
+          break;
+        }
+      case RPC_ANA:
+        {
+          if(len < 3) break;
+          uint16_t value = (uint16_t)payload[1] | ((uint16_t)payload[2] << 8);
+          Serial.print(F("ANALOG ")); Serial.print(payload[0]); Serial.print(F(": ")); Serial.print(value);
+          break;
+        }
+      case RPC_SNAP:
+        {
+          Snapshot snap;
+          if(len < SNAP_SIZE || payload[0] != SNAP_VERSION) { Serial.println(F("SNAPSHOT VERSION UNKNOWN")); return; }
+          memcpy(&snap, payload, SNAP_SIZE);
+          snapshot_print(label, &snap);
+          return;
+        }
+      case RPC_PROF:
+        prof_print_rpc(payload, len);
+        return;
+      default:
+        Serial.print(F("PONG"));
+        break;
+    }
+  Serial.print(F("  ")); Serial.print(latency); Serial.println(F(" us"));
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_drain: Print the results rpc_print() kept. Runs as a task (task.ino).
+//----------------------------------------------------------------------------------------
+void rpc_drain(void)
+{
+  while(rpcResultTail != rpcResultHead)
+    {
+      const RpcResult* r = &rpcResults[rpcResultTail & (RPC_RESULTS - 1)];
+      if(IDE) rpc_show(r->label, r->method, r->status, r->payload, r->len, r->latency);
+      rpcResultTail++;
+    }
+  if(rpcResultLost && IDE)
+    {
+      Serial.print(F("RPC RESULTS NOT PRINTED: ")); Serial.println(rpcResultLost);
+      rpcResultLost = 0;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// rpc_poll_all: One call per defined board, all in flight at once
+//----------------------------------------------------------------------------------------
+void rpc_poll_all(uint8_t method, uint8_t arg)
+{
+  uint8_t sent = 0;
+  for(uint8_t i = 0; i < DB_count; i++)
+    {
+      if(DB[i].TYPE == UNDEF || DB[i].LBL == LABEL) continue;
+      if(method == RPC_ANA && DB[i].TYPE == SWITCH) continue;
+      if(rpc_call(DB[i].LBL, method, &arg, method == RPC_SNAP ? 0 : 1, rpc_print)) sent++;
+    }
+  if(IDE) { Serial.print(F("RPC CALLS SENT: ")); Serial.println(sent); }
+}
@@ -14,16 +14,9 @@ typedef struct {
 
 void setup()
   {
-  	Serial.begin(115200);
-    unsigned long start = millis();
-
-// Wait up to 5 seconds for Serial to be ready
-    while(!Serial && (millis() - start < 5000)) { DELAY(10); }
-
-// Detection of IDE connection
-    if(Serial && Serial.dtr()) { IDE = true; } else { IDE = false; }
-  
-    randomSeed(micros());
+    DWT_Init();                                                                                   // Cycle counter first, the boot timeline counts from here
+    boot_mark(BOOT_ENTRY);
+  	Serial.begin(115200);                                                                         // Not waited for, bootTask sets IDE (boot.h)
 
     pinMode(PIN_CAN_STANDBY, OUTPUT);
     digitalWrite(PIN_CAN_STANDBY, false);                                                        // turn off STANDBY
@@ -37,6 +30,7 @@ void setup()
     CAN_BASE  = getCAN(UID);
     LABEL     = getLBL(UID);
     TYPE      = getTYPE(UID);
+    board_bind(TYPE);                                                                            // Handlers of this board type (board.h)
 
 // Set control frame
     stx = STX >> 8;                                                                              // Remove label from original STX marker
@@ -44,101 +38,56 @@ void setup()
     dle = DLE >> 8;
     ack = ACK >> 8;
     nak = NAK >> 8;
-
-#define VERSION   01             
-#define REVISION  00  
-
-const char  copyright[] PROGMEM = { "©2026 QIF / karel@qif.ch http://qif.ch" };
-
-    if(IDE)
-      {
-        Serial.println();                                                                         // Connected to IDE, print some debugging messages
-        Serial.println ((const __FlashStringHelper *) copyright);
-        Serial.println(F("CONNECTED TO THE QIF/BATOTIK"));
-        Serial.print(F("VERSION:      "));
-        Serial.print(VERSION);
-        Serial.print('.');
-        Serial.print(REVISION);
-        Serial.print("  ");
-        now = DateTime(F(__DATE__), F(__TIME__));                                                 // if IDE connected to a PC
-        Serial.print(now.timestamp(DateTime::TIMESTAMP_DATE));
-        Serial.print(" ");
-        Serial.println(now.timestamp(DateTime::TIMESTAMP_TIME)); 
-        Serial.print(F("GENERATED ON: "));
-        Serial.println(LABEL);
-        Serial.print(F("BOARD:        "));
-        Serial.println(BOARD_NAME);
-        Serial.print(F("UUID:         0x"));
-        for(uint8_t i = 0; i < (8 > 8 ? 8 : 8); i++) { UUID[i] = UniqueID[i]; Serial.print(UniqueID[i], HEX); }
-        Serial.println(); 
-        Serial.print(F("UID:          0x"));
-        Serial.println(UID, HEX);
-        Serial.print(F("LABEL:        "));
-        Serial.println(LABEL);
-        Serial.print(F("CAN:          0x"));
-        Serial.println(CAN_BASE,HEX);
-        Serial.print(F("TYPE:         "));
-        Serial.println(typeToString(DB[LABEL].TYPE));
-        Serial.print(F("DB SIZE       "));
-        Serial.println(sizeof(DB));
-        uint32_t flash_used = (uint32_t)&__etext;
-        Serial.print("FLASH USED:   ");
-        Serial.print((float)flash_used / 1024.0, 2);
-        Serial.println(" KB");
-      } 
-
-    if(!IDE) now = 946728000;                                                                     // Not connected set at 1/1/2000 12:00:00
-
     strip.begin();
     strip.setBrightness(10);
+    boot_mark(BOOT_IDENT);
 
-    rtc.begin();
-    rtc.adjust(now);             
-    DateTime alarm = DateTime(now.year(), now.month(), now.day(), now.hour(), now.minute() + 1, now.second());
-    rtc.setAlarm(0, alarm);
-    rtc.enableAlarm(0, rtc.MATCH_SS);
-    rtc.attachInterrupt(alarmMatch);                                                              // RTC interrupt evey minute
-
+    InitPins(LABEL);                                                                              // Safe output states, quiet: IDE is not known yet
+    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
+      {
+        saved_PWM[i] = 0;
+        pwmDir[i] = 0;
+        pwmPendingResume[i] = false;
+        pwmNextDuty[i] = 0;
+        pwmNextDir[i] = 0;
 
-    Wire.begin();
-    Wire.setClock(250000);                                                                        // Start the I2C bus at 250 kbps
-    ScanI2C();
-    if(BME688 != 0)
+        boardOps.duty(i, 0);                                                                     // 0%, max duty on SWITCH to turn off the active-low LEDs
+      }
+    if(TYPE == LPOWER)
       {
-        BME_FLAG = true;
-        Wire.beginTransmission(BME688);
+        analogReadResolution(12);                                                                 // Set ADC resolution to 12 bits (0–4096)
+        analogReference(AR_DEFAULT);                                                              // Use internal 1.0 V reference
       }
-    else Wire.endTransmission();                                                                  // No module present, disable I2C
+    if(!ITimer.attachInterruptInterval(TIMER_INTERVAL_US, boardOps.pwm))                           // Start PWM timer interrupt, duties already at 0 %
+      boot.failed |= 1UL << BOOT_OUTPUTS;
+    boot_mark(BOOT_OUTPUTS);
 
-    if(BME_FLAG) { if(IDE) Serial.println(F("BME688        MODULE FOUND")); }
-    else { if(IDE) Serial.println(F("BME688        MODULE NOT FOUND")); }
+    prof_reset();                                                                                 // Profiler counters and ISR periods (prof.h)
+    timer_init();                                                                                 // Empty timing wheel, before its tick starts
+    TCC2_Setup();                                                                                 // Setup timer counter interrupt handler
 
-    if(BME_FLAG)
-        {
-          iaqSensor.begin(BME688, Wire);                                                          // I2C connect to BME688
-
-        if(IDE)
-          {
-            Serial.print(F("BSEC LIBRARY VERSION: ")) ;
-            Serial.print(iaqSensor.version.major);
-            Serial.print("." );
-            Serial.println(iaqSensor.version.minor);
-          }
-        DELAY(1000);
-        iaqSensor.updateSubscription(sensorList, 13, BSEC_SAMPLE_RATE_LP);
-        checkIaqSensorStatus();
-        readBME();
-        }
-      
-    if(!flash.begin())                                                                            // Initialize QSPI flash
+    if(!CAN_Setup())                                                                              // Initializes CAN
       {
-        if(IDE) Serial.println(F("Failed to initialize QSPI flash"));
+        if(IDE) Serial.println(F("Filter apply failed"));
         while (true)
           {
-            BLINK(LILAC); DELAY(1000);                                                            // Error
+            BLINK(LILAC); DELAY(1000);
           }
       }
-    if(IDE) Serial.println(F("QSPI MEMORY   INITIALIZED"));
+    boot_mark(BOOT_CAN);
+
+    if(!IDE) now = 946728000;                                                                     // 1/1/2000 12:00:00, bootTask sets the build time with an IDE
+    rtc.begin();
+    rtc.adjust(now);
+    DateTime alarm = DateTime(now.year(), now.month(), now.day(), now.hour(), now.minute() + 1, now.second());
+    rtc.setAlarm(0, alarm);
+    rtc.enableAlarm(0, rtc.MATCH_SS);
+    rtc.attachInterrupt(alarmMatch);                                                              // RTC interrupt evey minute
+
+    startDelay(0, 1000);                                                                           // Init with 1000    * 1ms  -> 1000ms   (1 second)
+    startDelay(1, 2000);                                                                           // Init with 2000    * 1ms  -> 2000ms   (2 second)
+    startDelay(2, 60000);                                                                          // Init with 60000   * 1 ms -> 6000ms   (1 minute)
+    startDelay(3, 3600000);                                                                        // Init with 3600000 * 1 ms -> 360000ms (1 hour)
 
 /*
   if(!eraseQSPI()) if(IDE) Serial.println(F("QSPI ERASE FAILED"));                                // Erase all QSPI memory (all 0xff)
@@ -146,61 +95,9 @@ const char  copyright[] PROGMEM = { "©2026 QIF / karel@qif.ch http://qif.ch" };
   verifyQSPI();
 */
 
-  DWT_Init();                                                                                     // Initialize the cycle counter
-  TCC2_Setup();                                                                                   // Setup timer counter interrupt handler
-
-  if(!CAN_Setup())                                                                                // Initializes CAN
-    {
-      if(IDE) Serial.println(F("Filter apply failed"));
-      while (true)
-        {
-          BLINK(LILAC); DELAY(1000);
-        }
-    } 
-  if(IDE) Serial.println();  
-
-  startDelay(0, 1000);                                                                             // Init with 1000    * 1ms  -> 1000ms   (1 second)
-  startDelay(1, 2000);                                                                             // Init with 2000    * 1ms  -> 2000ms   (2 second)
-  startDelay(2, 60000);                                                                            // Init with 60000   * 1 ms -> 6000ms   (1 minute)
-  startDelay(3, 3600000);                                                                          // Init with 3600000 * 1 ms -> 360000ms (1 hour)
-
-  InitPins(LABEL);
-
-  if(TYPE == LPOWER)
-    {
-      analogReadResolution(12);                                                                     // Set ADC resolution to 12 bits (0–4096)     
-      analogReference(AR_DEFAULT);                                                                  // Use internal 1.0 V reference
-      DELAY(1);
-      Serial.println();
-      float measuredvbat = analogRead(A6);                                                          // Read raw ADC value (0–4095)
-      measuredvbat = (measuredvbat * 2.0 * 3.3) / 4096.0;                                           // Measure was divided by 2, multiply back, multiply by 1.0V, 1.0V internal
-      if(IDE) { Serial.print("BATTERY: " ); Serial.print(measuredvbat); Serial.println(F(" Volt")); }
-    }
-
-  if(!ITimer.attachInterruptInterval(TIMER_INTERVAL_US, TimerHandler))                              // Start PWM timer interrupt
-    {                              
-      if(IDE)Serial.println(F("Failed to start ITimer!"));
-    }
-  else
-    {
-      if(IDE)Serial.println(F("8-CHANNEL PWM STARTED."));                                           // Set all PWM channels duty cycle
-
-
-    for (uint8_t i = 0; i < PWM_CHANNELS; i++)
-      {
-        saved_PWM[i] = 0;
-        pwmDir[i] = 0;
-        pwmPendingResume[i] = false;
-        pwmNextDuty[i] = 0;
-        pwmNextDir[i] = 0;
-        pwmStopTime[i] = 0;
-
-        if(TYPE == SWITCH) pwmDuty[i] = map(100, 0, 100, 0, PWM_RESOLUTION);                         // Inverted logic — 0% → max duty to turn off LED (active-low)
-        else pwmDuty[i] = 0;                                                                         // Motors or non-inverted outputs
-      }
-    }
-
-  Help();
+    sched_init();                                                                                 // Cooperative tasks, loop() only runs sched_run()
+    task_start(bootTask, nullptr, "BOOT");                                                        // Serial, QSPI, I2C, BME, battery in the background (boot.h)
+    boot_mark(BOOT_SCHED);
 
 //  WDT_Setup();                                                                                      // Watchdog setup (not used at this time of development)                                                                       
   }
@@ -297,7 +194,7 @@ bool CAN_Setup(void)
 
   // Configure software driver buffers (used between hardware and app)
   settings.mDriverReceiveFIFO0Size      = 256;                                                        // Software RX FIFO0 size
-  settings.mDriverTransmitFIFOSize      = 128;                                                        // Software TX buffer size                                             
+  settings.mDriverTransmitFIFOSize      = TXQ_DRIVER_FIFO;                                            // Software TX buffer size, kept short: txqueue does the buffering
 
   const uint32_t errorCode = can1.beginFD(settings);
     if(errorCode != 0)
@@ -325,7 +222,8 @@ FilterEntry ServiceFilters[] = {
   { (uint16_t)(SVR + Gps),          (uint16_t)(SVR + Gps),          Process_GPS         },
   { (uint16_t)(SVR + Gyro),         (uint16_t)(SVR + Gyro),         Process_Gyro        },
   { (uint16_t)(SVR + Anl),          (uint16_t)(SVR + Anl),          Process_Analog_RX   },
-  { (uint16_t)(SVR + Pir),          (uint16_t)(SVR + Pir),          Process_Pir         }
+  { (uint16_t)(SVR + Pir),          (uint16_t)(SVR + Pir),          Process_Pir         },
+  { (uint16_t)(SVR + Bme),          (uint16_t)(SVR + Bme),          Process_BME_Telemetry }
 };
 
 const size_t ServiceFilterCount = sizeof(ServiceFilters) / sizeof(FilterEntry);
@@ -342,6 +240,7 @@ FilterEntry SwitchFilters[] = {
   { (uint16_t)(CAN_BASE + 0x05),    (uint16_t)(CAN_BASE + 0x05),    Process_Led         },
   { (uint16_t)(CAN_BASE + 0x06),    (uint16_t)(CAN_BASE + 0x06),    Process_Led         },
   { (uint16_t)(CAN_BASE + 0x07),    (uint16_t)(CAN_BASE + 0x07),    Process_Led         },
+  { (uint16_t)(CAN_BASE + ctl),     (uint16_t)(CAN_BASE + ctl),     Process_Ctl         },
   { (uint16_t)(CAN_BASE + 0x0F),    (uint16_t)(CAN_BASE + 0x0F),    Process_BME         }
 };
 const size_t SwitchFilterCount = sizeof(SwitchFilters) / sizeof(FilterEntry);
@@ -364,6 +263,7 @@ FilterEntry LpowerFilters[] = {
   { (uint16_t)(CAN_BASE + 0x0B),    (uint16_t)(CAN_BASE + 0x0B),    Process_Analog      },
   { (uint16_t)(CAN_BASE + 0x0C),    (uint16_t)(CAN_BASE + 0x0C),    Process_Analog      },
   { (uint16_t)(CAN_BASE + 0x0D),    (uint16_t)(CAN_BASE + 0x0D),    Process_Isense      },
+  { (uint16_t)(CAN_BASE + ctl),     (uint16_t)(CAN_BASE + ctl),     Process_Ctl         },
   { (uint16_t)(CAN_BASE + 0x0F),    (uint16_t)(CAN_BASE + 0x0F),    Process_BME         }
 };
 const size_t LpowerFilterCount = sizeof(LpowerFilters) / sizeof(FilterEntry);
@@ -384,6 +284,7 @@ FilterEntry MpowerFilters[] = {
   { (uint16_t)(CAN_BASE + 0x0B),    (uint16_t)(CAN_BASE + 0x0B),    Process_Analog      },
   { (uint16_t)(CAN_BASE + 0x0C),    (uint16_t)(CAN_BASE + 0x0C),    Process_Analog      },
   { (uint16_t)(CAN_BASE + 0x0D),    (uint16_t)(CAN_BASE + 0x0D),    Process_Isense      },
+  { (uint16_t)(CAN_BASE + ctl),     (uint16_t)(CAN_BASE + ctl),     Process_Ctl         },
   { (uint16_t)(CAN_BASE + 0x0F),    (uint16_t)(CAN_BASE + 0x0F),    Process_BME }
 };
 const size_t MpowerFilterCount = sizeof(MpowerFilters) / sizeof(FilterEntry);
@@ -404,6 +305,7 @@ FilterEntry HpowerFilters[] = {
   { (uint16_t)(CAN_BASE + 0x0B),    (uint16_t)(CAN_BASE + 0x0B),    Process_Analog      },
   { (uint16_t)(CAN_BASE + 0x0C),    (uint16_t)(CAN_BASE + 0x0C),    Process_Analog      },
   { (uint16_t)(CAN_BASE + 0x0D),    (uint16_t)(CAN_BASE + 0x0D),    Process_Isense      },
+  { (uint16_t)(CAN_BASE + ctl),     (uint16_t)(CAN_BASE + ctl),     Process_Ctl         },
   { (uint16_t)(CAN_BASE + 0x0F),    (uint16_t)(CAN_BASE + 0x0F),    Process_BME         }
 };
 const size_t HpowerFilterCount = sizeof(HpowerFilters) / sizeof(FilterEntry);
@@ -455,6 +357,20 @@ for (uint8_t group = 0; group < 2; group++) {
   }
 }
 
+// Group subscriptions of this board (db.h GROUPS), one filter per group
+for (uint8_t i = 0; i < GROUPS_count; i++) {
+  if (GROUPS[i].LBL != LABEL) continue;
+  bool installed = false;
+  for (uint8_t j = 0; j < i; j++)                                                                      // Same group listed twice: one filter is enough
+    if (GROUPS[j].LBL == LABEL && GROUPS[j].GRP == GROUPS[i].GRP) installed = true;
+  if (!installed)
+    filterManager_add(&filterManager,
+                      GRP(GROUPS[i].GRP),
+                      GRP(GROUPS[i].GRP),
+                      ACANFD_FeatherM4CAN_FilterAction::FIFO0,
+                      Process_Group);
+}
+
 // Initialize CAN with settings and filter
     bool status = filterManager_apply(&filterManager, &can1, &settings);                               // Apply filter
     if(!status && IDE) { Serial.println(F("Filter not applied!")); }
@@ -562,12 +478,24 @@ void InitPins(uint8_t label)
     if(IDE) { Serial.println(); Serial.println(F("PINS INIT:    DONE")); };
   }
 
+//----------------------------------------------------------------------------------------
+// startDelay: Set delays[slot].flag in ticks ms. One-shot timer on the wheel (timer.h),
+// restarting a slot cancels its previous timer.
+//----------------------------------------------------------------------------------------
+void delayExpired(uint32_t slot)
+{
+  delays[slot].flag   = true;                                                              // Mark task as completed
+  delays[slot].active = false;                                                             // Auto-disable after expiry
+  delays[slot].timer  = 0;
+}
+
 void startDelay(uint8_t slot, uint64_t ticks) 
 {
   if (slot >= MAX_TIMERS) return;
-  delays[slot].counter = ticks;
-  delays[slot].active = true;
+  timer_cancel(delays[slot].timer);
   delays[slot].flag = false;
+  delays[slot].timer = timer_start(ticks > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)ticks, 0, delayExpired, slot, TIMER_IRQ);
+  delays[slot].active = delays[slot].timer != 0;
 }
 
 const char* typeToString(uint8_t type) {
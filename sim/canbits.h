@@ -0,0 +1,150 @@
+
+// ~/Arduino/QIF/sim/canbits.h Bit-level CAN / CAN FD frame, simulator
+
+/*
+Frame on the wire, bit by bit
+
+can_wire() lays out a base-format frame as the controller puts it on the bus
+(ISO 11898-1:2015): SOF to the end of the data field with the dynamic stuff
+bits, then the tail that does not depend on the content:
+
+  classic      CRC-15 (stuffed, computed), CRC delimiter, ACK slot + delimiter,
+               EOF 7, intermission 3
+  CAN FD       stuff count (4) and CRC-17 / CRC-21 with fixed stuff bits every
+               4 bits, CRC delimiter, ACK slot + delimiter, EOF 7, intermission 3
+
+With bit rate switch the data phase runs from ESI to the CRC delimiter at the
+data rate, the rest at the nominal rate. The stuffed bits SOF..data are kept:
+the arbitration compares them bit by bit, dominant (0) wins, and two frames of
+the same ID with different content part at their first differing bit (bit
+error, error frame). The CRC of a CAN FD frame is behind fixed stuff bits, its
+value does not change the length and is not computed.
+*/
+
+#ifndef   CANBITS_H
+#define   CANBITS_H
+
+#include <cstdint>
+
+#define CANBITS_MAX       720                                                                       // SOF..64 data bytes, stuffed
+#define CAN_TAIL_NOM      12                                                                        // ACK slot, ACK delimiter, EOF, intermission
+#define CAN_ERROR_BITS    23                                                                        // Error flags (superposed) 12, delimiter 8, intermission 3
+
+typedef struct {
+  uint16_t n;                                                                                       // Stuffed bits SOF..end of data field
+  uint16_t arbEnd;                                                                                  // First bit after the arbitration field (RRS / RTR)
+  uint16_t brsAt;                                                                                   // First data-rate bit, n: no bit rate switch
+  uint16_t nomBits;                                                                                 // Whole frame at the nominal rate
+  uint16_t dataBits;                                                                                // Whole frame at the data rate
+  uint16_t stuffBits;                                                                               // Dynamic stuff bits
+  uint8_t  bit[CANBITS_MAX];
+} CanWire;
+
+static const uint8_t canFdLen[7] = { 12, 16, 20, 24, 32, 48, 64 };                                 // DLC 9..15
+
+static inline uint8_t can_dlc(uint8_t len)
+{
+  if(len <= 8) return len;
+  for(uint8_t i = 0; i < 7; i++) if(len <= canFdLen[i]) return 9 + i;
+  return 15;
+}
+
+//----------------------------------------------------------------------------------------
+// can_wire: Bits and durations of a standard-ID frame. fd: CAN FD format, brs: data
+// phase at the data rate.
+//----------------------------------------------------------------------------------------
+static inline void can_wire(CanWire* w, uint16_t id, const uint8_t* data, uint8_t len, bool fd, bool brs)
+{
+  uint8_t  raw[CANBITS_MAX];
+  uint16_t n = 0, arbEnd = 0, brsRaw = 0xFFFF;
+  auto put = [&](uint32_t v, uint8_t bits) { while(bits--) raw[n++] = (v >> bits) & 1; };
+
+  if(!fd) brs = false;
+  put(0, 1);                                                                                        // SOF
+  put(id & 0x7FF, 11);
+  put(0, 1);                                                                                        // RTR (data frame) / RRS
+  arbEnd = n;
+  put(0, 1);                                                                                        // IDE
+  if(fd)
+    {
+      put(1, 1);                                                                                    // FDF
+      put(0, 1);                                                                                    // res
+      put(brs ? 1 : 0, 1);                                                                          // BRS
+      if(brs) brsRaw = n;
+      put(0, 1);                                                                                    // ESI, error active
+    }
+  else put(0, 1);                                                                                   // r0
+  const uint8_t dlc = can_dlc(len);
+  put(dlc, 4);
+  const uint8_t bytes = fd ? (dlc <= 8 ? dlc : canFdLen[dlc - 9]) : (len > 8 ? 8 : len);
+  for(uint8_t i = 0; i < bytes; i++) put(i < len ? data[i] : 0, 8);
+
+  if(!fd)
+    {
+      uint16_t crc = 0;                                                                             // CRC-15, x^15+x^14+x^10+x^8+x^7+x^4+x^3+1
+      for(uint16_t i = 0; i < n; i++)
+        {
+          const bool x = raw[i] ^ ((crc >> 14) & 1);
+          crc = (crc << 1) & 0x7FFF;
+          if(x) crc ^= 0x4599;
+        }
+      put(crc, 15);
+    }
+
+  uint16_t out = 0, stuff = 0, run = 0, brsAt = 0xFFFF;
+  uint8_t  last = 2;
+  for(uint16_t i = 0; i < n; i++)
+    {
+      if(i == brsRaw) brsAt = out;
+      w->bit[out++] = raw[i];
+      run  = (raw[i] == last) ? run + 1 : 1;
+      last = raw[i];
+      if(i == arbEnd - 1) w->arbEnd = out;
+      if(run == 5 && (i + 1 < n || !fd))                                                            // Stuff bit of opposite value, CAN FD: the fixed one follows
+        {
+          w->bit[out++] = !last;
+          last = !last;
+          run  = 1;
+          stuff++;
+        }
+    }
+  w->n         = out;
+  w->stuffBits = stuff;
+  w->brsAt     = brs ? brsAt : out;
+
+  uint16_t tailData = 0, tailNom = CAN_TAIL_NOM;
+  if(fd)
+    {
+      const uint8_t crcBits = (bytes <= 16) ? 17 : 21;
+      const uint8_t field   = 4 + crcBits;                                                          // Stuff count and CRC
+      tailData = field + (field - 1) / 4 + 1 + 1;                                                   // Fixed stuff bits, CRC delimiter
+    }
+  else tailNom += 1;                                                                                // CRC delimiter (the CRC is in the stuffed part)
+  if(brs)
+    {
+      w->nomBits  = w->brsAt + tailNom;
+      w->dataBits = (out - w->brsAt) + tailData;
+    }
+  else
+    {
+      w->nomBits  = out + tailData + tailNom;
+      w->dataBits = 0;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// can_time_ns: Duration of the first bits of the frame, bits = n: up to the end of the
+// data field; whole frame with can_frame_ns()
+//----------------------------------------------------------------------------------------
+static inline int64_t can_time_ns(const CanWire* w, uint16_t bits, int64_t tNom, int64_t tData)
+{
+  if(bits <= w->brsAt) return bits * tNom;
+  return w->brsAt * tNom + (bits - w->brsAt) * tData;
+}
+
+static inline int64_t can_frame_ns(const CanWire* w, int64_t tNom, int64_t tData)
+{
+  return w->nomBits * tNom + w->dataBits * tData;
+}
+
+#endif
@@ -0,0 +1,99 @@
+
+// ~/Arduino/QIF/sim/host.h Host build of firmware files, simulator and benchmarks
+
+/*
+Host build of firmware files
+
+The host programs include firmware files as they are (txqueue.ino, db.h, ...),
+this header stands in for the Arduino core, the ACANFD driver and the parts of
+qif.h they use. Interrupts do not exist: ATOMIC() is a plain block, BLINK and
+the profiler probes compile to nothing.
+
+The host program defines millis(), micros() and can1.tryToSendReturnStatusFD():
+the simulator runs them on the clock and the controller of the node being run.
+
+IDE gates the prints as on the board, Serial writes to stdout.
+*/
+
+#ifndef   HOST_H
+#define   HOST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#define QIF_H                                                                                       // The sketch header is not used on the host
+#define PROGMEM
+#define F(s)              (s)
+
+inline bool IDE          = false;
+inline bool MONITOR_FLAG = false;
+
+uint32_t millis(void);
+uint32_t micros(void);
+
+static inline void noInterrupts(void) {}
+static inline void interrupts(void)   {}
+
+#define ATOMIC()          for (bool _once = (noInterrupts(), true); _once; _once = (interrupts(), false))
+#define BLINK(color)      do { } while(0)
+#define PROF_SCOPE(id)
+#define PROF_PERIOD(id)
+#define DLOG(...)         do { } while(0)
+#define DLOG_DATA(...)    do { } while(0)
+
+//----------------------------------------------------------------------------------------
+// ACANFD
+//----------------------------------------------------------------------------------------
+struct CANFDMessage {
+  enum Type : uint8_t { CAN_REMOTE, CAN_DATA, CANFD_NO_BIT_RATE_SWITCH, CANFD_WITH_BIT_RATE_SWITCH };
+  uint32_t id;
+  bool     ext;
+  Type     type;
+  uint8_t  idx;
+  uint8_t  len;
+  union {
+    uint64_t data64[8];
+    uint32_t data32[16];
+    uint8_t  data[64];
+  };
+};
+
+struct HostCan {
+  uint32_t tryToSendReturnStatusFD(const CANFDMessage& frame);                                      // Host program: the controller of the running node
+};
+
+extern HostCan can1;
+
+//----------------------------------------------------------------------------------------
+// Serial, printed with an IDE only
+//----------------------------------------------------------------------------------------
+struct HostSerial {
+  void print(const char* s)                { if(IDE) fputs(s, stdout); }
+  void print(char c)                       { if(IDE) putchar(c); }
+  void print(double v, int digits = 2)     { if(IDE) printf("%.*f", digits, v); }
+  template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+  void print(T v, int base = 10)
+  {
+    if(!IDE) return;
+    if(base == 16) printf("%llX", (unsigned long long)v);
+    else if(std::is_signed<T>::value) printf("%lld", (long long)v);
+    else printf("%llu", (unsigned long long)v);
+  }
+  void println(void)                       { print('\n'); }
+  template<typename T> void println(T v)   { print(v); println(); }
+  template<typename T> void println(T v, int f) { print(v, f); println(); }
+};
+
+inline HostSerial Serial;
+
+//----------------------------------------------------------------------------------------
+// db.h function table, the handlers are not run on the host
+//----------------------------------------------------------------------------------------
+#define HOST_FCT(name)    static inline void name(const CANFDMessage&) {}
+HOST_FCT(DUMMY)
+HOST_FCT(FCT00) HOST_FCT(FCT01) HOST_FCT(FCT02) HOST_FCT(FCT03) HOST_FCT(FCT04) HOST_FCT(FCT05) HOST_FCT(FCT06) HOST_FCT(FCT07)
+HOST_FCT(FCT08) HOST_FCT(FCT09) HOST_FCT(FCT10) HOST_FCT(FCT11) HOST_FCT(FCT12) HOST_FCT(FCT13) HOST_FCT(FCT14) HOST_FCT(FCT15)
+
+#endif
@@ -0,0 +1,434 @@
+
+// ~/Arduino/QIF/sim/qifbench.cpp Host build of the benchmark suite
+
+/*
+Benchmark suite on the host
+
+The cases of bench.h, compiled for the host from the firmware files as they are
+and run on a nanosecond clock. Same JSON as serial command G 6 on the board, to
+stdout:
+
+  g++ -O2 -std=gnu++17 -o qifbench sim/qifbench.cpp
+  ./qifbench > new.json
+  tools/benchcmp.py old.json new.json
+
+Firmware built here: crc64.ino, update.h, lookup.ino, click.ino, board.ino,
+txqueue.ino, timer.ino, tsdb.ino and bench.ino. The rest is a stand-in:
+
+  pins          digitalRead() reads released switches (HIGH), digitalWrite() and
+                analogRead() store to a port image, so the PWM loop is not
+                optimized away
+  filters       filterManager holds a table like CAN_Setup() (setup.ino) gives
+                a SWITCH board: service block, own block, groups
+  board         label 1, the PWM cases of every type are run
+  flash         the 8 MB QSPI as a RAM array (readBuffer, writeBuffer, eraseSector),
+                programming only clears bits as on the NOR flash
+  DWT->CYCCNT   a counter, one step per read: timer_tick() reads it twice, a clock
+                read would cost more than the tick (its slowest tick means nothing)
+
+Cases of the host only (BENCH_MORE):
+
+  pwm_legacy_TYPE
+                TimerHandler() as it was before board_pwm<T> (board.h), a copy
+                that computes isHBridge and tests TYPE on every call, run as
+                pwm_TYPE is: the before and after of the specialization, per type
+  timer_N       timer_tick() with N periodic timers running, periods from 2 ms to
+                60 s, callbacks in the tick (TIMER_IRQ). Per tick, cascades and
+                callbacks included. Only the timers that fire or cascade cost,
+                no tick walks all N of them
+  tsdb_add      tsdb_append() of 8 series sampled every 10 s, 4 BME values of a
+                remote board and the 4 analog inputs, pages and erases included.
+                The rate is 1e9 / ns samples per second, bytes_sample the flash
+                used per sample, page headers and unused tails counted
+  tsdb_hour     tsdb_query() of the last hour of one series over all that history
+  tsdb_day      the last 24 hours, samples: samples visited per query
+
+Host times say whether a change made a routine faster or slower, not how long
+it takes on the SAME51: compare host with host, board with board.
+*/
+
+#include "host.h"
+#include "../db.h"
+#include "../crc64.h"
+#include "../qspi.h"
+#include "../telemetry.h"
+#include "../capture.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------------------
+// qif.h, the part the firmware files below use
+//----------------------------------------------------------------------------------------
+#define N                 8
+#define SHORT             20
+#define VERY_LONG         100
+#define WAIT_RESET        200
+#define SHORT_DELAY_LIMIT 20
+#define PWM_CHANNELS      8
+#define PWM_RESOLUTION    63
+#define QSPI_PAGE_SIZE    256
+#define QSPI_BLOCK_SIZE   4096
+#define MAX_FILTERS       128
+#define ON                1
+#define OFF               0
+#define HIGH              1
+#define LOW               0
+#define CAN_NULL          0x0400
+#define CTL_HEADER        3
+
+enum CTL : uint8_t { CTL_NONE = 0, CTL_BATCH, CTL_RPC_REQ, CTL_RPC_RSP, CTL_TS_QUERY, CTL_TS_DATA };
+
+typedef void (*FilterCallback)(const CANFDMessage &);
+
+enum ClickValue : uint8_t { CLICK_NONE = 0, CLICK_S, CLICK_SS, CLICK_L, CLICK_SL, CLICK_VL };
+
+typedef struct {
+  uint8_t tim, wait, cnt, longCnt, state, shortDetected, shortDelay;
+} Switch;
+
+typedef struct {                                                                                    // Main sketch, filter manager
+  uint16_t       idStart;
+  uint16_t       idEnd;
+  uint8_t        action;
+  FilterCallback callback;
+  bool           valid;
+} CANFilterEntry;
+
+typedef struct {
+  CANFilterEntry entries[MAX_FILTERS];
+  uint8_t        count;
+} CANFilterManager;
+
+//----------------------------------------------------------------------------------------
+// Main sketch globals and the Arduino core
+//----------------------------------------------------------------------------------------
+uint8_t           LABEL = 1;
+uint8_t           TYPE  = SWITCH;
+const char*       typeNames[] = { "UNDEF", "SWITCH", "LPOWER", "MPOWER", "HPOWER" };
+uint8_t           pwmPins[PWM_CHANNELS * 2];                                                        // H-bridge boards: two pins per channel
+volatile uint8_t  pwmDuty[PWM_CHANNELS];
+volatile uint8_t  pwmDir[PWM_CHANNELS];
+volatile uint8_t  pwmTick;
+volatile uint16_t Isense;
+uint8_t           analogPins[4];
+uint8_t           switchPins[N];
+Switch            switchState[N];
+CANFilterManager  filterManager;
+volatile bool     STX_FLAG = false;                                                                 // No firmware update running
+
+static volatile uint8_t port[64];                                                                   // Pin levels
+
+static inline int  digitalRead(uint8_t pin)              { (void)pin; return HIGH; }
+static inline void digitalWrite(uint8_t pin, uint8_t v)  { port[pin & 63] = v; }
+static inline int  analogRead(uint8_t pin)               { return port[pin & 63] + 512; }
+static inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+HostCan can1;
+static const auto hostStart = std::chrono::steady_clock::now();
+
+static inline uint64_t host_ns(void)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+uint32_t millis(void) { return (uint32_t)(host_ns() / 1000000); }
+uint32_t micros(void) { return (uint32_t)(host_ns() / 1000); }
+
+struct HostCycles { uint32_t n; operator uint32_t() { return n++; } };
+struct HostDwt    { HostCycles CYCCNT; };
+static HostDwt hostDwt;
+#define DWT               (&hostDwt)
+
+struct HostRtc {                                                                                    // RTC_SAMD51
+  struct DateTime { uint32_t t; uint32_t unixtime(void) const { return t; } };
+  DateTime now(void) { return DateTime{ (uint32_t)(1700000000UL + millis() / 1000) }; }
+};
+
+struct HostFlash {                                                                                  // Adafruit_SPIFlash on a RAM array, 8 MB
+  std::vector<uint8_t> mem = std::vector<uint8_t>(8UL << 20, 0xFF);
+  uint32_t size(void) { return mem.size(); }
+  uint32_t readBuffer(uint32_t addr, uint8_t* buf, uint32_t len)
+  {
+    if(addr + len > mem.size()) return 0;
+    memcpy(buf, &mem[addr], len);
+    return len;
+  }
+  uint32_t writeBuffer(uint32_t addr, const uint8_t* buf, uint32_t len)
+  {
+    if(addr + len > mem.size()) return 0;
+    for(uint32_t i = 0; i < len; i++) mem[addr + i] &= buf[i];                                      // Programming clears bits only
+    return len;
+  }
+  bool eraseSector(uint32_t sector)
+  {
+    if((sector + 1) * QSPI_BLOCK_SIZE > mem.size()) return false;
+    memset(&mem[sector * QSPI_BLOCK_SIZE], 0xFF, QSPI_BLOCK_SIZE);
+    return true;
+  }
+};
+
+HostRtc   rtc;
+HostFlash flash;
+
+//----------------------------------------------------------------------------------------
+// Firmware, the prototypes the Arduino builder would make
+//----------------------------------------------------------------------------------------
+#define BENCH_CLOCK()     ((uint32_t)host_ns())                                                     // Differences only, wraps after 4 s
+#define BENCH_HZ          1000000000UL
+#define BENCH_TARGET      "host"
+#define BENCH_TYPES       ((1U << SWITCH) | (1U << LPOWER) | (1U << MPOWER) | (1U << HPOWER))
+#define BENCH_SCALE       64                                                                        // The host clock is coarser than the cycles
+#define BENCH_MORE(first) bench_host(first)
+
+#include "../txqueue.h"
+#include "../task.h"
+#include "../update.h"
+#include "../board.h"
+#include "../bench.h"
+#include "../timer.h"
+#include "../batch.h"
+#include "../tsdb.h"
+
+uint32_t HostCan::tryToSendReturnStatusFD(const CANFDMessage&) { return kTryToSendReturnStatusFD_OK; }
+void           Switch_Handler(void);
+void           Send_Click(uint8_t n, ClickValue value);
+void           clickSent(uint16_t handle, uint16_t id, uint8_t status) { (void)handle; (void)id; (void)status; }
+uint16_t       Lbl2Can(uint8_t lbl);
+uint8_t        getLBL(uint64_t uid);
+FilterCallback filter_lookup(const CANFilterManager* mgr, uint16_t id);
+static void    bench_host(bool* first);
+
+bool sendCANFDFrame(const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio)                   // routine.ino
+{
+  return canSend(data, len, id, prio) != 0;
+}
+
+#include "../crc64.ino"
+#include "../txqueue.ino"
+#include "../lookup.ino"
+#include "../click.ino"
+#include "../board.ino"
+#include "../batch.ino"
+#include "../timer.ino"
+#include "../tsdb.ino"
+#include "../bench.ino"
+
+//----------------------------------------------------------------------------------------
+// TimerHandler as it was before board_pwm<T> (board.h): TYPE tested in the interrupt
+//----------------------------------------------------------------------------------------
+static void pwm_legacy(void)
+{
+  pwmTick++;
+  if (pwmTick >= PWM_RESOLUTION) pwmTick = 0;
+
+  const bool isHBridge = (TYPE == MPOWER || TYPE == HPOWER);
+  bool anyActive = false;  // Track if any channel is running
+
+  for (uint8_t ch = 0; ch < PWM_CHANNELS; ch++)
+  {
+    const uint8_t duty = pwmDuty[ch];
+
+    if (duty > 0)
+      anyActive = true;  // At least one channel active
+
+    if (isHBridge)
+    {
+      const uint8_t pinA = pwmPins[ch * 2];       // Even index = A
+      const uint8_t pinB = pwmPins[ch * 2 + 1];   // Odd index = B
+      const bool dir     = pwmDir[ch];            // Direction: 0 = forward, 1 = reverse
+
+      if (duty == 0)
+      {
+        // Braking mode: set both A & B LOW to short motor terminals
+        digitalWrite(pinA, LOW);
+        digitalWrite(pinB, LOW);
+      }
+      else
+      {
+        const bool pwmState = (pwmTick < duty);
+
+        if (!dir)
+        {
+          digitalWrite(pinA,  pwmState);  // Forward: A = PWM
+          digitalWrite(pinB, !pwmState);  //           B = inverted
+        }
+        else
+        {
+          digitalWrite(pinA, !pwmState);  // Reverse: A = inverted
+          digitalWrite(pinB,  pwmState);  //           B = PWM
+        }
+      }
+    }
+    else
+    {
+      // Single-pin PWM mode (SWITCH or LPOWER)
+      const bool pwmState = (pwmTick < duty);
+      digitalWrite(pwmPins[ch], pwmState ? HIGH : LOW);
+    }
+  }
+
+  // Control PWCTRL if TYPE != SWITCH & update current sense
+  if (TYPE != SWITCH)
+  {
+    digitalWrite(PWCTRL, anyActive ? ON : OFF);
+    Isense = analogRead(analogPins[0]);                                               // Analog input A0
+  }
+}
+
+void (*pwmLegacy)(void) = pwm_legacy;                                                               // Called through a pointer, as boardOps.pwm
+
+static void bench_pwm_legacy(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) pwmLegacy();
+}
+
+static void bench_legacy(bool* first)
+{
+  const uint8_t type = TYPE;
+  for(TYPE = SWITCH; TYPE <= HPOWER; TYPE++)
+    {
+      char name[24];
+      snprintf(name, sizeof(name), "pwm_legacy_%s", typeNames[TYPE]);
+      const BenchStat r = bench_case(bench_pwm_legacy, 8 * BENCH_SCALE);                          // Same ops as pwm_TYPE
+      bench_print(name, 8 * BENCH_SCALE, 0, &r, first);
+    }
+  TYPE = type;
+}
+
+//----------------------------------------------------------------------------------------
+// Timing wheel: cost of a tick against the number of timers running
+//----------------------------------------------------------------------------------------
+static void bench_timer_fire(uint32_t arg) { benchSink += arg; }
+
+static void bench_timer_tick(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++) timer_tick();
+}
+
+static void bench_timers(bool* first)
+{
+  static const uint16_t counts[] = { 0, 16, 64, 128, TIMER_POOL };
+  for(uint8_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+      timer_init();
+      for(uint16_t i = 0; i < counts[c]; i++)
+        {
+          const uint32_t period = 2 + (uint32_t)(i * 2654435761UL >> 8) % 60000;                   // Spread over the levels
+          timer_start(1 + i % period, period, bench_timer_fire, i, TIMER_IRQ);
+        }
+      char name[16];
+      snprintf(name, sizeof(name), "timer_%u", counts[c]);
+      const BenchStat r = bench_case(bench_timer_tick, 4096);                                      // 16 level 0 turns per sample
+      bench_print(name, 4096, 0, &r, first, "active", timerStats.active);
+    }
+  timer_init();
+}
+
+//----------------------------------------------------------------------------------------
+// Time-series store on the RAM flash: ingest, then range queries over what was stored
+//----------------------------------------------------------------------------------------
+#define TSB_SERIES        8
+#define TSB_PERIOD        10                                                                        // s, TSDB_SAMPLE_S
+#define TSB_T0            1700000000UL
+
+static uint32_t tsbSamples;                                                                         // Appended so far, the clock of the series
+static uint32_t tsbNoise = 1;
+
+static void bench_tsdb_add(uint32_t ops)
+{
+  for(uint32_t i = 0; i < ops; i++, tsbSamples++)
+    {
+      const uint8_t  s = tsbSamples % TSB_SERIES;
+      const uint32_t t = TSB_T0 + tsbSamples / TSB_SERIES * TSB_PERIOD;
+      const double   w = sin(t * (2 * M_PI / 86400));                                               // Daily cycle
+      tsbNoise = tsbNoise * 1664525 + 1013904223;
+      const int      n = (int)(tsbNoise >> 29) - 4;                                                 // -4..3
+      if(s < 4)                                                                                     // BME688 of board 3: 0.01 resolution
+        {
+          static const float base[4] = { 21.0f, 1013.0f, 55.0f, 120.0f };
+          static const float span[4] = { 3.0f, 4.0f, 10.0f, 30.0f };
+          tsdb_append(3, Q_TEMP + s, t, roundf((base[s] + span[s] * w) * 100 + n) / 100);
+        }
+      else tsdb_append(LABEL, Q_ANA0 + s - 4, t, (float)(512 + (int)(200 * w) + n));               // Raw ADC counts
+    }
+}
+
+static uint32_t tsbRange;                                                                           // s
+
+static bool bench_tsdb_visit(const TsSample* s, void* ctx)
+{
+  benchSink += ts_bits(s->v);
+  (*(uint32_t*)ctx)++;
+  return true;
+}
+
+static void bench_tsdb_query(uint32_t ops)
+{
+  const uint32_t end = TSB_T0 + (tsbSamples / TSB_SERIES - 1) * TSB_PERIOD;
+  uint32_t n = 0;
+  for(uint32_t i = 0; i < ops; i++) tsdb_query(3, Q_TEMP, end - tsbRange, end, bench_tsdb_visit, &n);
+}
+
+static void bench_tsdb(bool* first)
+{
+  IDE = false;                                                                                      // No mount report inside the JSON
+  tsdb_mount();
+  IDE = true;
+  BenchStat r = bench_case(bench_tsdb_add, 256 * BENCH_SCALE);
+  tsdb_flush();
+  const float perSample = tsdbStats.appended ? (float)tsdbStats.pages * TSDB_PAGE / tsdbStats.appended : 0;
+  bench_print("tsdb_add", 256 * BENCH_SCALE, 0, &r, first, "bytes_sample", perSample);
+
+  static const struct { const char* name; uint32_t range; uint32_t ops; } q[] = {
+    { "tsdb_hour", 3600,  16 },                                                                     // Queries per sample
+    { "tsdb_day",  86400, 4 },
+  };
+  for(uint8_t i = 0; i < sizeof(q) / sizeof(q[0]); i++)
+    {
+      uint32_t n = 0;
+      tsbRange = q[i].range;
+      const uint32_t end = TSB_T0 + (tsbSamples / TSB_SERIES - 1) * TSB_PERIOD;
+      tsdb_query(3, Q_TEMP, end - tsbRange, end, bench_tsdb_visit, &n);
+      r = bench_case(bench_tsdb_query, q[i].ops);
+      bench_print(q[i].name, q[i].ops, 0, &r, first, "samples", n);
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// Filters of a SWITCH board, CAN_Setup() (setup.ino)
+//----------------------------------------------------------------------------------------
+static void filter_add(uint16_t idStart, uint16_t idEnd)
+{
+  if(filterManager.count >= MAX_FILTERS) return;
+  CANFilterEntry* e = &filterManager.entries[filterManager.count++];
+  e->idStart  = idStart;
+  e->idEnd    = idEnd;
+  e->callback = DUMMY;
+  e->valid    = true;
+}
+
+static void bench_host(bool* first)
+{
+  bench_legacy(first);
+  bench_timers(first);
+  bench_tsdb(first);
+}
+
+int main(void)
+{
+  IDE = true;
+  const uint16_t base = Lbl2Can(LABEL);
+  filter_add(0x000, 0x00F);                                                                         // Service block
+  for(uint16_t sub = 0; sub < 16; sub++) filter_add(base + sub, base + sub);                        // Own block, one entry per handler
+  for(uint8_t g = 0; g < GROUPS_count; g++) if(GROUPS[g].LBL == LABEL) filter_add(GRP(GROUPS[g].GRP), GRP(GROUPS[g].GRP));
+  for(uint8_t i = 0; i < PWM_CHANNELS * 2; i++) pwmPins[i] = i;
+  for(uint8_t i = 0; i < PWM_CHANNELS; i++) pwmDuty[i] = i * 8;
+  board_bind(TYPE);
+  bench_run();
+  return 0;
+}
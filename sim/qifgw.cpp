@@ -0,0 +1,185 @@
+// ~/Arduino/QIF/sim/qifgw.cpp Host build of the gateway codec, checked against tools/qifgw.py
+
+/*
+Gateway codec check
+
+gwproto.h compiled for the host as it is, against the frames tools/qifgw.py packs
+and seals (sim/qifgw.h, regenerated with "tools/qifgw.py vectors > sim/qifgw.h"
+when the wire format changes). The board and the host tool have to agree byte for
+byte, qifgw.py selftest only checks the Python codec against itself:
+
+  g++ -O2 -std=gnu++17 -o qifgw sim/qifgw.cpp
+  ./qifgw
+
+Checks, FAIL and exit status 1 if one does not hold:
+
+  crc           gw_crc16("123456789") is the CRC-16/CCITT-FALSE check value 0x29B1
+  cobs          cobs_encode() of every VEC_COBS input gives the Python frame, runs of
+                253, 254, 255 and 508 bytes and a trailing zero included, no 0x00
+                before the delimiter. cobs_decode() gives the input back, -1 when
+                the output does not fit, on a 0x00 code or a run past the end
+  records       gw_put() of each record type gives the bytes of pack(), gw_get()
+                of those bytes the same fields and the same size. gw_get() refuses
+                every record cut short, gw_put() a record past max
+  frame         gw_seal() of all the records gives the frame of seal(), gw_open()
+                and gw_get() read them back in order
+  damage        gw_open() refuses the frame with any one byte changed, and the
+                frame cut at any length
+*/
+
+#include "../gwproto.h"
+#include "qifgw.h"
+
+#include <cstdio>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+//----------------------------------------------------------------------------------------
+// The records of VECTOR_RECORDS in tools/qifgw.py, same order
+//----------------------------------------------------------------------------------------
+static std::vector<GwRecord> records()
+{
+  std::vector<GwRecord> v;
+  GwRecord r;
+  memset(&r, 0, sizeof(r)); r.type = GW_TX; r.seq = 7; r.id = 0x123; r.flags = 2 | 0x80; r.len = 2; r.data[1] = 0x01; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_TX; r.seq = 0xFFFF; r.id = 0x7FF; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_SYNC; r.host = 1ULL << 40; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_EXIT; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_RX; r.flags = GW_RX_FD | GW_RX_BRS; r.stamp = 0xFFFFFFF0; r.id = 0x7FF; r.len = 64;
+  for(uint8_t k = 0; k < 64; k++) r.data[k] = k;
+  v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_RX; r.stamp = 1; r.id = 0x001; r.len = 1; r.data[0] = 0x80; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_TXC; r.status = GW_TX_REFUSED; r.seq = 7; r.stamp = 12345; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_TIME; r.host = 0x0123456789ABCDEFULL; r.stamp = 5; v.push_back(r);
+  memset(&r, 0, sizeof(r)); r.type = GW_STAT; r.count[0] = 1; r.count[1] = 2; r.count[2] = 3; r.count[3] = 0xFFFFFFFF; v.push_back(r);
+  return v;
+}
+
+static Bytes hex(const char* s)
+{
+  Bytes b;
+  for(; s[0] && s[1]; s += 2)
+    {
+      unsigned v;
+      sscanf(s, "%2x", &v);
+      b.push_back(v);
+    }
+  return b;
+}
+
+static bool same(const GwRecord& a, const GwRecord& b)
+{
+  return a.type == b.type && a.flags == b.flags && a.status == b.status && a.len == b.len && a.seq == b.seq
+      && a.id == b.id && a.stamp == b.stamp && a.host == b.host && !memcmp(a.count, b.count, sizeof(a.count))
+      && !memcmp(a.data, b.data, a.len);
+}
+
+static uint8_t failures;
+
+static void check(const char* name, bool ok, const char* note = "")
+{
+  printf("%-16s %s%s\n", name, ok ? "PASS" : "FAIL", note);
+  if(!ok) failures++;
+}
+
+//----------------------------------------------------------------------------------------
+// cobs_check: Both directions of every VEC_COBS pair, then the malformed inputs
+//----------------------------------------------------------------------------------------
+static bool cobs_check()
+{
+  bool ok = true;
+  for(const auto& v : VEC_COBS)
+    {
+      const Bytes in = hex(v[0]), enc = hex(v[1]);
+      Bytes out(in.size() + in.size() / 254 + 2), dec(in.size() + 1);
+      const uint16_t n = cobs_encode(in.data(), in.size(), out.data());
+      out.resize(n);
+      ok = ok && out == enc && memchr(out.data(), 0, n - 1) == nullptr;
+      ok = ok && cobs_decode(enc.data(), n - 1, dec.data(), dec.size()) == (int32_t)in.size()
+              && !memcmp(dec.data(), in.data(), in.size());
+      if(!in.empty()) ok = ok && cobs_decode(enc.data(), n - 1, dec.data(), in.size() - 1) == -1;
+    }
+  uint8_t dec[8];
+  const uint8_t zero[] = { 0x02, 0x11, 0x00, 0x22 }, past[] = { 0x05, 0x11, 0x22 };
+  return ok && cobs_decode(zero, sizeof(zero), dec, sizeof(dec)) == -1 && cobs_decode(past, sizeof(past), dec, sizeof(dec)) == -1;
+}
+
+//----------------------------------------------------------------------------------------
+// records_check: gw_put() / gw_get() of each record against its pack() bytes
+//----------------------------------------------------------------------------------------
+static bool records_check(const std::vector<GwRecord>& recs)
+{
+  bool ok = recs.size() == sizeof(VEC_RECORDS) / sizeof(VEC_RECORDS[0]);
+  for(size_t i = 0; ok && i < recs.size(); i++)
+    {
+      const Bytes want = hex(VEC_RECORDS[i]);
+      uint8_t buf[GW_FRAME_MAX];
+      GwRecord r;
+      ok = gw_put(buf, 0, sizeof(buf), &recs[i]) == want.size() && !memcmp(buf, want.data(), want.size());
+      ok = ok && gw_put(buf, 1, want.size(), &recs[i]) == 0;                                        // One byte short
+      ok = ok && gw_get(want.data(), 0, want.size(), &r) == want.size() && same(r, recs[i]);
+      for(uint16_t end = 0; ok && end < want.size(); end++) ok = gw_get(want.data(), 0, end, &r) == 0;
+    }
+  return ok;
+}
+
+//----------------------------------------------------------------------------------------
+// frame_check: All the records in one frame, sealed and opened
+//----------------------------------------------------------------------------------------
+static bool frame_check(const std::vector<GwRecord>& recs, Bytes& sealed)
+{
+  uint8_t frame[GW_FRAME_MAX] = {}, out[GW_COBS_MAX], back[GW_FRAME_MAX];
+  uint16_t pos = 0;
+  for(const GwRecord& r : recs) pos = gw_put(frame, pos, GW_FRAME_MAX - 2, &r);
+  const uint16_t n = gw_seal(frame, pos, out);
+  sealed.assign(out, out + n);
+  bool ok = pos != 0 && sealed == hex(VEC_FRAME);
+  const int32_t len = gw_open(out, n - 1, back, sizeof(back));
+  ok = ok && len == pos;
+  uint16_t at = 0;
+  for(size_t i = 0; ok && i < recs.size(); i++)
+    {
+      GwRecord r;
+      at = gw_get(back, at, len, &r);
+      ok = at != 0 && same(r, recs[i]);
+    }
+  return ok && at == len;
+}
+
+//----------------------------------------------------------------------------------------
+// damage_check: Every byte of the sealed frame changed in turn, every cut
+//----------------------------------------------------------------------------------------
+static bool damage_check(Bytes sealed, uint16_t& changed, uint16_t& cut)
+{
+  uint8_t back[GW_FRAME_MAX];
+  const uint16_t n = sealed.size() - 1;                                                             // Without the 0x00
+  changed = cut = 0;
+  for(uint16_t i = 0; i < n; i++)
+    for(const uint8_t x : { 0x01, 0x40, 0xFF })
+      {
+        sealed[i] ^= x;
+        if(gw_open(sealed.data(), n, back, sizeof(back)) >= 0) changed++;
+        sealed[i] ^= x;
+      }
+  for(uint16_t len = 0; len < n; len++)
+    if(gw_open(sealed.data(), len, back, sizeof(back)) >= 0) cut++;
+  return changed == 0 && cut == 0;
+}
+
+int main()
+{
+  const std::vector<GwRecord> recs = records();
+  Bytes sealed;
+  char note[64];
+
+  check("CRC", gw_crc16((const uint8_t*)"123456789", 9) == 0x29B1);
+  check("COBS", cobs_check());
+  check("RECORDS", records_check(recs));
+  check("FRAME", frame_check(recs, sealed));
+  uint16_t changed, cut;
+  const bool damaged = damage_check(sealed, changed, cut);
+  snprintf(note, sizeof(note), damaged ? "" : " (%u CHANGED, %u CUT ACCEPTED)", changed, cut);
+  check("DAMAGE", damaged, note);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,358 @@
+// ~/Arduino/QIF/sim/qifreplay.cpp Host build of the CAN trace replay, determinism check
+
+/*
+Replay determinism check
+
+replay.ino compiled for the host from the firmware file as it is, run on a
+synthetic capture in a RAM flash. The replay is a measurement: M 6 twice on the
+same capture has to hand the same frames to the same handlers at the same ticks,
+or two runs of a sweep cannot be compared. Built and run on the host:
+
+  g++ -O2 -std=gnu++17 -o qifreplay sim/qifreplay.cpp
+  ./qifreplay --frames 20000 --seed 7
+
+Firmware built here: crc64.ino, txqueue.ino, lookup.ino and replay.ino. The rest is a stand-in:
+
+  flash         the 8 MB QSPI as a RAM array (readBuffer, readStatus never busy),
+                a capture written at CAP_START as capture.ino lays it out: header
+                page, records, an epoch record where the us upper word changes,
+                erased flash after the last record
+  capture       --frames records, ids 0x080..0x3FF, the CAN FD lengths, gaps of
+                150 us on average and now and then a burst of 300 frames 20 us
+                apart, more than REP_FIFO: the 1x run drops frames
+  filters       two blocks, 0x100..0x1FF and 0x300..0x30F, the other ids are
+                filtered out. The callbacks log tick, id, type, len and a hash
+                of the data
+  scheduler     task_start() keeps repTask, the loop calls it every PACE ticks
+                (1 ms each) after rep_tick(), until it returns TASK_DONE
+  DWT->CYCCNT   a counter, one step per read, as in qifbench.cpp: the handler
+                cycles are the same from one run to the next
+
+Checks, FAIL and exit status 1 if one does not hold:
+
+  same run      M 6 1 1 twice: identical log (ticks included) and counters
+  loader pace   M 6 1 1 with the loader every 3rd tick: the same log, as long as
+                the loader keeps ahead (STARVED 0)
+  capture order every speed of the sweep: the frames handled are the accepted
+                frames of the capture in order, content unchanged, the missing
+                ones are the drops, FRAMES = accepted + filtered
+  max speed     M 6 0: no drops, every accepted frame handled
+*/
+
+#include "host.h"
+#include "../db.h"
+#include "../crc64.h"
+#include "../capture.h"
+#include "../erase.h"
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+//----------------------------------------------------------------------------------------
+// qif.h, the part the firmware files below use
+//----------------------------------------------------------------------------------------
+#define MAX_FILTERS       128
+#define CAN_NULL          0x0400
+
+typedef void (*FilterCallback)(const CANFDMessage &);
+
+typedef struct {                                                                                    // Main sketch, filter manager
+  uint16_t       idStart;
+  uint16_t       idEnd;
+  uint8_t        action;
+  FilterCallback callback;
+  bool           valid;
+} CANFilterEntry;
+
+typedef struct {
+  CANFilterEntry entries[MAX_FILTERS];
+  uint8_t        count;
+} CANFilterManager;
+
+//----------------------------------------------------------------------------------------
+// Main sketch globals and the Arduino core
+//----------------------------------------------------------------------------------------
+uint8_t          LABEL = 1;
+CANFilterManager filterManager;
+uint32_t         SystemCoreClock = 120000000UL;
+volatile bool    gwOn = false;                                                                      // gateway.h, no gateway running
+
+HostCan  can1;
+uint32_t hostMs;                                                                                    // The tick count of the loop
+
+uint32_t millis(void) { return hostMs; }
+uint32_t micros(void) { return hostMs * 1000; }
+
+struct HostCycles { uint32_t n; operator uint32_t() { return n++; } };
+struct HostDwt    { HostCycles CYCCNT; };
+static HostDwt hostDwt;
+#define DWT               (&hostDwt)
+
+struct HostFlash {                                                                                  // Adafruit_SPIFlash on a RAM array, 8 MB
+  std::vector<uint8_t> mem = std::vector<uint8_t>(8UL << 20, 0xFF);
+  uint8_t  readStatus(void) { return 0; }                                                           // Never busy
+  uint32_t readBuffer(uint32_t addr, uint8_t* buf, uint32_t len)
+  {
+    if(addr + len > mem.size()) return 0;
+    memcpy(buf, &mem[addr], len);
+    return len;
+  }
+};
+
+HostFlash flash;
+
+//----------------------------------------------------------------------------------------
+// Firmware, the prototypes the Arduino builder would make
+//----------------------------------------------------------------------------------------
+#include "../txqueue.h"
+#include "../task.h"
+#include "../replay.h"
+
+uint32_t HostCan::tryToSendReturnStatusFD(const CANFDMessage&) { return kTryToSendReturnStatusFD_OK; }
+uint16_t       Lbl2Can(uint8_t lbl);
+uint8_t        getLBL(uint64_t uid);
+FilterCallback filter_lookup(const CANFilterManager* mgr, uint16_t id);
+uint8_t        repTask(Task* t);
+
+static TaskFn hostTask;                                                                             // task.ino: the one task of this program
+static Task   hostTaskState;
+
+Task* task_start(TaskFn fn, void* ctx, const char* name)
+{
+  if(hostTask) return nullptr;
+  memset(&hostTaskState, 0, sizeof(hostTaskState));
+  hostTaskState.fn   = fn;
+  hostTaskState.ctx  = ctx;
+  hostTaskState.name = name;
+  hostTask = fn;
+  return &hostTaskState;
+}
+
+bool task_running(TaskFn fn) { return hostTask == fn; }
+
+#include "../crc64.ino"
+#include "../txqueue.ino"
+#include "../lookup.ino"
+#include "../replay.ino"
+
+//----------------------------------------------------------------------------------------
+// Capture and the log of the handlers
+//----------------------------------------------------------------------------------------
+struct Frame {
+  uint32_t tick;                                                                                    // repTicks when handled, 0 in the capture
+  uint16_t id;
+  uint8_t  type;
+  uint8_t  len;
+  uint64_t hash;                                                                                    // FNV-1a of the data
+  bool operator==(const Frame& o) const { return tick == o.tick && id == o.id && type == o.type && len == o.len && hash == o.hash; }
+  bool same(const Frame& o) const       { return id == o.id && type == o.type && len == o.len && hash == o.hash; }
+};
+
+static std::vector<Frame> capFrames;                                                                // Every data record of the capture
+static std::vector<Frame> accepted;                                                                 // The ones a filter takes
+static std::vector<Frame> handled;                                                                  // Log of the callbacks, one run
+
+static uint64_t fnv(const uint8_t* p, uint8_t n)
+{
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for(uint8_t i = 0; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ULL;
+  return h;
+}
+
+static void host_log(const CANFDMessage& message)
+{
+  handled.push_back({ repTicks, (uint16_t)message.id, (uint8_t)message.type, message.len, fnv(message.data, message.len) });
+}
+
+static void host_log2(const CANFDMessage& message) { host_log(message); }                           // Second block, another handler
+
+static void filter_add(uint16_t idStart, uint16_t idEnd, FilterCallback callback)
+{
+  CANFilterEntry* e = &filterManager.entries[filterManager.count++];
+  e->idStart  = idStart;
+  e->idEnd    = idEnd;
+  e->callback = callback;
+  e->valid    = true;
+}
+
+static void cap_write(uint32_t* addr, const void* p, uint32_t n)
+{
+  memcpy(&flash.mem[*addr], p, n);
+  *addr += n;
+}
+
+//----------------------------------------------------------------------------------------
+// capture_make: frames records from CAP_START + CAP_PAGE, the us upper word crossed
+// 1 s in. Returns the epoch records written.
+//----------------------------------------------------------------------------------------
+static uint32_t capture_make(uint32_t frames, uint32_t seed)
+{
+  static const uint8_t lens[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64 };
+  std::mt19937 rng(seed);
+  std::exponential_distribution<double> gap(1.0 / 150);
+
+  CapHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic     = CAP_MAGIC;
+  h.unixStart = 1700000000UL;
+  h.epoch     = 0;
+  h.trigId    = CAP_NO_TRIGGER;
+  uint32_t addr = CAP_START;
+  cap_write(&addr, &h, sizeof(h));
+
+  addr = CAP_START + CAP_PAGE;
+  uint64_t us    = 0x100000000ULL - 1000000;
+  uint32_t epoch = 0;
+  uint32_t burst = 0;
+  uint32_t epochs = 0;
+  for(uint32_t i = 0; i < frames; i++)
+    {
+      if(!burst && rng() % 2000 == 0) burst = 300;
+      us += burst ? (burst--, 20) : 1 + (uint64_t)gap(rng);
+      if((uint32_t)(us >> 32) != epoch)
+        {
+          epoch = us >> 32;
+          const CapRecord e = { 0, 0, CAP_EPOCH, 4 };
+          cap_write(&addr, &e, sizeof(e));
+          cap_write(&addr, &epoch, 4);
+          epochs++;
+        }
+
+      CapRecord r;
+      r.us    = (uint32_t)us;
+      r.id    = 0x080 + rng() % 0x380;
+      r.len   = lens[rng() % sizeof(lens)];
+      r.flags = (r.len > 8 || rng() % 2) ? CAP_FD : 0;
+      if((r.flags & CAP_FD) && rng() % 2) r.flags |= CAP_BRS;
+      uint8_t data[64];
+      for(uint8_t b = 0; b < r.len; b++) data[b] = rng();
+      if(addr + CAP_REC(r.len) + sizeof(CapRecord) > CAP_END) break;                                // Full, as capture.ino stops
+      cap_write(&addr, &r, sizeof(r));
+      cap_write(&addr, data, r.len);
+      addr += CAP_REC(r.len) - sizeof(r) - r.len;                                                   // Padding, left erased
+
+      uint8_t type = CANFDMessage::CAN_DATA;
+      if(r.flags & CAP_FD) type = (r.flags & CAP_BRS) ? CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH : CANFDMessage::CANFD_NO_BIT_RATE_SWITCH;
+      const Frame f = { 0, r.id, type, r.len, fnv(data, r.len) };
+      capFrames.push_back(f);
+      if(filter_lookup(&filterManager, r.id)) accepted.push_back(f);
+    }
+  return epochs;
+}
+
+//----------------------------------------------------------------------------------------
+// replay: One M command to its end, rep_tick() every 1 ms, repTask every pace ticks
+//----------------------------------------------------------------------------------------
+struct Run {
+  std::vector<Frame> log;
+  RepStats           stats;
+  uint8_t            speed;
+  uint32_t           ticks;
+};
+
+static std::vector<Run> replay(uint8_t mode, uint8_t a, uint8_t b, uint8_t pace)
+{
+  std::vector<Run> runs;
+  handled.clear();
+  rep_command(mode, a, b);
+  for(hostMs = 0; hostTask && hostMs < 100000000UL; hostMs++)
+    {
+      rep_tick();
+      if(hostMs % pace) continue;
+      if(repState == REP_DONE)                                                                      // repTask reports it, then the next speed of a sweep
+        {
+          runs.push_back({ handled, repStats, repSpeed, repTicks });
+          handled.clear();
+        }
+      if(hostTask(&hostTaskState) == TASK_DONE) hostTask = nullptr;
+    }
+  return runs;
+}
+
+static bool stats_same(const RepStats& x, const RepStats& y)
+{
+  return x.frames == y.frames && x.dispatched == y.dispatched && x.drops == y.drops && x.filtered == y.filtered
+      && x.starved == y.starved && x.peak == y.peak && x.handlerCycles == y.handlerCycles && x.handlerMax == y.handlerMax
+      && x.tickMax == y.tickMax && x.txPeak == y.txPeak;
+}
+
+//----------------------------------------------------------------------------------------
+// in_order: run handled the accepted frames in order, content unchanged, drops aside
+//----------------------------------------------------------------------------------------
+static bool in_order(const Run& run)
+{
+  size_t j = 0;
+  for(const Frame& f : run.log)
+    {
+      while(j < accepted.size() && !accepted[j].same(f)) j++;
+      if(j++ == accepted.size()) return false;
+    }
+  return run.log.size() == run.stats.dispatched && run.stats.dispatched + run.stats.drops == accepted.size()
+      && run.stats.frames == capFrames.size() && run.stats.filtered == capFrames.size() - accepted.size();
+}
+
+static uint8_t failures;
+
+static void check(const char* name, bool ok, const char* note = "")
+{
+  printf("%-16s %s%s\n", name, ok ? "PASS" : "FAIL", note);
+  if(!ok) failures++;
+}
+
+//----------------------------------------------------------------------------------------
+// run_print: The counters of rep_report(), which prints on the board only (IDE muted)
+//----------------------------------------------------------------------------------------
+static void run_print(const char* name, const Run& r)
+{
+  char speed[8];
+  snprintf(speed, sizeof(speed), r.speed ? "%ux" : "MAX", r.speed);
+  printf("%-12s %5s %8u %10u %7u %9u %6u/%u %8u %8u\n", name, speed, r.stats.frames, r.stats.dispatched,
+         r.stats.drops, r.stats.filtered, r.stats.peak, REP_FIFO, r.stats.starved, r.ticks);
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t frames = 20000;
+  uint32_t seed   = 7;
+  for(int i = 1; i + 1 < argc; i += 2)
+    {
+      if(!strcmp(argv[i], "--frames"))    frames = strtoul(argv[i + 1], nullptr, 0);
+      else if(!strcmp(argv[i], "--seed")) seed   = strtoul(argv[i + 1], nullptr, 0);
+      else { fprintf(stderr, "usage: qifreplay [--frames N] [--seed S]\n"); return 2; }
+    }
+
+  filter_add(0x100, 0x1FF, host_log);
+  filter_add(0x300, 0x30F, host_log2);
+  const uint32_t epochs = capture_make(frames, seed);
+  printf("CAPTURE: %u FRAMES, %u ACCEPTED, %u EPOCH RECORD(S), SEED %u\n\n",
+         (unsigned)capFrames.size(), (unsigned)accepted.size(), (unsigned)epochs, (unsigned)seed);
+
+  const std::vector<Run> a = replay(6, 1, 1, 1);                                                    // M 6 1 1
+  const std::vector<Run> b = replay(6, 1, 1, 1);
+  const std::vector<Run> c = replay(6, 1, 1, 3);
+  const std::vector<Run> s = replay(7, 1, 0, 1);                                                    // M 7 1
+  const std::vector<Run> m = replay(6, 0, 0, 1);                                                    // M 6 0
+  if(a.size() != 1 || b.size() != 1 || c.size() != 1 || s.size() != REP_SWEEP || m.size() != 1)
+    {
+      printf("FAIL: a replay did not finish\n");
+      return 1;
+    }
+
+  printf("%-12s %5s %8s %10s %7s %9s %10s %8s %8s\n", "RUN", "SPEED", "FRAMES", "DISPATCHED", "DROPS", "NO FILTER", "FIFO PEAK", "STARVED", "TICKS");
+  run_print("M 6 1 1", a[0]);
+  run_print("M 6 1 1", b[0]);
+  run_print("PACE 3", c[0]);
+  for(const Run& r : s) run_print("M 7 1", r);
+  run_print("M 6 0", m[0]);
+  printf("\n");
+
+  check("SAME RUN", a[0].log == b[0].log && stats_same(a[0].stats, b[0].stats));
+  if(c[0].stats.starved) check("LOADER PACE", true, " (NOT COMPARED, LOADER STARVED)");
+  else check("LOADER PACE", a[0].log == c[0].log);
+  bool ordered = in_order(a[0]) && in_order(m[0]);
+  for(const Run& r : s) ordered = ordered && in_order(r);
+  check("CAPTURE ORDER", ordered, a[0].stats.drops ? "" : " (NO DROP AT 1x, NO BURST IN THIS CAPTURE)");
+  check("MAX SPEED", m[0].stats.drops == 0 && m[0].log.size() == accepted.size());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,1516 @@
+
+// ~/Arduino/QIF/sim/qifsim.cpp Discrete-event simulator of the QIF CAN network
+
+/*
+Network simulator
+
+Runs N boards of DB[] on one CAN FD bus, much faster than real time, and reports
+what the boat would see: switch to output latency, bus load, collisions and the
+frames lost in the queues. Built and run on the host:
+
+  g++ -O2 -std=gnu++17 -o qifsim sim/qifsim.cpp
+  ./qifsim --nodes 119 --duration 600 --runs 8
+  ./qifsim --sweep 8,32,64,119 --press-rate 6 --update 1@30:262144
+
+What is the firmware and what is modelled
+
+  txqueue.ino   the real code: canSend(), coalescing, expiry, txqueue_pump(). Each
+                node has its own rings, swapped in before the node runs.
+  controller    driver FIFO (TXQ_DRIVER_FIFO) and hardware TX FIFO (16), sent in
+                order, tryToSendReturnStatusFD() full past that.
+  bus           bit by bit (canbits.h): dynamic stuff bits, arbitration on the
+                stuffed identifier, bit rate switch. Two nodes sending the same ID
+                with different data part at the first differing bit: error frame,
+                TEC +8 for both, error passive past 127, bus off past 255.
+  receive       filters of CAN_Setup() (setup.ino): service IDs, the type block
+                of the own base, the groups of db.h. Hardware FIFO0 16 + driver
+                256 frames, one frame dispatched per 1 ms TCC2 tick.
+  switches      click.ino, the real Switch_Handler() and Send_Click(), every 10th
+                tick on the switchState[] of the node; digitalRead() gives the
+                pressed switches. Send_Click() sends to DB[].lnk: db.h is built as
+                dbFile, DB[] is a copy the links of the added boards are written in.
+  heartbeat     sendHeartbeatFrame() once a minute. The call site is in the main
+                loop, outside this tree: every node sends at the minute boundary of
+                its RTC, --hbt-skew spreads the clocks.
+  telemetry     bme_publish(), 48 bytes every TLM_PERIOD_S on the boards with a
+                BME688 (--bme, fraction of the boards).
+  update        update.ino, the real updateTask(): STX, 8-byte frames every
+                UPD_FRAME_MS while the low ring has UPD_TX_ROOM free slots, CRC,
+                ETX, all stream frames (TXQ_STREAM). One scheduler pass per 1 ms,
+                the QSPI image is B bytes of data then 0x00 (flash.readBuffer()).
+  scene         batch.ino, the real batch frame builder: SendScene() (routine.ino),
+                every PWM channel of a power board in one frame on its base + ctl,
+                against SendPwm() once per channel. Applied when dispatched.
+  slider        SendPwm() of channel CH of a power board STEPS times, STEP_MS apart,
+                as state frames (coalesced in the queue) or as event frames.
+  fan-out       the first BOARDS power boards subscribe to GROUP; a batch frame on
+                the group ID (SendGroup()) against the same frame on the base + ctl
+                of each of them.
+
+Boards: the ones defined in DB[], or --nodes N: the defined ones, then the UNDEF
+labels from 1 up to 119 with the --mix of types (labels 0 and 120..127 are never
+boards, db.h). Switches of added boards link to random power channels.
+
+Script (--script file), one line per action, # comments:
+
+  TIME[/PERIOD] press LABEL|* SW|* HOLD_MS
+  TIME[/PERIOD] update LABEL BYTES
+  TIME[/PERIOD] frame LABEL ID LEN high|normal|low [state]
+  TIME[/PERIOD] scene LABEL|* batch|channels [PERCENT]
+  TIME[/PERIOD] slide LABEL|* CH STEPS STEP_MS state|event
+  TIME[/PERIOD] fanout GROUP BOARDS group|unicast [PERCENT]
+
+Runs are independent (own seed), --jobs of them at a time in worker processes,
+results merged. Latency: click released to the frame handled by the target
+(the worst of the receivers for a group), split in switch detection, transmit
+queue, bus and receive FIFO.
+
+A scene, a slider or a fan-out is sent by a random switch board, to power board
+LABEL or to the boards of the group. Each of these lines has its row in the report:
+frames, bytes and bus time per command, latency from queued to the last channel
+applied (a slider: its last step, the end state), and the apply skew, first
+channel or board applied to the last:
+
+  1/2 scene * batch 80
+  2/2 scene * channels 80
+  1/5 slide * 0 50 0 state
+  3/5 slide * 0 50 0 event
+  1/2 fanout 10 24 group
+  2/2 fanout 10 24 unicast
+*/
+
+#include "host.h"
+#include "canbits.h"
+#define DB dbFile                                                                                   // db.h as built, DB[] below is the copy the firmware reads
+#include "../db.h"
+#undef  DB
+#include "../crc64.h"
+#include "../txqueue.h"
+#include "../task.h"
+#include "../arena.h"
+#include "../crc64.ino"
+#include "../txqueue.ino"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------------------
+// Firmware constants the simulator mirrors (file of origin in the comment)
+//----------------------------------------------------------------------------------------
+#define N                 8                                                                         // qif.h, switches per board
+#define SHORT             20                                                                        // qif.h, scans
+#define VERY_LONG         100                                                                       // qif.h
+#define WAIT_RESET        200                                                                       // qif.h
+#define SHORT_DELAY_LIMIT 20                                                                        // qif.h
+#define HIGH              1
+#define LOW               0
+#define SW_SCAN_TICKS     10                                                                        // board.ino board_scan(), Switch_Handler every 10th TCC2 tick
+#define CTRL_DEPTH        (TXQ_DRIVER_FIFO + 16)                                                    // Driver FIFO + SAME51 TX FIFO
+#define RX_DEPTH          (16 + 256)                                                                // SAME51 RX FIFO0 + driver FIFO
+#define TLM_FRAME         48                                                                        // telemetry.h, TLM_SIZE padded to a CAN FD length
+#define TLM_PERIOD_S      60                                                                        // telemetry.h
+#define STX               0x2A3F9E2D4C7B0A8EULL                                                     // qif.h
+#define ETX               0x8E3A6F5D42B9C0E7ULL                                                     // qif.h
+#define MARKER_MASK       0xA5A5A5A5A5A5A5ULL                                                       // qif.h
+#define QSPI_BLOCK_SIZE   4096                                                                      // qif.h
+#define PWM_CHANNELS      8                                                                         // qif.h
+#define CTL_HEADER        3                                                                         // qif.h
+
+enum ClickValue : uint8_t { CLICK_NONE = 0, CLICK_S, CLICK_SS, CLICK_L, CLICK_SL, CLICK_VL };       // qif.h
+enum CTL : uint8_t { CTL_NONE = 0, CTL_BATCH };                                                     // qif.h, the opcode sent here
+
+#define SVR               0x00                                                                      // qif.h, service block
+#define MS                ((int64_t)1000000)                                                        // ns
+#define MAX_NODES         119
+
+typedef struct {                                                                                    // qif.h Switch
+  uint8_t tim, wait, cnt, longCnt, state, shortDetected, shortDelay;
+} Switch;
+
+enum KIND : uint8_t { K_CLICK, K_HBT, K_TLM, K_UPDATE, K_SCRIPT, K_SCENE, K_SLIDE, K_FANOUT, KINDS };
+static const char* const kindNames[KINDS] = { "CLICK", "HEARTBEAT", "TELEMETRY", "UPDATE", "SCRIPT", "SCENE", "SLIDER", "FANOUT" };
+
+enum EVENT : uint8_t { EV_PRESS, EV_RELEASE, EV_HBT, EV_TLM, EV_UPDATE, EV_SCRIPT, EV_SLIDE, EV_BUS_END, EV_TICK, EV_RECOVER, EV_ARB };
+
+//----------------------------------------------------------------------------------------
+// Histogram, log-linear: 1 us bins up to 64 us, then 32 bins per power of two
+//----------------------------------------------------------------------------------------
+#define H_LIN             64
+#define H_SUB             32
+#define H_BINS            (H_LIN + 40 * H_SUB)
+
+typedef struct {
+  uint64_t n;
+  uint64_t max;                                                                                     // us
+  double   sum;
+  uint32_t bin[H_BINS];
+} Hist;
+
+static void hist_add(Hist* h, int64_t ns)
+{
+  const uint64_t us = ns < 0 ? 0 : (uint64_t)ns / 1000;
+  uint32_t b;
+  if(us < H_LIN) b = us;
+  else
+    {
+      const int e = 63 - __builtin_clzll(us);                                                       // 6 and up
+      b = H_LIN + (e - 6) * H_SUB + (uint32_t)((us >> (e - 5)) & (H_SUB - 1));
+      if(b >= H_BINS) b = H_BINS - 1;
+    }
+  h->bin[b]++;
+  h->n++;
+  h->sum += us;
+  if(us > h->max) h->max = us;
+}
+
+static double hist_pct(const Hist* h, double p)                                                     // ms
+{
+  if(!h->n) return 0;
+  const uint64_t rank = (uint64_t)ceil(p / 100.0 * h->n);
+  uint64_t seen = 0;
+  for(uint32_t b = 0; b < H_BINS; b++)
+    {
+      seen += h->bin[b];
+      if(seen < rank || !h->bin[b]) continue;
+      if(b < H_LIN) return b / 1000.0;
+      const int e = (b - H_LIN) / H_SUB + 6;
+      const uint64_t lo = (1ULL << e) + ((uint64_t)((b - H_LIN) % H_SUB) << (e - 5));
+      return std::min((double)h->max, lo + (1ULL << (e - 6)) / 1.0) / 1000.0;                       // Middle of the bin
+    }
+  return h->max / 1000.0;
+}
+
+//----------------------------------------------------------------------------------------
+// Result of a run, plain data: sent back from the worker through a pipe and merged
+//----------------------------------------------------------------------------------------
+enum LAT : uint8_t { L_CLICK, L_DETECT, L_QUEUE, L_BUS, L_FIFO, L_TLM, L_HBT, LATS };
+static const char* const latNames[LATS] = {
+  "release -> handled", "  switch detection", "  transmit queue", "  on the bus", "  receive FIFO",
+  "telemetry queued -> handled", "heartbeat queued -> handled" };
+
+#define LOAD_BINS         101
+#define SCENARIOS         16                                                                        // Script lines reported one by one (scene)
+
+typedef struct {                                                                                    // Script line of commands sent as frames: one row of the report
+  uint64_t sent, done, lost;                                                                        // Commands
+  uint64_t frames, bytes;
+  double   busS;
+  Hist     lat, skew;                                                                               // Queued -> last channel applied, first -> last applied
+} Scenario;
+
+typedef struct {
+  double   simS, wallS;
+  uint32_t runs;
+  uint64_t frames[KINDS], bytes[KINDS];
+  double   busyS;
+  uint64_t load10[LOAD_BINS];                                                                       // 10 ms windows by load %
+  double   peak10, peak1s;
+  uint64_t arbLost, collisions, errorFrames, passive, busOff;
+  uint64_t queued, ringFull[KINDS], expired[KINDS], coalesced, retried;
+  uint32_t ringPeak[TXQ_LEVELS], ctrlPeak, rxPeak;
+  uint64_t rxDelivered, rxOverrun;
+  uint64_t presses, clicks[6], clicksLost, unlinked, clickTargets;
+  uint64_t updFrames, updRuns;
+  double   updS;
+  Hist     lat[LATS];
+  Scenario sc[SCENARIOS];
+} Result;
+
+static void hist_merge(Hist* h, const Hist* g)
+{
+  h->n += g->n; h->sum += g->sum; h->max = std::max(h->max, g->max);
+  for(int i = 0; i < H_BINS; i++) h->bin[i] += g->bin[i];
+}
+
+static void result_merge(Result* a, const Result* b)
+{
+  a->simS += b->simS; a->wallS += b->wallS; a->runs += b->runs;
+  for(int k = 0; k < KINDS; k++)
+    {
+      a->frames[k] += b->frames[k]; a->bytes[k] += b->bytes[k];
+      a->ringFull[k] += b->ringFull[k]; a->expired[k] += b->expired[k];
+    }
+  a->busyS += b->busyS;
+  for(int i = 0; i < LOAD_BINS; i++) a->load10[i] += b->load10[i];
+  a->peak10 = std::max(a->peak10, b->peak10);
+  a->peak1s = std::max(a->peak1s, b->peak1s);
+  a->arbLost += b->arbLost; a->collisions += b->collisions; a->errorFrames += b->errorFrames;
+  a->passive += b->passive; a->busOff += b->busOff;
+  a->queued += b->queued; a->coalesced += b->coalesced; a->retried += b->retried;
+  for(int p = 0; p < TXQ_LEVELS; p++) a->ringPeak[p] = std::max(a->ringPeak[p], b->ringPeak[p]);
+  a->ctrlPeak = std::max(a->ctrlPeak, b->ctrlPeak);
+  a->rxPeak   = std::max(a->rxPeak, b->rxPeak);
+  a->rxDelivered += b->rxDelivered; a->rxOverrun += b->rxOverrun;
+  a->presses += b->presses; a->clicksLost += b->clicksLost; a->unlinked += b->unlinked;
+  a->clickTargets += b->clickTargets;
+  for(int c = 0; c < 6; c++) a->clicks[c] += b->clicks[c];
+  a->updFrames += b->updFrames; a->updRuns += b->updRuns; a->updS += b->updS;
+  for(int l = 0; l < LATS; l++) hist_merge(&a->lat[l], &b->lat[l]);
+  for(int i = 0; i < SCENARIOS; i++)
+    {
+      Scenario* s = &a->sc[i];
+      const Scenario* t = &b->sc[i];
+      s->sent += t->sent; s->done += t->done; s->lost += t->lost;
+      s->frames += t->frames; s->bytes += t->bytes; s->busS += t->busS;
+      hist_merge(&s->lat, &t->lat);
+      hist_merge(&s->skew, &t->skew);
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// Configuration
+//----------------------------------------------------------------------------------------
+typedef struct {
+  double   at, period;                                                                              // s, period 0: once
+  uint8_t  cmd;                                                                                     // 0 press, 1 update, 2 frame, 3 scene, 4 slide, 5 fanout
+  int      label, sw, hold;                                                                         // -1: random. Slide: channel, ms per step. Fanout: group, boards
+  uint32_t bytes;
+  uint16_t id;
+  uint8_t  len, prio;
+  uint8_t  value;
+  bool     batch;
+  uint16_t steps;
+  int8_t   sc;                                                                                      // Row in Result.sc, -1: none
+  std::string text;                                                                                 // As written, for the report
+} ScriptLine;
+
+typedef struct {
+  double   duration  = 300;
+  int      nodes     = 0;                                                                           // 0: as defined in DB[]
+  int      mix[5]    = { 0, 4, 2, 1, 1 };                                                           // Added boards: SWITCH LPOWER MPOWER HPOWER
+  double   pressRate = 2;                                                                           // Presses per switch board and minute
+  double   bme       = 0.5;
+  bool     hbt       = true;
+  double   hbtSkew   = 20;                                                                          // ms
+  bool     stayOff   = false;                                                                       // Bus off without recovery
+  int64_t  tNom      = 4000;                                                                        // 250 kbit/s
+  int64_t  tData     = 1000;                                                                        // 1 Mbit/s
+  uint64_t seed      = 1;
+  uint32_t runs      = 1;
+  uint32_t jobs      = 0;
+  std::vector<int> sweep;
+  std::vector<ScriptLine> script;
+} Config;
+
+static Config cfg;
+
+//----------------------------------------------------------------------------------------
+// Simulation state
+//----------------------------------------------------------------------------------------
+typedef struct {
+  uint8_t  kind;
+  int32_t  click;                                                                                   // Index in clicks, -1
+  int64_t  tQueued;
+  int32_t  apply = -1;                                                                              // Index in applies, -1
+} Tag;
+
+typedef struct {
+  CANFDMessage frame;
+  Tag      tag;
+  int64_t  tCtrl;
+} CtrlFrame;
+
+typedef struct {
+  uint8_t  kind;
+  int32_t  click;
+  int64_t  tQueued, tEof;
+  int32_t  apply;
+} RxFrame;
+
+typedef struct {
+  uint8_t  label, type;
+  uint16_t base;
+  int64_t  phase;                                                                                   // 1 ms tick phase
+  int64_t  tickAt;                                                                                  // Next tick scheduled, -1 none
+  TxRing   ring[TXQ_LEVELS];                                                                        // txqueue.ino state while not running
+  TxStats  stats;
+  uint16_t handle;
+  std::unordered_map<uint16_t, Tag> tags;                                                           // canSend() handle -> frame tag
+  std::deque<CtrlFrame> ctrl;
+  CanWire  wire;
+  bool     wireValid;
+  std::deque<RxFrame> rx;
+  int      tec;
+  bool     passive, busOff;
+  int64_t  suspendUntil;
+  bool     bme;
+  int64_t  hbtOffset;
+  Switch   sw[N];                                                                                   // click.ino state while not running
+  bool     pressed[N];
+  bool     scanning;
+  int64_t  released[N];
+  bool     inScan;                                                                                  // Inside Switch_Handler()
+  uint8_t  scanSw;                                                                                  // Switch being scanned, the last pin read
+  uint16_t scanHandle;                                                                              // Last handle given to a switch
+  std::vector<std::pair<uint16_t, uint8_t>> scanClicks;                                             // Handle, switch
+  std::vector<std::pair<uint16_t, CtrlFrame*>> scanSent;                                            // Clicks the controller took during the scan
+  uint32_t updTotal;                                                                                // Image in QSPI, 0: no update
+  int64_t  updStart;
+  Task     updTask;                                                                                 // updateTask() and its job, started as QSPI2CAN() does
+  UpdateJob updJob;
+  std::vector<uint8_t> updBuffer;                                                                   // The arena lease
+  uint8_t  tlmSeq;
+} Node;
+
+typedef struct {
+  int64_t  tRelease, tClick, tSof, tEof;
+  uint16_t targets, handled;
+  int64_t  worst;
+} Click;
+
+typedef struct {                                                                                    // Command of a script line, applied by every frame it sent
+  int8_t   sc;
+  bool     counted;                                                                                 // false: the steps of a slide before the last, frames only
+  int64_t  tQueued;
+  uint16_t targets, handled;                                                                        // Frames x receivers, dispatched so far
+  int64_t  tFirst;
+} Apply;
+
+typedef struct {
+  int64_t  t;
+  uint8_t  type;
+  uint16_t node;
+  uint32_t arg;
+  uint64_t seq;
+} Event;
+
+struct EventLater {
+  bool operator()(const Event& a, const Event& b) const
+  {
+    if(a.t != b.t) return a.t > b.t;
+    if(a.type != b.type) return a.type > b.type;                                                    // Same instant: inputs, bus, ticks, arbitration
+    return a.seq > b.seq;
+  }
+};
+
+static std::vector<Node> nodes;
+static std::vector<std::vector<uint16_t>> accept(2048);                                             // CAN ID -> receiving nodes
+static std::vector<Click> clicks;
+static std::vector<Apply> applies;
+
+typedef struct {                                                                                    // Slider being moved
+  uint32_t line;
+  uint16_t from, to;
+  uint16_t step;
+  int32_t  moves;                                                                                   // Apply of the steps before the last
+} Slide;
+
+static std::vector<Slide> slides;
+static std::priority_queue<Event, std::vector<Event>, EventLater> events;
+static uint64_t evSeq;
+static int64_t  simNow;
+static Node*    fwNode;
+static std::mt19937_64 rng;
+static Result*  res;
+
+uint8_t  LABEL;                                                                                     // Main sketch globals, those of the running node
+uint8_t  switchPins[N] = { 0, 1, 2, 3, 4, 5, 6, 7 };                                                // Pin n reads switch n
+Switch   switchState[N];
+static IO DB[128];                                                                                  // dbFile, the added boards linked (network)
+
+static struct {
+  bool     busy, arbQueued;
+  int64_t  start, idleAt;
+  std::vector<uint16_t> senders;
+  std::vector<uint16_t> faulted;                                                                    // Error passive, bit error in the data
+  bool     error;
+  std::vector<float> busy10;                                                                        // Busy ns per 10 ms window
+} bus;
+
+static void post(int64_t t, uint8_t type, uint16_t node = 0, uint32_t arg = 0)
+{
+  events.push(Event{ t, type, node, arg, evSeq++ });
+}
+
+static double uniform(void) { return std::uniform_real_distribution<double>(0, 1)(rng); }
+
+//----------------------------------------------------------------------------------------
+// Firmware glue: clock, controller, per-node txqueue state
+//----------------------------------------------------------------------------------------
+HostCan can1;
+uint32_t millis(void) { return (uint32_t)((simNow - (fwNode ? fwNode->phase : 0)) / MS); }
+uint32_t micros(void) { return (uint32_t)(simNow / 1000); }
+
+static void fw_enter(Node* n)
+{
+  if(fwNode == n) return;
+  if(fwNode)
+    {
+      memcpy((void*)fwNode->ring, (const void*)txRing, sizeof(txRing));
+      memcpy((void*)&fwNode->stats, (const void*)&txStats, sizeof(txStats));
+      fwNode->handle = txHandle;
+      memcpy(fwNode->sw, switchState, sizeof(switchState));
+    }
+  fwNode = n;
+  if(!n) return;
+  memcpy((void*)txRing, (const void*)n->ring, sizeof(txRing));
+  memcpy((void*)&txStats, (const void*)&n->stats, sizeof(txStats));
+  memcpy(switchState, n->sw, sizeof(switchState));
+  txHandle   = n->handle;
+  LABEL      = n->label;
+  txPumpBusy = false;
+}
+
+static void bus_kick(int64_t t);
+
+uint32_t HostCan::tryToSendReturnStatusFD(const CANFDMessage& frame)
+{
+  Node* n = fwNode;
+  if(n->ctrl.size() >= CTRL_DEPTH) return kTryToSendReturnStatusFD_TxFifoFull;
+  n->ctrl.push_back(CtrlFrame{ frame, Tag{ K_SCRIPT, -1, simNow }, simNow });
+  if(n->ctrl.size() > res->ctrlPeak) res->ctrlPeak = n->ctrl.size();
+  bus_kick(simNow);
+  return kTryToSendReturnStatusFD_OK;
+}
+
+static void sim_sent(uint16_t handle, uint16_t id, uint8_t status)                                 // TxCallback, right after the controller took it
+{
+  (void)id;
+  Node* n = fwNode;
+  auto it = n->tags.find(handle);
+  if(it == n->tags.end()) return;
+  const Tag tag = it->second;
+  n->tags.erase(it);
+  if(status == TX_SENT) n->ctrl.back().tag = tag;
+  else if(status == TX_EXPIRED) res->expired[tag.kind]++;
+}
+
+static uint16_t receivers(const Node* n, uint16_t id)                                              // Nodes taking the frame, not looped back to the sender
+{
+  const auto& rx = accept[id & 0x7FF];
+  return rx.size() - std::count(rx.begin(), rx.end(), (uint16_t)(n - nodes.data()));
+}
+
+static bool sim_send(Node* n, const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio, uint8_t kind, int32_t click = -1,
+                     int32_t apply = -1)
+{
+  fw_enter(n);
+  uint16_t next = txHandle + 1;                                                                     // The handle canSend() is about to give
+  if(next == 0) next = 1;
+  n->tags[next] = Tag{ kind, click, simNow, apply };
+  const uint16_t handle = canSend(data, len, id, prio, sim_sent);
+  if(!handle)
+    {
+      n->tags.erase(next);
+      res->ringFull[kind]++;
+      return false;
+    }
+  if(apply >= 0) applies[apply].targets += receivers(n, id);
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// Firmware update sender: update.ino on the QSPI image of the running node
+//----------------------------------------------------------------------------------------
+static uint64_t stx = STX >> 8;                                                                     // setup.ino, label removed
+static uint64_t etx = ETX >> 8;
+
+struct HostFlash {                                                                                  // Adafruit_SPIFlash
+  bool readBuffer(uint32_t addr, uint8_t* buf, uint32_t len)
+  {
+    for(uint32_t i = 0; i < len; i++) buf[i] = (addr + i < fwNode->updTotal) ? (uint8_t)((addr + i) * 151 + 7) | 1 : 0x00;
+    return true;
+  }
+};
+
+static HostFlash flash;
+
+static uint8_t sendKind  = K_UPDATE;                                                                // What sendCANFDFrame() sends: the update task, or a scene
+static int32_t sendApply = -1;
+
+bool sendCANFDFrame(const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio)                   // routine.ino
+{
+  if(!sim_send(fwNode, data, len, id, prio, sendKind, -1, sendApply)) return false;
+  if(sendKind == K_UPDATE) res->updFrames++;
+  return true;
+}
+
+static void PrintCANFrameHex(const uint8_t* frame, uint8_t len = 8) { (void)frame; (void)len; }     // routine.ino, IDE prints
+static void PrintHex64(uint64_t data)                               { (void)data; }
+
+uint8_t  updateTask(Task* t);
+bool     sendControlMarker(uint64_t marker, uint8_t label);
+uint64_t obfuscate(uint64_t val);
+
+#include "../update.ino"
+#include "../batch.h"
+#include "../batch.ino"
+
+//----------------------------------------------------------------------------------------
+// Node tick: 1 ms TCC2 interrupt, only while the node has something to do
+//----------------------------------------------------------------------------------------
+static void tick_at(Node* n, int64_t t)
+{
+  const int64_t k  = (t - n->phase + MS - 1) / MS;
+  const int64_t at = n->phase + k * MS;
+  if(n->tickAt >= 0 && n->tickAt <= at) return;
+  n->tickAt = at;
+  post(at, EV_TICK, n - nodes.data());
+}
+
+static bool sw_idle(const Node* n)                                                                 // The running node
+{
+  for(uint8_t i = 0; i < N; i++)
+    {
+      const Switch& s = switchState[i];
+      if(n->pressed[i] || s.tim || s.shortDetected || s.cnt || s.longCnt) return false;
+    }
+  return true;
+}
+
+static void scan_claim(Node* n)                                                                     // Handles given since the last pin read: that switch's clicks
+{
+  for(uint16_t h = n->scanHandle; h != txHandle; )
+    {
+      if(++h == 0) h = 1;
+      n->scanClicks.emplace_back(h, n->scanSw);
+    }
+  n->scanHandle = txHandle;
+}
+
+static int digitalRead(uint8_t pin)                                                                 // Switch_Handler() reads switch n, then clicks it
+{
+  Node* n = fwNode;
+  if(n->inScan) { scan_claim(n); n->scanSw = pin; }
+  return n->pressed[pin] ? LOW : HIGH;                                                              // Pressed pulls the pin low
+}
+
+void Send_Click(uint8_t n, ClickValue value);
+
+void clickSent(uint16_t handle, uint16_t id, uint8_t status)                                       // TxCallback of Send_Click()
+{
+  Node* n = fwNode;
+  if(!n->inScan) { sim_sent(handle, id, status); return; }
+  if(status == TX_SENT) n->scanSent.emplace_back(handle, &n->ctrl.back());                          // Tagged when the scan returns
+}
+
+#include "../click.ino"
+
+//----------------------------------------------------------------------------------------
+// switch_scan: TCC2 10 ms slot, Switch_Handler() of the node. The clicks it queued get
+// their tag when it returns: a handle belongs to the switch whose pin was read last.
+//----------------------------------------------------------------------------------------
+static void switch_scan(Node* n)
+{
+  fw_enter(n);
+  const uint32_t dropped = txStats.dropped;
+  n->scanClicks.clear();
+  n->scanSent.clear();
+  n->scanHandle = txHandle;
+  n->inScan     = true;
+  Switch_Handler();
+  scan_claim(n);
+  n->inScan     = false;
+  res->ringFull[K_CLICK] += txStats.dropped - dropped;
+
+  for(const auto& [h, sw] : n->scanClicks)
+    {
+      const CANFDMessage* f = nullptr;
+      CtrlFrame* sent = nullptr;
+      for(const auto& [handle, c] : n->scanSent) if(handle == h) { sent = c; f = &c->frame; }
+      for(uint8_t i = 0; !f && i < TXQ_DEPTH; i++)
+        if(txRing[TXQ_HIGH].slot[i].handle == h) f = &txRing[TXQ_HIGH].slot[i].frame;
+      if(!f) continue;
+
+      const uint16_t targets = receivers(n, f->id);
+      res->clicks[f->data[0] < 6 ? f->data[0] : 0]++;
+      res->clickTargets += targets;
+      clicks.push_back(Click{ n->released[sw], simNow, 0, 0, targets, 0, 0 });
+      const Tag tag{ K_CLICK, (int32_t)clicks.size() - 1, simNow };
+      if(sent) sent->tag = tag;
+      else n->tags[h] = tag;
+    }
+}
+
+static void dispatch(Node* n, int64_t t)                                                            // can1.dispatchReceivedMessage(), one frame
+{
+  const RxFrame f = n->rx.front();
+  n->rx.pop_front();
+  hist_add(&res->lat[L_FIFO], t - f.tEof);
+  if(f.kind == K_TLM) hist_add(&res->lat[L_TLM], t - f.tQueued);
+  if(f.kind == K_HBT) hist_add(&res->lat[L_HBT], t - f.tQueued);
+  if(f.apply >= 0)                                                                                  // Channels of a scene
+    {
+      Apply& a = applies[f.apply];
+      if(!a.handled) a.tFirst = t;
+      if(++a.handled == a.targets && a.counted)
+        {
+          Scenario* sc = &res->sc[a.sc];
+          sc->done++;
+          hist_add(&sc->lat,  t - a.tQueued);
+          hist_add(&sc->skew, t - a.tFirst);
+        }
+    }
+  if(f.click < 0) return;
+  Click& c = clicks[f.click];
+  c.worst = std::max(c.worst, t - c.tRelease);
+  if(++c.handled < c.targets) return;
+  hist_add(&res->lat[L_CLICK],  c.worst);                                                           // Last receiver of the click
+  hist_add(&res->lat[L_DETECT], c.tClick - c.tRelease);
+  hist_add(&res->lat[L_QUEUE],  c.tSof - c.tClick);
+  hist_add(&res->lat[L_BUS],    c.tEof - c.tSof);
+}
+
+static void node_tick(Node* n, int64_t t)
+{
+  n->tickAt = -1;
+  const int64_t k = (t - n->phase) / MS;
+  if(n->scanning && k % SW_SCAN_TICKS == 0)
+    {
+      switch_scan(n);
+      n->scanning = !sw_idle(n);
+    }
+  if(!n->rx.empty()) dispatch(n, t);
+  fw_enter(n);
+  txqueue_pump();
+
+  bool queued = false;
+  for(uint8_t p = 0; p < TXQ_LEVELS; p++) queued |= txRing[p].count != 0;
+  if(!n->rx.empty() || queued) tick_at(n, t + MS);
+  else if(n->scanning) tick_at(n, n->phase + (k / SW_SCAN_TICKS + 1) * SW_SCAN_TICKS * MS);
+}
+
+//----------------------------------------------------------------------------------------
+// Bus: arbitration when idle, error frames, fault confinement
+//----------------------------------------------------------------------------------------
+static void bus_kick(int64_t t)
+{
+  if(bus.busy || bus.arbQueued) return;
+  bus.arbQueued = true;
+  post(std::max(t, bus.idleAt), EV_ARB);
+}
+
+static void load_add(int64_t from, int64_t to)
+{
+  while(from < to)
+    {
+      const int64_t w   = from / (10 * MS);
+      const int64_t end = std::min(to, (w + 1) * 10 * MS);
+      if((size_t)w < bus.busy10.size()) bus.busy10[w] += end - from;
+      from = end;
+    }
+}
+
+static void fault(Node* n, int64_t t)                                                               // Transmit error: TEC + 8, fault confinement
+{
+  n->tec += 8;
+  if(n->tec > 255)
+    {
+      n->busOff = true;
+      res->busOff++;
+      if(!cfg.stayOff) post(t + 128 * 11 * cfg.tNom, EV_RECOVER, n - nodes.data());                // 128 x 11 recessive bits
+    }
+  else if(n->tec > 127 && !n->passive) { n->passive = true; res->passive++; }
+  if(n->passive) n->suspendUntil = t + 8 * cfg.tNom;                                                // Suspend transmission
+}
+
+static void bus_arbitrate(int64_t t)
+{
+  bus.arbQueued = false;
+  if(bus.busy) return;
+
+  std::vector<uint16_t> in;
+  int64_t wake = -1;
+  for(uint16_t i = 0; i < nodes.size(); i++)
+    {
+      Node& n = nodes[i];
+      if(n.busOff || n.ctrl.empty()) continue;
+      if(n.suspendUntil > t) { wake = (wake < 0) ? n.suspendUntil : std::min(wake, n.suspendUntil); continue; }
+      if(!n.wireValid)
+        {
+          const CANFDMessage& f = n.ctrl.front().frame;
+          can_wire(&n.wire, f.id, f.data, f.len, f.type >= CANFDMessage::CANFD_NO_BIT_RATE_SWITCH,
+                   f.type == CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH);
+          n.wireValid = true;
+        }
+      in.push_back(i);
+    }
+  if(in.empty())
+    {
+      if(wake >= 0) { bus.arbQueued = true; post(wake, EV_ARB); }
+      return;
+    }
+
+  int errBit = -1;
+  bus.faulted.clear();
+  for(uint16_t b = 0; in.size() > 1; b++)
+    {
+      uint16_t len = 0xFFFF;
+      for(uint16_t i : in) len = std::min(len, nodes[i].wire.n);
+      if(b >= len) break;                                                                           // Same bits to the end: sent together
+      bool dominant = false, recessive = false;
+      for(uint16_t i : in) (nodes[i].wire.bit[b] ? recessive : dominant) = true;
+      if(!(dominant && recessive)) continue;
+      const auto lost = [&](uint16_t i) { return nodes[i].wire.bit[b]; };
+      if(b >= nodes[in[0]].wire.arbEnd)                                                             // Same ID, different content: bit error of the recessive ones
+        {
+          if(std::any_of(in.begin(), in.end(), [&](uint16_t i) { return lost(i) && !nodes[i].passive; })) { errBit = b; break; }
+          for(uint16_t i : in) if(lost(i)) bus.faulted.push_back(i);                               // Passive error flag is recessive, the others go on
+        }
+      else res->arbLost += std::count_if(in.begin(), in.end(), lost);
+      in.erase(std::remove_if(in.begin(), in.end(), lost), in.end());
+    }
+
+  const CanWire* w = &nodes[in[0]].wire;
+  bus.busy    = true;
+  bus.start   = t;
+  bus.senders = in;
+  bus.error   = errBit >= 0;
+  const int64_t dur = bus.error ? can_time_ns(w, errBit + 1, cfg.tNom, cfg.tData) + CAN_ERROR_BITS * cfg.tNom
+                                : can_frame_ns(w, cfg.tNom, cfg.tData);
+  for(uint16_t i : in)
+    {
+      CtrlFrame& f = nodes[i].ctrl.front();
+      if(f.tag.click >= 0 && !clicks[f.tag.click].tSof) clicks[f.tag.click].tSof = t;
+    }
+  post(t + dur, EV_BUS_END);
+}
+
+static void bus_end(int64_t t)
+{
+  bus.busy   = false;
+  bus.idleAt = t;
+  load_add(bus.start, t);
+  for(uint16_t i : bus.faulted) fault(&nodes[i], t);
+
+  if(bus.error)
+    {
+      res->collisions++;
+      res->errorFrames++;
+      for(uint16_t i : bus.senders) fault(&nodes[i], t);
+    }
+  else
+    {
+      const CtrlFrame first = nodes[bus.senders[0]].ctrl.front();
+      for(uint16_t i : bus.senders)
+        {
+          Node& n = nodes[i];
+          const CtrlFrame f = n.ctrl.front();
+          n.ctrl.pop_front();
+          n.wireValid = false;
+          if(n.tec) n.tec--;
+          if(n.passive && n.tec <= 127) n.passive = false;
+          if(n.passive) n.suspendUntil = t + 8 * cfg.tNom;
+          res->frames[f.tag.kind]++;
+          res->bytes[f.tag.kind] += f.frame.len;
+          if(f.tag.apply >= 0)
+            {
+              Scenario* sc = &res->sc[applies[f.tag.apply].sc];
+              sc->frames++;
+              sc->bytes += f.frame.len;
+              sc->busS  += (t - bus.start) / 1e9;
+            }
+          if(f.tag.click >= 0) clicks[f.tag.click].tEof = t;
+          fw_enter(&n);                                                                             // Room in the controller: the next tick refills it
+          tick_at(&n, t);
+        }
+      for(uint16_t r : accept[first.frame.id & 0x7FF])
+        {
+          if(std::find(bus.senders.begin(), bus.senders.end(), r) != bus.senders.end()) continue;
+          Node& n = nodes[r];
+          if(n.busOff) continue;
+          if(n.rx.size() >= RX_DEPTH)
+            {
+              res->rxOverrun++;
+              continue;
+            }
+          n.rx.push_back(RxFrame{ first.tag.kind, first.tag.click, first.tag.tQueued, t, first.tag.apply });
+          if(n.rx.size() > res->rxPeak) res->rxPeak = n.rx.size();
+          res->rxDelivered++;
+          tick_at(&n, t);
+        }
+    }
+  bus_kick(t);
+}
+
+//----------------------------------------------------------------------------------------
+// Traffic
+//----------------------------------------------------------------------------------------
+static void press(Node* n, int sw, int64_t holdMs, int64_t t)
+{
+  if(n->type != SWITCH) return;
+  if(sw < 0) sw = rng() % N;
+  if(n->pressed[sw]) return;                                                                        // Already held
+  res->presses++;
+  if(DB[n->label].lnk[sw] == None) res->unlinked++;                                                 // Send_Click() drops its clicks
+  n->pressed[sw] = true;
+  n->scanning    = true;
+  post(t + holdMs * MS, EV_RELEASE, n - nodes.data(), sw);
+  tick_at(n, t);
+}
+
+static int64_t hold_random(void)
+{
+  const double r = uniform();
+  if(r < 0.70) return 80 + rng() % 100;                                                             // Short click
+  if(r < 0.95) return 300 + rng() % 600;                                                            // Long
+  return 1200 + rng() % 1500;                                                                       // Very long
+}
+
+static Node* node_label(int label)
+{
+  std::vector<Node*> sw;
+  for(Node& n : nodes)
+    {
+      if(label >= 0 && n.label == label) return &n;
+      if(label < 0 && n.type == SWITCH) sw.push_back(&n);
+    }
+  return sw.empty() ? nullptr : sw[rng() % sw.size()];
+}
+
+static void update_run(Node* n, int64_t t)                                                          // sched_run(), one pass of the UPDATE task
+{
+  fw_enter(n);
+  if(updateTask(&n->updTask) == TASK_WAITING) { post(t + MS, EV_UPDATE, n - nodes.data()); return; }
+  res->updRuns++;
+  res->updS += (t - n->updStart) / 1e9;
+  n->updTotal = 0;
+}
+
+static void update_start(Node* n, uint32_t bytes, int64_t t)                                        // routine.ino QSPI2CAN, once its checks passed
+{
+  if(n->updTotal) return;                                                                           // One update at a time
+  n->updTotal  = bytes;
+  n->updStart  = t;
+  n->updBuffer.resize(QSPI_BLOCK_SIZE);
+  memset(&n->updJob, 0, sizeof(n->updJob));
+  n->updJob.label  = 0;                                                                             // No receiver modelled, the frames go to SVR + Update
+  n->updJob.buffer = n->updBuffer.data();
+  memset(&n->updTask, 0, sizeof(n->updTask));
+  n->updTask.fn    = updateTask;
+  n->updTask.ctx   = &n->updJob;
+  n->updTask.name  = "UPDATE";
+  update_run(n, t);
+}
+
+static Node* node_power(int label)                                                                  // A power board, -1: any
+{
+  std::vector<Node*> pw;
+  for(Node& n : nodes) if(n.type != SWITCH && (label < 0 || n.label == label)) pw.push_back(&n);
+  return pw.empty() ? nullptr : pw[rng() % pw.size()];
+}
+
+static int32_t apply_start(int8_t sc, int64_t t, bool counted = true)
+{
+  applies.push_back(Apply{ sc, counted, t, 0, 0, 0 });
+  if(counted) res->sc[sc].sent++;
+  return applies.size() - 1;
+}
+
+//----------------------------------------------------------------------------------------
+// scene_send: A switch board sets every PWM channel of a power board, as SendScene()
+// (routine.ino) with one batch frame, or as SendPwm() with one frame per channel
+//----------------------------------------------------------------------------------------
+static void scene_send(const ScriptLine& s, Node* from, const Node* to, int64_t t)
+{
+  fw_enter(from);
+  sendKind  = K_SCENE;
+  sendApply = apply_start(s.sc, t);
+  const uint8_t channels = (to->type == MPOWER || to->type == HPOWER) ? 6 : PWM_CHANNELS;
+  if(s.batch)
+    {
+      Batch batch;
+      batch_begin(&batch, to->base + ctl);
+      for(uint8_t ch = 0; ch < channels; ch++) batch_pwm(&batch, ch, s.value, 0);
+      batch_send(&batch);
+    }
+  else
+    for(uint8_t ch = 0; ch < channels; ch++)
+      {
+        const uint8_t data[2] = { s.value, 0 };
+        sendCANFDFrame(data, 2, to->base + ch, TXQ_NORMAL | TXQ_STATE);
+      }
+  sendKind  = K_UPDATE;
+  sendApply = -1;
+}
+
+//----------------------------------------------------------------------------------------
+// slide_step: A dimmer slider moved by a switch board, one SendPwm() per position. State
+// frames are coalesced in the transmit queue, event frames are all sent: the end state
+// waits behind every step still queued.
+//----------------------------------------------------------------------------------------
+static void slide_step(uint32_t k, int64_t t)
+{
+  Slide* sl = &slides[k];
+  const ScriptLine& s = cfg.script[sl->line];
+  const bool last = ++sl->step == s.steps;
+  fw_enter(&nodes[sl->from]);
+  sendKind  = K_SLIDE;
+  sendApply = last ? apply_start(s.sc, t) : sl->moves;
+  const uint8_t data[2] = { (uint8_t)(sl->step * 100 / s.steps), 0 };                               // Duty up to 100 %, direction
+  sendCANFDFrame(data, 2, nodes[sl->to].base + s.sw, s.prio);
+  sendKind  = K_UPDATE;
+  sendApply = -1;
+  if(!last) post(t + s.hold * MS, EV_SLIDE, 0, k);
+}
+
+//----------------------------------------------------------------------------------------
+// Fan-out: the first s.sw power boards subscribe to group s.label (filters), a switch
+// board sets them all with one batch frame on the group ID as SendGroup() (routine.ino),
+// or with the same frame on the control channel of each of them
+//----------------------------------------------------------------------------------------
+static std::vector<uint16_t> fanout_members(const ScriptLine& s)
+{
+  std::vector<uint16_t> m;
+  for(uint16_t i = 0; i < nodes.size() && (int)m.size() < s.sw; i++) if(nodes[i].type != SWITCH) m.push_back(i);
+  return m;
+}
+
+static void fanout_send(const ScriptLine& s, Node* from, int64_t t)
+{
+  fw_enter(from);
+  sendKind  = K_FANOUT;
+  sendApply = apply_start(s.sc, t);
+  Batch batch;
+  if(s.batch)
+    {
+      batch_begin(&batch, GRP(s.label));
+      batch_pwm(&batch, 0x0F, s.value, 0);                                                          // Every channel of the group mask
+      batch_send(&batch);
+    }
+  else
+    for(uint16_t m : fanout_members(s))
+      {
+        batch_begin(&batch, nodes[m].base + ctl);
+        batch_pwm(&batch, 0x0F, s.value, 0);
+        batch_send(&batch);
+      }
+  sendKind  = K_UPDATE;
+  sendApply = -1;
+}
+
+static void script_run(const ScriptLine& s, int64_t t)
+{
+  if(s.cmd == 5)
+    {
+      Node* from = node_label(-1);
+      if(from) fanout_send(s, from, t);
+      return;
+    }
+  if(s.cmd == 4)
+    {
+      Node* from = node_label(-1);
+      Node* to   = node_power(s.label);
+      if(!from || !to) return;
+      slides.push_back(Slide{ (uint32_t)(&s - cfg.script.data()), (uint16_t)(from - nodes.data()), (uint16_t)(to - nodes.data()), 0,
+                              apply_start(s.sc, t, false) });
+      slide_step(slides.size() - 1, t);
+      return;
+    }
+  if(s.cmd == 3)
+    {
+      Node* from = node_label(-1);
+      Node* to   = node_power(s.label);
+      if(from && to) scene_send(s, from, to, t);
+      return;
+    }
+  Node* n = node_label(s.label);
+  if(!n) return;
+  if(s.cmd == 0) press(n, s.sw, s.hold < 0 ? hold_random() : s.hold, t);
+  else if(s.cmd == 1) update_start(n, s.bytes, t);
+  else
+    {
+      uint8_t data[64];
+      for(uint8_t i = 0; i < 64; i++) data[i] = rng();
+      sim_send(n, data, s.len, s.id, s.prio, K_SCRIPT);
+    }
+}
+
+static void handle(const Event& e)
+{
+  simNow = e.t;
+  Node* n = &nodes[e.node];
+  switch(e.type)
+    {
+      case EV_PRESS:
+        {
+          Node* s = node_label(-1);
+          if(s) press(s, -1, hold_random(), e.t);
+          const double perS = cfg.pressRate / 60.0 * std::count_if(nodes.begin(), nodes.end(), [](const Node& x) { return x.type == SWITCH; });
+          post(e.t + (int64_t)(std::exponential_distribution<double>(perS)(rng) * 1e9), EV_PRESS);
+          break;
+        }
+      case EV_RELEASE:
+        n->pressed[e.arg]  = false;
+        n->released[e.arg] = e.t;
+        break;
+      case EV_HBT:
+        {
+          const uint8_t data[1] = { n->label };                                                     // sendHeartbeatFrame()
+          sim_send(n, data, 1, SVR + Hbt, TXQ_LOW, K_HBT);
+          post(e.t + 60000 * MS, EV_HBT, e.node);
+          break;
+        }
+      case EV_TLM:
+        {
+          uint8_t data[TLM_FRAME] = { n->label, n->tlmSeq++ };                                      // bme_publish(), label and sequence first
+          for(uint8_t i = 8; i < 36; i++) data[i] = rng();
+          sim_send(n, data, TLM_FRAME, SVR + Bme, TXQ_LOW, K_TLM);
+          post(e.t + TLM_PERIOD_S * 1000 * MS, EV_TLM, e.node);
+          break;
+        }
+      case EV_UPDATE:  update_run(n, e.t); break;
+      case EV_SCRIPT:
+        {
+          const ScriptLine& s = cfg.script[e.arg];
+          script_run(s, e.t);
+          if(s.period > 0) post(e.t + (int64_t)(s.period * 1e9), EV_SCRIPT, 0, e.arg);
+          break;
+        }
+      case EV_SLIDE:   slide_step(e.arg, e.t); break;
+      case EV_BUS_END: bus_end(e.t); break;
+      case EV_TICK:    if(e.t == n->tickAt) node_tick(n, e.t); break;
+      case EV_RECOVER:
+        n->busOff = false; n->passive = false; n->tec = 0; n->wireValid = false;
+        bus_kick(e.t);
+        break;
+      case EV_ARB:     bus_arbitrate(e.t); break;
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// Network: boards, links, receive filters
+//----------------------------------------------------------------------------------------
+static void filters(void)                                                                           // setup.ino CAN_Setup
+{
+  for(auto& a : accept) a.clear();
+  auto add = [](uint16_t id, uint16_t node) { if(std::find(accept[id].begin(), accept[id].end(), node) == accept[id].end()) accept[id].push_back(node); };
+  static const uint8_t svc[] = { Time, Reset, Update, Abme, Hbt, Ack, Nack, Gps, Gyro, Anl, Pir, Bme };
+  for(uint16_t i = 0; i < nodes.size(); i++)
+    {
+      const Node& n = nodes[i];
+      for(uint8_t s : svc) add(SVR + s, i);
+      uint16_t own = 0;                                                                             // Offsets of the own block, bit n = base + n
+      if(n.type == SWITCH) own = 0x00FF | 1 << ctl | 1 << Bme;                                      // LED, control, BME
+      else if(n.type == LPOWER) own = 0xFFFF;                                                       // PWM 0..7, power, analog, current, control, BME
+      else own = 0x003F | 0xFF00;                                                                   // PWM 0..5, power, analog, current, control, BME
+      for(uint8_t o = 0; o < 16; o++) if(own & (1 << o)) add(n.base + o, i);
+      for(uint8_t g = 0; g < GROUPS_count; g++) if(GROUPS[g].LBL == n.label) add(GRP(GROUPS[g].GRP), i);
+    }
+  for(const ScriptLine& s : cfg.script)                                                             // Groups of the fan-out lines
+    if(s.cmd == 5) for(uint16_t m : fanout_members(s)) add(GRP(s.label), m);
+}
+
+static void network(void)
+{
+  nodes.clear();
+  memcpy(DB, dbFile, sizeof(DB));
+  std::vector<uint8_t> labels;
+  for(uint8_t i = 1; i < DB_count && i <= MAX_NODES; i++) if(DB[i].TYPE != UNDEF) labels.push_back(i);
+  if(cfg.nodes && cfg.nodes < (int)labels.size()) labels.resize(cfg.nodes);
+  const size_t defined = labels.size();
+  for(uint8_t i = 1; i <= MAX_NODES && (int)labels.size() < cfg.nodes; i++)
+    if(std::find(labels.begin(), labels.begin() + defined, i) == labels.begin() + defined) labels.push_back(i);
+  std::sort(labels.begin(), labels.end());
+
+  int total = 0, given[5] = {0};
+  for(int t = SWITCH; t <= HPOWER; t++) total += cfg.mix[t];
+  nodes.resize(labels.size());
+  for(size_t k = 0; k < labels.size(); k++)
+    {
+      Node& n = nodes[k];
+      const uint8_t l = labels[k];
+      n.label = l;
+      n.base  = l < DB_count ? DB[l].CAN : l << 4;
+      n.type  = l < DB_count ? DB[l].TYPE : (uint8_t)UNDEF;
+      if(n.type == UNDEF)                                                                           // Added board: the type the mix is most short of
+        {
+          int best = SWITCH;
+          double gap = -1e9;
+          for(int t = SWITCH; t <= HPOWER; t++)
+            {
+              const double g = (double)cfg.mix[t] / total * (k + 1) - given[t];
+              if(g > gap) { gap = g; best = t; }
+            }
+          n.type = best;
+        }
+      given[n.type]++;
+      n.phase  = (int64_t)(uniform() * MS);
+      n.tickAt = -1;
+      n.bme    = uniform() < cfg.bme;
+      n.hbtOffset = (int64_t)(uniform() * cfg.hbtSkew * MS);
+    }
+  for(Node& n : nodes)                                                                              // Links of the added switches
+    {
+      int16_t* lnk = DB[n.label].lnk;
+      if(n.type != SWITCH || lnk[0] != None) continue;
+      std::vector<uint16_t> outs;
+      for(const Node& p : nodes)
+        {
+          if(p.type == LPOWER) for(uint8_t c = 0; c < 8; c++) outs.push_back(p.base + c);
+          if(p.type == MPOWER || p.type == HPOWER) for(uint8_t c = 0; c < 6; c++) outs.push_back(p.base + c);
+        }
+      for(uint8_t s = 0; s < N && !outs.empty(); s++) lnk[s] = outs[rng() % outs.size()];
+    }
+  filters();
+}
+
+static void network_print(void)
+{
+  int count[5] = {0};
+  for(const Node& n : nodes) count[n.type]++;
+  printf("%zu BOARDS: SWITCH %d, LPOWER %d, MPOWER %d, HPOWER %d\n", nodes.size(), count[SWITCH], count[LPOWER], count[MPOWER], count[HPOWER]);
+  for(size_t a = 0; a < nodes.size(); a++)
+    for(size_t b = a + 1; b < nodes.size(); b++)
+      if(nodes[a].base == nodes[b].base)
+        printf("WARNING: BOARDS %u AND %u SHARE CAN BASE 0x%03X (db.h)\n", nodes[a].label, nodes[b].label, nodes[a].base);
+  for(const Node& n : nodes)
+    if(n.type == SWITCH)
+      for(uint8_t s = 0; s < N; s++)
+        if(DB[n.label].lnk[s] != None && accept[DB[n.label].lnk[s] & 0x7FF].empty())
+          printf("WARNING: BOARD %u SWITCH %u LINKS TO 0x%03X, NO BOARD RECEIVES IT\n", n.label, s, DB[n.label].lnk[s]);
+}
+
+//----------------------------------------------------------------------------------------
+// run: One simulation, its own seed
+//----------------------------------------------------------------------------------------
+static void run(Result* r, uint64_t seed, int nodeCount, bool print)
+{
+  const auto wall = std::chrono::steady_clock::now();
+  memset(r, 0, sizeof(*r));
+  res = r;
+  rng.seed(seed);
+  cfg.nodes = nodeCount;
+  fwNode = nullptr;
+  memset((void*)txRing, 0, sizeof(txRing));
+  memset((void*)&txStats, 0, sizeof(txStats));
+  txHandle = 0;
+  network();
+  if(print) network_print();
+
+  events = decltype(events)();
+  clicks.clear();
+  applies.clear();
+  slides.clear();
+  evSeq  = 0;
+  simNow = 0;
+  bus.busy = bus.arbQueued = false;
+  bus.idleAt = 0;
+  const int64_t end = (int64_t)(cfg.duration * 1e9);
+  bus.busy10.assign(end / (10 * MS) + 1, 0);
+
+  for(uint16_t i = 0; i < nodes.size(); i++)
+    {
+      Node& n = nodes[i];
+      if(cfg.hbt) post(60000 * MS + n.hbtOffset, EV_HBT, i);
+      if(n.bme)   post((int64_t)(uniform() * TLM_PERIOD_S * 1e9), EV_TLM, i);
+    }
+  if(cfg.pressRate > 0) post(0, EV_PRESS);
+  for(uint32_t s = 0; s < cfg.script.size(); s++) post((int64_t)(cfg.script[s].at * 1e9), EV_SCRIPT, 0, s);
+
+  while(!events.empty() && events.top().t < end)
+    {
+      const Event e = events.top();
+      events.pop();
+      handle(e);
+    }
+  if(bus.busy) load_add(bus.start, end);
+
+  fw_enter(nullptr);
+  for(Node& n : nodes)
+    {
+      r->queued    += n.stats.queued;
+      r->coalesced += n.stats.coalesced;
+      r->retried   += n.stats.retried;
+      for(uint8_t p = 0; p < TXQ_LEVELS; p++) r->ringPeak[p] = std::max<uint32_t>(r->ringPeak[p], n.stats.peak[p]);
+    }
+  for(const Click& c : clicks)
+    if(c.targets && c.handled < c.targets && c.tClick < end - 1000 * MS) r->clicksLost++;          // Dropped somewhere, not the last second
+  for(const Apply& a : applies)
+    if(a.counted && a.handled < a.targets && a.tQueued < end - 1000 * MS) r->sc[a.sc].lost++;
+
+  double busy = 0, sec = 0;
+  for(size_t w = 0; w < bus.busy10.size(); w++)
+    {
+      const double load = bus.busy10[w] / (10.0 * MS);
+      busy += bus.busy10[w];
+      sec  += bus.busy10[w];
+      r->load10[std::min(100, (int)(load * 100 + 0.5))]++;
+      r->peak10 = std::max(r->peak10, load);
+      if(w % 100 == 99 || w + 1 == bus.busy10.size()) { r->peak1s = std::max(r->peak1s, sec / (1000.0 * MS)); sec = 0; }
+    }
+  r->busyS = busy / 1e9;
+  r->simS  = cfg.duration;
+  r->runs  = 1;
+  r->wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+}
+
+//----------------------------------------------------------------------------------------
+// Report
+//----------------------------------------------------------------------------------------
+static void report(const Result* r, int nodeCount, uint32_t jobs, double elapsed)
+{
+  const double sim = r->simS;
+  uint64_t frames = 0;
+  for(int k = 0; k < KINDS; k++) frames += r->frames[k];
+  printf("SIMULATED:    %u x %.0f s IN %.2f s, %.0f x REAL TIME (%u JOBS, %.0f x PER CORE)\n",
+         r->runs, cfg.duration, elapsed, sim / std::max(elapsed, 1e-6), jobs, sim / std::max(r->wallS, 1e-6));
+  printf("BUS:          %lld/%lld kbit/s, %d BOARDS\n", 1000000LL / cfg.tNom, 1000000LL / cfg.tData, nodeCount);
+  printf("FRAMES:       %llu (%.1f/s)", (unsigned long long)frames, frames / sim);
+  for(int k = 0; k < KINDS; k++) if(r->frames[k]) printf(", %s %llu", kindNames[k], (unsigned long long)r->frames[k]);
+  printf("\n");
+
+  uint64_t windows = 0, seen = 0;
+  for(int i = 0; i < LOAD_BINS; i++) windows += r->load10[i];
+  int p99 = 0;
+  for(int i = 0; i < LOAD_BINS; i++) { seen += r->load10[i]; if(seen * 100 >= windows * 99) { p99 = i; break; } }
+  printf("LOAD:         MEAN %.2f %%, 10 ms P99 %d %% PEAK %.0f %%, 1 s PEAK %.1f %%\n",
+         r->busyS / sim * 100, p99, r->peak10 * 100, r->peak1s * 100);
+  printf("ARBITRATION:  %llu LOST, %llu COLLISIONS (SAME ID), %llu ERROR PASSIVE, %llu BUS OFF\n",
+         (unsigned long long)r->arbLost, (unsigned long long)r->collisions, (unsigned long long)r->passive,
+         (unsigned long long)r->busOff);
+
+  printf("TX QUEUE:     %llu QUEUED, %llu COALESCED, %llu RETRIED, PEAK H/N/L %u/%u/%u, CONTROLLER PEAK %u\n",
+         (unsigned long long)r->queued, (unsigned long long)r->coalesced, (unsigned long long)r->retried,
+         r->ringPeak[TXQ_HIGH], r->ringPeak[TXQ_NORMAL], r->ringPeak[TXQ_LOW], r->ctrlPeak);
+  for(int k = 0; k < KINDS; k++)
+    if(r->ringFull[k] || r->expired[k])
+      printf("  %-11s %llu RING FULL, %llu EXPIRED\n", kindNames[k], (unsigned long long)r->ringFull[k], (unsigned long long)r->expired[k]);
+  printf("RX FIFO:      %llu DELIVERED, %llu OVERRUN, PEAK %u/%d\n",
+         (unsigned long long)r->rxDelivered, (unsigned long long)r->rxOverrun, r->rxPeak, RX_DEPTH);
+
+  uint64_t clicks = 0;
+  for(int c = 1; c < 6; c++) clicks += r->clicks[c];
+  printf("SWITCHES:     %llu PRESSES, %llu CLICKS (S %llu SS %llu L %llu SL %llu VL %llu), %llu NOT LINKED, %llu LOST\n",
+         (unsigned long long)r->presses, (unsigned long long)clicks, (unsigned long long)r->clicks[CLICK_S],
+         (unsigned long long)r->clicks[CLICK_SS], (unsigned long long)r->clicks[CLICK_L], (unsigned long long)r->clicks[CLICK_SL],
+         (unsigned long long)r->clicks[CLICK_VL], (unsigned long long)r->unlinked, (unsigned long long)r->clicksLost);
+  if(r->updRuns)
+    printf("UPDATE:       %llu RUNS, %.1f s EACH, %.0f B/s\n", (unsigned long long)r->updRuns, r->updS / r->updRuns,
+           (r->updFrames - 3 * r->updRuns) * 8.0 / r->updS);
+
+  printf("LATENCY ms                          COUNT      P50      P90      P99    P99.9      MAX\n");
+  for(int l = 0; l < LATS; l++)
+    {
+      const Hist* h = &r->lat[l];
+      if(!h->n) continue;
+      printf("  %-28s %10llu %8.2f %8.2f %8.2f %8.2f %8.2f\n", latNames[l], (unsigned long long)h->n,
+             hist_pct(h, 50), hist_pct(h, 90), hist_pct(h, 99), hist_pct(h, 99.9), h->max / 1000.0);
+    }
+
+  bool rows = false;
+  for(const ScriptLine& s : cfg.script)
+    {
+      const Scenario* sc = (s.sc >= 0) ? &r->sc[s.sc] : nullptr;
+      if(!sc || !sc->sent) continue;
+      if(!rows) printf("SCRIPT ms                      SENT  LOST FRAMES/EACH BYTES/EACH BUS/EACH   P50   P99  SKEW P50   P99\n");
+      rows = true;
+      printf("  %-26s %6llu %5llu %11.1f %10.0f %8.3f %5.2f %5.2f %9.2f %5.2f\n", s.text.c_str(),
+             (unsigned long long)sc->sent, (unsigned long long)sc->lost, (double)sc->frames / sc->sent,
+             (double)sc->bytes / sc->sent, sc->busS * 1000 / sc->sent, hist_pct(&sc->lat, 50), hist_pct(&sc->lat, 99),
+             hist_pct(&sc->skew, 50), hist_pct(&sc->skew, 99));
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// Runs in worker processes, up to jobs at a time, results back through pipes
+//----------------------------------------------------------------------------------------
+static void run_all(Result* total, int nodeCount, uint32_t jobs)
+{
+  memset(total, 0, sizeof(*total));
+  Result* r = (Result*)calloc(1, sizeof(Result));
+  if(jobs <= 1)
+    {
+      for(uint32_t i = 0; i < cfg.runs; i++) { run(r, cfg.seed + i, nodeCount, i == 0); result_merge(total, r); }
+      free(r);
+      return;
+    }
+
+  run(r, cfg.seed, nodeCount, true);                                                                // First run here: prints the network
+  result_merge(total, r);
+  std::deque<std::pair<pid_t, int>> busy;
+  uint32_t next = 1;
+  while(next < cfg.runs || !busy.empty())
+    {
+      if(next < cfg.runs && busy.size() < jobs)
+        {
+          int fd[2];
+          if(pipe(fd)) { perror("pipe"); exit(1); }
+          fflush(stdout);
+          const pid_t pid = fork();
+          if(pid == 0)
+            {
+              close(fd[0]);
+              run(r, cfg.seed + next, nodeCount, false);
+              const uint8_t* p = (const uint8_t*)r;
+              for(size_t left = sizeof(Result); left; )
+                {
+                  const ssize_t w = write(fd[1], p, left);
+                  if(w <= 0) _exit(1);
+                  p += w; left -= w;
+                }
+              _exit(0);
+            }
+          close(fd[1]);
+          busy.emplace_back(pid, fd[0]);
+          next++;
+          continue;
+        }
+      const auto [pid, fd] = busy.front();
+      busy.pop_front();
+      uint8_t* p = (uint8_t*)r;
+      size_t got = 0;
+      for(ssize_t n; got < sizeof(Result) && (n = read(fd, p + got, sizeof(Result) - got)) > 0; ) got += n;
+      close(fd);
+      int status;
+      waitpid(pid, &status, 0);
+      if(got != sizeof(Result)) { fprintf(stderr, "worker %d failed\n", (int)pid); exit(1); }
+      result_merge(total, r);
+    }
+  free(r);
+}
+
+//----------------------------------------------------------------------------------------
+// Options and script
+//----------------------------------------------------------------------------------------
+static bool script_load(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if(!f) { perror(path); return false; }
+  char line[256];
+  int8_t rows = 0;
+  for(int no = 1; fgets(line, sizeof(line), f); no++)
+    {
+      if(char* c = strchr(line, '#')) *c = 0;
+      char time[32], cmd[16], a[16], b[16], c[16], d[16], e[16];
+      const int k = sscanf(line, "%31s %15s %15s %15s %15s %15s %15s", time, cmd, a, b, c, d, e);
+      if(k <= 0) continue;
+      ScriptLine s{};
+      s.label = (a[0] == '*') ? -1 : atoi(a);
+      s.sw = s.hold = -1;
+      s.sc = -1;
+      char* slash = strchr(time, '/');
+      s.at     = atof(time);
+      s.period = slash ? atof(slash + 1) : 0;
+      if(!strcmp(cmd, "press") && k >= 4)
+        {
+          s.cmd = 0;
+          s.sw  = (b[0] == '*') ? -1 : atoi(b);
+          if(k >= 5) s.hold = (c[0] == '*') ? -1 : atoi(c);
+        }
+      else if(!strcmp(cmd, "update") && k >= 4) { s.cmd = 1; s.bytes = strtoul(b, nullptr, 0); }
+      else if(!strcmp(cmd, "frame") && k >= 6)
+        {
+          s.cmd  = 2;
+          s.id   = strtoul(b, nullptr, 0) & 0x7FF;
+          s.len  = std::min(64, atoi(c));
+          s.prio = !strcmp(d, "high") ? TXQ_HIGH : !strcmp(d, "normal") ? TXQ_NORMAL : TXQ_LOW;
+          if(k >= 7 && !strcmp(e, "state")) s.prio |= TXQ_STATE;
+        }
+      else if(!strcmp(cmd, "scene") && k >= 4)
+        {
+          s.cmd   = 3;
+          s.batch = !strcmp(b, "batch");
+          s.value = (k >= 5) ? std::min(100, atoi(c)) : 50;
+        }
+      else if(!strcmp(cmd, "slide") && k >= 7)
+        {
+          s.cmd   = 4;
+          s.sw    = atoi(b) & 0x0F;
+          s.steps = std::max(1, atoi(c));
+          s.hold  = std::max(0, atoi(d));
+          s.prio  = TXQ_NORMAL | (!strcmp(e, "state") ? TXQ_STATE : 0);
+        }
+      else if(!strcmp(cmd, "fanout") && k >= 5)
+        {
+          s.cmd   = 5;
+          s.label = atoi(a) % GRP_COUNT;
+          s.sw    = atoi(b);
+          s.batch = !strcmp(c, "group");
+          s.value = (k >= 6) ? std::min(100, atoi(d)) : 50;
+        }
+      else { fprintf(stderr, "%s:%d: not understood\n", path, no); fclose(f); return false; }
+      if(s.cmd >= 3)
+        {
+          if(rows == SCENARIOS) { fprintf(stderr, "%s:%d: more than %d scene lines\n", path, no, SCENARIOS); fclose(f); return false; }
+          s.sc = rows++;
+          const char* word[] = { time, cmd, a, b, c, d, e };
+          for(int w = 0; w < k; w++) s.text += (w ? " " : "") + std::string(word[w]);
+        }
+      cfg.script.push_back(s);
+    }
+  fclose(f);
+  return true;
+}
+
+static void usage(void)
+{
+  puts("qifsim [options]\n"
+       "  --nodes N            boards, DB[] defined ones first, up to 119 (default: DB[] as is)\n"
+       "  --sweep N,N,...      one report per board count\n"
+       "  --mix S,L,M,H        types of the added boards (default 4,2,1,1)\n"
+       "  --duration S         simulated seconds per run (300)\n"
+       "  --runs N             independent runs, merged (1)\n"
+       "  --jobs N             worker processes (all cores)\n"
+       "  --seed N\n"
+       "  --press-rate R       presses per switch board and minute (2)\n"
+       "  --bme F              fraction of the boards with a BME688 (0.5)\n"
+       "  --hbt-skew MS        spread of the board clocks for the heartbeat (20)\n"
+       "  --no-hbt             no heartbeat\n"
+       "  --update LABEL@S:B   firmware update of B bytes from LABEL at S seconds\n"
+       "  --script FILE        scripted actions (see qifsim.cpp)\n"
+       "  --nominal BPS        nominal bit rate (250000)\n"
+       "  --data BPS           data phase bit rate (1000000)\n"
+       "  --stay-off           a board in bus off stays off");
+}
+
+int main(int argc, char** argv)
+{
+  for(int i = 1; i < argc; i++)
+    {
+      const std::string o = argv[i];
+      const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+      auto arg = [&]() { if(!v) { usage(); exit(1); } i++; return v; };
+      if(o == "--nodes") cfg.nodes = std::min(MAX_NODES, atoi(arg()));
+      else if(o == "--sweep")
+        {
+          for(char* t = strtok((char*)arg(), ","); t; t = strtok(nullptr, ",")) cfg.sweep.push_back(std::min(MAX_NODES, atoi(t)));
+        }
+      else if(o == "--mix")      sscanf(arg(), "%d,%d,%d,%d", &cfg.mix[SWITCH], &cfg.mix[LPOWER], &cfg.mix[MPOWER], &cfg.mix[HPOWER]);
+      else if(o == "--duration") cfg.duration  = atof(arg());
+      else if(o == "--runs")     cfg.runs      = std::max(1, atoi(arg()));
+      else if(o == "--jobs")     cfg.jobs      = std::max(1, atoi(arg()));
+      else if(o == "--seed")     cfg.seed      = strtoull(arg(), nullptr, 0);
+      else if(o == "--press-rate") cfg.pressRate = atof(arg());
+      else if(o == "--bme")      cfg.bme       = atof(arg());
+      else if(o == "--hbt-skew") cfg.hbtSkew   = atof(arg());
+      else if(o == "--no-hbt")   cfg.hbt       = false;
+      else if(o == "--stay-off") cfg.stayOff   = true;
+      else if(o == "--nominal")  cfg.tNom      = 1000000000LL / atoll(arg());
+      else if(o == "--data")     cfg.tData     = 1000000000LL / atoll(arg());
+      else if(o == "--script")   { if(!script_load(arg())) return 1; }
+      else if(o == "--update")
+        {
+          ScriptLine s{};
+          s.cmd = 1;
+          s.sc  = -1;
+          if(sscanf(arg(), "%d@%lf:%u", &s.label, &s.at, &s.bytes) != 3) { usage(); return 1; }
+          cfg.script.push_back(s);
+        }
+      else { usage(); return o == "--help" ? 0 : 1; }
+    }
+  if(!cfg.jobs) cfg.jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  cfg.jobs = std::min(cfg.jobs, cfg.runs);
+  if(cfg.sweep.empty()) cfg.sweep.push_back(cfg.nodes);
+
+  Result* total = (Result*)calloc(1, sizeof(Result));
+  for(size_t s = 0; s < cfg.sweep.size(); s++)
+    {
+      if(s) printf("\n");
+      const auto start = std::chrono::steady_clock::now();
+      run_all(total, cfg.sweep[s], cfg.jobs);
+      report(total, nodes.size(), cfg.jobs, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+  free(total);
+  return 0;
+}
@@ -0,0 +1,63 @@
+
+// ~/Arduino/QIF/snapshot.h Located in parent directory and linked in subdirectory
+
+/*
+Board state snapshot
+
+The whole live state of a board in one RPC_SNAP response (see rpc.h), so a
+supervisor reads a board with one round trip instead of one request per value
+and no longer has to guess state from the commands it sent.
+
+Packed, little-endian, SNAP_SIZE bytes (fits RPC_MAX_PAYLOAD):
+
+   0  version     SNAP_VERSION, bumped when the layout changes
+   1  type        Board type (SWITCH, LPOWER...)
+   2  seq         Snapshot sequence, +1 per snapshot served
+   4  uptime      Seconds since boot
+   8  duty[8]     PWM duty 0-100, bit 7 = direction (same as BATCH_DIR)
+  16  pending     Bit n = channel n waits for a resume after a direction change
+  17  flags       SNAP_PWCTRL, SNAP_BME, SNAP_MONITOR
+  18  analog[4]   Raw analog inputs, read when the request arrives (0 on SWITCH)
+  26  isense      Last current sense sample
+  28  counters    TX dropped, failed, expired, RPC timeouts, late responses
+                  (16 bits each, saturating)
+
+A receiver must check version before using the fields; fields are only ever
+appended, so a newer frame may be longer than the structure it knows.
+*/
+
+#ifndef   SNAPSHOT_H
+#define   SNAPSHOT_H
+
+#define SNAP_VERSION      1
+#define SNAP_CHANNELS     8                                                                         // PWM_CHANNELS
+
+#define SNAP_PWCTRL       0x01                                                                      // Power stage on
+#define SNAP_BME          0x02                                                                      // BME688 present
+#define SNAP_MONITOR      0x04                                                                      // Monitor mode, board does not transmit on its own
+
+typedef struct __attribute__((packed)) {
+  uint8_t  version;
+  uint8_t  type;
+  uint16_t seq;
+  uint32_t uptime;
+  uint8_t  duty[SNAP_CHANNELS];
+  uint8_t  pending;
+  uint8_t  flags;
+  uint16_t analog[4];
+  uint16_t isense;
+  uint16_t txDropped;
+  uint16_t txFailed;
+  uint16_t txExpired;
+  uint16_t rpcTimeouts;
+  uint16_t rpcLate;
+} Snapshot;
+
+#define SNAP_SIZE         sizeof(Snapshot)                                                          // 38 bytes
+
+uint16_t snapSeq = 0;                                                                               // Sequence of the next snapshot served
+
+void snapshot_fill(Snapshot* s);
+void snapshot_print(uint8_t label, const Snapshot* s);
+
+#endif
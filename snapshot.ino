@@ -0,0 +1,85 @@
+
+// ~/Arduino/QIF/switch/snapshot.ino
+
+
+#include "qif.h"
+
+static uint16_t sat16(uint32_t v) { return v > 0xFFFF ? 0xFFFF : v; }                      // Saturate a counter to 16 bits
+
+//----------------------------------------------------------------------------------------
+// snapshot_fill: Capture the live state of this board (see snapshot.h)
+//
+// PWM arrays are copied in one interrupt-free section so duty, direction and pending
+// resume of a channel always belong to the same PWM tick.
+//----------------------------------------------------------------------------------------
+void snapshot_fill(Snapshot* s)
+{
+  memset(s, 0, sizeof(Snapshot));
+  s->version = SNAP_VERSION;
+  s->type    = TYPE;
+  s->seq     = snapSeq++;
+  s->uptime  = millis() / 1000;
+
+  ATOMIC()
+    {
+      for(uint8_t ch = 0; ch < SNAP_CHANNELS; ch++)
+        {
+          s->duty[ch] = saved_PWM[ch] | (pwmDir[ch] ? BATCH_DIR : 0);                        // Percent applied, not the 0-63 register (inverted on SWITCH)
+          if(pwmPendingResume[ch]) s->pending |= 1 << ch;
+        }
+      s->isense = Isense;
+    }
+
+  if(TYPE != SWITCH)
+    {
+      for(uint8_t ch = 0; ch < 4; ch++) s->analog[ch] = analogRead(analogPins[ch]);
+      if(digitalRead(PWCTRL) == ON) s->flags |= SNAP_PWCTRL;                                // PWCTRL is a LED pin on SWITCH boards
+    }
+  if(BME_FLAG)     s->flags |= SNAP_BME;
+  if(MONITOR_FLAG) s->flags |= SNAP_MONITOR;
+
+  uint32_t timeouts = 0;
+  for(uint8_t m = 0; m < RPC_METHODS; m++) timeouts += rpcStats[m].timeouts;
+  s->txDropped   = sat16(txStats.dropped);
+  s->txFailed    = sat16(txStats.failed);
+  s->txExpired   = sat16(txStats.expired);
+  s->rpcTimeouts = sat16(timeouts);
+  s->rpcLate     = sat16(rpcLate);
+}
+
+//----------------------------------------------------------------------------------------
+// snapshot_print: Print a snapshot received from a board
+//----------------------------------------------------------------------------------------
+void snapshot_print(uint8_t label, const Snapshot* s)
+{
+  if(!IDE) return;
+
+  Serial.print(F("SNAPSHOT LABEL: ")); Serial.print(label);
+  Serial.print(F("  TYPE: "));         Serial.print(s->type);
+  Serial.print(F("  SEQ: "));          Serial.print(s->seq);
+  Serial.print(F("  UPTIME: "));       Serial.print(s->uptime); Serial.println(F(" s"));
+
+  Serial.print(F("PWM:    "));
+  for(uint8_t ch = 0; ch < SNAP_CHANNELS; ch++)
+    {
+      Serial.print(s->duty[ch] & ~BATCH_DIR);
+      Serial.print(s->duty[ch] & BATCH_DIR ? '<' : '>');
+      if(s->pending & (1 << ch)) Serial.print('*');                                         // Waiting for resume
+      Serial.print(' ');
+    }
+  Serial.println();
+
+  Serial.print(F("ANALOG: "));
+  for(uint8_t ch = 0; ch < 4; ch++) { Serial.print(s->analog[ch]); Serial.print(' '); }
+  Serial.print(F(" ISENSE: ")); Serial.println(s->isense);
+
+  Serial.print(F("PWCTRL: "));    Serial.print(s->flags & SNAP_PWCTRL  ? F("ON")  : F("OFF"));
+  Serial.print(F("  BME: "));     Serial.print(s->flags & SNAP_BME     ? F("YES") : F("NO"));
+  Serial.print(F("  MONITOR: ")); Serial.println(s->flags & SNAP_MONITOR ? F("ON")  : F("OFF"));
+
+  Serial.print(F("ERRORS: TX DROPPED ")); Serial.print(s->txDropped);
+  Serial.print(F("  FAILED "));           Serial.print(s->txFailed);
+  Serial.print(F("  EXPIRED "));          Serial.print(s->txExpired);
+  Serial.print(F("  RPC TIMEOUT "));      Serial.print(s->rpcTimeouts);
+  Serial.print(F("  LATE "));             Serial.println(s->rpcLate);
+}
@@ -0,0 +1,108 @@
+
+// ~/Arduino/QIF/task.h Located in parent directory and linked in subdirectory
+
+/*
+Cooperative tasks
+
+Stackless tasks (protothreads): a task is a function called again and again by
+sched_run(), it keeps its place in Task.lc between calls with a switch on the line
+number. A wait returns to the scheduler, the other tasks run, the task resumes on
+the line after the wait. Local variables are not kept across a wait: state lives in
+the task context (Task.ctx) or in globals. No switch() statement may span a wait.
+
+  uint8_t blinkTask(Task* t)
+  {
+    TASK_BEGIN(t);
+    while(true)
+      {
+        BLINK(RED);   TASK_DELAY(t, 500);
+        BLINK(BLACK); TASK_DELAY(t, 500);
+      }
+    TASK_END(t);
+  }
+
+  task_start(blinkTask, nullptr, "BLINK");
+
+Waits: TASK_DELAY (ms), TASK_WAIT_TX (room in a transmit ring), TASK_WAIT_SENT
+(a frame queued, tried again while the ring is full or in monitor mode),
+TASK_WAIT_FLASH (QSPI write or erase finished), TASK_WAIT_UNTIL (any condition),
+TASK_YIELD.
+
+loop() only calls sched_run(). timer_run(), bme_task(), tsdb_task() and rpc_drain()
+are tasks started by sched_init(). DELAY() called from main context runs the other tasks while
+it waits, so a blocking call (Help, Reboot) no longer stops them; it still spins in
+interrupt context and before sched_init().
+
+Responsiveness is measured all the time (serial command G): the longest gap between
+two scheduler passes and the click latency, Send_Click() to the frame accepted by
+the CAN controller.
+*/
+
+#ifndef   TASK_H
+#define   TASK_H
+
+#define TASK_MAX          8                                                                         // Tasks running at the same time
+#define UPD_FRAME_MS      5                                                                         // Firmware update pacing, one 8-byte frame per UPD_FRAME_MS
+#define UPD_TX_ROOM       4                                                                         // Leave this many TXQ_LOW slots to the others
+
+enum TASK_RESULT : uint8_t { TASK_WAITING = 0, TASK_DONE };
+
+struct Task;
+typedef uint8_t (*TaskFn)(struct Task* t);
+
+typedef struct Task {
+  TaskFn      fn;                                                                                   // nullptr = free slot
+  uint16_t    lc;                                                                                   // Resume line, 0 = start
+  uint32_t    until;                                                                                // TASK_DELAY deadline (millis)
+  void*       ctx;
+  const char* name;
+  bool        busy;                                                                                 // Running, not entered again from DELAY()
+  uint32_t    runs;
+  uint32_t    maxUs;                                                                                // Longest single run
+} Task;
+
+typedef struct {
+  uint32_t passes;                                                                                  // sched_run() calls
+  uint32_t lastPassUs;
+  uint32_t gapMaxUs;                                                                                // Longest time without a scheduler pass
+  uint32_t clicks;                                                                                  // Click frames sent
+  uint32_t clickSumUs;
+  uint32_t clickMaxUs;
+  uint16_t clickHandle;                                                                             // Click frame waiting in the transmit queue
+  uint32_t clickStart;                                                                              // micros() of Send_Click()
+} SchedStats;
+
+typedef struct {                                                                                    // Firmware update transfer (QSPI2CAN)
+  uint8_t      label;
+  uint32_t     size;                                                                                // Program size
+  uint32_t     limit;                                                                               // Size rounded up to a block
+  uint32_t     offset;                                                                              // Block being sent
+  uint16_t     chunk;                                                                               // Byte offset in the block
+  uint8_t*     buffer;                                                                              // QSPI_BLOCK_SIZE, arena lease (arena.h)
+  crc64_stream crc;
+} UpdateJob;
+
+#define TASK_BEGIN(t)          switch((t)->lc) { case 0:
+#define TASK_END(t)            } (t)->lc = 0; return TASK_DONE;
+#define TASK_EXIT(t)           do { (t)->lc = 0; return TASK_DONE; } while(0)
+#define TASK_YIELD(t)          do { (t)->lc = __LINE__; return TASK_WAITING; case __LINE__:; } while(0)
+#define TASK_WAIT_UNTIL(t, c)  do { (t)->lc = __LINE__; __attribute__((fallthrough)); case __LINE__: if(!(c)) return TASK_WAITING; } while(0)
+#define TASK_DELAY(t, ms)      do { (t)->until = millis() + (ms); TASK_WAIT_UNTIL(t, (int32_t)(millis() - (t)->until) >= 0); } while(0)
+#define TASK_WAIT_TX(t, p, n)  TASK_WAIT_UNTIL(t, txRing[p].count + (n) <= TXQ_DEPTH)
+#define TASK_WAIT_SENT(t, p, s) TASK_WAIT_UNTIL(t, txRing[p].count < TXQ_DEPTH && (s))                // Send s again until canSend() takes it
+#define TASK_WAIT_FLASH(t)     TASK_WAIT_UNTIL(t, !(flash.readStatus() & 0x01))              // WIP bit of the status register
+
+Task       tasks[TASK_MAX];
+SchedStats schedStats;
+uint8_t    schedDepth = 0;                                                                          // 1 inside sched_run(), 2 inside a DELAY() in a task
+bool       schedOn    = false;
+UpdateJob  updateJob;
+
+void  sched_init(void);
+void  sched_run(void);
+void  sched_yield(void);
+Task* task_start(TaskFn fn, void* ctx, const char* name);
+bool  task_running(TaskFn fn);
+void  sched_print(void);
+
+#endif
@@ -0,0 +1,136 @@
+
+// ~/Arduino/QIF/switch/task.ino
+
+
+#include "qif.h"
+
+//========================================================================================
+// Scheduler (see task.h)
+//========================================================================================
+
+uint8_t timersTask(Task* t) { timer_run();  return TASK_WAITING; }                          // Timer callbacks in main context
+uint8_t bmeTask(Task* t)    { bme_task();   return TASK_WAITING; }                          // BSEC sample and telemetry
+uint8_t tsdbTask(Task* t)   { tsdb_task();  return TASK_WAITING; }                          // History store
+uint8_t rpcTask(Task* t)    { rpc_drain();  return TASK_WAITING; }                          // RPC results printed (rpc.h)
+
+//----------------------------------------------------------------------------------------
+// sched_init: Start the permanent tasks. Call at the end of setup().
+//----------------------------------------------------------------------------------------
+void sched_init(void)
+{
+  memset(tasks, 0, sizeof(tasks));
+  memset(&schedStats, 0, sizeof(schedStats));
+  task_start(timersTask, nullptr, "TIMERS");
+  task_start(bmeTask,    nullptr, "BME");
+  task_start(tsdbTask,   nullptr, "TSDB");
+  task_start(dlogTask,   nullptr, "LOG");
+  task_start(rpcTask,    nullptr, "RPC");
+  schedStats.lastPassUs = micros();
+  schedOn = true;
+}
+
+//----------------------------------------------------------------------------------------
+// task_start: Add a task, it runs from the next scheduler pass.
+// Returns nullptr if all TASK_MAX slots are used.
+//----------------------------------------------------------------------------------------
+Task* task_start(TaskFn fn, void* ctx, const char* name)
+{
+  for(uint8_t i = 0; i < TASK_MAX; i++)
+    {
+      Task* t = &tasks[i];
+      if(t->fn) continue;
+      memset(t, 0, sizeof(Task));
+      t->ctx  = ctx;
+      t->name = name;
+      t->fn   = fn;
+      return t;
+    }
+  return nullptr;
+}
+
+bool task_running(TaskFn fn)
+{
+  for(uint8_t i = 0; i < TASK_MAX; i++) if(tasks[i].fn == fn) return true;
+  return false;
+}
+
+//----------------------------------------------------------------------------------------
+// sched_run: Run every task once. The only call in loop().
+//----------------------------------------------------------------------------------------
+void sched_run(void)
+{
+  const uint32_t now = micros();
+  const uint32_t gap = now - schedStats.lastPassUs;
+  if(gap > schedStats.gapMaxUs) schedStats.gapMaxUs = gap;
+  schedStats.lastPassUs = now;
+  schedStats.passes++;
+
+  schedDepth++;
+  for(uint8_t i = 0; i < TASK_MAX; i++)
+    {
+      Task* t = &tasks[i];
+      if(!t->fn || t->busy) continue;                                                       // Free, or waiting in a DELAY() below us
+
+      t->busy = true;
+      const uint32_t start = micros();
+      const uint8_t result = t->fn(t);
+      const uint32_t took  = micros() - start;
+      t->busy = false;
+      t->runs++;
+      if(took > t->maxUs) t->maxUs = took;
+      if(result == TASK_DONE) t->fn = nullptr;
+    }
+  schedDepth--;
+}
+
+//----------------------------------------------------------------------------------------
+// sched_yield: Let the other tasks run during a blocking wait (DELAY).
+// Does nothing in interrupt context, before sched_init() or more than one level deep.
+//----------------------------------------------------------------------------------------
+void sched_yield(void)
+{
+  if(!schedOn || schedDepth > 1 || __get_IPSR()) return;
+  sched_run();
+}
+
+//----------------------------------------------------------------------------------------
+// Click latency: Send_Click() to the frame accepted by the controller (TX_SENT)
+//----------------------------------------------------------------------------------------
+void clickSent(uint16_t handle, uint16_t id, uint8_t status)
+{
+  if(handle != schedStats.clickHandle || status != TX_SENT) return;
+  const uint32_t us = micros() - schedStats.clickStart;
+  schedStats.clicks++;
+  schedStats.clickSumUs += us;
+  if(us > schedStats.clickMaxUs) schedStats.clickMaxUs = us;
+  schedStats.clickHandle = 0;
+}
+
+//----------------------------------------------------------------------------------------
+// sched_print: Serial command G, task list and responsiveness
+//----------------------------------------------------------------------------------------
+void sched_print(void)
+{
+  if(!IDE) return;
+  Serial.println(F("TASK      RUNS        MAX(us)"));
+  for(uint8_t i = 0; i < TASK_MAX; i++)
+    {
+      const Task* t = &tasks[i];
+      if(!t->fn) continue;
+      Serial.print(t->name);  Serial.print(F("\t  "));
+      Serial.print(t->runs);  Serial.print(F("\t      "));
+      Serial.println(t->maxUs);
+    }
+  Serial.print(F("PASSES: "));              Serial.print(schedStats.passes);
+  Serial.print(F("  LONGEST GAP (us): "));  Serial.println(schedStats.gapMaxUs);
+  Serial.print(F("CLICKS: "));              Serial.print(schedStats.clicks);
+  if(schedStats.clicks)
+    {
+      Serial.print(F("  CLICK TO FRAME AVG/MAX (us): "));
+      Serial.print(schedStats.clickSumUs / schedStats.clicks); Serial.print('/');
+      Serial.print(schedStats.clickMaxUs);
+    }
+  Serial.println();
+  schedStats.gapMaxUs = 0;                                                                  // Next reading covers the next interval
+  schedStats.clickMaxUs = 0;
+}
@@ -0,0 +1,107 @@
+
+// ~/Arduino/QIF/telemetry.h Located in parent directory and linked in subdirectory
+
+/*
+BME688 telemetry frame
+
+One frame carries a complete BSEC reading and is broadcast on the service channel
+(SVR + Bme), so every board that wants it gets it without asking. It replaces
+seven sendBME() request/response pairs.
+
+Packed, little-endian, TLM_SIZE bytes (sent as a 48-byte CAN FD frame):
+
+   0  label       Sender label
+   1  seq         Frame sequence (wraps), a gap means frames were lost
+   2  status      Bits 0-1 IAQ accuracy (0-3), TLM_STAB, TLM_RUNIN
+   3  reason      TLM_PERIODIC or TLM_CHANGE
+   4  time        RTC unix time of the reading
+   8  value[7]    float, same order as enum INFO: temperature, pressure,
+                  humidity, gas, IAQ, VOC, CO2
+
+bme_task() runs as a task (task.h) in main context: it runs BSEC (I2C, never from an interrupt)
+and publishes when the period has elapsed or when a value moved by more than its
+deadband since the last frame sent.
+
+Telemetry cache
+
+The last value received from every (label, quantity) pair, filled by the CAN
+callbacks (telemetry frames, BME and analog responses, heartbeats) so local logic
+reads a remote value from RAM instead of asking over the bus:
+
+  float t;
+  if(tlm_get(3, Q_TEMP, &t, 120000) == TLM_HIT) ...                // Cabin temperature, 2 min max age
+
+Fixed size, no allocation: TLM_CACHE_SIZE entries, open addressing on a hash of
+the key with at most TLM_PROBE probes. When the probe window is full the oldest
+entry of the window is replaced.
+*/
+
+#ifndef   TELEMETRY_H
+#define   TELEMETRY_H
+
+#define TLM_VALUES        7                                                                         // BMETEMP..BMECO2
+#define TLM_PERIOD_S      60                                                                        // Default publish period
+#define TLM_MIN_GAP_MS    3000                                                                      // Change frames no closer than one BSEC LP sample
+
+#define TLM_ACCURACY      0x03                                                                      // Status bits
+#define TLM_STAB          0x04                                                                      // Gas sensor stabilized
+#define TLM_RUNIN         0x08                                                                      // Gas sensor run-in done
+
+enum TLM_REASON : uint8_t { TLM_PERIODIC = 0, TLM_CHANGE };
+
+#define TLM_CACHE_SIZE    128                                                                       // Entries, power of 2
+#define TLM_PROBE         8                                                                         // Slots searched per key
+
+enum QTY : uint8_t {                                                                                // Cached quantities
+  Q_TEMP = 0, Q_PRESS, Q_HUMID, Q_GAS, Q_IAQ, Q_VOC, Q_CO2,                                         // Same order as enum INFO
+  Q_ANA0, Q_ANA1, Q_ANA2, Q_ANA3,                                                                   // Raw analog inputs
+  Q_ISENSE,                                                                                         // Current sense
+  Q_BEAT,                                                                                           // Heartbeat seen (value 1)
+  Q_COUNT
+};
+
+enum TLM_RESULT : uint8_t { TLM_HIT = 0, TLM_STALE, TLM_MISS };
+
+typedef struct {
+  uint8_t  label;
+  uint8_t  qty;
+  uint8_t  seq;                                                                                     // Source sequence (0 if the source has none)
+  uint32_t stamp;                                                                                   // millis() when stored, 0 if the slot is free
+  float    value;
+} TlmEntry;
+
+typedef struct {
+  uint32_t hits;
+  uint32_t stale;
+  uint32_t misses;
+  uint32_t stores;
+  uint32_t evictions;
+} TlmStats;
+
+typedef struct __attribute__((packed)) {
+  uint8_t  label;
+  uint8_t  seq;
+  uint8_t  status;
+  uint8_t  reason;
+  uint32_t time;
+  float    value[TLM_VALUES];
+} BmeTelemetry;
+
+#define TLM_SIZE          sizeof(BmeTelemetry)                                                      // 36 bytes
+
+const float tlmDeadband[TLM_VALUES] = { 0.5, 1.0, 2.0, 5.0, 10.0, 0.5, 50.0 };                      // °C, hPa, %, %, IAQ, ppm, ppm
+
+uint16_t     tlmPeriod = TLM_PERIOD_S;                                                              // Seconds, 0 = change only
+uint8_t      tlmSeq    = 0;
+uint32_t     tlmLastMs = 0;                                                                         // millis() of the last frame sent
+BmeTelemetry tlmLast;                                                                               // Last frame sent, deadband reference
+
+TlmEntry     tlmCache[TLM_CACHE_SIZE];
+TlmStats     tlmStats;
+
+bool bme_task(void);
+bool bme_publish(uint8_t reason);
+void tlm_put(uint8_t label, uint8_t qty, float value, uint8_t seq = 0);
+uint8_t tlm_get(uint8_t label, uint8_t qty, float* value, uint32_t maxAgeMs, uint32_t* age = nullptr);
+
+#endif
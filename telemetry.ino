@@ -0,0 +1,197 @@
+
+// ~/Arduino/QIF/switch/telemetry.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// bme_task: Sample the BME688 and publish the telemetry frame when it is due.
+// Runs as a task (task.ino). Returns true when a frame was queued.
+//----------------------------------------------------------------------------------------
+bool bme_task(void)
+{
+  if(!BME_FLAG || !sampleBME()) return false;                                               // BSEC paces itself, false until the next sample
+  bst_sample();                                                                             // BSEC state copy, saved to QSPI when due (bstate.h)
+
+  const uint32_t now = rtc.now().unixtime();
+  float sample;
+  for(uint8_t i = 0; i < TLM_VALUES; i++)                                                   // Local history
+    if(bmeValue(BMETEMP + i, &sample)) tsdb_append(LABEL, Q_TEMP + i, now, sample);
+
+  const uint32_t nowMs = millis();
+  const uint32_t since = nowMs - tlmLastMs;
+
+  if(tlmLastMs == 0 || (tlmPeriod && since >= (uint32_t)tlmPeriod * 1000))
+    return bme_publish(TLM_PERIODIC);
+
+  if(since < TLM_MIN_GAP_MS) return false;                                                  // A noisy value cannot flood the bus
+
+  float value;
+  for(uint8_t i = 0; i < TLM_VALUES; i++)
+    {
+      bmeValue(BMETEMP + i, &value);
+      if(fabsf(value - tlmLast.value[i]) > tlmDeadband[i]) return bme_publish(TLM_CHANGE);
+    }
+  return false;
+}
+
+//----------------------------------------------------------------------------------------
+// bme_publish: Broadcast the last reading on SVR + Bme (see telemetry.h)
+//----------------------------------------------------------------------------------------
+bool bme_publish(uint8_t reason)
+{
+  uint8_t frame[64] = {0};
+  BmeTelemetry* t = (BmeTelemetry*)frame;
+
+  t->label  = LABEL;
+  t->seq    = tlmSeq++;
+  t->status = BME.status;
+  t->reason = reason;
+  t->time   = rtc.now().unixtime();
+  for(uint8_t i = 0; i < TLM_VALUES; i++) bmeValue(BMETEMP + i, &t->value[i]);
+
+  if(!sendCANFDFrame(frame, canfd_len(TLM_SIZE), SVR + Bme, TXQ_LOW)) return false;
+  memcpy(&tlmLast, t, TLM_SIZE);                                                            // Deadband reference is what the others have
+  tlmLastMs = millis();
+  if(tlmLastMs == 0) tlmLastMs = 1;                                                         // 0 means never sent
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// Process_BME_Telemetry: Telemetry frame from another board (SVR + Bme)
+//----------------------------------------------------------------------------------------
+void Process_BME_Telemetry(const CANFDMessage & message)
+  {
+    PROF_SCOPE(PROF_TELEM);
+    BLINK(BLUE);                                                                              // Visual feedback for activity
+
+    if(message.len < TLM_SIZE) return;
+
+    BmeTelemetry t;
+    memcpy(&t, message.data, TLM_SIZE);
+    for(uint8_t i = 0; i < TLM_VALUES; i++) tlm_put(t.label, Q_TEMP + i, t.value[i], t.seq);
+
+    int32_t v[TLM_VALUES];                                                                  // Hundredths, printed later by dlogTask
+    for(uint8_t i = 0; i < TLM_VALUES; i++) v[i] = (int32_t)(t.value[i] * 100.0f);
+    DLOG(DLOG_TELEM, t.label, t.seq, t.status & TLM_ACCURACY, t.reason == TLM_CHANGE);
+    DLOG(DLOG_TELEM_AIR, v[0], v[1], v[2], v[3]);
+    DLOG(DLOG_TELEM_IAQ, v[4], v[5], v[6]);
+  }
+
+//----------------------------------------------------------------------------------------
+// Serial command E: set the publish period, 0 = publish on change only
+//----------------------------------------------------------------------------------------
+void bme_period(uint16_t seconds)
+{
+  tlmPeriod = seconds;
+  if(IDE)
+    {
+      Serial.print(F("BME TELEMETRY PERIOD: "));
+      if(seconds) { Serial.print(seconds); Serial.println(F(" s")); }
+      else Serial.println(F("ON CHANGE ONLY"));
+    }
+}
+
+//========================================================================================
+// Telemetry cache (see telemetry.h)
+//========================================================================================
+
+static inline uint8_t tlm_hash(uint8_t label, uint8_t qty)
+{
+  return ((((uint32_t)label << 4) | qty) * 2654435761u) >> (32 - 7) & (TLM_CACHE_SIZE - 1); // Fibonacci hashing of the 11-bit key
+}
+
+//----------------------------------------------------------------------------------------
+// tlm_put: Store a received value. Safe from CAN callbacks (interrupt context).
+//----------------------------------------------------------------------------------------
+void tlm_put(uint8_t label, uint8_t qty, float value, uint8_t seq)
+{
+  const uint8_t h = tlm_hash(label, qty);
+  uint32_t nowMs = millis();
+  if(nowMs == 0) nowMs = 1;                                                                 // 0 marks a free slot
+
+  ATOMIC()
+    {
+      TlmEntry* slot   = nullptr;
+      TlmEntry* oldest = nullptr;
+      for(uint8_t i = 0; i < TLM_PROBE; i++)
+        {
+          TlmEntry* e = &tlmCache[(h + i) & (TLM_CACHE_SIZE - 1)];
+          if(e->stamp && e->label == label && e->qty == qty) { slot = e; break; }           // Update in place
+          if(!e->stamp) { if(!slot) slot = e; continue; }                                   // First free slot, keep looking for the key
+          if(!oldest || (int32_t)(e->stamp - oldest->stamp) < 0) oldest = e;
+        }
+      if(!slot) { slot = oldest; tlmStats.evictions++; }                                    // Window full: the least recently stored goes
+
+      slot->label = label;
+      slot->qty   = qty;
+      slot->seq   = seq;
+      slot->value = value;
+      slot->stamp = nowMs;
+      tlmStats.stores++;
+    }
+  if(label != LABEL && qty != Q_BEAT) tsdb_stage(label, qty, value);                        // History in QSPI
+}
+
+//----------------------------------------------------------------------------------------
+// tlm_get: Read a cached value.
+//
+// Returns TLM_HIT if present and not older than maxAgeMs, TLM_STALE if present but
+// older (value and age are still returned), TLM_MISS if never received.
+//----------------------------------------------------------------------------------------
+uint8_t tlm_get(uint8_t label, uint8_t qty, float* value, uint32_t maxAgeMs, uint32_t* age)
+{
+  const uint8_t h = tlm_hash(label, qty);
+  TlmEntry copy;
+  bool found = false;
+
+  ATOMIC()
+    {
+      for(uint8_t i = 0; i < TLM_PROBE; i++)
+        {
+          const TlmEntry* e = &tlmCache[(h + i) & (TLM_CACHE_SIZE - 1)];
+          if(e->stamp && e->label == label && e->qty == qty) { copy = *e; found = true; break; }
+        }
+    }
+
+  if(!found) { tlmStats.misses++; return TLM_MISS; }
+
+  const uint32_t elapsed = millis() - copy.stamp;
+  if(value) *value = copy.value;
+  if(age)   *age   = elapsed;
+  if(elapsed > maxAgeMs) { tlmStats.stale++; return TLM_STALE; }
+  tlmStats.hits++;
+  return TLM_HIT;
+}
+
+//----------------------------------------------------------------------------------------
+// tlm_dump: Print the cache content and counters
+//----------------------------------------------------------------------------------------
+void tlm_dump(void)
+{
+  if(!IDE) return;
+  static const char* const names[Q_COUNT] = { "TEMP", "PRESS", "HUMID", "GAS", "IAQ", "VOC", "CO2",
+                                              "ANA0", "ANA1", "ANA2", "ANA3", "ISENSE", "BEAT" };
+  const uint32_t nowMs = millis();
+  uint8_t used = 0;
+
+  Serial.println(F("LABEL   QTY     VALUE       AGE(ms) SEQ"));
+  for(uint16_t i = 0; i < TLM_CACHE_SIZE; i++)
+    {
+      TlmEntry e;
+      ATOMIC() e = tlmCache[i];
+      if(!e.stamp) continue;
+      used++;
+      Serial.print(e.label);                                     Serial.print('\t');
+      Serial.print(e.qty < Q_COUNT ? names[e.qty] : "?");        Serial.print('\t');
+      Serial.print(e.value);                                     Serial.print(F("\t    "));
+      Serial.print(nowMs - e.stamp);                             Serial.print('\t');
+      Serial.println(e.seq);
+    }
+  Serial.print(F("ENTRIES: "));    Serial.print(used); Serial.print('/'); Serial.println(TLM_CACHE_SIZE);
+  Serial.print(F("HITS: "));       Serial.print(tlmStats.hits);
+  Serial.print(F("  STALE: "));    Serial.print(tlmStats.stale);
+  Serial.print(F("  MISSES: "));   Serial.print(tlmStats.misses);
+  Serial.print(F("  STORES: "));   Serial.print(tlmStats.stores);
+  Serial.print(F("  EVICTED: "));  Serial.println(tlmStats.evictions);
+}
@@ -0,0 +1,93 @@
+
+// ~/Arduino/QIF/timer.h Located in parent directory and linked in subdirectory
+
+/*
+Software timers on a hierarchical timing wheel
+
+One tick per millisecond from TCC2. A timer is one entry of a fixed pool, linked
+in the slot of the wheel where it expires:
+
+  Level 0   256 slots of 1 ms          0 ..  255 ms ahead
+  Level 1    64 slots of 256 ms      .. 16.4 s
+  Level 2    64 slots of 16.4 s      .. 17.5 min
+  Level 3    64 slots of 17.5 min    .. 18.6 h  (further: parked in the last slot,
+                                                 moved again when it comes round)
+
+Start and cancel are O(1): a push or an unlink of a doubly-linked list. A tick only
+looks at one level 0 slot; every 256 ticks the next level 1 slot is spread over
+level 0 (every 16384 ticks a level 2 slot over level 1, ...), each timer is moved
+at most once per level, so the cost per tick does not depend on the number of
+timers waiting.
+
+Callbacks run in main context: an expired timer is moved to a ready list and
+timer_run(), a task (task.h), calls it. A periodic timer is started again from
+its own expiry time, it does not drift when loop() is late. TIMER_IRQ makes the
+callback run in the tick instead, for short deadlines that must not wait for
+loop() (motor brake, legacy delays[] flags).
+
+  uint16_t t = timer_start(500, 500, blink, RED);               // Every 500 ms
+  timer_cancel(t);
+
+The handle carries a generation count: cancelling a timer that already expired or
+was reused does nothing.
+*/
+
+#ifndef   TIMER_H
+#define   TIMER_H
+
+#define TIMER_POOL        256                                                                       // Timers, at most 256 (8-bit index in the handle)
+#define TW_BITS0          8                                                                         // Level 0: 256 slots
+#define TW_BITS           6                                                                         // Levels 1-3: 64 slots
+#define TW_LEVELS         4
+#define TW_SLOTS0         (1 << TW_BITS0)
+#define TW_SLOTS          (1 << TW_BITS)
+#define TW_LISTS          (TW_SLOTS0 + (TW_LEVELS - 1) * TW_SLOTS)                                  // Wheel slots, 448
+#define TW_READY          TW_LISTS                                                                  // List of expired timers waiting for timer_run()
+#define TW_NONE           0xFFFF                                                                    // End of list, not linked
+
+#define TIMER_IRQ         0x01                                                                      // Callback runs in the tick (interrupt context)
+#define TIMER_USED        0x80
+
+#define PWM_BRAKE_MS      1000                                                                      // Motor stopped this long on a direction change
+
+typedef void (*TimerCallback)(uint32_t arg);
+
+typedef struct {
+  uint32_t      expires;                                                                            // Tick of expiry
+  uint32_t      period;                                                                             // 0 = one-shot
+  TimerCallback cb;
+  uint32_t      arg;
+  uint16_t      next;                                                                               // Pool index, TW_NONE = end
+  uint16_t      prev;
+  uint16_t      list;                                                                               // Slot (or TW_READY) holding it, TW_NONE = free
+  uint8_t       gen;                                                                                // Handle generation, never 0
+  uint8_t       flags;
+} Timer;
+
+typedef struct {
+  uint32_t started;
+  uint32_t fired;
+  uint32_t cancelled;
+  uint32_t full;                                                                                    // timer_start() refused, pool empty
+  uint32_t late;                                                                                    // Periodic timer run more than one period late
+  uint32_t cascaded;                                                                                // Timers moved down a level
+  uint16_t active;
+  uint16_t peak;
+  uint32_t tickCycles;                                                                              // CPU cycles of the slowest tick
+} TimerStats;
+
+Timer      timers[TIMER_POOL];
+uint16_t   twHead[TW_LISTS + 1];                                                                    // Wheel slots + ready list
+uint16_t   twReadyTail = TW_NONE;
+uint16_t   twFree      = TW_NONE;
+volatile uint32_t twNow = 0;                                                                        // Current tick
+TimerStats timerStats;
+
+void     timer_init(void);
+uint16_t timer_start(uint32_t delayMs, uint32_t periodMs, TimerCallback cb, uint32_t arg = 0, uint8_t flags = 0);
+bool     timer_cancel(uint16_t handle);
+bool     timer_pending(uint16_t handle);
+void     timer_tick(void);
+uint16_t timer_run(void);
+
+#endif
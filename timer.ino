@@ -0,0 +1,270 @@
+
+// ~/Arduino/QIF/switch/timer.ino
+
+
+#include "qif.h"
+
+//========================================================================================
+// Timing wheel (see timer.h). List helpers are called with interrupts off or from the tick.
+//========================================================================================
+
+static inline void tw_unlink(uint16_t i)
+{
+  Timer* t = &timers[i];
+  if(t->prev != TW_NONE) timers[t->prev].next = t->next;
+  else twHead[t->list] = t->next;
+  if(t->next != TW_NONE) timers[t->next].prev = t->prev;
+  else if(t->list == TW_READY) twReadyTail = t->prev;
+  t->list = TW_NONE;
+}
+
+static inline void tw_push(uint16_t list, uint16_t i)                                       // Wheel slot: order does not matter
+{
+  Timer* t = &timers[i];
+  t->list = list;
+  t->prev = TW_NONE;
+  t->next = twHead[list];
+  if(t->next != TW_NONE) timers[t->next].prev = i;
+  twHead[list] = i;
+}
+
+static inline void tw_ready(uint16_t i)                                                     // Ready list: first expired, first run
+{
+  Timer* t = &timers[i];
+  t->list = TW_READY;
+  t->next = TW_NONE;
+  t->prev = twReadyTail;
+  if(twReadyTail != TW_NONE) timers[twReadyTail].next = i;
+  else twHead[TW_READY] = i;
+  twReadyTail = i;
+}
+
+//----------------------------------------------------------------------------------------
+// tw_place: Link a timer in the slot of the lowest level that reaches its expiry
+//----------------------------------------------------------------------------------------
+static void tw_place(uint16_t i)
+{
+  const uint32_t expires = timers[i].expires;
+  const uint32_t delta   = expires - twNow;
+
+  if(delta < TW_SLOTS0) { tw_push(expires & (TW_SLOTS0 - 1), i); return; }
+
+  for(uint8_t level = 1; level < TW_LEVELS; level++)
+    {
+      const uint8_t shift = TW_BITS0 + level * TW_BITS;
+      if(delta < (1UL << shift) || level == TW_LEVELS - 1)
+        {
+          uint32_t at = expires;
+          if(delta >= (1UL << shift)) at = twNow + (1UL << shift) - 1;                      // Beyond the wheel: last slot, placed again later
+          const uint8_t slot = (at >> (shift - TW_BITS)) & (TW_SLOTS - 1);
+          tw_push(TW_SLOTS0 + (level - 1) * TW_SLOTS + slot, i);
+          return;
+        }
+    }
+}
+
+static void tw_cascade(uint16_t list)                                                       // Spread one slot over the levels below
+{
+  uint16_t i;
+  while((i = twHead[list]) != TW_NONE)
+    {
+      tw_unlink(i);
+      tw_place(i);
+      timerStats.cascaded++;
+    }
+}
+
+static void tw_release(uint16_t i)
+{
+  Timer* t = &timers[i];
+  t->flags = 0;
+  t->list  = TW_NONE;
+  if(++t->gen == 0) t->gen = 1;                                                             // Old handles no longer match
+  t->next  = twFree;
+  twFree   = i;
+  timerStats.active--;
+}
+
+//----------------------------------------------------------------------------------------
+// timer_init: Empty wheel, every timer free. Call once before TCC2_Setup().
+//----------------------------------------------------------------------------------------
+void timer_init(void)
+{
+  ATOMIC()
+    {
+      for(uint16_t l = 0; l <= TW_LISTS; l++) twHead[l] = TW_NONE;
+      twReadyTail = TW_NONE;
+      twFree = TW_NONE;
+      for(int16_t i = TIMER_POOL - 1; i >= 0; i--)
+        {
+          timers[i].gen   = 1;
+          timers[i].flags = 0;
+          timers[i].list  = TW_NONE;
+          timers[i].next  = twFree;
+          twFree = i;
+        }
+      memset(&timerStats, 0, sizeof(timerStats));
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// timer_start: Call cb(arg) in delayMs (minimum 1), then every periodMs if not 0.
+// Safe from interrupts (CAN callbacks). Returns the handle, 0 if the pool is empty.
+//----------------------------------------------------------------------------------------
+uint16_t timer_start(uint32_t delayMs, uint32_t periodMs, TimerCallback cb, uint32_t arg, uint8_t flags)
+{
+  uint16_t handle = 0;
+  if(!cb) return 0;
+  if(delayMs == 0) delayMs = 1;
+
+  ATOMIC()
+    {
+      const uint16_t i = twFree;
+      if(i == TW_NONE) timerStats.full++;
+      else
+        {
+          Timer* t = &timers[i];
+          twFree     = t->next;
+          t->expires = twNow + delayMs;
+          t->period  = periodMs;
+          t->cb      = cb;
+          t->arg     = arg;
+          t->flags   = (flags & TIMER_IRQ) | TIMER_USED;
+          tw_place(i);
+          handle = ((uint16_t)t->gen << 8) | i;
+          timerStats.started++;
+          if(++timerStats.active > timerStats.peak) timerStats.peak = timerStats.active;
+        }
+    }
+  return handle;
+}
+
+//----------------------------------------------------------------------------------------
+// timer_cancel: Stop a timer, also if it expired and waits for timer_run().
+// Returns false if the handle is stale (one-shot already run, or cancelled).
+//----------------------------------------------------------------------------------------
+bool timer_cancel(uint16_t handle)
+{
+  const uint8_t i   = handle & 0xFF;
+  const uint8_t gen = handle >> 8;
+  bool done = false;
+
+  ATOMIC()
+    {
+      Timer* t = &timers[i];
+      if(gen && t->gen == gen && (t->flags & TIMER_USED))
+        {
+          if(t->list != TW_NONE) tw_unlink(i);
+          tw_release(i);
+          timerStats.cancelled++;
+          done = true;
+        }
+    }
+  return done;
+}
+
+bool timer_pending(uint16_t handle)
+{
+  const Timer* t = &timers[handle & 0xFF];
+  return (handle >> 8) && t->gen == (handle >> 8) && (t->flags & TIMER_USED);
+}
+
+//----------------------------------------------------------------------------------------
+// timer_tick: Advance the wheel one millisecond. Called from TCC2_0_Handler only.
+//----------------------------------------------------------------------------------------
+void timer_tick(void)
+{
+  const uint32_t start = DWT->CYCCNT;
+  const uint32_t now   = ++twNow;
+  const uint16_t slot  = now & (TW_SLOTS0 - 1);
+
+  if(slot == 0)                                                                             // Level 0 turned: bring down the next slot of level 1,
+    for(uint8_t level = 1; level < TW_LEVELS; level++)                                      // and of level 2 if level 1 turned too...
+      {
+        const uint8_t s = (now >> (TW_BITS0 + (level - 1) * TW_BITS)) & (TW_SLOTS - 1);
+        tw_cascade(TW_SLOTS0 + (level - 1) * TW_SLOTS + s);
+        if(s) break;
+      }
+
+  uint16_t i;
+  while((i = twHead[slot]) != TW_NONE)                                                      // A callback cannot add to this slot, expiry is at least now + 1
+    {
+      Timer* t = &timers[i];
+      tw_unlink(i);
+      if(!(t->flags & TIMER_IRQ)) { tw_ready(i); continue; }                                // Run by timer_run()
+
+      const TimerCallback cb  = t->cb;
+      const uint32_t      arg = t->arg;
+      if(t->period) { t->expires += t->period; tw_place(i); }
+      else tw_release(i);
+      timerStats.fired++;
+      cb(arg);
+    }
+
+  const uint32_t cycles = DWT->CYCCNT - start;
+  if(cycles > timerStats.tickCycles) timerStats.tickCycles = cycles;
+}
+
+//----------------------------------------------------------------------------------------
+// timer_run: Call the callbacks of the expired timers. Runs as a task (task.ino).
+// Returns the number of callbacks run.
+//----------------------------------------------------------------------------------------
+uint16_t timer_run(void)
+{
+  uint16_t count = 0;
+
+  while(count < TIMER_POOL)                                                                 // A 1 ms periodic timer cannot hold loop() forever
+    {
+      TimerCallback cb = nullptr;
+      uint32_t arg = 0;
+
+      ATOMIC()
+        {
+          const uint16_t i = twHead[TW_READY];
+          if(i != TW_NONE)
+            {
+              Timer* t = &timers[i];
+              tw_unlink(i);
+              cb  = t->cb;
+              arg = t->arg;
+              if(t->period)
+                {
+                  t->expires += t->period;                                                  // Same phase as the first expiry
+                  if((int32_t)(t->expires - twNow) <= 0)                                    // loop() held longer than a period: skip the missed ones
+                    {
+                      t->expires += ((twNow - t->expires) / t->period + 1) * t->period;
+                      timerStats.late++;
+                    }
+                  tw_place(i);
+                }
+              else tw_release(i);
+              timerStats.fired++;
+            }
+        }
+
+      if(!cb) break;
+      cb(arg);
+      count++;
+    }
+  return count;
+}
+
+//----------------------------------------------------------------------------------------
+// Serial command G: timer counters
+//----------------------------------------------------------------------------------------
+void timer_print(void)
+{
+  if(!IDE) return;
+  TimerStats s;
+  ATOMIC() s = timerStats;
+
+  Serial.print(F("TIMERS ACTIVE: ")); Serial.print(s.active); Serial.print('/'); Serial.print(TIMER_POOL);
+  Serial.print(F("  PEAK: "));        Serial.println(s.peak);
+  Serial.print(F("STARTED: "));       Serial.print(s.started);
+  Serial.print(F("  FIRED: "));       Serial.print(s.fired);
+  Serial.print(F("  CANCELLED: "));   Serial.print(s.cancelled);
+  Serial.print(F("  LATE: "));        Serial.print(s.late);
+  Serial.print(F("  FULL: "));        Serial.println(s.full);
+  Serial.print(F("CASCADED: "));      Serial.print(s.cascaded);
+  Serial.print(F("  SLOWEST TICK: ")); Serial.print(s.tickCycles); Serial.println(F(" cycles"));
+}
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# ~/Arduino/QIF/tools/benchcmp.py
+
+"""
+Compare two runs of the benchmark suite (bench.h) and flag the regressions.
+
+Each input is the JSON of serial command G 6 or of sim/qifbench, alone or in a
+saved serial log (the document is found between {"bench" and ]}).
+
+  benchcmp.py old.json new.json
+  benchcmp.py before.txt after.txt --threshold 3 --noise 4
+
+A case is compared on its median ns per op. The change counts only past the
+larger of --threshold percent and --noise times the spread of the two runs
+(MAD of old + MAD of new): a noisy case needs a bigger change. Exit status 1
+when a case got slower, so a script can stop on it. Compare host with host and
+board with board, the script warns when the targets differ.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """The suite document in a file, JSON alone or inside a serial log"""
+    with open(path, encoding='utf-8', errors='replace') as f:
+        text = f.read()
+    start = text.rfind('{"bench"')                                                  # The last run of the log
+    if start < 0:
+        sys.exit('no benchmark output in ' + path)
+    end = text.find(']}', start)
+    if end < 0:
+        sys.exit('benchmark output cut short in ' + path)
+    try:
+        doc = json.loads(text[start:end + 2])
+    except ValueError as e:
+        sys.exit('%s: %s' % (path, e))
+    return doc
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('old')
+    p.add_argument('new')
+    p.add_argument('--threshold', type=float, default=5.0, help='smallest change flagged, percent')
+    p.add_argument('--noise', type=float, default=3.0, help='MADs of margin')
+    a = p.parse_args()
+
+    old, new = load(a.old), load(a.new)
+    for key in ('target', 'type', 'clock_hz'):
+        if old.get(key) != new.get(key):
+            print('warning: %s %s against %s' % (key, old.get(key), new.get(key)), file=sys.stderr)
+
+    before = {c['name']: c for c in old['cases']}
+    after = {c['name']: c for c in new['cases']}
+    regressions = 0
+    print('%-12s %12s %12s %8s %8s  %s' % ('CASE', 'OLD ns', 'NEW ns', 'CHANGE', 'BAND', ''))
+    for name in list(before) + [n for n in after if n not in before]:
+        if name not in after:
+            print('%-12s %12.1f %12s   missing in new' % (name, before[name]['ns'], '-'))
+            continue
+        if name not in before:
+            print('%-12s %12s %12.1f   new case' % (name, '-', after[name]['ns']))
+            continue
+        b, c = before[name], after[name]
+        if b['ns'] <= 0:
+            continue
+        change = (c['ns'] - b['ns']) * 100.0 / b['ns']
+        band = max(a.threshold, a.noise * (b['mad'] + c['mad']) * 100.0 / b['ns'])
+        verdict = ''
+        if change > band:
+            verdict = 'REGRESSION'
+            regressions += 1
+        elif change < -band:
+            verdict = 'IMPROVED'
+        extra = ''
+        if c.get('mbps'):
+            extra = '  %.1f -> %.1f MB/s' % (b.get('mbps', 0), c['mbps'])
+        print('%-12s %12.1f %12.1f %+7.1f%% %7.1f%%  %s%s' % (name, b['ns'], c['ns'], change, band, verdict, extra))
+
+    print('%d regression%s' % (regressions, '' if regressions == 1 else 's'))
+    sys.exit(1 if regressions else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+# ~/Arduino/QIF/tools/qifcap.py
+
+"""
+Fetch the CAN capture stored in QSPI (monitor mode, capture.h).
+
+Sends "M 3", collects the candump log lines until "# END" and writes them to a
+.log file that can-utils read (canplayer -I, log2asc...). With --pcap the same
+frames go to a pcap file (LINKTYPE_CAN_SOCKETCAN) for Wireshark / tshark.
+A .log file already saved can be converted without a board (--from).
+
+  qifcap.py /dev/ttyACM0 boat.log
+  qifcap.py /dev/ttyACM0 boat.log --pcap boat.pcap
+  qifcap.py --from boat.log --pcap boat.pcap
+
+Needs pyserial for the board.
+"""
+
+import argparse
+import re
+import struct
+import sys
+import time
+
+LINE = re.compile(r'^\((\d+)\.(\d{6})\) (\S+) ([0-9A-Fa-f]{3,8})(##?)([0-9A-Fa-f]*)$')
+CANFD_BRS, CANFD_FDF = 0x01, 0x04
+
+
+def fetch(port, timeout):
+    import serial
+    lines = []
+    with serial.Serial(port, 115200, timeout=timeout) as s:
+        s.reset_input_buffer()
+        s.write(b'M 3\n')
+        while True:
+            raw = s.readline()
+            if not raw:
+                sys.exit('no answer from the board (capture still running? send M first)')
+            text = raw.decode('ascii', 'replace').strip()
+            if text.startswith('NO CAPTURE') or text.startswith('CAPTURE RUNNING'):
+                sys.exit(text)
+            if text.startswith('# END'):
+                print(text[2:], file=sys.stderr)
+                break
+            if text.startswith('#'):
+                print(text[2:], file=sys.stderr)
+            elif LINE.match(text):
+                lines.append(text)
+    return lines
+
+
+def parse(line):
+    m = LINE.match(line)
+    if not m:
+        return None
+    sec, usec, _, ident, sep, data = m.groups()
+    fd = sep == '##'
+    flags = 0
+    if fd:
+        flags = int(data[0], 16)
+        data = data[1:]
+    return int(sec), int(usec), int(ident, 16), fd, flags, bytes.fromhex(data)
+
+
+def write_pcap(path, lines):
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<IHHiIII', 0xA1B2C3D4, 2, 4, 0, 0, 65535, 227))   # LINKTYPE_CAN_SOCKETCAN
+        for line in lines:
+            p = parse(line)
+            if not p:
+                continue
+            sec, usec, ident, fd, flags, data = p
+            fdflags = (CANFD_FDF | (CANFD_BRS if flags & 1 else 0)) if fd else 0
+            pkt = struct.pack('>IBBBB', ident, len(data), fdflags, 0, 0) + data
+            f.write(struct.pack('<IIII', sec, usec, len(pkt), len(pkt)) + pkt)
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('port', nargs='?')
+    p.add_argument('log', nargs='?', help='candump log to write')
+    p.add_argument('--from', dest='source', help='convert an existing log, no board')
+    p.add_argument('--pcap')
+    p.add_argument('--timeout', type=float, default=5.0)
+    a = p.parse_args()
+
+    if a.source:
+        with open(a.source) as f:
+            lines = [l.strip() for l in f if l.startswith('(')]
+    elif a.port and a.log:
+        t0 = time.monotonic()
+        lines = fetch(a.port, a.timeout)
+        with open(a.log, 'w') as f:
+            f.write('\n'.join(lines) + '\n')
+        print('%d frames in %.1f s' % (len(lines), time.monotonic() - t0), file=sys.stderr)
+    else:
+        p.error('need PORT LOG or --from LOG')
+
+    if a.pcap:
+        write_pcap(a.pcap, lines)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,383 @@
+#!/usr/bin/env python3
+# ~/Arduino/QIF/tools/qifgw.py
+
+"""
+Host side of the USB to CAN FD gateway (serial command "M 1", gateway.h).
+
+Library:
+
+  with Gateway('/dev/ttyACM0') as gw:
+      seq = gw.send(0x123, b'\\x01\\x02')           # Confirmed later by a 'txc' event
+      for ev in gw.events():                        # ('rx', host_time, id, data, flags)
+          ...                                       # ('txc', seq, status, latency_s)
+                                                    # ('stat', rx, lost, tx, refused)
+
+Command line:
+
+  qifgw.py /dev/ttyACM0 dump                        # Print every frame on the bus
+  qifgw.py /dev/ttyACM0 send 0x123 0102 --count 100 # Send, report confirmation latency
+  qifgw.py selftest                                 # Codec round trips, no board
+  qifgw.py vectors > sim/qifgw.h                    # Test vectors of sim/qifgw.cpp
+
+The codec functions (cobs_*, crc16, pack/unpack, seal/open_frame) are the same
+wire format as gwproto.h and need nothing but the standard library. Needs
+pyserial for the board. sim/qifgw.cpp builds gwproto.h on the host and checks it
+against the frames this file packs and seals (the vectors command).
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+GW_TX, GW_SYNC, GW_EXIT = 0x01, 0x02, 0x03
+GW_RX, GW_TXC, GW_TIME, GW_STAT = 0x81, 0x82, 0x83, 0x84
+GW_TX_REFUSED = 0xFF
+GW_FRAME_MAX = 1024
+TX_STATUS = {0: 'sent', 1: 'failed', 2: 'expired', 3: 'superseded', GW_TX_REFUSED: 'refused'}
+
+# Codec, gwproto.h ------------------------------------------------------------------------
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code = 0
+    run = 1
+    for b in data:
+        if b == 0:
+            out[code] = run
+            code = len(out)
+            out.append(0)
+            run = 1
+            continue
+        out.append(b)
+        run += 1
+        if run == 0xFF:
+            out[code] = run
+            code = len(out)
+            out.append(0)
+            run = 1
+    out[code] = run
+    out.append(0)
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ValueError('bad COBS code')
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def pack(rec):
+    """rec is a tuple: ('tx', seq, id, data, prio, state) ('sync', host) ('exit',)
+    or the board records ('rx', flags, stamp, id, data) ('txc', status, seq, stamp)
+    ('time', host, stamp) ('stat', rx, lost, tx, refused)."""
+    kind = rec[0]
+    if kind == 'tx':
+        _, seq, ident, data, prio, state = rec
+        return struct.pack('<BBHHB', GW_TX, prio | (0x80 if state else 0), seq, ident, len(data)) + bytes(data)
+    if kind == 'sync':
+        return struct.pack('<BQ', GW_SYNC, rec[1])
+    if kind == 'exit':
+        return bytes([GW_EXIT])
+    if kind == 'rx':
+        _, flags, stamp, ident, data = rec
+        return struct.pack('<BBIHB', GW_RX, flags, stamp, ident, len(data)) + bytes(data)
+    if kind == 'txc':
+        return struct.pack('<BBHI', GW_TXC, *rec[1:])
+    if kind == 'time':
+        return struct.pack('<BQI', GW_TIME, *rec[1:])
+    if kind == 'stat':
+        return struct.pack('<B4I', GW_STAT, *rec[1:])
+    raise ValueError(kind)
+
+
+def unpack(frame):
+    """Records of one decoded frame (CRC removed)."""
+    recs = []
+    pos = 0
+    while pos < len(frame):
+        t = frame[pos]
+        if t == GW_TX:
+            _, prio, seq, ident, n = struct.unpack_from('<BBHHB', frame, pos)
+            recs.append(('tx', seq, ident, frame[pos + 7:pos + 7 + n], prio & 0x7F, bool(prio & 0x80)))
+            pos += 7 + n
+        elif t == GW_SYNC:
+            recs.append(('sync', struct.unpack_from('<Q', frame, pos + 1)[0]))
+            pos += 9
+        elif t == GW_EXIT:
+            recs.append(('exit',))
+            pos += 1
+        elif t == GW_RX:
+            _, flags, stamp, ident, n = struct.unpack_from('<BBIHB', frame, pos)
+            recs.append(('rx', flags, stamp, ident, frame[pos + 9:pos + 9 + n]))
+            pos += 9 + n
+        elif t == GW_TXC:
+            recs.append(('txc',) + struct.unpack_from('<BHI', frame, pos + 1))
+            pos += 8
+        elif t == GW_TIME:
+            recs.append(('time',) + struct.unpack_from('<QI', frame, pos + 1))
+            pos += 13
+        elif t == GW_STAT:
+            recs.append(('stat',) + struct.unpack_from('<4I', frame, pos + 1))
+            pos += 17
+        else:
+            raise ValueError('record type 0x%02X' % t)
+        if pos > len(frame):
+            raise ValueError('truncated record')
+    return recs
+
+
+def seal(records):
+    """Packed records to one wire frame, 0x00 included."""
+    body = b''.join(records)
+    return cobs_encode(body + struct.pack('>H', crc16(body)))
+
+
+def open_frame(raw):
+    """One wire frame without its 0x00 to the records bytes, ValueError if damaged."""
+    frame = cobs_decode(raw)
+    if len(frame) < 3 or crc16(frame[:-2]) != struct.unpack('>H', frame[-2:])[0]:
+        raise ValueError('CRC')
+    return frame[:-2]
+
+# Board ----------------------------------------------------------------------------------
+
+class Gateway:
+    def __init__(self, port, baud=115200):
+        import serial
+        self.port = serial.Serial(port, baud, timeout=0.05)
+        self.buf = bytearray()
+        self.seq = 0
+        self.sent = {}                                      # seq -> host time of send()
+        self.offset = None                                  # host seconds - board seconds
+        self.last_stamp = 0
+        self.wraps = 0
+        self.bad = 0
+        self.port.reset_input_buffer()
+        self.port.write(b'M 1\n')
+        self.port.readline()                                # "GATEWAY ON" line, binary after it
+        self.sync()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def close(self):
+        self.port.write(seal([pack(('exit',))]))
+        self.port.flush()
+        self.port.close()
+
+    def write(self, records):
+        frame = []
+        size = 0
+        for r in records:                                   # Batch as many records per frame as fit
+            if size + len(r) + 2 > GW_FRAME_MAX:
+                self.port.write(seal(frame))
+                frame, size = [], 0
+            frame.append(r)
+            size += len(r)
+        if frame:
+            self.port.write(seal(frame))
+
+    def sync(self):
+        self.write([pack(('sync', time.monotonic_ns()))])
+
+    def send(self, ident, data, prio=1, state=False):
+        return self.send_many([(ident, data, prio, state)])[0]
+
+    def send_many(self, frames):
+        seqs = []
+        records = []
+        now = time.monotonic()
+        for ident, data, prio, state in frames:
+            self.seq = (self.seq + 1) & 0xFFFF
+            self.sent[self.seq] = now
+            seqs.append(self.seq)
+            records.append(pack(('tx', self.seq, ident, data, prio, state)))
+        self.write(records)
+        return seqs
+
+    def host_time(self, stamp):
+        """Board micros() to host monotonic seconds, 32-bit wrap handled."""
+        if stamp < self.last_stamp and self.last_stamp - stamp > 0x80000000:
+            self.wraps += 1
+        self.last_stamp = stamp
+        board = (self.wraps * 0x100000000 + stamp) / 1e6
+        return board + self.offset if self.offset is not None else None
+
+    def events(self, duration=None):
+        end = None if duration is None else time.monotonic() + duration
+        while end is None or time.monotonic() < end:
+            chunk = self.port.read(self.port.in_waiting or 1)
+            self.buf += chunk
+            while True:
+                n = self.buf.find(b'\x00')
+                if n < 0:
+                    break
+                raw, self.buf = bytes(self.buf[:n]), self.buf[n + 1:]
+                if not raw:
+                    continue
+                try:
+                    recs = unpack(open_frame(raw))
+                except (ValueError, struct.error):
+                    self.bad += 1
+                    continue
+                for r in recs:
+                    ev = self.event(r)
+                    if ev:
+                        yield ev
+
+    def event(self, r):
+        kind = r[0]
+        if kind == 'time':
+            host, stamp = r[1], r[2]
+            now = time.monotonic_ns()
+            mid = (host + now) / 2e9                        # Board stamp taken halfway, within the round trip
+            self.last_stamp = stamp
+            self.offset = mid - (self.wraps * 0x100000000 + stamp) / 1e6
+            return None
+        if kind == 'rx':
+            _, flags, stamp, ident, data = r
+            return ('rx', self.host_time(stamp), ident, data, flags)
+        if kind == 'txc':
+            _, status, seq, stamp = r
+            t0 = self.sent.pop(seq, None)
+            latency = (self.host_time(stamp) - t0) if (t0 is not None and self.offset is not None) else None
+            return ('txc', seq, TX_STATUS.get(status, status), latency)
+        if kind == 'stat':
+            return r
+        return None
+
+# Command line ---------------------------------------------------------------------------
+
+# Test vectors: COBS runs around the 254 byte limit, one record of each type, one frame
+
+def _run(n):
+    return bytes(i % 255 + 1 for i in range(n))                        # No zero byte
+
+
+VECTOR_COBS = [b'', b'\x00', b'\x00\x00', b'\x11\x22\x00\x33', b'\x11\x22\x33\x00',
+               _run(253), _run(254), _run(255), _run(254) + b'\x00', _run(255) + b'\x00', _run(508),
+               bytes((i * 37) & 0xFF for i in range(300))]
+VECTOR_RECORDS = [('tx', 7, 0x123, b'\x00\x01', 2, True), ('tx', 0xFFFF, 0x7FF, b'', 0, False),
+                  ('sync', 1 << 40), ('exit',), ('rx', 3, 0xFFFFFFF0, 0x7FF, bytes(range(64))),
+                  ('rx', 0, 1, 0x001, b'\x80'), ('txc', GW_TX_REFUSED, 7, 12345),
+                  ('time', 0x0123456789ABCDEF, 5), ('stat', 1, 2, 3, 0xFFFFFFFF)]
+
+
+def selftest():
+    import random
+    rnd = random.Random(1)
+    for n in (0, 1, 253, 254, 255, 1000):
+        for fill in (0, 1, None):
+            data = bytes(rnd.randrange(256) if fill is None else fill for _ in range(n))
+            enc = cobs_encode(data)
+            assert enc[-1] == 0 and 0 not in enc[:-1]
+            assert cobs_decode(enc[:-1]) == data
+    assert crc16(b'123456789') == 0x29B1                   # CRC-16/CCITT-FALSE check value
+    raw = seal([pack(r) for r in VECTOR_RECORDS])
+    got = unpack(open_frame(raw[:-1]))
+    assert [tuple(bytes(x) if isinstance(x, (bytes, bytearray)) else x for x in g) for g in got] == VECTOR_RECORDS, got
+    bad = bytearray(raw[:-1])
+    bad[3] ^= 0x40
+    try:
+        open_frame(bytes(bad))
+        raise AssertionError('damaged frame accepted')
+    except ValueError:
+        pass
+    print('codec OK')
+
+
+def vectors():
+    """C tables of sim/qifgw.h: what this codec gives for VECTOR_COBS and VECTOR_RECORDS."""
+    def c(b):
+        h = b.hex().upper()
+        return '\n'.join('    "%s"' % h[i:i + 96] for i in range(0, len(h), 96)) if h else '    ""'
+    print('// ~/Arduino/QIF/sim/qifgw.h Test vectors of sim/qifgw.cpp, generated by tools/qifgw.py vectors\n')
+    print('// COBS: input, then cobs_encode() of it with the 0x00 delimiter')
+    print('static const char* const VEC_COBS[][2] = {')
+    for d in VECTOR_COBS:
+        print('  {\n%s,\n%s },' % (c(d), c(cobs_encode(d))))
+    print('};\n')
+    print('// pack() of each VECTOR_RECORDS entry, in order')
+    print('static const char* const VEC_RECORDS[] = {')
+    for r in VECTOR_RECORDS:
+        print('%s,' % c(pack(r)))
+    print('};\n')
+    print('// seal() of all the records above in one frame')
+    print('static const char* const VEC_FRAME =\n%s;' % c(seal([pack(r) for r in VECTOR_RECORDS])))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('port', help='serial port, "selftest" or "vectors"')
+    p.add_argument('command', nargs='?', default='dump', choices=['dump', 'send'])
+    p.add_argument('id', nargs='?', type=lambda s: int(s, 0))
+    p.add_argument('data', nargs='?', default='')
+    p.add_argument('--count', type=int, default=1)
+    p.add_argument('--prio', type=int, default=1, help='0 high, 1 normal, 2 low')
+    p.add_argument('--time', type=float, default=None, help='seconds, dump only')
+    a = p.parse_args()
+
+    if a.port == 'selftest':
+        selftest()
+        return
+    if a.port == 'vectors':
+        vectors()
+        return
+
+    with Gateway(a.port) as gw:
+        if a.command == 'dump':
+            for ev in gw.events(a.time):
+                if ev[0] == 'rx':
+                    _, t, ident, data, flags = ev
+                    print('%14.6f  %03X  [%2d] %s%s' % (t or 0, ident, len(data), data.hex(' '),
+                                                         '  FD' if flags & 1 else ''))
+                elif ev[0] == 'stat':
+                    print('# board rx %d lost %d tx %d refused %d' % ev[1:], file=sys.stderr)
+            return
+
+        data = bytes.fromhex(a.data)
+        time.sleep(0.1)                                     # Let the clock pairing come back
+        list(gw.events(0.1))
+        pending = set(gw.send_many([(a.id, data, a.prio, False)] * a.count))
+        lat = []
+        for ev in gw.events(2.0):
+            if ev[0] == 'txc' and ev[1] in pending:
+                pending.discard(ev[1])
+                if ev[2] == 'sent' and ev[3] is not None:
+                    lat.append(ev[3])
+                elif ev[2] != 'sent':
+                    print('seq %d %s' % (ev[1], ev[2]))
+            if not pending:
+                break
+        if lat:
+            lat.sort()
+            print('%d sent, confirmation latency min %.3f / median %.3f / max %.3f ms'
+                  % (len(lat), lat[0] * 1e3, lat[len(lat) // 2] * 1e3, lat[-1] * 1e3))
+        if pending:
+            print('%d without confirmation' % len(pending))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+# ~/Arduino/QIF/tools/qiflog.py
+
+"""
+Decode the deferred log of a board built with DLOG_MODE DLOG_HEX (dlog.h).
+
+Each "~" line is one raw record in hex: header, DWT cycle stamp, arguments,
+payload. The formats come from the DLOG_FORMATS table of dlog.h itself, so the
+decoder always matches the firmware it was built with. Other lines (command
+answers, reports) are printed unchanged.
+
+  qiflog.py /dev/ttyACM0                  live, until Ctrl-C
+  qiflog.py --from session.txt            a saved serial log
+  qiflog.py /dev/ttyACM0 --mhz 120 --level 3
+
+Time stamps are seconds since the first record, from the cycle counter (the
+32-bit wrap is followed as long as two records are less than 35 s apart).
+Needs pyserial for the board.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+VALID = 0x80000000
+CONV = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?([a-zA-Z])')
+ENTRY = re.compile(r'X\((\w+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+LEVELS = {'DLOG_ERROR': 1, 'DLOG_WARN': 2, 'DLOG_INFO': 3, 'DLOG_DEBUG': 4}
+
+
+def load_table(path):
+    """[(name, level, python format)] in id order, from the X() lines of dlog.h"""
+    table = []
+    with open(path, encoding='utf-8') as f:
+        inside = False
+        for line in f:
+            if line.startswith('#define DLOG_FORMATS'):
+                inside = True
+                continue
+            if not inside:
+                continue
+            m = ENTRY.search(line)
+            if m:
+                name, level, fmt = m.groups()
+                table.append((name, LEVELS.get(level, 4), re.sub(r'%(\d*)l([uUdxX])', r'%\1\2', fmt)))
+            if not line.rstrip().endswith('\\'):
+                break
+    if not table:
+        sys.exit('no DLOG_FORMATS table in ' + path)
+    return table
+
+
+class Decoder:
+    def __init__(self, table, mhz, level):
+        self.table, self.mhz, self.level = table, mhz, level
+        self.high = 0
+        self.last = None
+        self.first = None
+
+    def stamp(self, cycles):
+        if self.last is not None and cycles < self.last:
+            self.high += 1
+        self.last = cycles
+        full = self.high << 32 | cycles
+        if self.first is None:
+            self.first = full
+        return (full - self.first) / (self.mhz * 1e6)
+
+    def record(self, text):
+        raw = bytes.fromhex(text)
+        if len(raw) < 8 or len(raw) % 4:
+            return '? ' + text
+        header, cycles = struct.unpack_from('<II', raw)
+        if not header & VALID:
+            return '? ' + text
+        ident, n, size = header & 0xFF, (header >> 8) & 0x0F, (header >> 16) & 0x7F
+        args = struct.unpack_from('<%dI' % n, raw, 8)
+        data = raw[8 + 4 * n:8 + 4 * n + size]
+        t = self.stamp(cycles)
+        if ident >= len(self.table):
+            return '%12.6f  LOG ID %d ?' % (t, ident)
+        name, level, fmt = self.table[ident]
+        if level > self.level:
+            return None
+        kinds = CONV.findall(fmt.replace('%%', ''))
+        args = tuple(a - (1 << 32) if k == 'd' and a & 0x80000000 else a for a, k in zip(args, kinds))  # %ld: signed
+        try:
+            line = fmt % args[:len(kinds)]
+        except (TypeError, ValueError):
+            line = '%s %s' % (name, ' '.join(str(a) for a in args))
+        if data:
+            line += ' ' + ' '.join('%02X' % b for b in data)
+        return '%12.6f  %s' % (t, line)
+
+    def line(self, text):
+        if text.startswith('~'):
+            return self.record(text[1:])
+        return text
+
+
+def lines_from(args):
+    if args.source:
+        with open(args.source, encoding='utf-8', errors='replace') as f:
+            for line in f:
+                yield line.rstrip('\r\n')
+        return
+    import serial
+    with serial.Serial(args.port, 115200, timeout=1) as s:
+        while True:
+            raw = s.readline()
+            if raw:
+                yield raw.decode('utf-8', 'replace').rstrip('\r\n')
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('port', nargs='?', help='serial port of the board')
+    p.add_argument('--from', dest='source', help='decode a saved serial log instead')
+    p.add_argument('--table', default=os.path.join(here, '..', 'dlog.h'), help='dlog.h of the firmware')
+    p.add_argument('--mhz', type=float, default=120.0, help='CPU clock (SystemCoreClock)')
+    p.add_argument('--level', type=int, default=4, help='hide records above this level (1 error .. 4 debug)')
+    args = p.parse_args()
+    if not args.port and not args.source:
+        p.error('a serial port or --from FILE')
+
+    dec = Decoder(load_table(args.table), args.mhz, args.level)
+    try:
+        for text in lines_from(args):
+            out = dec.line(text)
+            if out is not None:
+                print(out, flush=True)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+# ~/Arduino/QIF/tools/qifread.py
+
+"""
+Host side of the binary bulk read-out (serial command X, bulk.h).
+
+Sends "X source first count", reassembles the COBS frames into an image file,
+checks the CRC64 of every frame and of the whole image, and prints the rate.
+With --hex N it also times N hex dumps of QSPI blocks (command Q, 4 KB each)
+so both paths can be compared on the same board and cable.
+
+  qifread.py /dev/ttyACM0 qspi.bin                      # All of the QSPI
+  qifread.py /dev/ttyACM0 boot.bin --flash --count 4    # First 256 KB of internal flash
+  qifread.py /dev/ttyACM0 part.bin --first 2 --count 1 --hex 16
+
+Needs pyserial.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import serial
+
+UNIT = 0x10000
+HEADER = 8
+START, DATA, END, ERROR = ord('S'), ord('D'), ord('E'), ord('X')
+
+# CRC64 as crc64_update() in the firmware: ECMA-182 reflected, init all ones, no final inversion
+POLY = 0xC96C5795D7870F42
+TABLE = []
+for i in range(256):
+    c = i
+    for _ in range(8):
+        c = (c >> 1) ^ POLY if c & 1 else c >> 1
+    TABLE.append(c)
+
+
+def crc64(data, crc=0xFFFFFFFFFFFFFFFF):
+    for b in data:
+        crc = TABLE[(crc ^ b) & 0xFF] ^ (crc >> 8)
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            raise ValueError("bad COBS code")
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def frames(port, timeout):
+    """Yield decoded frames. Text before the first frame (the command echo) is skipped."""
+    buf = bytearray()
+    deadline = time.monotonic() + timeout
+    while True:
+        chunk = port.read(port.in_waiting or 1)
+        if chunk:
+            deadline = time.monotonic() + timeout
+            buf += chunk
+        elif time.monotonic() > deadline:
+            raise TimeoutError("no data from the board")
+        while True:
+            end = buf.find(b'\x00')
+            if end < 0:
+                break
+            raw, buf = bytes(buf[:end]), buf[end + 1:]
+            if not raw:
+                continue
+            try:
+                frame = cobs_decode(raw)
+            except ValueError:
+                continue                                    # Leftover text or a damaged frame
+            if len(frame) < HEADER + 8:
+                continue
+            kind, source, addr, length = struct.unpack_from('<BBIH', frame)
+            if len(frame) != HEADER + length + 8:
+                continue
+            body = frame[:HEADER + length]
+            (crc,) = struct.unpack_from('<Q', frame, HEADER + length)
+            yield kind, source, addr, body[HEADER:], crc64(body) == crc
+
+
+def bulk(port, path, source, first, count, timeout):
+    port.reset_input_buffer()
+    port.write(b'X %d %d %d\n' % (source, first, count))
+
+    image = None
+    base = total = 0
+    bad = 0
+    crc = 0xFFFFFFFFFFFFFFFF
+    t0 = None
+    for kind, _, addr, data, ok in frames(port, timeout):
+        if not ok:
+            bad += 1
+            if kind != DATA:
+                sys.exit("CRC error in a control frame, giving up")
+            continue
+        if kind == START:
+            t0 = time.monotonic()
+            base = addr
+            (total,) = struct.unpack('<I', data)
+            image = bytearray(b'\xFF' * total)
+        elif kind == DATA and image is not None:
+            image[addr - base:addr - base + len(data)] = data
+            crc = crc64(data, crc)
+        elif kind == ERROR:
+            sys.exit("board could not read 0x%X" % addr)
+        elif kind == END:
+            elapsed = time.monotonic() - (t0 or time.monotonic())
+            sent, board_ms, board_crc = struct.unpack('<IIQ', data)
+            break
+
+    with open(path, 'wb') as f:
+        f.write(image)
+
+    print("%d bytes from 0x%X in %.2f s: %.3f MB/s (board: %d ms, %.3f MB/s)"
+          % (total, base, elapsed, total / elapsed / 1e6 if elapsed else 0,
+             board_ms, sent / board_ms / 1e3 if board_ms else 0))
+    if bad:
+        print("%d frames with a CRC error, image incomplete" % bad)
+        return False
+    if crc != board_crc:
+        print("IMAGE CRC64 MISMATCH: host %016X board %016X" % (crc, board_crc))
+        return False
+    print("IMAGE CRC64 %016X OK" % crc)
+    return True
+
+
+def hex_rate(port, blocks, timeout):
+    """Time `blocks` hex dumps of 4 KB QSPI blocks (command Q)."""
+    port.reset_input_buffer()
+    t0 = time.monotonic()
+    for block in range(blocks):
+        port.write(b'Q %d\n' % block)
+        lines = 0
+        deadline = time.monotonic() + timeout
+        while lines < 256:
+            line = port.readline()
+            if line.startswith(b'0x'):
+                lines += 1
+                deadline = time.monotonic() + timeout
+            elif time.monotonic() > deadline:
+                raise TimeoutError("hex dump stopped after %d lines" % lines)
+    elapsed = time.monotonic() - t0
+    size = blocks * 4096
+    print("HEX DUMP: %d bytes in %.2f s: %.3f MB/s" % (size, elapsed, size / elapsed / 1e6))
+    return size / elapsed
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('port')
+    p.add_argument('output')
+    p.add_argument('--flash', action='store_true', help='internal flash instead of QSPI')
+    p.add_argument('--first', type=int, default=0, help='first 64 KB unit')
+    p.add_argument('--count', type=int, default=0, help='64 KB units, 0 = up to the end')
+    p.add_argument('--hex', type=int, default=0, metavar='N', help='also time N hex dump blocks')
+    p.add_argument('--timeout', type=float, default=3.0)
+    a = p.parse_args()
+
+    with serial.Serial(a.port, 115200, timeout=0.2) as port:
+        ok = bulk(port, a.output, 1 if a.flash else 0, a.first, a.count, a.timeout)
+        if a.hex:
+            time.sleep(0.2)
+            hex_rate(port, a.hex, a.timeout)
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
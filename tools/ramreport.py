@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+# ~/Arduino/QIF/tools/ramreport.py
+
+"""
+Worst-case RAM budget of a build: static RAM per symbol and stack per call chain.
+
+Build with the stack usage files and the heap guard (arena.h), then point this
+script at the build directory:
+
+  arduino-cli compile -b adafruit:samd:adafruit_feather_m4_can --build-path build \\
+    --build-property "compiler.c.extra_flags=-fstack-usage" \\
+    --build-property "compiler.cpp.extra_flags=-fstack-usage" \\
+    --build-property "compiler.c.elf.extra_flags=-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc"
+  ramreport.py build
+  ramreport.py build --heap 3400 --top 30
+
+Static: .data + .bss of the ELF, the largest symbols first.
+Stack: frame sizes from the .su files, call graph from the disassembly (bl, b.w
+tail calls). Calls through a pointer (CAN callbacks, tasks, timers, boardOps) may
+reach any function matching --indirect. Names are merged over overloads and
+template instantiations at their largest frame. Worst case = deepest main chain
+plus every interrupt handler nested on top of it, each with an exception frame.
+Recursion and functions without a .su entry (libraries built without the flag,
+assembler) are listed: their depth is not counted.
+
+--heap: heap allocated at boot, G 4 on the board prints it (HEAP ... at boot).
+Needs arm-none-eabi-nm and arm-none-eabi-objdump in PATH, or --tools PREFIX.
+"""
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+
+RAM = 192 * 1024
+EXC_FRAME = 104                                                 # Exception frame with lazy FPU context
+INDIRECT = r'^(Process_\w+|board_\w+|\w+Task|FCT\d+|PWM_Resume|delayExpired|alarmMatch|rpc_\w+)$'
+FUNC = re.compile(r'^[0-9a-f]+ <(.+)>:$')
+CALL = re.compile(r'\s(bl|b\.w|b)\s+[0-9a-f]+ <(.+?)(?:\+0x[0-9a-f]+)?>\s*$')
+ICALL = re.compile(r'\sblx\s+r\d+')
+
+
+def key(name):
+    """Bare function name from a .su or objdump -C name"""
+    name = re.sub(r'\s*\[with .*\]$', '', name)
+    while True:
+        stripped = re.sub(r'<[^<>]*>', '', name)
+        if stripped == name:
+            break
+        name = stripped
+    name = name.split('(')[0].strip()
+    return name.split()[-1] if name else name
+
+
+def run(cmd):
+    return subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+
+
+def static_ram(nm, elf, top):
+    syms = []
+    for line in run([nm, '-S', '-C', '--size-sort', elf]).splitlines():
+        parts = line.split(None, 3)
+        if len(parts) == 4 and parts[2] in 'bBdD':
+            syms.append((int(parts[1], 16), parts[3]))
+    syms.sort(reverse=True)
+    total = sum(s for s, _ in syms)
+    print('STATIC RAM   %7d bytes (.data + .bss)' % total)
+    for size, name in syms[:top]:
+        print('  %7d  %s' % (size, name))
+    return total
+
+
+def frames(build):
+    size, dynamic = {}, set()
+    for path in glob.glob(os.path.join(build, '**', '*.su'), recursive=True):
+        with open(path, encoding='utf-8', errors='replace') as f:
+            for line in f:
+                parts = line.rstrip('\n').split('\t')
+                if len(parts) < 3:
+                    continue
+                name = key(parts[0].split(':', 3)[-1])
+                size[name] = max(size.get(name, 0), int(parts[1]))
+                if parts[2].startswith('dynamic'):
+                    dynamic.add(name)
+    return size, dynamic
+
+
+def graph(objdump, elf):
+    calls, indirect, current = {}, set(), None
+    for line in run([objdump, '-d', '-C', '--no-show-raw-insn', elf]).splitlines():
+        m = FUNC.match(line)
+        if m:
+            current = key(m.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        m = CALL.search(line)
+        if m and key(m.group(2)) != current:
+            calls[current].add(key(m.group(2)))
+        elif ICALL.search(line):
+            indirect.add(current)
+    return calls, indirect
+
+
+class Stack:
+    def __init__(self, size, calls, indirect, targets):
+        self.size, self.calls, self.indirect, self.targets = size, calls, indirect, targets
+        self.memo, self.active = {}, set()
+        self.recursive, self.unknown = set(), set()
+
+    def depth(self, f):
+        """(bytes, chain) of the deepest path from f"""
+        if f in self.memo:
+            return self.memo[f]
+        if f in self.active:
+            self.recursive.add(f)
+            return 0, [f]
+        if f not in self.size:
+            self.unknown.add(f)
+        self.active.add(f)
+        callees = set(self.calls.get(f, ()))
+        if f in self.indirect:
+            callees |= self.targets
+        best = (0, [])
+        for c in callees:
+            d = self.depth(c)
+            if d[0] > best[0]:
+                best = d
+        self.active.discard(f)
+        result = (self.size.get(f, 0) + best[0], [f] + best[1])
+        self.memo[f] = result
+        return result
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('build', help='arduino-cli --build-path directory')
+    p.add_argument('--heap', type=int, default=0, help='heap bytes allocated at boot (G 4)')
+    p.add_argument('--top', type=int, default=20, help='largest static symbols listed')
+    p.add_argument('--indirect', default=INDIRECT, help='functions a call through a pointer may reach')
+    p.add_argument('--tools', default='arm-none-eabi-', help='toolchain prefix')
+    args = p.parse_args()
+
+    elves = glob.glob(os.path.join(args.build, '*.elf'))
+    if not elves:
+        sys.exit('no .elf in ' + args.build)
+    size, dynamic = frames(args.build)
+    if not size:
+        sys.exit('no .su files in %s: build with -fstack-usage' % args.build)
+
+    static = static_ram(args.tools + 'nm', elves[0], args.top)
+    calls, indirect = graph(args.tools + 'objdump', elves[0])
+    targets = {f for f in calls if re.match(args.indirect, f)}
+    st = Stack(size, calls, indirect, targets)
+
+    print('\nSTACK, WORST CHAIN PER ENTRY')
+    main_depth, chain = st.depth('main')
+    print('  %7d  main: %s' % (main_depth, ' > '.join(chain)))
+    total = main_depth
+    for isr in sorted(f for f in calls if f.endswith('_Handler')):
+        d, chain = st.depth(isr)
+        if d:
+            print('  %7d  %s: %s' % (d + EXC_FRAME, isr, ' > '.join(chain)))
+            total += d + EXC_FRAME
+
+    for title, names in (('RECURSIVE (depth not counted)', st.recursive),
+                         ('NO FRAME SIZE (library / assembler)', st.unknown & set(calls)),
+                         ('DYNAMIC FRAME (alloca / VLA)', dynamic)):
+        if names:
+            print('\n%s: %s' % (title, ' '.join(sorted(names))))
+
+    free = RAM - static - args.heap - total
+    print('\nBUDGET       %7d RAM - %d static - %d heap - %d stack worst case = %d bytes %s'
+          % (RAM, static, args.heap, total, free, 'FREE' if free >= 0 else 'OVER'))
+    sys.exit(0 if free >= 0 else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,173 @@
+
+// ~/Arduino/QIF/tsdb.h Located in parent directory and linked in subdirectory
+
+/*
+Time-series store in QSPI
+
+History of BME, analog and current sense values (local and received from other
+boards) in the QSPI region above the firmware image and Boot2, 5.5 MB. Above it
+8 KB of BSEC state (bstate.h), then the 2 MB CAN capture area (capture.h).
+
+Log structure
+  The region is a ring of 4 KB sectors written page by page (256 bytes), never
+  rewritten. When the writer enters a sector it erases it first, this drops the
+  oldest 4 KB of history. Every sector is erased once per turn of the ring, so
+  wear is level without any bookkeeping.
+
+Page
+  16-byte header (TsPageHeader) then a bit stream of records. Pages decode on
+  their own: the first record of a series in a page is stored in full, the next
+  ones compressed against the previous sample of the same series.
+
+  Record   : 1 bit  0 = known series + 5-bit index in the page,
+                    1 = new series + 11-bit key (label << 4 | qty), then
+                        32-bit time + 32-bit value, end of record
+             time   delta-of-delta in seconds:
+                    0 | 10 + 7 bits | 110 + 9 bits | 1110 + 12 bits | 1111 + 32 bits
+             value  XOR with the previous float:
+                    0 same value | 10 + meaningful bits in the previous window |
+                    11 + 5-bit leading zeros + 5-bit length - 1 + meaningful bits
+
+  A slow-moving sensor sampled at a fixed period costs a few bits for the time and
+  10-20 bits for the value instead of 8 bytes.
+
+Index
+  The first page header of each sector is a sparse time index: a range query does a
+  binary search on it, then skips pages with the header time range and decodes only
+  the pages that overlap. The page being filled in RAM is searched too.
+
+Concurrency
+  Everything here runs in main context (tsdb_task, task.h), never from an interrupt. Values from
+  CAN callbacks go through a small staging ring (tsdb_stage). Flash is not touched
+  while a firmware update owns the QSPI (STX_FLAG).
+
+Streaming
+  CTL_TS_QUERY on the control channel asks a board for a range, the samples come
+  back on the control channel of the caller as CTL_TS_DATA frames:
+
+  Query : CTL_TS_QUERY, caller label, seq, label, qty, start (u32), end (u32)
+  Data  : CTL_TS_DATA, sender label, seq, frame index, count, base time (u32),
+          count x (time - base (u16), value (float)). count = 0 ends the stream,
+          frame index 0xFF with count 0 means refused (another stream running).
+*/
+
+#ifndef   TSDB_H
+#define   TSDB_H
+
+#define TSDB_START        0x00080000UL                                                              // Above BOOT2_START_ADDR + protected area
+#define TSDB_END          0x005FE000UL                                                              // BST_START, BSEC state then capture area above
+#define TSDB_SECTOR       4096                                                                      // Erase unit (QSPI_BLOCK_SIZE)
+#define TSDB_PAGE         256                                                                       // Program unit (QSPI_PAGE_SIZE)
+#define TSDB_SECTORS      ((TSDB_END - TSDB_START) / TSDB_SECTOR)                                   // 1406
+#define TSDB_PAGES        (TSDB_SECTOR / TSDB_PAGE)                                                 // 16 pages per sector
+
+#define TSDB_MAGIC        0x5453                                                                    // "TS", 0xFFFF = erased page
+#define TSDB_HEADER       16
+#define TSDB_BITS         ((TSDB_PAGE - TSDB_HEADER) * 8)                                           // Payload bits per page
+#define TSDB_MAX_RECORD   86                                                                        // Longest record in bits
+#define TSDB_SERIES       32                                                                        // Series per page (5-bit index)
+
+#define TSDB_FLUSH_S      300                                                                       // Write a partial page after this long
+#define TSDB_SAMPLE_S     10                                                                        // Local analog / current sense period
+#define TSDB_STAGE        32                                                                        // Values waiting from CAN callbacks, power of 2
+#define TSDB_FRAME_MAX    9                                                                         // Samples per CTL_TS_DATA frame
+#define TSDB_BURST        4                                                                         // CTL_TS_DATA frames per tsdb_task call
+
+typedef struct __attribute__((packed)) {
+  uint16_t magic;
+  uint16_t nbits;                                                                                   // Bits used in the payload
+  uint32_t seq;                                                                                     // Page sequence, +1 per page written
+  uint32_t tFirst;                                                                                  // Oldest and newest sample time in the page
+  uint32_t tLast;
+} TsPageHeader;
+
+typedef struct {                                                                                    // Compression state of one series in a page
+  uint16_t key;
+  uint32_t t;
+  int32_t  delta;
+  uint32_t v;
+  uint8_t  lead;                                                                                    // XOR window, 0xFF = none yet
+  uint8_t  trail;
+} TsSeries;
+
+typedef struct {
+  uint32_t t;                                                                                       // Unix time (RTC)
+  uint8_t  label;
+  uint8_t  qty;                                                                                     // enum QTY
+  float    v;
+} TsSample;
+
+typedef struct {                                                                                    // Page being filled
+  uint8_t  page[TSDB_PAGE];
+  TsSeries series[TSDB_SERIES];
+  uint8_t  nseries;
+  uint16_t nbits;
+  uint32_t tFirst;
+  uint32_t tLast;
+  uint32_t firstMs;                                                                                 // millis() of the first record, flush timer
+  uint32_t seq;                                                                                     // Sequence of this page
+  uint16_t sector;                                                                                  // Where it will be written
+  uint8_t  pageNo;
+  uint16_t oldest;                                                                                  // Oldest sector holding data
+  uint16_t used;                                                                                    // Sectors holding data
+  bool     mounted;
+} TsWriter;
+
+typedef struct {
+  uint32_t appended;                                                                                // Samples
+  uint32_t bits;                                                                                    // Payload bits of the samples
+  uint32_t pages;                                                                                   // Pages written
+  uint32_t erases;                                                                                  // Sectors erased
+  uint32_t staged;
+  uint32_t dropped;                                                                                 // Staging ring full
+  uint32_t errors;                                                                                  // Flash errors
+} TsStats;
+
+typedef struct {                                                                                    // Staging ring entry, filled in interrupt context
+  uint32_t ms;
+  uint8_t  label;
+  uint8_t  qty;
+  float    v;
+} TsStage;
+
+typedef struct {                                                                                    // CAN stream in progress
+  volatile bool active;
+  uint8_t  caller;
+  uint8_t  seq;
+  uint8_t  label;
+  uint8_t  qty;
+  uint32_t start;                                                                                   // Resume point: next sample time
+  uint32_t end;
+  uint16_t skip;                                                                                    // Samples at time == start already sent
+  uint8_t  index;                                                                                   // Next frame index
+} TsStream;
+
+typedef struct {                                                                                    // CTL_TS_DATA frame being packed
+  uint8_t  frame[64];
+  uint8_t  count;                                                                                   // Samples in frame
+  uint32_t base;
+  uint8_t  sent;                                                                                    // Frames sent this call
+  uint16_t skip;                                                                                    // Samples at the resume time still to skip
+  uint32_t sentT;                                                                                   // Resume point after the last frame sent
+  uint16_t sentSame;
+  bool     stopped;
+} TsPack;
+
+typedef bool (*TsVisitor)(const TsSample* s, void* ctx);                                            // false stops the query
+
+TsWriter tsdb;
+TsStats  tsdbStats;
+TsStage  tsdbStage[TSDB_STAGE];
+volatile uint8_t tsdbStageHead = 0;                                                                 // Written by interrupts
+uint8_t  tsdbStageTail = 0;                                                                         // Read by tsdb_task
+TsStream tsdbStream;
+uint32_t tsdbSampleMs = 0;
+
+bool     tsdb_mount(void);
+bool     tsdb_append(uint8_t label, uint8_t qty, uint32_t t, float v);
+bool     tsdb_flush(void);
+void     tsdb_stage(uint8_t label, uint8_t qty, float v);
+void     tsdb_task(void);
+uint32_t tsdb_query(uint8_t label, uint8_t qty, uint32_t start, uint32_t end, TsVisitor visit, void* ctx);
+
+#endif
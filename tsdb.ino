@@ -0,0 +1,578 @@
+
+// ~/Arduino/QIF/switch/tsdb.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// QSPI access of the store, one place to swap for the RAM flash model of the simulator
+//----------------------------------------------------------------------------------------
+static uint32_t tsdb_addr(uint16_t sector, uint8_t page)
+{
+  return TSDB_START + (uint32_t)sector * TSDB_SECTOR + (uint32_t)page * TSDB_PAGE;
+}
+
+static bool tsdb_read(uint16_t sector, uint8_t page, void* buf, uint16_t len)
+{
+  QspiLease lease(QSPI_TSDB);
+  return lease.held && flash.readBuffer(tsdb_addr(sector, page), (uint8_t*)buf, len) == len;
+}
+
+static bool tsdb_program(uint16_t sector, uint8_t page, const uint8_t* buf)                 // Under the lease of tsdb_flush()
+{
+  if(!qspi_take(QSPI_TSDB)) return false;
+  return flash.writeBuffer(tsdb_addr(sector, page), buf, TSDB_PAGE) == TSDB_PAGE;
+}
+
+static bool tsdb_erase(uint16_t sector)
+{
+  if(!qspi_take(QSPI_TSDB)) return false;
+  return flash.eraseSector(tsdb_addr(sector, 0) / TSDB_SECTOR);                             // Sector number, not address
+}
+
+//----------------------------------------------------------------------------------------
+// Bit stream, MSB first. The page buffer is zeroed, so only ones are written.
+//----------------------------------------------------------------------------------------
+static void ts_put(uint8_t* buf, uint16_t* pos, uint32_t value, uint8_t bits)
+{
+  while(bits--)
+    {
+      if((value >> bits) & 1) buf[*pos >> 3] |= 0x80 >> (*pos & 7);
+      (*pos)++;
+    }
+}
+
+static uint32_t ts_get(const uint8_t* buf, uint16_t* pos, uint8_t bits)
+{
+  uint32_t value = 0;
+  while(bits--)
+    {
+      value = (value << 1) | ((buf[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+      (*pos)++;
+    }
+  return value;
+}
+
+static inline uint32_t ts_bits(float v)   { uint32_t u; memcpy(&u, &v, 4); return u; }
+static inline float    ts_float(uint32_t u) { float v; memcpy(&v, &u, 4); return v; }
+
+static void tsdb_reset_page(void)
+{
+  memset(tsdb.page, 0, sizeof(tsdb.page));
+  tsdb.nseries = 0;
+  tsdb.nbits   = 0;
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_mount: Find the newest page after boot. Call from bootTask after flash.begin().
+//
+// The head sector is the one whose first page has the highest sequence. If the next
+// sector holds data the ring has wrapped and that sector is the oldest.
+//----------------------------------------------------------------------------------------
+bool tsdb_mount(void)
+{
+  TsPageHeader h;
+  int32_t  head   = -1;
+  uint32_t maxSeq = 0;
+
+  memset(&tsdb, 0, sizeof(tsdb));
+  memset(&tsdbStats, 0, sizeof(tsdbStats));
+  if(flash.size() < TSDB_END) { if(IDE) Serial.println(F("TSDB: QSPI TOO SMALL")); return false; }
+
+  for(uint16_t s = 0; s < TSDB_SECTORS; s++)
+    {
+      if(!tsdb_read(s, 0, &h, sizeof(h)) || h.magic != TSDB_MAGIC) continue;
+      if(head < 0 || (int32_t)(h.seq - maxSeq) > 0) { head = s; maxSeq = h.seq; }
+    }
+
+  if(head < 0)                                                                              // Empty store: first write erases sector 0
+    {
+      tsdb.sector = TSDB_SECTORS - 1;
+      tsdb.pageNo = TSDB_PAGES;
+      tsdb.seq    = 0;
+      tsdb.oldest = 0;
+      tsdb.used   = 0;
+    }
+  else
+    {
+      uint8_t  p   = 1;
+      uint32_t seq = maxSeq;
+      for(; p < TSDB_PAGES; p++)
+        {
+          if(!tsdb_read(head, p, &h, sizeof(h)) || h.magic != TSDB_MAGIC) break;
+          seq = h.seq;
+        }
+      tsdb.sector = head;
+      tsdb.pageNo = p;
+      tsdb.seq    = seq + 1;
+
+      const uint16_t next = (head + 1) % TSDB_SECTORS;
+      if(tsdb_read(next, 0, &h, sizeof(h)) && h.magic == TSDB_MAGIC)
+        {
+          tsdb.oldest = next;                                                               // Wrapped
+          tsdb.used   = TSDB_SECTORS;
+        }
+      else
+        {
+          tsdb.oldest = 0;
+          tsdb.used   = head + 1;
+        }
+    }
+
+  tsdb_reset_page();
+  tsdb.mounted = true;
+
+  if(IDE)
+    {
+      Serial.print(F("TSDB          "));
+      Serial.print(tsdb.used); Serial.print('/'); Serial.print(TSDB_SECTORS);
+      Serial.println(F(" SECTORS USED"));
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_flush: Write the page being filled, even if partial.
+// Enters and erases the next sector when the current one is full.
+//----------------------------------------------------------------------------------------
+bool tsdb_flush(void)
+{
+  if(!tsdb.mounted || tsdb.nbits == 0) return true;
+  if(STX_FLAG || capState != CAP_OFF) return false;                                        // Firmware update or CAN capture owns the QSPI
+  QspiLease lease(QSPI_TSDB);                                                               // Erase and program, the tick stays off the QSPI
+  if(!lease.held) return false;
+
+  if(tsdb.pageNo >= TSDB_PAGES)
+    {
+      const uint16_t next = (tsdb.sector + 1) % TSDB_SECTORS;
+      if(!tsdb_erase(next)) { tsdbStats.errors++; return false; }
+      tsdbStats.erases++;
+      if(tsdb.used < TSDB_SECTORS) tsdb.used++;
+      else tsdb.oldest = (next + 1) % TSDB_SECTORS;                                         // Oldest 4 KB of history dropped
+      tsdb.sector = next;
+      tsdb.pageNo = 0;
+    }
+
+  TsPageHeader h = { TSDB_MAGIC, tsdb.nbits, tsdb.seq, tsdb.tFirst, tsdb.tLast };
+  memcpy(tsdb.page, &h, sizeof(h));
+  if(!tsdb_program(tsdb.sector, tsdb.pageNo, tsdb.page)) tsdbStats.errors++;                // Page skipped, never written twice
+  else tsdbStats.pages++;
+
+  tsdb.pageNo++;
+  tsdb.seq++;
+  tsdb_reset_page();
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_append: Add one sample to the page being filled (see tsdb.h for the encoding)
+//----------------------------------------------------------------------------------------
+bool tsdb_append(uint8_t label, uint8_t qty, uint32_t t, float v)
+{
+  if(!tsdb.mounted) return false;
+
+  const uint16_t key = ((uint16_t)(label & 0x7F) << 4) | (qty & 0x0F);
+  int8_t idx = -1;
+  for(uint8_t i = 0; i < tsdb.nseries; i++) if(tsdb.series[i].key == key) { idx = i; break; }
+
+  if((idx < 0 && tsdb.nseries >= TSDB_SERIES) || TSDB_BITS - tsdb.nbits < TSDB_MAX_RECORD)
+    {
+      if(!tsdb_flush()) { tsdbStats.dropped++; return false; }
+      idx = -1;                                                                             // New page, series start again
+    }
+
+  uint8_t* buf  = &tsdb.page[TSDB_HEADER];
+  uint16_t pos  = tsdb.nbits;
+  uint32_t bits = ts_bits(v);
+
+  if(pos == 0) { tsdb.tFirst = t; tsdb.tLast = t; tsdb.firstMs = millis(); }
+  if((int32_t)(t - tsdb.tFirst) < 0) tsdb.tFirst = t;
+  if((int32_t)(t - tsdb.tLast)  > 0) tsdb.tLast  = t;
+
+  if(idx < 0)
+    {
+      TsSeries* s = &tsdb.series[tsdb.nseries++];
+      ts_put(buf, &pos, 1, 1);
+      ts_put(buf, &pos, key, 11);
+      ts_put(buf, &pos, t, 32);
+      ts_put(buf, &pos, bits, 32);
+      s->key = key; s->t = t; s->delta = 0; s->v = bits; s->lead = 0xFF; s->trail = 0;
+    }
+  else
+    {
+      TsSeries* s = &tsdb.series[idx];
+      ts_put(buf, &pos, 0, 1);
+      ts_put(buf, &pos, idx, 5);
+
+      const int32_t delta = (int32_t)(t - s->t);
+      const int32_t dod   = delta - s->delta;
+      if(dod == 0)                         ts_put(buf, &pos, 0, 1);
+      else if(dod >= -63   && dod <= 64)   { ts_put(buf, &pos, 0x2, 2);  ts_put(buf, &pos, dod & 0x7F, 7);   }
+      else if(dod >= -255  && dod <= 256)  { ts_put(buf, &pos, 0x6, 3);  ts_put(buf, &pos, dod & 0x1FF, 9);  }
+      else if(dod >= -2047 && dod <= 2048) { ts_put(buf, &pos, 0xE, 4);  ts_put(buf, &pos, dod & 0xFFF, 12); }
+      else                                 { ts_put(buf, &pos, 0xF, 4);  ts_put(buf, &pos, dod, 32);         }
+      s->delta = delta;
+      s->t     = t;
+
+      const uint32_t x = bits ^ s->v;
+      if(x == 0) ts_put(buf, &pos, 0, 1);
+      else
+        {
+          const uint8_t lead  = __builtin_clz(x);
+          const uint8_t trail = __builtin_ctz(x);
+          if(s->lead != 0xFF && lead >= s->lead && trail >= s->trail)
+            {
+              ts_put(buf, &pos, 0x2, 2);                                                    // Fits the previous window
+              ts_put(buf, &pos, x >> s->trail, 32 - s->lead - s->trail);
+            }
+          else
+            {
+              const uint8_t len = 32 - lead - trail;
+              ts_put(buf, &pos, 0x3, 2);
+              ts_put(buf, &pos, lead, 5);
+              ts_put(buf, &pos, len - 1, 5);
+              ts_put(buf, &pos, x >> trail, len);
+              s->lead  = lead;
+              s->trail = trail;
+            }
+        }
+      s->v = bits;
+    }
+
+  tsdbStats.bits += pos - tsdb.nbits;
+  tsdbStats.appended++;
+  tsdb.nbits = pos;
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_scan: Decode one page payload, visit the samples of key inside [start, end].
+// Returns false if the visitor stopped the query.
+//----------------------------------------------------------------------------------------
+static bool tsdb_scan(const uint8_t* buf, uint16_t nbits, uint16_t key, uint32_t start, uint32_t end,
+                      TsVisitor visit, void* ctx, uint32_t* count)
+{
+  TsSeries series[TSDB_SERIES];
+  uint8_t  n   = 0;
+  uint16_t pos = 0;
+
+  while(pos < nbits)
+    {
+      TsSeries* s;
+      if(ts_get(buf, &pos, 1))
+        {
+          if(n >= TSDB_SERIES) return true;                                                 // Corrupt page, give up on it
+          s = &series[n++];
+          s->key   = ts_get(buf, &pos, 11);
+          s->t     = ts_get(buf, &pos, 32);
+          s->v     = ts_get(buf, &pos, 32);
+          s->delta = 0;
+          s->lead  = 0xFF;
+        }
+      else
+        {
+          const uint8_t idx = ts_get(buf, &pos, 5);
+          if(idx >= n) return true;
+          s = &series[idx];
+
+          int32_t dod = 0;
+          if(ts_get(buf, &pos, 1))
+            {
+              if(!ts_get(buf, &pos, 1))      { dod = ts_get(buf, &pos, 7);  if(dod > 64)   dod -= 128;  }
+              else if(!ts_get(buf, &pos, 1)) { dod = ts_get(buf, &pos, 9);  if(dod > 256)  dod -= 512;  }
+              else if(!ts_get(buf, &pos, 1)) { dod = ts_get(buf, &pos, 12); if(dod > 2048) dod -= 4096; }
+              else                             dod = (int32_t)ts_get(buf, &pos, 32);
+            }
+          s->delta += dod;
+          s->t     += s->delta;
+
+          if(ts_get(buf, &pos, 1))
+            {
+              uint32_t x;
+              if(!ts_get(buf, &pos, 1))
+                {
+                  if(s->lead == 0xFF) return true;                                          // No window yet: corrupt page
+                  x = ts_get(buf, &pos, 32 - s->lead - s->trail) << s->trail;
+                }
+              else
+                {
+                  const uint8_t lead = ts_get(buf, &pos, 5);
+                  const uint8_t len  = ts_get(buf, &pos, 5) + 1;
+                  s->lead  = lead;
+                  s->trail = 32 - lead - len;
+                  x = ts_get(buf, &pos, len) << s->trail;
+                }
+              s->v ^= x;
+            }
+        }
+
+      if(s->key == key && (int32_t)(s->t - start) >= 0 && (int32_t)(end - s->t) >= 0)
+        {
+          TsSample sample = { s->t, (uint8_t)(key >> 4), (uint8_t)(key & 0x0F), ts_float(s->v) };
+          (*count)++;
+          if(!visit(&sample, ctx)) return false;
+        }
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_query: Visit every stored sample of (label, qty) with start <= time <= end,
+// oldest first, then the samples still in RAM. Returns the number of samples visited.
+//----------------------------------------------------------------------------------------
+uint32_t tsdb_query(uint8_t label, uint8_t qty, uint32_t start, uint32_t end, TsVisitor visit, void* ctx)
+{
+  const uint16_t key = ((uint16_t)(label & 0x7F) << 4) | (qty & 0x0F);
+  uint32_t count = 0;
+  if(!tsdb.mounted) return 0;
+
+  if(tsdb.used && !STX_FLAG && capState == CAP_OFF)
+    {
+      TsPageHeader h;
+      int32_t lo = 0, hi = tsdb.used - 1, first = 0;                                        // Last sector starting at or before start
+      while(lo <= hi)
+        {
+          const int32_t mid = (lo + hi) / 2;
+          if(tsdb_read((tsdb.oldest + mid) % TSDB_SECTORS, 0, &h, sizeof(h)) && h.magic == TSDB_MAGIC
+             && (int32_t)(start - h.tFirst) >= 0) { first = mid; lo = mid + 1; }
+          else hi = mid - 1;
+        }
+
+      uint8_t page[TSDB_PAGE];
+      bool    done = false;
+      for(uint16_t i = first; i < tsdb.used && !done; i++)
+        {
+          const uint16_t sector = (tsdb.oldest + i) % TSDB_SECTORS;
+          for(uint8_t p = 0; p < TSDB_PAGES; p++)
+            {
+              if(!tsdb_read(sector, p, &h, sizeof(h)) || h.magic != TSDB_MAGIC) break;      // Rest of the sector not written yet
+              if(p == 0 && (int32_t)(h.tFirst - end) > 0) { done = true; break; }           // Sector starts after the range
+              if((int32_t)(h.tLast - start) < 0 || (int32_t)(h.tFirst - end) > 0) continue; // No overlap, header only
+              if(!tsdb_read(sector, p, page, TSDB_PAGE)) continue;
+              if(!tsdb_scan(&page[TSDB_HEADER], h.nbits, key, start, end, visit, ctx, &count)) return count;
+            }
+        }
+    }
+
+  if(tsdb.nbits && (int32_t)(tsdb.tLast - start) >= 0 && (int32_t)(tsdb.tFirst - end) <= 0)
+    tsdb_scan(&tsdb.page[TSDB_HEADER], tsdb.nbits, key, start, end, visit, ctx, &count);
+  return count;
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_stage: Keep a value received in interrupt context for tsdb_task (from tlm_put)
+//----------------------------------------------------------------------------------------
+void tsdb_stage(uint8_t label, uint8_t qty, float v)
+{
+  ATOMIC()
+    {
+      const uint8_t next = (tsdbStageHead + 1) & (TSDB_STAGE - 1);
+      if(next == tsdbStageTail) tsdbStats.dropped++;                                        // Ring full, tsdb_task late
+      else
+        {
+          TsStage* e = &tsdbStage[tsdbStageHead];
+          e->ms    = millis();
+          e->label = label;
+          e->qty   = qty;
+          e->v     = v;
+          tsdbStageHead = next;
+          tsdbStats.staged++;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// CAN streaming of a range (CTL_TS_QUERY / CTL_TS_DATA, see tsdb.h)
+//----------------------------------------------------------------------------------------
+static bool tsdb_send_frame(TsPack* p)
+{
+  const uint16_t base = Lbl2Can(tsdbStream.caller);
+  if(base == 0xFFFF) return false;
+
+  p->frame[0] = CTL_TS_DATA;
+  p->frame[1] = LABEL;
+  p->frame[2] = tsdbStream.seq;
+  p->frame[3] = tsdbStream.index;
+  p->frame[4] = p->count;
+  memcpy(&p->frame[5], &p->base, 4);
+  if(!canSend(p->frame, canfd_len(9 + p->count * 6), base + ctl, TXQ_LOW)) return false;
+
+  for(uint8_t i = 0; i < p->count; i++)                                                     // Advance the resume point
+    {
+      uint16_t dt;
+      memcpy(&dt, &p->frame[9 + i * 6], 2);
+      const uint32_t t = p->base + dt;
+      if(t == p->sentT) p->sentSame++;
+      else { p->sentT = t; p->sentSame = 1; }
+    }
+  tsdbStream.index++;
+  p->sent++;
+  p->count = 0;
+  memset(p->frame, 0, sizeof(p->frame));
+  return true;
+}
+
+static bool tsdb_pack(const TsSample* s, void* ctx)
+{
+  TsPack* p = (TsPack*)ctx;
+  if(p->skip && s->t == tsdbStream.start) { p->skip--; return true; }                      // Sent by the previous call
+
+  if(p->count && (p->count == TSDB_FRAME_MAX || s->t < p->base || s->t - p->base > 0xFFFF))
+    {
+      if(p->sent >= TSDB_BURST || !tsdb_send_frame(p)) { p->stopped = true; return false; }
+    }
+  if(p->count == 0) p->base = s->t;
+
+  const uint16_t dt = s->t - p->base;
+  memcpy(&p->frame[9 + p->count * 6], &dt, 2);
+  memcpy(&p->frame[11 + p->count * 6], &s->v, 4);
+  p->count++;
+  return true;
+}
+
+static void tsdb_stream(void)
+{
+  if(txRing[TXQ_LOW].count > TXQ_DEPTH - TSDB_BURST - 2) return;                           // Let the bus drain first
+
+  TsPack p;
+  memset(&p, 0, sizeof(p));
+  p.skip     = tsdbStream.skip;
+  p.sentT    = tsdbStream.start;
+  p.sentSame = tsdbStream.skip;
+
+  tsdb_query(tsdbStream.label, tsdbStream.qty, tsdbStream.start, tsdbStream.end, tsdb_pack, &p);
+
+  if(p.stopped)                                                                             // Burst done, resume after the last frame sent
+    {
+      tsdbStream.start = p.sentT;
+      tsdbStream.skip  = p.sentSame;
+      return;
+    }
+  if(p.count && !tsdb_send_frame(&p)) { tsdbStream.active = false; return; }
+  tsdb_send_frame(&p);                                                                      // count = 0: end of stream
+  tsdbStream.active = false;
+}
+
+// Control channel: range request from another board (interrupt context, work done in tsdb_task)
+void Process_Ts_Query(const CANFDMessage & message)
+{
+  if(message.len < 13) return;
+
+  if(tsdbStream.active || !tsdb.mounted)                                                    // One stream at a time
+    {
+      uint8_t frame[12] = { CTL_TS_DATA, LABEL, message.data[2], 0xFF, 0 };
+      const uint16_t base = Lbl2Can(message.data[1]);
+      if(base != 0xFFFF) canSend(frame, 12, base + ctl, TXQ_LOW);
+      return;
+    }
+  tsdbStream.caller = message.data[1];
+  tsdbStream.seq    = message.data[2];
+  tsdbStream.label  = message.data[3];
+  tsdbStream.qty    = message.data[4];
+  memcpy(&tsdbStream.start, &message.data[5], 4);
+  memcpy(&tsdbStream.end,   &message.data[9], 4);
+  tsdbStream.skip   = 0;
+  tsdbStream.index  = 0;
+  tsdbStream.active = true;
+}
+
+// Control channel: range data coming back
+void Process_Ts_Data(const CANFDMessage & message)
+{
+  if(message.len < 9 || !IDE) return;
+
+  const uint8_t count = message.data[4];
+  uint32_t base;
+  memcpy(&base, &message.data[5], 4);
+
+  Serial.print(F("TS FROM: ")); Serial.print(message.data[1]);
+  Serial.print(F("  FRAME: ")); Serial.print(message.data[3]);
+  if(count == 0) { Serial.println(message.data[3] == 0xFF ? F("  REFUSED") : F("  END")); return; }
+  Serial.print(F("  SAMPLES: ")); Serial.println(count);
+
+  for(uint8_t i = 0; i < count && 9 + i * 6 + 6 <= message.len; i++)
+    {
+      uint16_t dt;
+      float    v;
+      memcpy(&dt, &message.data[9 + i * 6], 2);
+      memcpy(&v,  &message.data[11 + i * 6], 4);
+      Serial.print(base + dt); Serial.print('\t'); Serial.println(v);
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// tsdb_task: Runs as a task (task.ino). Stores the staged values, samples the local analog
+// inputs, writes a page that waited too long and runs the CAN stream.
+//----------------------------------------------------------------------------------------
+void tsdb_task(void)
+{
+  if(!tsdb.mounted) return;
+  const uint32_t nowMs = millis();
+
+  if(tsdbStageTail != tsdbStageHead)
+    {
+      const uint32_t now = rtc.now().unixtime();
+      while(tsdbStageTail != tsdbStageHead)
+        {
+          const TsStage e = tsdbStage[tsdbStageTail];
+          tsdb_append(e.label, e.qty, now - (nowMs - e.ms) / 1000, e.v);                    // Back to the reception time
+          tsdbStageTail = (tsdbStageTail + 1) & (TSDB_STAGE - 1);
+        }
+    }
+
+  if(TYPE != SWITCH && nowMs - tsdbSampleMs >= TSDB_SAMPLE_S * 1000UL)
+    {
+      const uint32_t now = rtc.now().unixtime();
+      tsdbSampleMs = nowMs;
+      tsdb_append(LABEL, Q_ISENSE, now, Isense);
+      for(uint8_t ch = 0; ch < 4; ch++) tsdb_append(LABEL, Q_ANA0 + ch, now, analogRead(analogPins[ch]));
+    }
+
+  if(tsdb.nbits && nowMs - tsdb.firstMs >= TSDB_FLUSH_S * 1000UL) tsdb_flush();
+  if(tsdbStream.active) tsdb_stream();
+}
+
+//----------------------------------------------------------------------------------------
+// Serial commands Z (local query) and J (ask another board)
+//----------------------------------------------------------------------------------------
+static bool tsdb_print(const TsSample* s, void*)
+{
+  Serial.print(s->t); Serial.print('\t'); Serial.println(s->v);
+  return true;
+}
+
+void tsdb_local(uint8_t label, uint8_t qty, uint16_t hours)
+{
+  if(!IDE) return;
+  const uint32_t end   = rtc.now().unixtime();
+  const uint32_t start = end - (uint32_t)(hours ? hours : 24) * 3600;
+
+  const uint32_t t0    = micros();
+  const uint32_t count = tsdb_query(label, qty, start, end, tsdb_print, nullptr);
+  const uint32_t us    = micros() - t0;                                                     // Includes the serial output
+
+  Serial.print(F("SAMPLES: "));        Serial.print(count);
+  Serial.print(F("  QUERY (us): "));   Serial.println(us);
+  Serial.print(F("STORED: "));         Serial.print(tsdbStats.appended);
+  Serial.print(F("  BITS/SAMPLE: "));  Serial.print(tsdbStats.appended ? (float)tsdbStats.bits / tsdbStats.appended : 0);
+  Serial.print(F("  PAGES: "));        Serial.print(tsdbStats.pages);
+  Serial.print(F("  ERASES: "));       Serial.print(tsdbStats.erases);
+  Serial.print(F("  SECTORS: "));      Serial.print(tsdb.used); Serial.print('/'); Serial.print(TSDB_SECTORS);
+  Serial.print(F("  DROPPED: "));      Serial.print(tsdbStats.dropped);
+  Serial.print(F("  ERRORS: "));       Serial.println(tsdbStats.errors);
+}
+
+void tsdb_remote(uint8_t board, uint8_t label, uint8_t qty, uint16_t hours)
+{
+  const uint16_t base = Lbl2Can(board);
+  if(base == 0xFFFF) { if(IDE) Serial.println(F("Label not found in DB")); return; }
+
+  const uint32_t end   = rtc.now().unixtime();
+  const uint32_t start = end - (uint32_t)(hours ? hours : 24) * 3600;
+  static uint8_t seq = 0;
+
+  uint8_t frame[16] = { CTL_TS_QUERY, LABEL, seq++, label, qty };
+  memcpy(&frame[5], &start, 4);
+  memcpy(&frame[9], &end, 4);
+  sendCANFDFrame(frame, 16, base + ctl, TXQ_NORMAL);
+}
@@ -0,0 +1,99 @@
+
+// ~/Arduino/QIF/txqueue.h Located in parent directory and linked in subdirectory
+
+/*
+CAN FD transmit queue
+
+Frames are never pushed straight into the controller by the caller any more.
+`canSend()` copies the frame into one of three software rings (one per priority)
+and returns at once with a non-zero handle, or 0 when the ring is full.
+
+`txqueue_pump()` moves frames from the rings into the ACANFD driver, highest
+priority first. It is called right after each enqueue and from the 1 ms TCC2 tick,
+so a frame that finds the controller busy is simply retried one tick later.
+Nobody spins: callers in the TCC2 interrupt (CAN callbacks, switch scanner) return
+immediately whatever the bus load is.
+
+The driver FIFO is kept short (TXQ_DRIVER_FIFO) so that a high priority frame
+never waits behind a long tail of low priority frames already handed to the driver.
+
+State frames (priority OR'ed with TXQ_STATE: PWM levels, relays, power control)
+are last-value-wins: a newer frame for an ID still waiting in the ring overwrites
+the queued one in place and keeps its place in the line; the old handle is reported
+TX_SUPERSEDED. Event frames (clicks, LED steps, update data, ACK/NACK) are never
+merged and keep strict order.
+
+A frame older than TXQ_MAX_AGE_MS is dropped and reported as TX_EXPIRED, except
+stream frames (priority OR'ed with TXQ_STREAM: the firmware image, its STX/ETX
+markers and CRC). They wait as long as it takes, a lost one would corrupt the
+image; the sender checks canSend() and waits for room when the ring is full.
+Completion is reported through an optional callback, called from the pump context
+(interrupt or main loop): keep it short and do not print from it.
+*/
+
+#ifndef   TXQUEUE_H
+#define   TXQUEUE_H
+
+#define TXQ_DEPTH          32                                                                       // Frames per priority ring (power of 2)
+#define TXQ_MAX_AGE_MS     100                                                                      // Drop frames waiting longer than this (old worst case retry time)
+#define TXQ_DRIVER_FIFO    8                                                                        // ACANFD software TX FIFO size, short to keep priorities
+
+#define kTryToSendReturnStatusFD_OK                     0                                           // tryToSendReturnStatusFD return code
+#define kTryToSendReturnStatusFD_TooLong                1
+#define kTryToSendReturnStatusFD_InvalidBitRateSwitch   2
+#define kTryToSendReturnStatusFD_InvalidFormat          3
+#define kTryToSendReturnStatusFD_InvalidLength          4
+#define kTryToSendReturnStatusFD_TxFifoFull             5
+
+enum TXPRIO : uint8_t { TXQ_HIGH = 0, TXQ_NORMAL, TXQ_LOW, TXQ_LEVELS };                            // Transmit priority, TXQ_HIGH drained first
+
+#define TXQ_STATE          0x80                                                                     // OR with priority: state frame, last value wins
+#define TXQ_STREAM         0x40                                                                     // OR with priority: ordered stream, never expires
+
+#define TXF_STATE          0x01                                                                     // TxEntry flags: may be overwritten by a newer value
+#define TXF_INFLIGHT       0x02                                                                     // Being handed to the driver, do not touch
+#define TXF_STREAM         0x04                                                                     // Never expires (TXQ_STREAM)
+
+enum TXSTATUS : uint8_t { TX_SENT = 0, TX_FAILED, TX_EXPIRED, TX_SUPERSEDED };                      // Completion status given to the callback
+
+typedef void (*TxCallback)(uint16_t handle, uint16_t id, uint8_t status);
+
+typedef struct {
+  CANFDMessage frame;                                                                               // Ready to send frame
+  uint32_t     stamp;                                                                               // millis() when queued
+  uint16_t     handle;                                                                              // Handle returned by canSend()
+  TxCallback   callback;                                                                            // Completion callback or nullptr
+  volatile uint8_t flags;                                                                           // TXF_STATE, TXF_INFLIGHT, TXF_STREAM
+} TxEntry;
+
+typedef struct {
+  TxEntry          slot[TXQ_DEPTH];
+  volatile uint8_t head;                                                                            // Next frame to send
+  volatile uint8_t tail;                                                                            // Next free slot
+  volatile uint8_t count;                                                                           // Frames waiting
+} TxRing;
+
+typedef struct {
+  volatile uint32_t queued;                                                                         // Frames accepted by canSend()
+  volatile uint32_t sent;                                                                           // Frames accepted by the controller
+  volatile uint32_t dropped;                                                                        // Frames refused because the ring was full
+  volatile uint32_t retried;                                                                        // Pump passes deferred by a full controller FIFO
+  volatile uint32_t failed;                                                                         // Frames rejected by the driver (format, length)
+  volatile uint32_t expired;                                                                        // Frames dropped after TXQ_MAX_AGE_MS
+  volatile uint32_t coalesced;                                                                      // State frames merged into a queued one
+  volatile uint8_t  lastError;                                                                      // Last driver error code
+  volatile uint8_t  peak[TXQ_LEVELS];                                                               // Highest ring fill level seen
+} TxStats;
+
+TxRing   txRing[TXQ_LEVELS];
+TxStats  txStats;
+volatile uint16_t txHandle   = 0;                                                                   // Last handle given, 0 is never used
+volatile bool     txPumpBusy = false;                                                               // Pump running in some context
+
+uint16_t canSend(const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio, TxCallback cb = nullptr);
+bool     sendCANFDFrame(const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio = TXQ_NORMAL);
+TxEntry* txqueue_find(TxRing* q, uint16_t id);
+void     txqueue_pump(void);
+void     txqueue_stats(void);
+
+#endif
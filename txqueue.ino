@@ -0,0 +1,211 @@
+
+// ~/Arduino/QIF/switch/txqueue.ino
+
+
+#include "qif.h"
+
+//----------------------------------------------------------------------------------------
+// canSend: Queue a CAN FD frame for transmission, never blocks.
+//
+// Parameters:
+//   - data : Pointer to the payload (max 64 bytes)
+//   - len  : Payload length, must be a valid CAN FD length
+//   - id   : 11-bit standard CAN ID
+//   - prio : TXQ_HIGH, TXQ_NORMAL or TXQ_LOW, OR'ed with TXQ_STATE for state frames
+//            or TXQ_STREAM for frames that must never expire
+//   - cb   : Optional completion callback (TX_SENT, TX_FAILED, TX_EXPIRED, TX_SUPERSEDED)
+//
+// Returns:
+//   Non-zero handle when queued, 0 when refused (ring full, monitor mode, bad length)
+//----------------------------------------------------------------------------------------
+uint16_t canSend(const uint8_t* data, uint8_t len, uint16_t id, uint8_t prio, TxCallback cb)
+{
+  if(MONITOR_FLAG) return 0;                                                                // Do not send anything while in monitor mode
+  if(len > 64) { txStats.failed++; txStats.lastError = kTryToSendReturnStatusFD_TooLong; return 0; }
+  bool state  = (prio & TXQ_STATE) != 0;
+  bool stream = (prio & TXQ_STREAM) != 0;
+  prio &= ~(TXQ_STATE | TXQ_STREAM);
+  if(prio >= TXQ_LEVELS) prio = TXQ_LOW;
+
+  uint16_t   handle    = 0;
+  uint16_t   oldHandle = 0;
+  TxCallback oldCb     = nullptr;
+  ATOMIC()
+    {
+      TxRing*  q   = &txRing[prio];
+      TxEntry* old = state ? txqueue_find(q, id) : nullptr;
+      if(old)
+        {
+          oldHandle = old->handle;                                                          // Newer value wins, keeps the queue position
+          oldCb     = old->callback;
+          old->frame.len = len;
+          memcpy(old->frame.data, data, len);
+          old->stamp    = millis();
+          if(++txHandle == 0) txHandle = 1;
+          old->handle   = txHandle;
+          old->callback = cb;
+          handle        = txHandle;
+          txStats.queued++;
+          txStats.coalesced++;
+        }
+      else if(q->count >= TXQ_DEPTH)
+        {
+          txStats.dropped++;                                                                // Ring full, caller gets 0
+        }
+      else
+        {
+          TxEntry* e = &q->slot[q->tail];
+          e->frame.id   = id;                                                               // Standard 11-bit CAN ID
+          e->frame.ext  = false;                                                            // Standard frame format
+          e->frame.len  = len;
+          e->frame.type = CANFDMessage::CANFD_WITH_BIT_RATE_SWITCH;                         // CAN FD with bit rate switch
+          e->frame.idx  = 0;                                                                // Default TX FIFO index
+          memcpy(e->frame.data, data, len);
+          e->stamp    = millis();
+          if(++txHandle == 0) txHandle = 1;                                                 // 0 means refused
+          e->handle   = txHandle;
+          e->callback = cb;
+          e->flags    = (state ? TXF_STATE : 0) | (stream ? TXF_STREAM : 0);
+          handle      = txHandle;
+          q->tail = (q->tail + 1) & (TXQ_DEPTH - 1);
+          q->count++;
+          if(q->count > txStats.peak[prio]) txStats.peak[prio] = q->count;
+          txStats.queued++;
+        }
+    }
+  if(oldCb) oldCb(oldHandle, id, TX_SUPERSEDED);
+  if(handle) txqueue_pump();                                                                // Idle bus: frame leaves now
+  return handle;
+}
+
+//----------------------------------------------------------------------------------------
+// txqueue_find: Return the waiting state frame for this ID, nullptr if none.
+// Must be called with interrupts disabled.
+//----------------------------------------------------------------------------------------
+TxEntry* txqueue_find(TxRing* q, uint16_t id)
+{
+  for(uint8_t i = 0; i < q->count; i++)
+    {
+      TxEntry* e = &q->slot[(q->head + i) & (TXQ_DEPTH - 1)];
+      if(e->frame.id == id && (e->flags & (TXF_STATE | TXF_INFLIGHT)) == TXF_STATE) return e;
+    }
+  return nullptr;
+}
+
+//----------------------------------------------------------------------------------------
+// txqueue_pump: Hand queued frames to the CAN driver, highest priority first.
+//
+// Called after each canSend() and every 1 ms from TCC2_0_Handler. Stops at the first
+// frame the controller cannot take, so order inside a priority is kept and the frame
+// is tried again on the next call. Only one context pumps at a time.
+//----------------------------------------------------------------------------------------
+void txqueue_pump(void)
+{
+  bool busy;
+  ATOMIC() { busy = txPumpBusy; txPumpBusy = true; }
+  if(busy) return;                                                                          // Another context is draining the rings
+  PROF_SCOPE(PROF_TXPUMP);
+
+  uint32_t nowMs = millis();
+  bool sent = false;
+  bool error = false;
+
+  for(uint8_t p = 0; p < TXQ_LEVELS; p++)
+    {
+      TxRing* q = &txRing[p];
+      while(q->count)
+        {
+          TxEntry* e = &q->slot[q->head];
+          uint8_t result;
+          ATOMIC() e->flags |= TXF_INFLIGHT;                                                // Freeze the frame while the driver copies it
+
+          if(!(e->flags & TXF_STREAM) && (uint32_t)(nowMs - e->stamp) > TXQ_MAX_AGE_MS)
+            {
+              result = TX_EXPIRED;                                                          // Waited too long, stale by now
+              txStats.expired++;
+            }
+          else
+            {
+              uint32_t status = can1.tryToSendReturnStatusFD(e->frame);
+              if(status == kTryToSendReturnStatusFD_TxFifoFull)
+                {
+                  txStats.retried++;                                                        // Controller full, try again next tick
+                  ATOMIC() e->flags &= ~TXF_INFLIGHT;                                       // Newer values may still replace it
+                  if(sent) BLINK(GREEN);
+                  txPumpBusy = false;
+                  return;
+                }
+              if(status == kTryToSendReturnStatusFD_OK)
+                {
+                  result = TX_SENT;
+                  txStats.sent++;
+                  sent = true;
+                }
+              else
+                {
+                  result = TX_FAILED;                                                       // Frame refused by the driver
+                  txStats.failed++;
+                  txStats.lastError = status;
+                  error = true;
+                }
+            }
+
+          TxCallback cb     = e->callback;
+          uint16_t   handle = e->handle;
+          uint16_t   id     = e->frame.id;
+          ATOMIC()
+            {
+              q->head = (q->head + 1) & (TXQ_DEPTH - 1);
+              q->count--;
+            }
+          if(result == TX_EXPIRED) error = true;
+          if(cb) cb(handle, id, result);
+        }
+    }
+
+  if(error) BLINK(RED);
+  else if(sent) BLINK(GREEN);
+  txPumpBusy = false;
+}
+
+//----------------------------------------------------------------------------------------
+// txqueue_stats: Print transmit queue counters
+//----------------------------------------------------------------------------------------
+void txqueue_stats(void)
+{
+  if(!IDE) return;
+  Serial.println(F("CAN TX QUEUE:"));
+  Serial.print(F("QUEUED:       ")); Serial.println(txStats.queued);
+  Serial.print(F("SENT:         ")); Serial.println(txStats.sent);
+  Serial.print(F("DROPPED:      ")); Serial.println(txStats.dropped);
+  Serial.print(F("RETRIED:      ")); Serial.println(txStats.retried);
+  Serial.print(F("FAILED:       ")); Serial.println(txStats.failed);
+  Serial.print(F("EXPIRED:      ")); Serial.println(txStats.expired);
+  Serial.print(F("COALESCED:    ")); Serial.println(txStats.coalesced);
+  Serial.print(F("WAITING H/N/L ")); Serial.print(txRing[TXQ_HIGH].count);   Serial.print('/');
+  Serial.print(txRing[TXQ_NORMAL].count); Serial.print('/'); Serial.println(txRing[TXQ_LOW].count);
+  Serial.print(F("PEAK    H/N/L ")); Serial.print(txStats.peak[TXQ_HIGH]);   Serial.print('/');
+  Serial.print(txStats.peak[TXQ_NORMAL]); Serial.print('/'); Serial.println(txStats.peak[TXQ_LOW]);
+  Serial.print(F("LAST ERROR:   ")); Serial.print(txStats.lastError); Serial.print(F(" → "));
+
+  switch (txStats.lastError) {
+    case kTryToSendReturnStatusFD_OK:
+      Serial.println(F("None"));
+      break;
+    case kTryToSendReturnStatusFD_TooLong:
+      Serial.println(F("Frame too long"));
+      break;
+    case kTryToSendReturnStatusFD_InvalidBitRateSwitch:
+      Serial.println(F("Invalid bit rate switch usage"));
+      break;
+    case kTryToSendReturnStatusFD_InvalidFormat:
+      Serial.println(F("Invalid frame format"));
+      break;
+    case kTryToSendReturnStatusFD_InvalidLength:
+      Serial.println(F("Invalid payload length"));
+      break;
+    default:
+      Serial.println(F("Unknown error"));
+      break;
+  }
+}
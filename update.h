@@ -0,0 +1,40 @@
+
+// ~/Arduino/QIF/update.h Located in parent directory and linked in subdirectory
+
+/*
+Firmware update, page assembly
+
+Process_Update() holds back each data frame until the next one arrives: the last
+8 bytes of the stream are the CRC64, not firmware. upd_page_add() takes the frame
+held back, hashes it into the stream CRC64 and appends it to the QSPI page, true
+when the page of size bytes is full and must be written.
+
+The size, QSPI_PAGE_SIZE, is a multiple of 8: a frame never straddles two pages.
+
+The receiver leases UPD_PAGES pages: one fills while the other waits for its
+write. A write is deferred while a task holds the QSPI, a lease it took before
+STX (tsdb, bstate and bulk take none while STX_FLAG is set): the task runs again
+as soon as the interrupt returns, the page is written with one of the next frames.
+Only a page filled while the other one still waits ends the update (NACK).
+
+The sender is updateTask() (update.ino), started by QSPI2CAN(): STX, the QSPI
+image in 8-byte frames, CRC64, ETX, all on the TXQ_LOW ring as stream frames.
+sim/qifsim.cpp runs it as it is (--update).
+*/
+
+#ifndef   UPDATE_H
+#define   UPDATE_H
+
+#define UPD_PAGES         2                                                                         // Receiver: page filling, page waiting for its write
+
+enum UPD_WRITE : uint8_t { UPD_WRITTEN = 0, UPD_DEFERRED, UPD_FAILED };
+
+static inline bool upd_page_add(crc64_stream* crc, uint8_t* page, uint16_t* index, uint16_t size, const uint8_t* frame)
+{
+  crc64_stream_update(crc, frame, 8);
+  memcpy(page + *index, frame, 8);
+  *index += 8;
+  return *index >= size;
+}
+
+#endif
@@ -0,0 +1,96 @@
+
+// ~/Arduino/QIF/switch/update.ino
+
+
+#include "qif.h"
+
+//========================================================================================
+// Firmware update transfer task, started by QSPI2CAN()
+//========================================================================================
+
+uint8_t updateTask(Task* t)
+{
+  UpdateJob* u = (UpdateJob*)t->ctx;
+
+  TASK_BEGIN(t);
+
+  u->size = 0;                                                                              // Actual firmware size in QSPI (stop on 0x00-filled block)
+  while(true)
+    {
+      if(!flash.readBuffer(u->size, u->buffer, QSPI_BLOCK_SIZE)) break;
+      {
+        bool all00 = true;
+        for(uint32_t i = 0; i < QSPI_BLOCK_SIZE; i++) if(u->buffer[i] != 0x00) { all00 = false; break; }
+        if(all00) break;
+      }
+      u->size += QSPI_BLOCK_SIZE;
+      TASK_YIELD(t);
+    }
+  u->limit = ((u->size + QSPI_BLOCK_SIZE - 1) / QSPI_BLOCK_SIZE) * QSPI_BLOCK_SIZE;
+
+  if(IDE)
+    {
+      Serial.println(F("QSPI to CAN FD transfer started ℹ️"));
+      Serial.print(F("Program size        : ")); Serial.println(u->size);
+      Serial.print(F("Aligned block limit : ")); Serial.println(u->limit);
+    }
+
+  TASK_WAIT_SENT(t, TXQ_LOW, sendControlMarker(obfuscate(stx), u->label));                 // Stream frames never expire, none may be lost
+  crc64_stream_init(&u->crc, 0);
+
+  for(u->offset = 0; u->offset < u->limit; u->offset += QSPI_BLOCK_SIZE)
+    {
+      memset(u->buffer, 0xFF, QSPI_BLOCK_SIZE);
+      {
+        const uint32_t valid = (u->offset + QSPI_BLOCK_SIZE <= u->size) ? QSPI_BLOCK_SIZE : (u->size - u->offset);
+        if(!flash.readBuffer(u->offset, u->buffer, valid)) { BLINK(BLACK); arena_give(ARENA_UPDATE_TX); TASK_EXIT(t); }
+      }
+
+      for(u->chunk = 0; u->chunk < QSPI_BLOCK_SIZE; u->chunk += 8)
+        {
+          TASK_WAIT_TX(t, TXQ_LOW, UPD_TX_ROOM);                                            // Never fill the ring, clicks and telemetry keep going
+          TASK_WAIT_SENT(t, TXQ_LOW, sendCANFDFrame(&u->buffer[u->chunk], 8, SVR + Update, TXQ_LOW | TXQ_STREAM));
+          crc64_stream_update(&u->crc, &u->buffer[u->chunk], 8);
+          {
+            const uint32_t n = (u->offset + u->chunk) / 8;
+            if(n % 128 == 0) { BLINK(MAGENTA); if(IDE) Serial.print("."); }
+            if(n % 256 == 0) BLINK(BLACK);
+          }
+          TASK_DELAY(t, UPD_FRAME_MS);                                                      // Receiver pacing, the other tasks run meanwhile
+        }
+    }
+
+  {
+    const uint64_t crc64_val = crc64_stream_finalize(&u->crc);                              // Final CRC64 transmission
+    for(uint8_t i = 0; i < 8; i++) u->buffer[i] = (crc64_val >> (8 * i)) & 0xFF;            // Kept across the wait below
+    if(IDE) { Serial.println(); Serial.print(F("CRC64: ")); PrintHex64(crc64_val); Serial.println(); }
+  }
+  TASK_WAIT_SENT(t, TXQ_LOW, sendCANFDFrame(u->buffer, 8, SVR + Update, TXQ_LOW | TXQ_STREAM));
+
+  TASK_WAIT_SENT(t, TXQ_LOW, sendControlMarker(obfuscate(etx), u->label));
+  BLINK(BLACK);
+  arena_give(ARENA_UPDATE_TX);
+
+  TASK_END(t);
+}
+
+// ----------------------------------------------------------------------------------
+// Send CAN FD control frame: label + 56-bit marker (total 64 bits)
+bool sendControlMarker(uint64_t marker, uint8_t label)
+{
+  uint8_t frame[8];
+  frame[0] = label;  // First byte is always the label
+
+  // Send least significant 7 bytes of marker (56 bits)
+  for (uint8_t i = 0; i < 7; i++)
+    frame[i + 1] = (marker >> (8 * i)) & 0xFF;
+
+  if(!sendCANFDFrame(frame, 8, SVR + Update, TXQ_LOW | TXQ_STREAM)) return false;  // Same ring as the data frames to keep order, never expires
+  PrintCANFrameHex(frame);
+  return true;
+}
+// ----------------------------------------------------------------------------------
+// Obfuscate control frames before sending
+uint64_t obfuscate(uint64_t val) {
+  return val ^ MARKER_MASK;
+}